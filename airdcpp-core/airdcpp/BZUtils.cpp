@@ -19,9 +19,12 @@
 #include "stdinc.h"
 #include "BZUtils.h"
 
+#include "concurrency.h"
 #include "Exception.h"
 #include "ResourceManager.h"
 
+#include <thread>
+
 namespace dcpp {
 	
 BZFilter::BZFilter() {
@@ -101,4 +104,500 @@ bool UnBZFilter::operator()(const void* in, size_t& insize, void* out, size_t& o
 	return err == BZ_OK;
 }
 
+#define BLOCK_MAGIC 0x314159265359ULL
+#define STREAM_END_MAGIC 0x177245385090ULL
+#define MAGIC_BITS 48
+
+// Stream header ("BZh" + block size)
+#define HEADER_BITS 32
+
+// Magic + CRC
+#define BLOCK_HEADER_BITS (MAGIC_BITS + 32)
+#define STREAM_END_BITS (MAGIC_BITS + 32)
+
+static size_t getParallelBatchSize(size_t aBatchSize) noexcept {
+	if (aBatchSize > 0) {
+		return aBatchSize;
+	}
+
+	return max(std::thread::hardware_concurrency(), 1U);
+}
+
+static uint32_t combineCRC(uint32_t aCombined, uint32_t aBlockCRC) noexcept {
+	return ((aCombined << 1) | (aCombined >> 31)) ^ aBlockCRC;
+}
+
+// Reads bits from a buffer that contains at least aPos + aCount bits (aCount <= 32)
+static uint32_t readBits(const string& aBuf, uint64_t aPos, int aCount) noexcept {
+	uint64_t ret = 0;
+	auto byte = static_cast<size_t>(aPos / 8);
+	int skip = static_cast<int>(aPos % 8);
+	int needed = skip + aCount;
+	for (int read = 0; read < needed; read += 8) {
+		ret = (ret << 8) | static_cast<uint8_t>(aBuf[byte++]);
+	}
+
+	ret >>= ((needed + 7) / 8) * 8 - needed;
+	return static_cast<uint32_t>(ret & ((1ULL << aCount) - 1));
+}
+
+static bool decompressStream(const string& aStream, string& out_) noexcept {
+	bz_stream zs;
+	memzero(&zs, sizeof(zs));
+	if (BZ2_bzDecompressInit(&zs, 0, 0) != BZ_OK) {
+		return false;
+	}
+
+	out_.resize(max(aStream.size() * 8, static_cast<size_t>(256 * 1024)));
+
+	zs.next_in = const_cast<char*>(aStream.data());
+	zs.avail_in = static_cast<unsigned int>(aStream.size());
+
+	size_t produced = 0;
+	bool ok = false;
+	for (;;) {
+		zs.next_out = &out_[produced];
+		zs.avail_out = static_cast<unsigned int>(out_.size() - produced);
+
+		auto err = BZ2_bzDecompress(&zs);
+		produced = out_.size() - zs.avail_out;
+		if (err == BZ_STREAM_END) {
+			ok = true;
+			break;
+		}
+
+		if (err != BZ_OK || (zs.avail_in == 0 && zs.avail_out != 0)) {
+			break;
+		}
+
+		if (zs.avail_out == 0) {
+			out_.resize(out_.size() * 2);
+		}
+	}
+
+	BZ2_bzDecompressEnd(&zs);
+	out_.resize(produced);
+	return ok;
+}
+
+ParallelBZFilter::ParallelBZFilter(size_t aBatchSize) : batchSize(getParallelBatchSize(aBatchSize)) {
+	input.reserve(batchSize * CHUNK_SIZE);
+	output = "BZh9";
+}
+
+ParallelBZFilter::~ParallelBZFilter() {
+	dcdebug("ParallelBZFilter end, " I64_FMT "/" I64_FMT " = %.04f\n", totalOut, totalIn, (float)totalOut / max((float)totalIn, (float)1));
+}
+
+void ParallelBZFilter::putBits(uint32_t aValue, int aCount) noexcept {
+	dcassert(aCount <= 24);
+	bitBuf = (bitBuf << aCount) | aValue;
+	bitCount += aCount;
+	while (bitCount >= 8) {
+		bitCount -= 8;
+		output += static_cast<char>((bitBuf >> bitCount) & 0xFF);
+	}
+
+	bitBuf &= (1U << bitCount) - 1;
+}
+
+void ParallelBZFilter::compressChunks() {
+	if (input.empty()) {
+		return;
+	}
+
+	auto chunkCount = (input.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	vector<string> streams(chunkCount);
+	vector<size_t> chunks(chunkCount);
+	for (size_t i = 0; i < chunkCount; ++i) {
+		chunks[i] = i;
+	}
+
+	atomic<bool> failed { false };
+	parallel_for_each(chunks.begin(), chunks.end(), [&](size_t aChunk) {
+		auto pos = aChunk * CHUNK_SIZE;
+		auto len = min(CHUNK_SIZE, input.size() - pos);
+
+		auto& stream = streams[aChunk];
+		auto streamLen = static_cast<unsigned int>(len + len / 100 + 600);
+		stream.resize(streamLen);
+		if (BZ2_bzBuffToBuffCompress(&stream[0], &streamLen, &input[pos], static_cast<unsigned int>(len), 9, 0, 30) != BZ_OK) {
+			failed = true;
+			return;
+		}
+
+		stream.resize(streamLen);
+	});
+
+	if (failed) {
+		throw Exception(STRING(COMPRESSION_ERROR));
+	}
+
+	totalIn += input.size();
+	input.clear();
+
+	// Each stream consists of the header, a single block and the end of stream marker
+	// Append the block bits to our stream
+	for (const auto& stream: streams) {
+		if (stream.size() * 8 < HEADER_BITS + BLOCK_HEADER_BITS + STREAM_END_BITS) {
+			throw Exception(STRING(COMPRESSION_ERROR));
+		}
+
+		auto blockCRC = readBits(stream, HEADER_BITS + MAGIC_BITS, 32);
+
+		// The stream end marker is followed by up to 7 bits of padding
+		uint64_t blockEnd = 0;
+		for (int padding = 0; padding < 8; ++padding) {
+			auto pos = stream.size() * 8 - padding - STREAM_END_BITS;
+			if (readBits(stream, pos, 24) == (STREAM_END_MAGIC >> 24) && readBits(stream, pos + 24, 24) == (STREAM_END_MAGIC & 0xFFFFFF) &&
+				readBits(stream, pos + MAGIC_BITS, 32) == blockCRC
+			) {
+				blockEnd = pos;
+				break;
+			}
+		}
+
+		if (blockEnd == 0) {
+			// More than one block?
+			throw Exception(STRING(COMPRESSION_ERROR));
+		}
+
+		// The block starts right after the stream header
+		auto fullBytes = static_cast<size_t>(blockEnd / 8);
+		if (bitCount == 0) {
+			output.append(stream, HEADER_BITS / 8, fullBytes - HEADER_BITS / 8);
+		} else {
+			for (size_t i = HEADER_BITS / 8; i < fullBytes; ++i) {
+				putBits(static_cast<uint8_t>(stream[i]), 8);
+			}
+		}
+
+		auto remainingBits = static_cast<int>(blockEnd % 8);
+		if (remainingBits > 0) {
+			putBits(readBits(stream, fullBytes * 8, remainingBits), remainingBits);
+		}
+
+		combinedCRC = combineCRC(combinedCRC, blockCRC);
+	}
+}
+
+bool ParallelBZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outsize) {
+	size_t consumed = 0;
+	if (insize == 0) {
+		if (!finished) {
+			compressChunks();
+
+			putBits(static_cast<uint32_t>(STREAM_END_MAGIC >> 24), 24);
+			putBits(static_cast<uint32_t>(STREAM_END_MAGIC & 0xFFFFFF), 24);
+			putBits(combinedCRC >> 16, 16);
+			putBits(combinedCRC & 0xFFFF, 16);
+			if (bitCount > 0) {
+				putBits(0, 8 - bitCount);
+			}
+
+			finished = true;
+		}
+	} else if (outputPos == output.size()) {
+		// Previous output has been returned, accept more input
+		output.clear();
+		outputPos = 0;
+
+		consumed = min(insize, batchSize * CHUNK_SIZE - input.size());
+		input.append(reinterpret_cast<const char*>(in), consumed);
+		if (input.size() == batchSize * CHUNK_SIZE) {
+			compressChunks();
+		}
+	}
+
+	insize = consumed;
+
+	outsize = min(outsize, output.size() - outputPos);
+	memcpy(out, &output[outputPos], outsize);
+	outputPos += outsize;
+	totalOut += outsize;
+
+	return !finished || outputPos < output.size();
+}
+
+ParallelUnBZFilter::ParallelUnBZFilter(size_t aBatchSize) : batchSize(getParallelBatchSize(aBatchSize)) {
+
+}
+
+ParallelUnBZFilter::~ParallelUnBZFilter() {
+	dcdebug("ParallelUnBZFilter end, %d streams, " I64_FMT " bytes\n", streams, totalIn);
+}
+
+uint32_t ParallelUnBZFilter::getBits(uint64_t aPos, int aCount) const noexcept {
+	return readBits(input, aPos, aCount);
+}
+
+void ParallelUnBZFilter::discardInput(uint64_t aPos) noexcept {
+	auto bytes = static_cast<size_t>(aPos / 8);
+	input.erase(0, bytes);
+
+	auto bits = static_cast<uint64_t>(bytes) * 8;
+	for (auto& b: blockStarts) {
+		b -= bits;
+	}
+
+	if (streamEndFound) {
+		streamEnd -= bits;
+	}
+
+	scanPos -= bits;
+}
+
+bool ParallelUnBZFilter::parseHeader(bool aEndOfInput) {
+	if (input.size() < HEADER_BITS / 8) {
+		if (!aEndOfInput) {
+			return false;
+		}
+
+		if (streams == 0 || !input.empty()) {
+			throw Exception(STRING(DECOMPRESSION_ERROR));
+		}
+
+		state = STATE_FINISHED;
+		return true;
+	}
+
+	if (input.compare(0, 3, "BZh") != 0 || input[3] < '1' || input[3] > '9') {
+		if (streams == 0) {
+			throw Exception(STRING(DECOMPRESSION_ERROR));
+		}
+
+		// Trailing garbage after a complete stream, ignore it like bzip2
+		state = STATE_FINISHED;
+		return true;
+	}
+
+	level = input[3];
+	combinedCRC = 0;
+	blockStarts.clear();
+	streamEndFound = false;
+	scanPos = HEADER_BITS;
+	state = STATE_BLOCKS;
+	return true;
+}
+
+void ParallelUnBZFilter::scan() {
+	// Check all bit offsets of a 64 bit big endian window
+	auto pos = static_cast<size_t>(scanPos / 8);
+	while (!streamEndFound && pos + 8 <= input.size()) {
+		uint64_t window = 0;
+		for (int i = 0; i < 8; ++i) {
+			window = (window << 8) | static_cast<uint8_t>(input[pos + i]);
+		}
+
+		for (int shift = 0; shift < 8; ++shift) {
+			auto bitPos = static_cast<uint64_t>(pos) * 8 + shift;
+			if (bitPos < scanPos) {
+				continue;
+			}
+
+			auto value = (window >> (16 - shift)) & 0xFFFFFFFFFFFFULL;
+			if ((value == BLOCK_MAGIC || value == STREAM_END_MAGIC) && blockStarts.empty() && bitPos != HEADER_BITS) {
+				throw Exception(STRING(DECOMPRESSION_ERROR));
+			}
+
+			if (value == BLOCK_MAGIC) {
+				blockStarts.push_back(bitPos);
+				scanPos = bitPos + MAGIC_BITS;
+			} else if (value == STREAM_END_MAGIC) {
+				streamEnd = bitPos;
+				streamEndFound = true;
+				scanPos = bitPos + MAGIC_BITS;
+				break;
+			}
+		}
+
+		pos++;
+	}
+
+	if (!streamEndFound) {
+		scanPos = max(scanPos, static_cast<uint64_t>(pos) * 8);
+	}
+}
+
+string ParallelUnBZFilter::getBlockStream(uint64_t aStart, uint64_t aEnd) const noexcept {
+	string ret("BZh");
+	ret += level;
+	ret.reserve(static_cast<size_t>((aEnd - aStart) / 8) + 16);
+
+	uint32_t bitBuf = 0;
+	int bitCount = 0;
+	auto put = [&](uint32_t aValue, int aCount) {
+		bitBuf = (bitBuf << aCount) | aValue;
+		bitCount += aCount;
+		while (bitCount >= 8) {
+			bitCount -= 8;
+			ret += static_cast<char>((bitBuf >> bitCount) & 0xFF);
+		}
+
+		bitBuf &= (1U << bitCount) - 1;
+	};
+
+	auto pos = aStart;
+	auto shift = static_cast<int>(pos % 8);
+	if (shift == 0) {
+		auto bytes = static_cast<size_t>((aEnd - aStart) / 8);
+		ret.append(input, static_cast<size_t>(pos / 8), bytes);
+		pos += static_cast<uint64_t>(bytes) * 8;
+	} else {
+		for (auto byte = static_cast<size_t>(pos / 8); pos + 8 <= aEnd; pos += 8, byte++) {
+			auto value = (static_cast<uint8_t>(input[byte]) << 8) | static_cast<uint8_t>(input[byte + 1]);
+			ret += static_cast<char>((value >> (8 - shift)) & 0xFF);
+		}
+	}
+
+	if (pos < aEnd) {
+		auto remaining = static_cast<int>(aEnd - pos);
+		put(getBits(pos, remaining), remaining);
+	}
+
+	// As the stream only has a single block, the stream CRC equals to the block CRC
+	auto blockCRC = getBits(aStart + MAGIC_BITS, 32);
+	put(static_cast<uint32_t>(STREAM_END_MAGIC >> 24), 24);
+	put(static_cast<uint32_t>(STREAM_END_MAGIC & 0xFFFFFF), 24);
+	put(blockCRC >> 16, 16);
+	put(blockCRC & 0xFFFF, 16);
+	if (bitCount > 0) {
+		put(0, 8 - bitCount);
+	}
+
+	return ret;
+}
+
+void ParallelUnBZFilter::decompressBlocks(bool aEndOfInput) {
+	vector<Block> blocks;
+	for (size_t i = 0; i + 1 < blockStarts.size(); ++i) {
+		blocks.push_back({ blockStarts[i], blockStarts[i + 1] });
+	}
+
+	bool streamComplete = streamEndFound && input.size() * 8 >= streamEnd + STREAM_END_BITS;
+	if (streamComplete && !blockStarts.empty()) {
+		blocks.push_back({ blockStarts.back(), streamEnd });
+	}
+
+	if (!streamComplete && aEndOfInput) {
+		throw Exception(STRING(DECOMPRESSION_ERROR));
+	}
+
+	vector<string> blockData(blocks.size());
+	vector<uint8_t> blockOk(blocks.size());
+	vector<size_t> indexes(blocks.size());
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		indexes[i] = i;
+	}
+
+	parallel_for_each(indexes.begin(), indexes.end(), [&](size_t aIndex) {
+		blockOk[aIndex] = decompressStream(getBlockStream(blocks[aIndex].start, blocks[aIndex].end), blockData[aIndex]);
+	});
+
+	output.clear();
+	outputPos = 0;
+
+	auto consumedPos = blockStarts.empty() ? static_cast<uint64_t>(HEADER_BITS) : blockStarts.front();
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		auto first = i;
+		if (!blockOk[i]) {
+			// The block magic may also appear inside the compressed data (although it's very unlikely)
+			// Try again by joining the following blocks
+			bool ok = false;
+			for (auto j = i + 1; j < blocks.size(); ++j) {
+				if (decompressStream(getBlockStream(blocks[first].start, blocks[j].end), blockData[first])) {
+					ok = true;
+					i = j;
+					break;
+				}
+			}
+
+			if (!ok) {
+				if (streamComplete) {
+					throw Exception(STRING(DECOMPRESSION_ERROR));
+				}
+
+				// Continue after more blocks have been located
+				break;
+			}
+		}
+
+		output += blockData[first];
+		combinedCRC = combineCRC(combinedCRC, getBits(blocks[first].start + MAGIC_BITS, 32));
+		consumedPos = blocks[i].end;
+	}
+
+	if (consumedPos == streamEnd && streamComplete) {
+		if (getBits(streamEnd + MAGIC_BITS, 32) != combinedCRC) {
+			throw Exception(STRING(DECOMPRESSION_ERROR));
+		}
+
+		// The next stream (if any) starts from the following byte
+		discardInput(((streamEnd + STREAM_END_BITS + 7) / 8) * 8);
+
+		streams++;
+		state = STATE_HEADER;
+		return;
+	}
+
+	if (blockStarts.empty()) {
+		return;
+	}
+
+	// Keep the first unprocessed block and the last located block
+	// (the boundaries between them have turned out to be false)
+	auto last = blockStarts.back();
+	blockStarts.erase(remove_if(blockStarts.begin(), blockStarts.end(), [&](uint64_t aPos) {
+		return aPos != consumedPos && aPos != last;
+	}), blockStarts.end());
+
+	discardInput(consumedPos);
+}
+
+bool ParallelUnBZFilter::operator()(const void* in, size_t& insize, void* out, size_t& outsize) {
+	size_t consumed = 0;
+	if (outputPos == output.size() && state != STATE_FINISHED) {
+		bool endOfInput = insize == 0;
+
+		consumed = insize;
+		input.append(reinterpret_cast<const char*>(in), consumed);
+		totalIn += consumed;
+
+		// Decompress until there's output to return or more data is needed
+		while (outputPos == output.size() && state != STATE_FINISHED) {
+			if (state == STATE_HEADER) {
+				if (!parseHeader(endOfInput)) {
+					break;
+				}
+
+				continue;
+			}
+
+			scan();
+
+			auto completeBlocks = blockStarts.empty() ? 0 : blockStarts.size() - 1;
+			bool streamComplete = streamEndFound && input.size() * 8 >= streamEnd + STREAM_END_BITS;
+			if (!streamComplete && !endOfInput && completeBlocks < batchSize) {
+				break;
+			}
+
+			auto prevState = state;
+			auto prevInput = input.size();
+			decompressBlocks(endOfInput);
+			if (state == prevState && output.empty() && input.size() == prevInput && !endOfInput) {
+				// Wait for more blocks
+				break;
+			}
+		}
+	}
+
+	insize = consumed;
+
+	outsize = min(outsize, output.size() - outputPos);
+	memcpy(out, &output[outputPos], outsize);
+	outputPos += outsize;
+
+	return state != STATE_FINISHED || outputPos < output.size();
+}
+
 } // namespace dcpp
\ No newline at end of file
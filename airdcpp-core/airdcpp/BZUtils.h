@@ -19,6 +19,8 @@
 #ifndef DCPLUSPLUS_DCPP_BZUTILS_H
 #define DCPLUSPLUS_DCPP_BZUTILS_H
 
+#include "typedefs.h"
+
 #include <bzlib.h>
 
 namespace dcpp {
@@ -57,6 +59,115 @@ private:
 	bz_stream zs;
 };
 
+/**
+* Block parallel bzip2 compressor
+*
+* The input is split into chunks that each fit in a single bzip2 block. The chunks are compressed
+* concurrently and the blocks are joined into a single standard bzip2 stream, so the output can be
+* decompressed with any bzip2 implementation.
+*/
+class ParallelBZFilter {
+public:
+	// Number of blocks that are compressed concurrently (0 = number of CPU cores)
+	explicit ParallelBZFilter(size_t aBatchSize = 0);
+	~ParallelBZFilter();
+
+	// See BZFilter
+	bool operator()(const void* in, size_t& insize, void* out, size_t& outsize);
+private:
+	// Worst case expansion of the initial run-length encoding is 5/4, keep the
+	// input of each chunk below the level 9 block size limit (899981 bytes)
+	static constexpr size_t CHUNK_SIZE = 700 * 1024;
+
+	void compressChunks();
+
+	// Bit writer for the joined stream
+	void putBits(uint32_t aValue, int aCount) noexcept;
+
+	string input;
+	const size_t batchSize;
+
+	// Full bytes of output that haven't been returned yet
+	string output;
+	size_t outputPos = 0;
+
+	uint32_t bitBuf = 0;
+	int bitCount = 0;
+
+	uint32_t combinedCRC = 0;
+	int64_t totalIn = 0;
+	int64_t totalOut = 0;
+	bool finished = false;
+};
+
+/**
+* Block parallel bzip2 decompressor
+*
+* Block boundaries are located by scanning the stream for the block header magic. Each block is then
+* decompressed as a separate stream on its own thread. Concatenated streams are supported.
+*/
+class ParallelUnBZFilter {
+public:
+	// Number of blocks that are decompressed concurrently (0 = number of CPU cores)
+	explicit ParallelUnBZFilter(size_t aBatchSize = 0);
+	~ParallelUnBZFilter();
+
+	// See UnBZFilter
+	bool operator()(const void* in, size_t& insize, void* out, size_t& outsize);
+private:
+	struct Block {
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// Reads the stream header from the beginning of the buffer
+	// Returns false if there isn't enough data yet
+	bool parseHeader(bool aEndOfInput);
+
+	// Locate the next block boundaries
+	// Throws if the stream doesn't start with a block or the stream end marker
+	void scan();
+
+	// Decompress the blocks that have been located
+	void decompressBlocks(bool aEndOfInput);
+
+	// Builds a standalone stream from a block that starts and ends at the given bit positions
+	string getBlockStream(uint64_t aStart, uint64_t aEnd) const noexcept;
+
+	uint32_t getBits(uint64_t aPos, int aCount) const noexcept;
+
+	// Discard the data before the given bit position
+	void discardInput(uint64_t aPos) noexcept;
+
+	enum State {
+		STATE_HEADER,
+		STATE_BLOCKS,
+		STATE_FINISHED
+	};
+
+	State state = STATE_HEADER;
+	const size_t batchSize;
+
+	string input;
+	char level = '9';
+
+	// Bit positions of the located block headers in the input buffer
+	vector<uint64_t> blockStarts;
+
+	// Bit position of the end of stream marker (if found)
+	uint64_t streamEnd = 0;
+	bool streamEndFound = false;
+
+	uint64_t scanPos = 0;
+	uint32_t combinedCRC = 0;
+
+	int streams = 0;
+	int64_t totalIn = 0;
+
+	string output;
+	size_t outputPos = 0;
+};
+
 } // namespace dcpp
 
 #endif // !defined(DCPLUSPLUS_DCPP_BZUTILS_H)
\ No newline at end of file
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "BinaryFilelist.h"
+
+#include "File.h"
+#include "Streams.h"
+#include "Util.h"
+
+#include <zlib.h>
+
+namespace dcpp {
+
+#define MAGIC "DCBL"
+#define MAGIC_LEN 4
+#define FORMAT_VERSION 1
+
+#define HEADER_SIZE (MAGIC_LEN + 1)
+#define FOOTER_SIZE (8 + 4 + 4 + MAGIC_LEN)
+
+// Sanity limit for the decompressed size of a single frame or the directory index
+#define MAX_BLOCK_SIZE (64 * 1024 * 1024)
+
+// Deflate can't compress the data more than this (the sizes in the list aren't trusted)
+#define MAX_COMPRESSION_RATIO 1032
+
+static void writeVarInt(string& buf_, uint64_t aValue) noexcept {
+	while (aValue >= 0x80) {
+		buf_ += static_cast<char>((aValue & 0x7F) | 0x80);
+		aValue >>= 7;
+	}
+
+	buf_ += static_cast<char>(aValue);
+}
+
+static void writeString(string& buf_, const string& aStr) noexcept {
+	writeVarInt(buf_, aStr.size());
+	buf_ += aStr;
+}
+
+static void writeFixed(string& buf_, uint64_t aValue, int aBytes) noexcept {
+	for (int i = 0; i < aBytes; ++i) {
+		buf_ += static_cast<char>((aValue >> (i * 8)) & 0xFF);
+	}
+}
+
+static uint64_t readFixed(const string& aBuf, size_t aPos, int aBytes) noexcept {
+	uint64_t ret = 0;
+	for (int i = 0; i < aBytes; ++i) {
+		ret |= static_cast<uint64_t>(static_cast<uint8_t>(aBuf[aPos + i])) << (i * 8);
+	}
+
+	return ret;
+}
+
+static string compress(const string& aData) {
+	if (aData.size() > MAX_BLOCK_SIZE) {
+		// The list couldn't be read
+		throw BinaryFilelistException("Too many items in a single block of the file list");
+	}
+
+	auto len = ::compressBound(static_cast<uLong>(aData.size()));
+	string ret(len, '\0');
+	if (::compress2(reinterpret_cast<Bytef*>(&ret[0]), &len, reinterpret_cast<const Bytef*>(aData.data()), static_cast<uLong>(aData.size()), Z_BEST_COMPRESSION) != Z_OK) {
+		throw BinaryFilelistException("Failed to compress the file list");
+	}
+
+	ret.resize(len);
+	return ret;
+}
+
+static void decompress(const string& aData, size_t aSize, string& out_) {
+	if (aSize > MAX_BLOCK_SIZE || aSize > aData.size() * MAX_COMPRESSION_RATIO) {
+		throw BinaryFilelistException("Invalid block size");
+	}
+
+	out_.resize(aSize);
+
+	uLongf len = static_cast<uLongf>(aSize);
+	if (::uncompress(reinterpret_cast<Bytef*>(&out_[0]), &len, reinterpret_cast<const Bytef*>(aData.data()), static_cast<uLong>(aData.size())) != Z_OK || len != aSize) {
+		throw BinaryFilelistException("Failed to decompress the file list");
+	}
+}
+
+BinaryFilelistWriter::BinaryFilelistWriter(OutputStream& aStream, const string& aBase, time_t aBaseDate, const string& aGenerator) :
+	os(aStream), base(aBase), generator(aGenerator) {
+
+	string header(MAGIC);
+	header += static_cast<char>(FORMAT_VERSION);
+	os.write(header);
+	pos += header.size();
+
+	directories.push_back({ 0, Util::emptyString, aBaseDate, 0, 0 });
+}
+
+size_t BinaryFilelistWriter::addDirectory(size_t aParent, const string& aName, time_t aDate) {
+	dcassert(aParent < directories.size());
+	if (frame.size() >= FRAME_SIZE) {
+		flushFrame();
+	}
+
+	directories.push_back({ aParent, aName, aDate, frames.size(), frame.size() });
+	return directories.size() - 1;
+}
+
+void BinaryFilelistWriter::addFile(const string& aName, int64_t aSize, const TTHValue& aTTH, time_t aDate) noexcept {
+	writeString(frame, aName);
+	writeVarInt(frame, static_cast<uint64_t>(aSize));
+	writeVarInt(frame, static_cast<uint64_t>(aDate));
+	frame.append(reinterpret_cast<const char*>(aTTH.data), TTHValue::BYTES);
+
+	directories.back().fileCount++;
+}
+
+void BinaryFilelistWriter::flushFrame() {
+	if (frame.empty()) {
+		return;
+	}
+
+	auto compressed = compress(frame);
+	os.write(compressed);
+	pos += compressed.size();
+
+	frames.push_back({ compressed.size(), frame.size() });
+	frame.clear();
+}
+
+void BinaryFilelistWriter::finish() {
+	flushFrame();
+
+	string index;
+	writeString(index, base);
+	writeString(index, generator);
+
+	writeVarInt(index, frames.size());
+	for (const auto& f: frames) {
+		writeVarInt(index, f.compressedSize);
+		writeVarInt(index, f.size);
+	}
+
+	writeVarInt(index, directories.size());
+	for (const auto& d: directories) {
+		writeVarInt(index, d.parent);
+		writeString(index, d.name);
+		writeVarInt(index, static_cast<uint64_t>(d.date));
+		writeVarInt(index, d.frame);
+		writeVarInt(index, d.offset);
+		writeVarInt(index, d.fileCount);
+	}
+
+	auto compressed = compress(index);
+	os.write(compressed);
+
+	string footer;
+	writeFixed(footer, pos, 8);
+	writeFixed(footer, compressed.size(), 4);
+	writeFixed(footer, index.size(), 4);
+	footer += MAGIC;
+	os.write(footer);
+
+	pos += compressed.size() + footer.size();
+}
+
+BinaryFilelistReader::BinaryFilelistReader(File& aFile) : file(aFile) {
+	auto fileSize = file.getSize();
+	if (fileSize < HEADER_SIZE + FOOTER_SIZE) {
+		throw BinaryFilelistException("Invalid file list");
+	}
+
+	file.setPos(0);
+	auto header = file.read(HEADER_SIZE);
+	if (header.size() != HEADER_SIZE || header.compare(0, MAGIC_LEN, MAGIC) != 0) {
+		throw BinaryFilelistException("Invalid file list");
+	}
+
+	if (header[MAGIC_LEN] != FORMAT_VERSION) {
+		throw BinaryFilelistException("Unsupported file list version " + Util::toString(static_cast<int>(header[MAGIC_LEN])));
+	}
+
+	file.setPos(fileSize - FOOTER_SIZE);
+	auto footer = file.read(FOOTER_SIZE);
+	if (footer.size() != FOOTER_SIZE || footer.compare(16, MAGIC_LEN, MAGIC) != 0) {
+		throw BinaryFilelistException("Invalid file list");
+	}
+
+	auto indexPos = static_cast<int64_t>(readFixed(footer, 0, 8));
+	auto indexCompressedSize = static_cast<size_t>(readFixed(footer, 8, 4));
+	auto indexSize = static_cast<size_t>(readFixed(footer, 12, 4));
+	if (indexPos < HEADER_SIZE || indexPos + static_cast<int64_t>(indexCompressedSize) != fileSize - FOOTER_SIZE) {
+		throw BinaryFilelistException("Invalid file list");
+	}
+
+	string index;
+	file.setPos(indexPos);
+	decompress(file.read(indexCompressedSize), indexSize, index);
+
+	size_t p = 0;
+	readString(index, p, base);
+	readString(index, p, generator);
+
+	{
+		auto frameCount = readVarInt(index, p);
+		if (frameCount > index.size()) {
+			throw BinaryFilelistException("Invalid frame count");
+		}
+
+		int64_t offset = HEADER_SIZE;
+		frames.reserve(frameCount);
+		for (uint64_t i = 0; i < frameCount; ++i) {
+			Frame f;
+			f.offset = offset;
+			f.compressedSize = static_cast<size_t>(readVarInt(index, p));
+			f.size = static_cast<size_t>(readVarInt(index, p));
+
+			if (f.compressedSize > static_cast<size_t>(indexPos - offset)) {
+				throw BinaryFilelistException("Invalid frame size");
+			}
+
+			offset += f.compressedSize;
+
+			frames.push_back(f);
+		}
+	}
+
+	{
+		auto directoryCount = readVarInt(index, p);
+		if (directoryCount == 0 || directoryCount > index.size()) {
+			throw BinaryFilelistException("Invalid directory count");
+		}
+
+		directories.reserve(directoryCount);
+		for (uint64_t i = 0; i < directoryCount; ++i) {
+			Directory d;
+			d.parent = static_cast<size_t>(readVarInt(index, p));
+			readString(index, p, d.name);
+			d.date = static_cast<time_t>(readVarInt(index, p));
+			d.frame = static_cast<size_t>(readVarInt(index, p));
+			d.offset = static_cast<size_t>(readVarInt(index, p));
+			d.fileCount = static_cast<size_t>(readVarInt(index, p));
+
+			// Parents must always precede their children
+			if (i > 0 && d.parent >= i) {
+				throw BinaryFilelistException("Invalid directory parent");
+			}
+
+			if (d.fileCount > 0 && (d.frame >= frames.size() || d.offset >= frames[d.frame].size)) {
+				throw BinaryFilelistException("Invalid directory frame");
+			}
+
+			directories.push_back(move(d));
+		}
+	}
+}
+
+const string& BinaryFilelistReader::readFrame(size_t aFrame) {
+	if (aFrame == currentFrame) {
+		return frameBuf;
+	}
+
+	const auto& f = frames[aFrame];
+
+	currentFrame = static_cast<size_t>(-1);
+
+	file.setPos(f.offset);
+	decompress(file.read(f.compressedSize), f.size, frameBuf);
+
+	currentFrame = aFrame;
+	return frameBuf;
+}
+
+uint64_t BinaryFilelistReader::readVarInt(const string& aBuf, size_t& pos_) {
+	uint64_t ret = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos_ >= aBuf.size()) {
+			throw BinaryFilelistException("Unexpected end of data");
+		}
+
+		auto b = static_cast<uint8_t>(aBuf[pos_++]);
+		ret |= static_cast<uint64_t>(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) {
+			return ret;
+		}
+	}
+
+	throw BinaryFilelistException("Invalid integer");
+}
+
+void BinaryFilelistReader::readString(const string& aBuf, size_t& pos_, string& str_) {
+	auto len = readVarInt(aBuf, pos_);
+	if (len > aBuf.size() - pos_) {
+		throw BinaryFilelistException("Unexpected end of data");
+	}
+
+	str_.assign(aBuf, pos_, static_cast<size_t>(len));
+	pos_ += static_cast<size_t>(len);
+}
+
+} // namespace dcpp
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_BINARY_FILELIST_H
+#define DCPLUSPLUS_DCPP_BINARY_FILELIST_H
+
+#include "typedefs.h"
+
+#include "Exception.h"
+#include "MerkleTree.h"
+
+namespace dcpp {
+
+/**
+* Compact binary alternative for full XML file lists.
+*
+* Layout:
+* - "DCBL" + format version
+* - File frames: zlib streams containing the files of consecutive directories
+* - Directory index (zlib): base path, generator, frame table and the directories in preorder
+*	(parent, name, date, frame, offset inside the frame, file count)
+* - Footer: index offset, compressed/uncompressed index size + "DCBL"
+*
+* Files are stored as [name][size][date][24 byte TTH]. Strings are length-prefixed,
+* and all integers except the footer values are varints. The directory at index 0 is the list base.
+*
+* As the frame of each directory is known, the files of a single directory can be read without
+* decompressing the whole list.
+*/
+
+STANDARD_EXCEPTION(BinaryFilelistException);
+
+class BinaryFilelistWriter {
+public:
+	// Uncompressed size after which a new frame will be started
+	static const size_t FRAME_SIZE = 256 * 1024;
+
+	BinaryFilelistWriter(OutputStream& aStream, const string& aBase, time_t aBaseDate, const string& aGenerator);
+
+	BinaryFilelistWriter(const BinaryFilelistWriter&) = delete;
+	BinaryFilelistWriter& operator=(const BinaryFilelistWriter&) = delete;
+
+	// Directories must be added in preorder (parent before its children)
+	// The files of the directory should be added before adding other directories
+	// Returns the index of the new directory
+	size_t addDirectory(size_t aParent, const string& aName, time_t aDate);
+
+	// Adds a file in the directory that was added last
+	void addFile(const string& aName, int64_t aSize, const TTHValue& aTTH, time_t aDate) noexcept;
+
+	// Writes the pending frame and the directory index
+	void finish();
+private:
+	struct Frame {
+		size_t compressedSize;
+		size_t size;
+	};
+
+	struct DirectoryInfo {
+		size_t parent;
+		string name;
+		time_t date;
+		size_t frame;
+		size_t offset;
+		size_t fileCount = 0;
+	};
+
+	void flushFrame();
+
+	OutputStream& os;
+
+	const string base;
+	const string generator;
+
+	string frame;
+	vector<Frame> frames;
+	vector<DirectoryInfo> directories;
+
+	int64_t pos = 0;
+};
+
+class BinaryFilelistReader {
+public:
+	struct Directory {
+		size_t parent;
+		string name;
+		time_t date;
+		size_t frame;
+		size_t offset;
+		size_t fileCount;
+	};
+
+	// Reads the directory index from the file
+	// Throws BinaryFilelistException if the list is corrupted
+	BinaryFilelistReader(File& aFile);
+
+	BinaryFilelistReader(const BinaryFilelistReader&) = delete;
+	BinaryFilelistReader& operator=(const BinaryFilelistReader&) = delete;
+
+	const string& getBase() const noexcept { return base; }
+	const string& getGenerator() const noexcept { return generator; }
+
+	// Base is the first directory
+	const vector<Directory>& getDirectories() const noexcept { return directories; }
+
+	// Calls aHandler(name, size, TTH, date) for each file in the directory
+	// Only the frame of the wanted directory is read from the disk
+	// Throws BinaryFilelistException if the list is corrupted
+	template<class HandlerT>
+	void forEachFile(size_t aDirectory, HandlerT&& aHandler) {
+		const auto& dir = directories.at(aDirectory);
+		if (dir.fileCount == 0) {
+			return;
+		}
+
+		const auto& buf = readFrame(dir.frame);
+
+		size_t p = dir.offset;
+		string name;
+		for (size_t i = 0; i < dir.fileCount; ++i) {
+			readString(buf, p, name);
+			auto size = static_cast<int64_t>(readVarInt(buf, p));
+			auto date = static_cast<time_t>(readVarInt(buf, p));
+
+			if (buf.size() - p < TTHValue::BYTES) {
+				throw BinaryFilelistException("Unexpected end of frame");
+			}
+
+			TTHValue tth(reinterpret_cast<const uint8_t*>(buf.data() + p));
+			p += TTHValue::BYTES;
+
+			aHandler(name, size, tth, date);
+		}
+	}
+
+	static uint64_t readVarInt(const string& aBuf, size_t& pos_);
+	static void readString(const string& aBuf, size_t& pos_, string& str_);
+private:
+	struct Frame {
+		int64_t offset;
+		size_t compressedSize;
+		size_t size;
+	};
+
+	const string& readFrame(size_t aFrame);
+
+	File& file;
+
+	string base;
+	string generator;
+
+	vector<Frame> frames;
+	vector<Directory> directories;
+
+	// The last decompressed frame
+	string frameBuf;
+	size_t currentFrame = static_cast<size_t>(-1);
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_BINARY_FILELIST_H)
@@ -19,73 +19,172 @@
 #ifndef DCPLUSPLUS_DCPP_BLOOM_FILTER_H
 #define DCPLUSPLUS_DCPP_BLOOM_FILTER_H
 
+#include "debug.h"
 #include "typedefs.h"
 
+#include <atomic>
+#include <bitset>
+
 namespace dcpp {
 
+/**
+* Blocked bloom filter for n-grams of strings
+*
+* All bits of an n-gram are set inside a single cache line sized block so that each lookup touches
+* only one line of memory. The table size is always a power of two.
+*
+* Bits are set atomically, which allows adding items from multiple threads (and while matching).
+* The number of set bits is counted while adding so that the fill ratio is available without scanning the table.
+*/
 template<size_t N>
 class BloomFilter {
 public:
-	BloomFilter(size_t tableSize) { table.resize(tableSize); }
+	static_assert(N > 0 && N <= sizeof(uint64_t), "n-grams must fit in a 64 bit word");
+
+	static const size_t BLOCK_BITS = 512;
+
+	// Number of bits to set for each n-gram
+	static const size_t PROBES = 3;
+
+	// aTableSize is the wanted number of bits (rounded up to the next power of two)
+	explicit BloomFilter(size_t aTableSize) {
+		blockCount = 1;
+		while (blockCount * BLOCK_BITS < aTableSize) {
+			blockCount <<= 1;
+		}
+
+		blockMask = blockCount - 1;
+		blocks.reset(new Block[blockCount]);
+		clear();
+	}
+
 	~BloomFilter() { }
 
-	void add(const string& s) { xadd(s, N); }
-	bool match(const string& s) const {
+	BloomFilter(const BloomFilter&) = delete;
+	BloomFilter& operator=(const BloomFilter&) = delete;
+
+	void add(const string& s) noexcept {
 		if(s.length() >= N) {
 			string::size_type l = s.length() - N;
 			for(string::size_type i = 0; i <= l; ++i) {
-				if(!table[getPos(s, i, N)]) {
-					return false;
+				auto h = getHash(s.data() + i);
+				auto& block = blocks[getBlock(h)];
+				for (size_t p = 0; p < PROBES; ++p) {
+					auto bit = getBit(h, p);
+					auto mask = 1ULL << (bit % 64);
+					if ((block.words[bit / 64].fetch_or(mask, std::memory_order_relaxed) & mask) == 0) {
+						setBits.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+			}
+		}
+	}
+
+	bool match(const string& s) const noexcept {
+		if(s.length() >= N) {
+			string::size_type l = s.length() - N;
+			for(string::size_type i = 0; i <= l; ++i) {
+				auto h = getHash(s.data() + i);
+				const auto& block = blocks[getBlock(h)];
+				for (size_t p = 0; p < PROBES; ++p) {
+					auto bit = getBit(h, p);
+					if ((block.words[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64))) == 0) {
+						return false;
+					}
 				}
 			}
 		}
 		return true;
 	}
-	void clear() {
-		size_t s = table.size();
-		table.clear();
-		table.resize(s);
+
+	void clear() noexcept {
+		for (size_t i = 0; i < blockCount; ++i) {
+			for (auto& w: blocks[i].words) {
+				w.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		setBits.store(0, std::memory_order_relaxed);
 	}
 
-	void merge(const BloomFilter<N>& aBloom) {
-		for (size_t i = 0; i < table.size(); ++i) {
-			if (aBloom.table[i] == true) {
-				table[i] = true;
+	void merge(const BloomFilter<N>& aBloom) noexcept {
+		dcassert(aBloom.blockCount == blockCount);
+		size_t newBits = 0;
+		for (size_t i = 0; i < blockCount; ++i) {
+			for (size_t w = 0; w < WORDS_PER_BLOCK; ++w) {
+				auto bits = aBloom.blocks[i].words[w].load(std::memory_order_relaxed);
+				newBits += bitCount(bits & ~blocks[i].words[w].fetch_or(bits, std::memory_order_relaxed));
 			}
 		}
+
+		setBits.fetch_add(newBits, std::memory_order_relaxed);
+	}
+
+	// Table size in bits
+	size_t getSize() const noexcept { return blockCount * BLOCK_BITS; }
+
+	// Share of the bits that have been set
+	double getFillRatio() const noexcept {
+		return static_cast<double>(setBits.load(std::memory_order_relaxed)) / static_cast<double>(getSize());
+	}
+
+	// Estimated probability for an n-gram that hasn't been added to match
+	static double getFalsePositiveRate(double aFillRatio) noexcept {
+		return pow(aFillRatio, static_cast<double>(PROBES));
+	}
+
+	// Table size (in bits) for the wanted number of n-grams
+	// The minimum size is used for empty shares so that the table won't need to be grown for small changes
+	static size_t getOptimalSize(size_t aNGramCount, size_t aMinSize, size_t aMaxSize) noexcept {
+		// k / ln(2) bits per item would be optimal for a regular bloom filter, add some extra for the uneven block fill
+		auto bits = static_cast<double>(aNGramCount) * (static_cast<double>(PROBES) / 0.69314718056) * 1.5;
+		return min(max(static_cast<size_t>(bits), aMinSize), aMaxSize);
 	}
 #ifdef TESTER
 	void print_table_status() {
-		int tot = 0;
-		for (unsigned int i = 0; i < table.size(); ++i) if (table[i] == true) ++tot;
-
-		std::cout << "table status: " << tot << " of " << table.size()
-			<< " filled, for an occupancy percentage of " << (100.*tot)/table.size()
+		auto fill = getFillRatio();
+		std::cout << "table status: " << static_cast<size_t>(fill * getSize()) << " of " << getSize()
+			<< " filled, for an occupancy percentage of " << (100. * fill)
 			<< "%" << std::endl;
 	}
 #endif
 private:
-	void xadd(const string& s, size_t n) {
-		if(s.length() >= n) {
-			string::size_type l = s.length() - n;
-			for(string::size_type i = 0; i <= l; ++i) {
-				table[getPos(s, i, n)] = true;
-			}
-		} 
+	static const size_t WORDS_PER_BLOCK = BLOCK_BITS / 64;
+
+	struct alignas(64) Block {
+		std::atomic<uint64_t> words[WORDS_PER_BLOCK];
+	};
+
+	// The n-gram is read as a single word instead of mixing it byte by byte
+	static uint64_t getHash(const char* aNGram) noexcept {
+		uint64_t h = 0;
+		memcpy(&h, aNGram, N);
+
+		h *= 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 32;
+		h *= 0xd6e8feb86659fd93ULL;
+		h ^= h >> 32;
+		return h;
 	}
 
-	/* This is roughly how boost::hash does it */
-	size_t getPos(const string& s, size_t i, size_t l) const {
-		size_t h = 0;
-		const char* c = s.data() + i;
-		const char* end = s.data() + i + l;
-		for(; c < end; ++c) {
-			h ^= *c + 0x9e3779b9 + (h<<6) + (h>>2);
-		}
-		return (h % table.size());
+	// The upper half is used for selecting the block and the lower half for the bits inside it
+	size_t getBlock(uint64_t aHash) const noexcept {
+		return static_cast<size_t>(aHash >> 32) & blockMask;
+	}
+
+	static size_t getBit(uint64_t aHash, size_t aProbe) noexcept {
+		return static_cast<size_t>(aHash >> (aProbe * 9)) & (BLOCK_BITS - 1);
+	}
+
+	static size_t bitCount(uint64_t aWord) noexcept {
+		return std::bitset<64>(aWord).count();
 	}
-	
-	vector<bool> table;
+
+	unique_ptr<Block[]> blocks;
+	size_t blockCount;
+	size_t blockMask;
+
+	std::atomic<size_t> setBits { 0 };
 };
 
 } // namespace dcpp
@@ -24,6 +24,7 @@
 #include <boost/scoped_array.hpp>
 
 #include "ConnectivityManager.h"
+#include "File.h"
 #include "SettingsManager.h"
 #include "SSLSocket.h"
 #include "Streams.h"
@@ -41,9 +42,11 @@ using std::max;
 
 BufferedSocket::BufferedSocket(char aSeparator, bool v4only) :
 separator(aSeparator), useLimiter(false), mode(MODE_LINE), dataBytes(0), rollback(0), state(STARTING),
-disconnecting(false), v4only(v4only)
+disconnecting(false), v4only(v4only), reactor(SocketReactor::getInstance())
 {
-	start();
+	if (!reactor) {
+		start();
+	}
 
 	++sockets;
 }
@@ -192,7 +195,24 @@ void BufferedSocket::threadRead() {
 	if(state != RUNNING)
 		return;
 
-	int left = (mode == MODE_DATA && useLimiter) ? ThrottleManager::getInstance()->read(sock.get(), &inbuf[0], inbuf.size()) : sock->read(&inbuf[0], inbuf.size());
+	int left;
+	if(mode == MODE_DATA && useLimiter && reactor) {
+		auto tm = ThrottleManager::getInstance();
+		auto readSize = tm->acquireDownload(throttleFlow, inbuf.size());
+		if(readSize == 0) {
+			// Wait for the tokens in the reactor
+			readWait = tm->getDownloadWaitTime(throttleFlow);
+			return;
+		}
+
+		left = sock->read(&inbuf[0], readSize);
+		if(left < static_cast<int>(readSize)) {
+			tm->releaseDownload(throttleFlow, readSize - max(left, 0));
+		}
+	} else {
+		left = (mode == MODE_DATA && useLimiter) ? ThrottleManager::getInstance()->read(sock.get(), &inbuf[0], inbuf.size(), throttleFlow) : sock->read(&inbuf[0], inbuf.size());
+	}
+
 	if(left == -1) {
 		// EWOULDBLOCK, no data received...
 		return;
@@ -301,6 +321,35 @@ void BufferedSocket::threadSendFile(InputStream* file) {
 	if(disconnecting)
 		return;
 	dcassert(file != NULL);
+
+	if(reactor) {
+		// Sent by the reactor without blocking
+		upload = make_unique<Upload>(file);
+
+		size_t sockSize = (size_t)sock->getSocketOptInt(SO_SNDBUF);
+		if(sock->canSendFile()) {
+			upload->sourceBytes = numeric_limits<int64_t>::max();
+			upload->sourceFile = file->getSourceFile(upload->sourceBytes);
+		}
+
+		if(upload->sourceFile) {
+			upload->chunkSize = max(sockSize / 2, (size_t)32*1024);
+		} else {
+			upload->chunkSize = sockSize / 2;
+			upload->readBuf.resize(max(sockSize, (size_t)64*1024));
+		}
+		return;
+	}
+
+	if(sock->canSendFile()) {
+		int64_t bytes = numeric_limits<int64_t>::max();
+		auto sourceFile = file->getSourceFile(bytes);
+		if(sourceFile) {
+			threadSendFileDirect(*sourceFile, bytes);
+			return;
+		}
+	}
+
 	size_t sockSize = (size_t)sock->getSocketOptInt(SO_SNDBUF);
 	size_t bufSize = max(sockSize, (size_t)64*1024);
 
@@ -350,7 +399,7 @@ void BufferedSocket::threadSendFile(InputStream* file) {
 				written = sock->write(&writeBufTmp[writePos], writeSize);
 			} else {
 				writeSize = min(sockSize / 2, writeBufTmp.size() - writePos);
-				written = useLimiter ? ThrottleManager::getInstance()->write(sock.get(), &writeBufTmp[writePos], writeSize) : sock->read(&inbuf[0], inbuf.size());
+				written = useLimiter ? ThrottleManager::getInstance()->write(sock.get(), &writeBufTmp[writePos], writeSize, throttleFlow) : sock->write(&writeBufTmp[writePos], writeSize);
 			}
 			
 			if(written > 0) {
@@ -389,6 +438,45 @@ void BufferedSocket::threadSendFile(InputStream* file) {
 	}
 }
 
+void BufferedSocket::threadSendFileDirect(File& aFile, int64_t aBytes) {
+	// Chunks of the same size as with buffered sending so that the limiter works the same way
+	size_t chunkSize = max((size_t)sock->getSocketOptInt(SO_SNDBUF) / 2, (size_t)32*1024);
+
+	while(!disconnecting) {
+		if(aBytes == 0) {
+			fire(BufferedSocketListener::TransmitDone());
+			return;
+		}
+
+		size_t len = (size_t)min((int64_t)chunkSize, aBytes);
+		int sent = useLimiter ? ThrottleManager::getInstance()->sendFile(sock.get(), aFile, len, throttleFlow) : sock->sendFile(aFile, (int)len);
+
+		if(sent > 0) {
+			aBytes -= sent;
+
+			// The data is read and sent at the same time
+			fire(BufferedSocketListener::BytesSent(), sent, sent);
+		} else if(sent == 0) {
+			if(aFile.getPos() >= aFile.getSize()) {
+				// The file was truncated
+				aBytes = 0;
+			}
+
+			// Otherwise there were no upload tokens available
+		} else {
+			while(!disconnecting) {
+				auto w = sock->wait(POLL_TIMEOUT, true, true);
+				if(w.first) {
+					threadRead();
+				}
+				if(w.second) {
+					break;
+				}
+			}
+		}
+	}
+}
+
 void BufferedSocket::write(const char* aBuf, size_t aLen) noexcept {
 	if(!sock.get())
 		return;
@@ -411,6 +499,12 @@ void BufferedSocket::threadSendData() {
 		writeBuf.swap(sendBuf);
 	}
 
+	if(reactor) {
+		// Sent by the reactor without blocking
+		sendPos = 0;
+		return;
+	}
+
 	size_t left = sendBuf.size();
 	size_t done = 0;
 	while(left > 0) {
@@ -435,8 +529,25 @@ void BufferedSocket::threadSendData() {
 	sendBuf.clear();
 }
 
+bool BufferedSocket::checkSending() noexcept {
+	if(!reactor || !isSending()) {
+		return false;
+	}
+
+	if(!disconnecting) {
+		return true;
+	}
+
+	// Abort
+	upload.reset();
+	sendBuf.clear();
+	sendPos = 0;
+	return false;
+}
+
 bool BufferedSocket::checkEvents() {
-	while(state == RUNNING ? taskSem.wait(0) : taskSem.wait()) {
+	// The reactor will schedule the socket again when there are new tasks
+	while(!checkSending() && ((state == RUNNING || reactor) ? taskSem.wait(0) : taskSem.wait())) {
 		pair<Tasks, unique_ptr<TaskData> > p;
 		{
 			Lock l(cs);
@@ -509,13 +620,234 @@ int BufferedSocket::run() {
 	return 0;
 }
 
+/**
+ * Reactor task dispatcher, processes the socket until there are no runnable tasks or data left
+ */
+void BufferedSocket::process() noexcept {
+	while(true) {
+		try {
+			if(!checkEvents()) {
+				reactor->unwatch(this);
+				delete this;
+				return;
+			}
+
+			if(state == RUNNING) {
+				readWait = 0;
+				writeWait = 0;
+				writeBlocked = false;
+
+				if(isSending() && !disconnecting && reactorSend()) {
+					// Continue with the queued tasks
+					continue;
+				}
+
+				if(sock->wait(0, true, false).first) {
+					threadRead();
+					if(readWait == 0) {
+						continue;
+					}
+				}
+
+				reactorWait();
+			}
+		} catch(const Exception& e) {
+			fail(e.getError());
+			continue;
+		}
+
+		Lock l(cs);
+		if((tasks.empty() || (isSending() && !disconnecting)) && !ready) {
+			scheduled = false;
+			return;
+		}
+
+		ready = false;
+	}
+}
+
+void BufferedSocket::reactorWait() {
+	// Reading is paused while waiting for the download tokens
+	auto wantRead = readWait == 0;
+	if(wantRead || writeBlocked) {
+		if(!reactor->watch(this, sock->getSock(), wantRead, writeBlocked)) {
+			throw SocketException(errno);
+		}
+	}
+
+	auto waitTime = readWait > 0 && writeWait > 0 ? min(readWait, writeWait) : max(readWait, writeWait);
+	if(waitTime > 0) {
+		reactor->setTimer(this, waitTime);
+	}
+}
+
+bool BufferedSocket::reactorSend() {
+	if(upload) {
+		if(!(upload->sourceFile ? reactorSendFileDirect(*upload) : reactorSendFile(*upload))) {
+			return false;
+		}
+
+		upload.reset();
+		return true;
+	}
+
+	while(sendPos < sendBuf.size()) {
+		// Failed writes are retried with the same size (OpenSSL)
+		int n = sock->write(&sendBuf[sendPos], sendBuf.size() - sendPos);
+		if(n <= 0) {
+			writeBlocked = true;
+			return false;
+		}
+
+		sendPos += n;
+	}
+
+	sendBuf.clear();
+	sendPos = 0;
+	return true;
+}
+
+size_t BufferedSocket::readUpload(Upload& aUpload, size_t aLen) {
+	size_t bytesRead = aLen;
+	size_t actual = aUpload.stream->read(&aUpload.readBuf[aUpload.readPos], bytesRead);
+
+	if(bytesRead > 0) {
+		fire(BufferedSocketListener::BytesSent(), bytesRead, 0);
+	}
+
+	if(actual == 0) {
+		aUpload.readDone = true;
+	} else {
+		aUpload.readPos += actual;
+	}
+
+	return actual;
+}
+
+bool BufferedSocket::reactorSendFile(Upload& aUpload) {
+	while(true) {
+		if(aUpload.writePos == aUpload.writeBuf.size()) {
+			auto bufSize = aUpload.readBuf.size();
+			if(!aUpload.readDone && bufSize > aUpload.readPos) {
+				// Fill read buffer
+				readUpload(aUpload, bufSize - aUpload.readPos);
+			}
+
+			if(aUpload.readDone && aUpload.readPos == 0) {
+				fire(BufferedSocketListener::TransmitDone());
+				return true;
+			}
+
+			aUpload.readBuf.swap(aUpload.writeBuf);
+			aUpload.readBuf.resize(bufSize);
+			aUpload.writeBuf.resize(aUpload.readPos);
+			aUpload.readPos = 0;
+			aUpload.writePos = 0;
+		}
+
+		int written;
+		if(aUpload.retrySize > 0) {
+			// workaround for OpenSSL (crashes when previous write failed and now retrying with different writeSize)
+			written = sock->write(&aUpload.writeBuf[aUpload.writePos], static_cast<int>(aUpload.retrySize));
+		} else {
+			auto writeSize = min(aUpload.chunkSize, aUpload.writeBuf.size() - aUpload.writePos);
+			if(useLimiter) {
+				auto tm = ThrottleManager::getInstance();
+				writeSize = tm->acquireUpload(throttleFlow, writeSize);
+				if(writeSize == 0) {
+					writeWait = tm->getUploadWaitTime(throttleFlow);
+					return false;
+				}
+			}
+
+			written = sock->write(&aUpload.writeBuf[aUpload.writePos], static_cast<int>(writeSize));
+			if(written <= 0) {
+				// The tokens stay consumed, the write is retried without the limiter
+				aUpload.retrySize = writeSize;
+			} else if(useLimiter && static_cast<size_t>(written) < writeSize) {
+				ThrottleManager::getInstance()->releaseUpload(throttleFlow, writeSize - written);
+			}
+		}
+
+		if(written > 0) {
+			aUpload.writePos += written;
+			aUpload.retrySize = 0;
+
+			fire(BufferedSocketListener::BytesSent(), 0, written);
+			continue;
+		}
+
+		if(!aUpload.readDone && aUpload.readPos < aUpload.readBuf.size()) {
+			// Read a little while waiting for the socket
+			readUpload(aUpload, min(aUpload.readBuf.size() - aUpload.readPos, aUpload.readBuf.size() / 2));
+		}
+
+		writeBlocked = true;
+		return false;
+	}
+}
+
+bool BufferedSocket::reactorSendFileDirect(Upload& aUpload) {
+	while(aUpload.sourceBytes > 0) {
+		auto len = (size_t)min((int64_t)aUpload.chunkSize, aUpload.sourceBytes);
+		if(useLimiter) {
+			auto tm = ThrottleManager::getInstance();
+			len = tm->acquireUpload(throttleFlow, len);
+			if(len == 0) {
+				writeWait = tm->getUploadWaitTime(throttleFlow);
+				return false;
+			}
+		}
+
+		int sent = sock->sendFile(*aUpload.sourceFile, (int)len);
+		if(useLimiter && sent < static_cast<int>(len)) {
+			ThrottleManager::getInstance()->releaseUpload(throttleFlow, len - max(sent, 0));
+		}
+
+		if(sent > 0) {
+			aUpload.sourceBytes -= sent;
+
+			// The data is read and sent at the same time
+			fire(BufferedSocketListener::BytesSent(), sent, sent);
+		} else if(sent == 0) {
+			// The file was truncated
+			aUpload.sourceBytes = 0;
+		} else {
+			writeBlocked = true;
+			return false;
+		}
+	}
+
+	fire(BufferedSocketListener::TransmitDone());
+	return true;
+}
+
+void BufferedSocket::onReady() noexcept {
+	Lock l(cs);
+	ready = true;
+	if(!scheduled) {
+		scheduled = true;
+		reactor->schedule(this);
+	}
+}
+
 void BufferedSocket::fail(const string& aError) {
 	if(state != FAILED) {
 		state = FAILED;
 		fire(BufferedSocketListener::Failed(), aError);
 	}
+	// Nothing can be sent anymore
+	upload.reset();
+	sendBuf.clear();
+	sendPos = 0;
+
 	//fire listener before deleting socket to be able to retrieve information from it.. does it cause any problems?? 
 	if (sock.get()) {
+		if (reactor) {
+			// The descriptor may be reused after closing
+			reactor->unwatch(this);
+		}
+
 		sock->disconnect();
 	}
 }
@@ -529,6 +861,11 @@ void BufferedSocket::shutdown(function<void ()> f) {
 void BufferedSocket::addTask(Tasks task, TaskData* data) {
 	dcassert(task == DISCONNECT || task == SHUTDOWN || sock.get());
 	tasks.emplace_back(task, unique_ptr<TaskData>(data)); taskSem.signal();
+
+	if(reactor && !scheduled) {
+		scheduled = true;
+		reactor->schedule(this);
+	}
 }
 
 } // namespace dcpp
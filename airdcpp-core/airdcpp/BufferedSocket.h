@@ -30,7 +30,9 @@
 #include "Semaphore.h"
 #include "Thread.h"
 #include "Socket.h"
+#include "SocketReactor.h"
 #include "Speaker.h"
+#include "ThrottleManager.h"
 
 namespace dcpp {
 
@@ -39,7 +41,13 @@ using std::function;
 using std::pair;
 using std::unique_ptr;
 
-class BufferedSocket : public Speaker<BufferedSocketListener>, public Thread {
+/**
+ * The socket tasks are run in a thread of their own, or by the socket reactor when it's available.
+ *
+ * With the reactor, data and files are sent without blocking: the socket is watched for writability
+ * and throttled transfers wait for a reactor timer instead of the limiter.
+ */
+class BufferedSocket : public Speaker<BufferedSocketListener>, public Thread, private SocketReactor::Client {
 public:
 	enum Modes {
 		MODE_LINE,
@@ -112,6 +120,9 @@ public:
 
 	GETSET(char, separator, Separator);
 	GETSET(bool, useLimiter, UseLimiter);
+
+	// Bandwidth sharing group of the socket (used with the limiter)
+	ThrottleManager::Flow& getThrottleFlow() noexcept { return throttleFlow; }
 private:
 	enum Tasks {
 		CONNECT,
@@ -149,6 +160,27 @@ private:
 		function<void ()> f;
 	};
 
+	// State of a file that is being sent by the reactor
+	struct Upload {
+		Upload(InputStream* aStream) : stream(aStream) { }
+
+		InputStream* stream;
+		size_t chunkSize = 0;
+
+		// Sent directly from the file
+		File* sourceFile = nullptr;
+		int64_t sourceBytes = 0;
+
+		ByteVector readBuf;
+		ByteVector writeBuf;
+		size_t readPos = 0;
+		size_t writePos = 0;
+		bool readDone = false;
+
+		// Size of a failed write that must be retried with the same size (OpenSSL)
+		size_t retrySize = 0;
+	};
+
 	BufferedSocket(char aSeparator, bool v4only);
 
 	virtual ~BufferedSocket();
@@ -168,18 +200,50 @@ private:
 	ByteVector sendBuf;
 
 	std::unique_ptr<Socket> sock;
+	ThrottleManager::Flow throttleFlow;
 	State state;
 	bool disconnecting;
 	bool v4only;
 
+	// Reactor mode
+	SocketReactor* const reactor;
+	bool scheduled = false; // guarded by cs
+	bool ready = false; // guarded by cs
+
+	unique_ptr<Upload> upload;
+	size_t sendPos = 0; // bytes of sendBuf that have been sent
+
+	// Set when the socket would block or the transfer is throttled (ms)
+	bool writeBlocked = false;
+	uint64_t readWait = 0;
+	uint64_t writeWait = 0;
+
 	virtual int run();
 
+	void process() noexcept override;
+	void onReady() noexcept override;
+
+	bool isSending() const noexcept { return upload || sendPos < sendBuf.size(); }
+
+	// Continue sending the pending data without blocking, returns true if everything was sent
+	bool reactorSend();
+	bool reactorSendFile(Upload& aUpload);
+	bool reactorSendFileDirect(Upload& aUpload);
+	void reactorWait();
+
+	// Read from the file that is being sent, returns the number of bytes read
+	size_t readUpload(Upload& aUpload, size_t aLen);
+
 	void threadConnect(const AddressInfo& aAddr, const string& aPort, const string& localPort, NatRoles natRole, bool proxy);
 	void threadAccept();
 	void threadRead();
 	void threadSendFile(InputStream* is);
+	void threadSendFileDirect(File& aFile, int64_t aBytes);
 	void threadSendData();
 
+	// Returns true if the queued tasks must wait until the pending data has been sent
+	bool checkSending() noexcept;
+
 	void fail(const string& aError);
 	static atomic<long> sockets;
 
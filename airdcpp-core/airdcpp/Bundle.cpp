@@ -231,7 +231,7 @@ void Bundle::getItems(const UserPtr& aUser, QueueItemList& ql) const noexcept {
 	for(int i = static_cast<int>(Priority::PAUSED_FORCE); i < static_cast<int>(Priority::LAST); ++i) {
 		auto j = userQueue[i].find(aUser);
 		if(j != userQueue[i].end()) {
-			copy(j->second, back_inserter(ql));
+			j->second.getItems(ql);
 		}
 	}
 }
@@ -320,21 +320,8 @@ void Bundle::addUserQueue(const QueueItemPtr& qi) noexcept {
 }
 
 bool Bundle::addUserQueue(const QueueItemPtr& qi, const HintedUser& aUser, bool isBad /*false*/) noexcept {
-	auto& l = userQueue[static_cast<int>(qi->getPriority())][aUser.user];
-	dcassert(find(l, qi) == l.end());
-
-	if (l.size() > 1) {
-		if (!seqOrder) {
-			/* Randomize the downloading order for each user if the bundle dir date is newer than 7 days to boost partial bundle sharing */
-			l.push_back(qi);
-			swap(l[Util::rand((uint32_t)l.size())], l[l.size()-1]);
-		} else {
-			/* Sequential order */
-			l.insert(upper_bound(l.begin(), l.end(), qi, QueueItem::AlphaSortOrder()), qi);
-		}
-	} else {
-		l.push_back(qi);
-	}
+	/* Randomize the downloading order for each user if the bundle dir date is newer than 7 days to boost partial bundle sharing */
+	userQueue[static_cast<int>(qi->getPriority())][aUser.user].add(qi, seqOrder);
 
 	if (isBad) {
 		auto i = find(badSources, aUser);
@@ -366,10 +353,12 @@ QueueItemPtr Bundle::getNextQI(const UserPtr& aUser, const OrderedStringSet& aOn
 		auto i = userQueue[p].find(aUser);
 		if(i != userQueue[p].end()) {
 			dcassert(!i->second.empty());
-			for(auto& qi: i->second) {
-				if (qi->hasSegment(aUser, aOnlineHubs, aLastError, aWantedSize, aLastSpeed, aType, aAllowOverlap)) {
-					return qi;
-				}
+			auto qi = i->second.findFirst(aType, [&](const QueueItemPtr& q) {
+				return q->hasSegment(aUser, aOnlineHubs, aLastError, aWantedSize, aLastSpeed, aType, aAllowOverlap);
+			});
+
+			if (qi) {
+				return qi;
 			}
 		}
 		p--;
@@ -430,16 +419,31 @@ void Bundle::rotateUserQueue(const QueueItemPtr& qi, const UserPtr& aUser) noexc
 	if (j == ulm.end()) {
 		return;
 	}
-	auto& l = j->second;
-	if (l.size() > 1) {
-		auto s = find(l, qi);
-		if (s != l.end()) {
-			l.erase(s);
-			l.push_back(qi);
+	j->second.moveToBack(qi);
+}
+
+void Bundle::updateUserQueue(const QueueItemPtr& qi) noexcept {
+	auto& ulm = userQueue[static_cast<int>(qi->getPriority())];
+	for (const auto& s: qi->getSources()) {
+		auto j = ulm.find(s.getUser());
+		if (j != ulm.end()) {
+			j->second.update(qi);
 		}
 	}
 }
 
+Bundle::UserQueueState Bundle::getUserQueueState(const UserPtr& aUser, bool aSmallSlot) const noexcept {
+	auto state = USER_QUEUE_EMPTY;
+	for (int i = static_cast<int>(Priority::LOWEST); i < static_cast<int>(Priority::LAST) && state != USER_QUEUE_WAITING; ++i) {
+		auto j = userQueue[i].find(aUser);
+		if (j != userQueue[i].end()) {
+			state = max(state, j->second.getState(aSmallSlot));
+		}
+	}
+
+	return state;
+}
+
 void Bundle::removeUserQueue(const QueueItemPtr& qi) noexcept {
 	for(auto& s: qi->getSources())
 		removeUserQueue(qi, s.getUser(), 0);
@@ -456,10 +460,7 @@ bool Bundle::removeUserQueue(const QueueItemPtr& qi, const UserPtr& aUser, Flags
 		return false;
 	}
 	auto& l = j->second;
-	auto s = find(l, qi);
-	if (s != l.end()) {
-		l.erase(s);
-	}
+	l.remove(qi);
 
 	if(l.empty()) {
 		ulm.erase(j);
@@ -880,4 +881,132 @@ void Bundle::save() {
 	dirty = false;
 }
 
+// Sequential order, ".rar" comes before the ".rXX" volumes
+static int compareSequential(const string& a, const string& b) noexcept {
+	auto getRarPos = [](const string& aPath) {
+		return aPath.length() >= 4 && Util::stricmp(aPath.c_str() + aPath.length() - 4, ".rar") == 0 ? aPath.length() - 2 : string::npos;
+	};
+
+	// Compare as if the "ar" of the extension was replaced with a character sorting before the digits
+	auto rarA = getRarPos(a), rarB = getRarPos(b);
+	auto lenA = rarA != string::npos ? rarA + 1 : a.length();
+	auto lenB = rarB != string::npos ? rarB + 1 : b.length();
+	for (size_t i = 0; i < lenA && i < lenB; ++i) {
+		auto ca = i == rarA ? 1 : static_cast<uint8_t>(a[i]);
+		auto cb = i == rarB ? 1 : static_cast<uint8_t>(b[i]);
+		if (ca != cb) {
+			return ca < cb ? -1 : 1;
+		}
+	}
+
+	return compare(lenA, lenB);
+}
+
+bool Bundle::UserItemQueue::PositionLess::operator()(const Position& a, const Position& b) const noexcept {
+	if (a.epoch != b.epoch) {
+		return a.epoch < b.epoch;
+	}
+
+	if (a.order != b.order) {
+		return a.order < b.order;
+	}
+
+	if (a.item == b.item) {
+		return false;
+	}
+
+	auto res = compareSequential(a.item->getTarget(), b.item->getTarget());
+	if (res != 0) {
+		return res < 0;
+	}
+
+	return a.item.get() < b.item.get();
+}
+
+Bundle::UserItemQueue::PositionSet& Bundle::UserItemQueue::getSet(const Position& aPosition) noexcept {
+	auto& lane = lanes[aPosition.lane];
+	return aPosition.item->isWaiting() ? lane.waiting : lane.running;
+}
+
+void Bundle::UserItemQueue::insert(const Position& aPosition) noexcept {
+	positions.emplace(aPosition.item.get(), aPosition);
+	getSet(aPosition).insert(aPosition);
+}
+
+void Bundle::UserItemQueue::add(const QueueItemPtr& aQI, bool aSequential) noexcept {
+	dcassert(positions.find(aQI.get()) == positions.end());
+
+	// Avoid 0 so that the random order won't fall back to comparing the paths
+	insert({ 0, aSequential ? 0 : max(Util::rand(), 1U), aQI, aQI->usesSmallSlot() ? LANE_SMALL : LANE_NORMAL });
+}
+
+bool Bundle::UserItemQueue::remove(const QueueItemPtr& aQI) noexcept {
+	auto i = positions.find(aQI.get());
+	if (i == positions.end()) {
+		return false;
+	}
+
+	auto& lane = lanes[i->second.lane];
+	if (lane.waiting.erase(i->second) == 0) {
+		lane.running.erase(i->second);
+	}
+
+	positions.erase(i);
+	return true;
+}
+
+void Bundle::UserItemQueue::moveToBack(const QueueItemPtr& aQI) noexcept {
+	auto i = positions.find(aQI.get());
+	if (i == positions.end() || positions.size() == 1) {
+		return;
+	}
+
+	auto position = i->second;
+	remove(aQI);
+
+	position.epoch = ++lastEpoch;
+	insert(position);
+}
+
+void Bundle::UserItemQueue::update(const QueueItemPtr& aQI) noexcept {
+	auto i = positions.find(aQI.get());
+	if (i == positions.end()) {
+		return;
+	}
+
+	auto& lane = lanes[i->second.lane];
+	auto& target = getSet(i->second);
+	if (target.find(i->second) == target.end()) {
+		(&target == &lane.waiting ? lane.running : lane.waiting).erase(i->second);
+		target.insert(i->second);
+	}
+}
+
+Bundle::UserQueueState Bundle::UserItemQueue::getState(bool aSmallSlot) const noexcept {
+	const auto& lane = lanes[aSmallSlot ? LANE_SMALL : LANE_NORMAL];
+	if (!lane.waiting.empty()) {
+		return USER_QUEUE_WAITING;
+	}
+
+	return lane.running.empty() ? USER_QUEUE_EMPTY : USER_QUEUE_RUNNING;
+}
+
+void Bundle::UserItemQueue::getItems(QueueItemList& items_) const noexcept {
+	auto start = items_.size();
+	for (const auto& lane: lanes) {
+		for (const auto& p: lane.waiting) {
+			items_.push_back(p.item);
+		}
+
+		for (const auto& p: lane.running) {
+			items_.push_back(p.item);
+		}
+	}
+
+	// Download order
+	sort(items_.begin() + start, items_.end(), [this](const QueueItemPtr& a, const QueueItemPtr& b) {
+		return PositionLess()(positions.at(a.get()), positions.at(b.get()));
+	});
+}
+
 }
@@ -156,6 +156,7 @@ public:
 
 	void setDirty() noexcept;
 	bool getDirty() const noexcept;
+	void clearDirty() noexcept { dirty = false; }
 	bool checkRecent() noexcept;
 	bool isRecent() const noexcept { return recent; }
 
@@ -244,6 +245,18 @@ public:
 
 	//moves the file back in userqueue for the given user (only within the same priority)
 	void rotateUserQueue(const QueueItemPtr& qi, const UserPtr& aUser) noexcept;
+
+	// Call after downloads have been added or removed for the item
+	void updateUserQueue(const QueueItemPtr& qi) noexcept;
+
+	enum UserQueueState {
+		USER_QUEUE_EMPTY,
+		USER_QUEUE_RUNNING, // all items have running downloads
+		USER_QUEUE_WAITING
+	};
+
+	// State of the user's unpaused items using the small slot (or the normal items)
+	UserQueueState getUserQueueState(const UserPtr& aUser, bool aSmallSlot) const noexcept;
 	bool isEmpty() const noexcept { return queueItems.empty() && finishedFiles.empty(); }
 private:
 	ActionHookRejectionPtr hookError = nullptr;
@@ -257,8 +270,110 @@ private:
 	bool dirty = false;
 	bool recent = false;
 
+	/*
+	* Queue items of a single user in the download order
+	*
+	* Items without running downloads are indexed separately from the running ones. The first waiting item is
+	* normally downloadable, so only the running items before it need to be checked for free segments.
+	*
+	* Items using the small slot can't be downloaded with normal MCN connections (and the other way around), so they are
+	* kept in a lane of their own. Blocked items of the other type won't need to be skipped when looking for the next item.
+	*/
+	class UserItemQueue {
+	public:
+		// Adds the item in a random or sequential (alphabetical) position
+		void add(const QueueItemPtr& aQI, bool aSequential) noexcept;
+		bool remove(const QueueItemPtr& aQI) noexcept;
+
+		// Move the item after all other items
+		void moveToBack(const QueueItemPtr& aQI) noexcept;
+
+		// Re-index the item after downloads have been added or removed
+		void update(const QueueItemPtr& aQI) noexcept;
+
+		// Returns the first item in the download order that may be downloaded with the connection type and is accepted by the filter
+		template<class FilterT>
+		QueueItemPtr findFirst(QueueItemBase::DownloadType aType, const FilterT& aFilter) const {
+			const Position* first = nullptr;
+			for (int i = 0; i < LANE_LAST; ++i) {
+				if ((i == LANE_SMALL && aType == TYPE_MCN_NORMAL) || (i == LANE_NORMAL && aType == TYPE_SMALL)) {
+					continue;
+				}
+
+				auto p = lanes[i].findFirst(aFilter);
+				if (p && (!first || PositionLess()(*p, *first))) {
+					first = p;
+				}
+			}
+
+			return first ? first->item : nullptr;
+		}
+
+		// Items in the download order
+		void getItems(QueueItemList& items_) const noexcept;
+
+		UserQueueState getState(bool aSmallSlot) const noexcept;
+
+		size_t size() const noexcept { return positions.size(); }
+		bool empty() const noexcept { return positions.empty(); }
+	private:
+		enum LaneType {
+			LANE_NORMAL,
+			LANE_SMALL,
+			LANE_LAST
+		};
+
+		struct Position {
+			uint64_t epoch; // increased when items are moved to the back
+			uint32_t order; // random order (0 with sequential order)
+			QueueItemPtr item;
+			LaneType lane;
+		};
+
+		struct PositionLess {
+			bool operator()(const Position& a, const Position& b) const noexcept;
+		};
+
+		typedef set<Position, PositionLess> PositionSet;
+
+		struct Lane {
+			PositionSet waiting;
+			PositionSet running;
+
+			template<class FilterT>
+			const Position* findFirst(const FilterT& aFilter) const {
+				const Position* firstWaiting = nullptr;
+				for (const auto& p: waiting) {
+					if (aFilter(p.item)) {
+						firstWaiting = &p;
+						break;
+					}
+				}
+
+				for (const auto& p: running) {
+					if (firstWaiting && !PositionLess()(p, *firstWaiting)) {
+						break;
+					}
+
+					if (aFilter(p.item)) {
+						return &p;
+					}
+				}
+
+				return firstWaiting;
+			}
+		};
+
+		void insert(const Position& aPosition) noexcept;
+		PositionSet& getSet(const Position& aPosition) noexcept;
+
+		Lane lanes[LANE_LAST];
+		unordered_map<const QueueItem*, Position> positions;
+		uint64_t lastEpoch = 0;
+	};
+
 	/** QueueItems by priority and user (this is where the download order is determined) */
-	unordered_map<UserPtr, deque<QueueItemPtr>, User::Hash> userQueue[static_cast<int>(Priority::LAST)];
+	unordered_map<UserPtr, UserItemQueue, User::Hash> userQueue[static_cast<int>(Priority::LAST)];
 	/** Currently running downloads, a QueueItem is always either here or in the userQueue */
 	unordered_map<UserPtr, QueueItemList, User::Hash> runningItems;
 
@@ -443,19 +443,96 @@ void BundleQueue::removeBundle(const BundlePtr& aBundle) noexcept{
 
 	dcassert(bundlePaths.size() == static_cast<size_t>(boost::count_if(bundles | map_values, [](const BundlePtr& b) { return !b->isFileBundle(); })));
 
-	aBundle->deleteXmlFile();
+	if (store) {
+		try {
+			store->removeBundle(aBundle->getToken());
+		} catch (const DbException& e) {
+			LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, aBundle->getName() % e.getError()), LogMessage::SEV_ERROR, STRING(SETTINGS));
+		}
+	} else {
+		aBundle->deleteXmlFile();
+	}
 }
 
-void BundleQueue::saveQueue(bool aForce) noexcept {
+bool BundleQueue::saveQueue(bool aForce) noexcept {
+	auto start = GET_TICK();
+	auto saved = store ? saveStore(aForce) : saveXml(aForce);
+
+	saveStats.durationMs = GET_TICK() - start;
+	return saved;
+}
+
+bool BundleQueue::saveXml(bool aForce) noexcept {
+	saveStats.bundles = 0;
+	saveStats.records = 0;
+
+	auto saved = true;
 	for(auto& b: bundles | map_values) {
 		if (b->getDirty() || aForce) {
 			try {
 				b->save();
+				saveStats.bundles++;
 			} catch(FileException& e) {
 				LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, b->getName() % e.getError()), LogMessage::SEV_ERROR, STRING(SETTINGS));
+				saved = false;
+			}
+		}
+	}
+
+	return saved;
+}
+
+// Don't keep too much data in memory when saving large queues
+#define MAX_STORE_BATCH_SIZE (4 * 1024 * 1024)
+
+bool BundleQueue::saveStore(bool aForce) noexcept {
+	saveStats.bundles = 0;
+	saveStats.records = 0;
+
+	auto saved = true;
+
+	QueueStore::Batch batch;
+	BundleList batchBundles;
+
+	auto write = [&] {
+		try {
+			store->write(batch);
+			saveStats.bundles += batchBundles.size();
+			saveStats.records += batch.size();
+		} catch (const DbException& e) {
+			LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, store->getDbPath() % e.getError()), LogMessage::SEV_ERROR, STRING(SETTINGS));
+			saved = false;
+
+			// Try again on the next save
+			for (const auto& b: batchBundles) {
+				b->setDirty();
+			}
+		}
+
+		batch = QueueStore::Batch();
+		batchBundles.clear();
+	};
+
+	for (auto& b: bundles | map_values) {
+		if (b->getDirty() || aForce) {
+			try {
+				store->saveBundle(*b, batch);
+			} catch (const DbException& e) {
+				LogManager::getInstance()->message(STRING_F(SAVE_FAILED_X, b->getName() % e.getError()), LogMessage::SEV_ERROR, STRING(SETTINGS));
+				saved = false;
+				continue;
+			}
+
+			b->clearDirty();
+			batchBundles.push_back(b);
+			if (batch.getDataSize() >= MAX_STORE_BATCH_SIZE) {
+				write();
 			}
 		}
 	}
+
+	write();
+	return saved;
 }
 
 } //dcpp
\ No newline at end of file
@@ -26,6 +26,7 @@
 #include "DupeType.h"
 #include "HintedUser.h"
 #include "PrioritySearchQueue.h"
+#include "QueueStore.h"
 #include "SortedVector.h"
 
 namespace dcpp {
@@ -76,7 +77,24 @@ public:
 
 	void removeBundle(const BundlePtr& aBundle) noexcept;
 
-	void saveQueue(bool aForce) noexcept;
+	// Returns false if any of the bundles couldn't be saved
+	bool saveQueue(bool aForce) noexcept;
+
+	// Save the bundles in the queue database instead of XML files (the store should contain all bundles)
+	void setStore(unique_ptr<QueueStore>&& aStore) noexcept { store = std::move(aStore); }
+	QueueStore* getStore() noexcept { return store.get(); }
+	const QueueStore* getStore() const noexcept { return store.get(); }
+
+	struct SaveStats {
+		// Bundles and database records written during the previous save
+		size_t bundles = 0;
+		size_t records = 0;
+
+		// Duration of the previous save in milliseconds
+		uint64_t durationMs = 0;
+	};
+
+	SaveStats getSaveStats() const noexcept { return saveStats; }
 	QueueItemList getSearchItems(const BundlePtr& aBundle) const noexcept;
 
 	DupeType isAdcDirectoryQueued(const string& aPath, int64_t aSize) const noexcept;
@@ -118,6 +136,12 @@ private:
 	Bundle::TokenMap bundles;
 
 	int64_t queueSize = 0;
+
+	bool saveStore(bool aForce) noexcept;
+	bool saveXml(bool aForce) noexcept;
+
+	unique_ptr<QueueStore> store;
+	SaveStats saveStats;
 };
 
 } // namespace dcpp
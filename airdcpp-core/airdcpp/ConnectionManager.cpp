@@ -90,7 +90,8 @@ ConnectionManager::ConnectionManager() : downloads(cqis[CONNECTION_TYPE_DOWNLOAD
 		"AD" + UserConnection::FEATURE_ADC_BZIP,
 		"AD" + UserConnection::FEATURE_ADC_TIGR,
 		"AD" + UserConnection::FEATURE_ADC_MCN1, 
-		"AD" + UserConnection::FEATURE_ADC_CPMI
+		"AD" + UserConnection::FEATURE_ADC_CPMI,
+		"AD" + UserConnection::FEATURE_ADC_BFL1
 	};
 
 	if (SETTING(USE_UPLOAD_BUNDLES))
@@ -138,9 +139,9 @@ void ConnectionManager::getDownloadConnection(const HintedUser& aUser, bool smal
 
 		{
 			WLock l(cs);
-			for(const auto& i: downloads) {
+			for(const auto& i: getUserDownloads(aUser.user)) {
 				cqi = i;
-				if (cqi->getUser() == aUser.user && !cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
+				if (!cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
 					if (cqi->isSet(ConnectionQueueItem::FLAG_MCN1)) {
 						supportMcn = true;
 						if (cqi->getState() != ConnectionQueueItem::RUNNING) {
@@ -149,6 +150,7 @@ void ConnectionManager::getDownloadConnection(const HintedUser& aUser, bool smal
 								// force in case we joined a new hub and there was a protocol error
 								if (cqi->getLastAttempt() == -1) {
 									cqi->setLastAttempt(0);
+									scheduleDownload(cqi, GET_TICK());
 								}
 								return;
 							}
@@ -162,6 +164,7 @@ void ConnectionManager::getDownloadConnection(const HintedUser& aUser, bool smal
 							// force in case we joined a new hub and there was a protocol error
 							if (cqi->getLastAttempt() == -1) {
 								cqi->setLastAttempt(0);
+								scheduleDownload(cqi, GET_TICK());
 							}
 							return;
 						}
@@ -190,10 +193,79 @@ ConnectionQueueItem* ConnectionManager::getCQI(const HintedUser& aUser, Connecti
 	auto cqi = new ConnectionQueueItem(aUser, aConnType, !aToken.empty() ? aToken : tokens.createToken(aConnType));
 	container.emplace_back(cqi);
 
+	if (aConnType == CONNECTION_TYPE_DOWNLOAD) {
+		userDownloads[aUser.user].push_back(cqi);
+		scheduleDownload(cqi, GET_TICK());
+	}
+
 	fire(ConnectionManagerListener::Added(), cqi);
 	return cqi;
 }
 
+const ConnectionQueueItem::List& ConnectionManager::getUserDownloads(const UserPtr& aUser) const noexcept {
+	static const ConnectionQueueItem::List emptyList;
+
+	auto i = userDownloads.find(aUser);
+	return i != userDownloads.end() ? i->second : emptyList;
+}
+
+void ConnectionManager::scheduleDownload(ConnectionQueueItem* aCQI, uint64_t aTick) noexcept {
+	Lock l(scheduleCS);
+	if (aCQI->getNextCheck() != 0) {
+		if (aCQI->getNextCheck() <= aTick) {
+			return;
+		}
+
+		downloadSchedule.erase(make_pair(aCQI->getNextCheck(), aCQI));
+	}
+
+	aCQI->setNextCheck(aTick);
+	downloadSchedule.emplace(aTick, aCQI);
+}
+
+void ConnectionManager::unscheduleDownload(ConnectionQueueItem* aCQI) noexcept {
+	Lock l(scheduleCS);
+	if (aCQI->getNextCheck() != 0) {
+		downloadSchedule.erase(make_pair(aCQI->getNextCheck(), aCQI));
+		aCQI->setNextCheck(0);
+	}
+}
+
+uint64_t ConnectionManager::getNextDownloadCheck(const ConnectionQueueItem* aCQI, uint64_t aTick) noexcept {
+	if (aCQI->getState() == ConnectionQueueItem::ACTIVE || aCQI->getState() == ConnectionQueueItem::RUNNING) {
+		// Will be scheduled again if the connection fails
+		return 0;
+	}
+
+	if (aCQI->getLastAttempt() == 0) {
+		// Forced attempt that didn't fit in the previous round
+		return aTick;
+	}
+
+	if (aCQI->getErrors() == -1) {
+		// Protocol error, wait for a forced attempt
+		return 0;
+	}
+
+	auto nextAttempt = aCQI->getLastAttempt() + 60 * 1000 * max(1, aCQI->getErrors()) + 1;
+	if (aCQI->getState() == ConnectionQueueItem::CONNECTING) {
+		// Connection timeout
+		return min(nextAttempt, aCQI->getLastAttempt() + 50 * 1000 + 1);
+	}
+
+	return nextAttempt;
+}
+
+ConnectionManager::DownloadSchedulerStats ConnectionManager::getDownloadSchedulerStats() const noexcept {
+	DownloadSchedulerStats stats;
+
+	Lock l(scheduleCS);
+	stats.scheduled = downloadSchedule.size();
+	stats.checked = lastCheckedDownloads;
+	stats.durationUs = lastDownloadCheckUs;
+	return stats;
+}
+
 void ConnectionManager::putCQI(ConnectionQueueItem* cqi) {
 	//allways called from inside lock
 
@@ -203,9 +275,21 @@ void ConnectionManager::putCQI(ConnectionQueueItem* cqi) {
 	dcassert(find(container.begin(), container.end(), cqi) != container.end());
 	container.erase(remove(container.begin(), container.end(), cqi), container.end());
 
-	if (cqi->getConnType() == CONNECTION_TYPE_DOWNLOAD)
+	if (cqi->getConnType() == CONNECTION_TYPE_DOWNLOAD) {
 		delayedTokens[cqi->getToken()] = GET_TICK();
 
+		unscheduleDownload(cqi);
+
+		auto u = userDownloads.find(cqi->getUser());
+		if (u != userDownloads.end()) {
+			auto& userCqis = u->second;
+			userCqis.erase(remove(userCqis.begin(), userCqis.end(), cqi), userCqis.end());
+			if (userCqis.empty()) {
+				userDownloads.erase(u);
+			}
+		}
+	}
+
 	tokens.removeToken(cqi->getToken());
 	delete cqi;
 }
@@ -232,9 +316,12 @@ void ConnectionManager::putConnection(UserConnection* aConn) {
 
 void ConnectionManager::onUserUpdated(const UserPtr& aUser) {
 	RLock l(cs);
-	for (const auto& cqi : downloads) {
-		if (cqi->getUser() == aUser) {
-			fire(ConnectionManagerListener::UserUpdated(), cqi);
+	for (const auto& cqi : getUserDownloads(aUser)) {
+		fire(ConnectionManagerListener::UserUpdated(), cqi);
+
+		// Waiting items will be removed if the user went offline
+		if (cqi->getState() != ConnectionQueueItem::ACTIVE && cqi->getState() != ConnectionQueueItem::RUNNING) {
+			scheduleDownload(cqi, GET_TICK());
 		}
 	}
 
@@ -261,90 +348,127 @@ void ConnectionManager::on(TimerManagerListener::Second, uint64_t aTick) noexcep
 }
 
 void ConnectionManager::attemptDownloads(uint64_t aTick, StringList& removedTokens) {
+	auto start = std::chrono::steady_clock::now();
+
 	RLock l(cs);
-	int attemptLimit = SETTING(DOWNCONN_PER_SEC);
-	uint16_t attempts = 0;
-	for (auto cqi : downloads) {
-		if (cqi->getState() != ConnectionQueueItem::ACTIVE && cqi->getState() != ConnectionQueueItem::RUNNING) {
-			if (!cqi->getUser().user->isOnline() || cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
-				removedTokens.push_back(cqi->getToken());
-				continue;
-			}
 
-			if (cqi->getErrors() == -1 && cqi->getLastAttempt() != 0) {
-				// protocol error, don't reconnect except after a forced attempt
-				continue;
-			}
+	ConnectionQueueItem::List dueItems;
+	{
+		Lock sl(scheduleCS);
+		for (auto i = downloadSchedule.begin(); i != downloadSchedule.end() && i->first <= aTick; i = downloadSchedule.erase(i)) {
+			i->second->setNextCheck(0);
+			dueItems.push_back(i->second);
+		}
+	}
 
-			if ((cqi->getLastAttempt() == 0 && attempts < attemptLimit * 2) || ((attemptLimit == 0 || attempts < attemptLimit) &&
-				cqi->getLastAttempt() + 60 * 1000 * max(1, cqi->getErrors()) < aTick))
-			{
-				// TODO: no one can understand this code, fix!
-				ScopedFunctor([=] { cqi->setLastAttempt(aTick); });
-
-				QueueToken bundleToken = 0;
-				string lastError, hubHint = cqi->getHubUrl();
-				bool allowUrlChange = true;
-				bool hasDownload = false;
-
-				auto type = cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL || cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL_CONF ? QueueItem::TYPE_SMALL : cqi->getDownloadType() == ConnectionQueueItem::TYPE_MCN_NORMAL ? QueueItem::TYPE_MCN_NORMAL : QueueItem::TYPE_ANY;
-
-				//we'll also validate the hubhint (and that the user is online) before making any connection attempt
-				auto startDown = QueueManager::getInstance()->startDownload(cqi->getUser(), hubHint, type, bundleToken, allowUrlChange, hasDownload, lastError);
-				if (!hasDownload && cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL && count_if(downloads.begin(), downloads.end(), [&](const ConnectionQueueItem* aCQI) { return aCQI != cqi && aCQI->getUser() == cqi->getUser(); }) == 0) {
-					//the small file finished already? try with any type
-					cqi->setDownloadType(ConnectionQueueItem::TYPE_ANY);
-					startDown = QueueManager::getInstance()->startDownload(cqi->getUser(), hubHint, QueueItem::TYPE_ANY,
-						bundleToken, allowUrlChange, hasDownload, lastError);
-				} else if (cqi->getDownloadType() == ConnectionQueueItem::TYPE_ANY && startDown.first == QueueItem::TYPE_SMALL &&
-					count_if(downloads.begin(), downloads.end(), [&](const ConnectionQueueItem* aCQI) {
-					return aCQI->getUser() == cqi->getUser() && (cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL || cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL_CONF);
-				}) == 0) {
-					// a small file has been added after the CQI was created
-					cqi->setDownloadType(ConnectionQueueItem::TYPE_SMALL);
-				}
+	int attempts = 0;
+	for (auto cqi : dueItems) {
+		if (!attemptDownload(cqi, aTick, attempts)) {
+			removedTokens.push_back(cqi->getToken());
+			continue;
+		}
 
+		auto nextCheck = getNextDownloadCheck(cqi, aTick);
+		if (nextCheck != 0) {
+			scheduleDownload(cqi, nextCheck);
+		}
+	}
 
-				if (!hasDownload) {
-					removedTokens.push_back(cqi->getToken());
-					continue;
-				}
+	{
+		Lock sl(scheduleCS);
+		lastCheckedDownloads = dueItems.size();
+		lastDownloadCheckUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
 
-				cqi->setLastBundle(bundleToken != 0 ? Util::toString(bundleToken) : Util::emptyString);
-				cqi->setHubUrl(hubHint);
-
-				if (cqi->getState() == ConnectionQueueItem::WAITING || 
-					// Forcing the connection and it's not connected yet? Retry
-					(cqi->getLastAttempt() == 0 && cqi->getState() == ConnectionQueueItem::CONNECTING && find(userConnections.begin(), userConnections.end(), cqi->getToken()) == userConnections.end())
-				) {
-					if (startDown.second) {
-						cqi->setState(ConnectionQueueItem::CONNECTING);
-						bool protocolError = false;
-
-						if (!ClientManager::getInstance()->connect(cqi->getUser(), cqi->getToken(), allowUrlChange, lastError, hubHint, protocolError)) {
-							cqi->setState(ConnectionQueueItem::WAITING);
-							cqi->setErrors(protocolError ? -1 : (cqi->getErrors() + 1)); // protocol error
-							dcassert(!lastError.empty());
-							fire(ConnectionManagerListener::Failed(), cqi, lastError);
-						} else {
-							cqi->setHubUrl(hubHint);
-							fire(ConnectionManagerListener::Connecting(), cqi);
-							attempts++;
-						}
-					} else {
-						fire(ConnectionManagerListener::Failed(), cqi, lastError);
-					}
-				}
-			} else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + 50 * 1000 < aTick) {
+bool ConnectionManager::attemptDownload(ConnectionQueueItem* cqi, uint64_t aTick, int& attempts_) {
+	if (cqi->getState() == ConnectionQueueItem::ACTIVE || cqi->getState() == ConnectionQueueItem::RUNNING) {
+		if (cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
+			cqi->unsetFlag(ConnectionQueueItem::FLAG_REMOVE);
+		}
+
+		return true;
+	}
+
+	if (!cqi->getUser().user->isOnline() || cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
+		return false;
+	}
 
-				cqi->setErrors(cqi->getErrors() + 1);
-				fire(ConnectionManagerListener::Failed(), cqi, STRING(CONNECTION_TIMEOUT));
-				cqi->setState(ConnectionQueueItem::WAITING);
+	if (cqi->getErrors() == -1 && cqi->getLastAttempt() != 0) {
+		// protocol error, don't reconnect except after a forced attempt
+		return true;
+	}
+
+	int attemptLimit = SETTING(DOWNCONN_PER_SEC);
+	if ((cqi->getLastAttempt() == 0 && attempts_ < attemptLimit * 2) || ((attemptLimit == 0 || attempts_ < attemptLimit) &&
+		cqi->getLastAttempt() + 60 * 1000 * max(1, cqi->getErrors()) < aTick))
+	{
+		// TODO: no one can understand this code, fix!
+		ScopedFunctor([=] { cqi->setLastAttempt(aTick); });
+
+		QueueToken bundleToken = 0;
+		string lastError, hubHint = cqi->getHubUrl();
+		bool allowUrlChange = true;
+		bool hasDownload = false;
+
+		auto type = cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL || cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL_CONF ? QueueItem::TYPE_SMALL : cqi->getDownloadType() == ConnectionQueueItem::TYPE_MCN_NORMAL ? QueueItem::TYPE_MCN_NORMAL : QueueItem::TYPE_ANY;
+
+		//we'll also validate the hubhint (and that the user is online) before making any connection attempt
+		auto startDown = QueueManager::getInstance()->startDownload(cqi->getUser(), hubHint, type, bundleToken, allowUrlChange, hasDownload, lastError);
+
+		const auto& userCqis = getUserDownloads(cqi->getUser());
+		if (!hasDownload && cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL && userCqis.size() == 1) {
+			//the small file finished already? try with any type
+			cqi->setDownloadType(ConnectionQueueItem::TYPE_ANY);
+			startDown = QueueManager::getInstance()->startDownload(cqi->getUser(), hubHint, QueueItem::TYPE_ANY,
+				bundleToken, allowUrlChange, hasDownload, lastError);
+		} else if (cqi->getDownloadType() == ConnectionQueueItem::TYPE_ANY && startDown.first == QueueItem::TYPE_SMALL &&
+			none_of(userCqis.begin(), userCqis.end(), [&](const ConnectionQueueItem* aCQI) {
+				return aCQI->getDownloadType() == ConnectionQueueItem::TYPE_SMALL || aCQI->getDownloadType() == ConnectionQueueItem::TYPE_SMALL_CONF;
+			})
+		) {
+			// a small file has been added after the CQI was created
+			cqi->setDownloadType(ConnectionQueueItem::TYPE_SMALL);
+		}
+
+
+		if (!hasDownload) {
+			return false;
+		}
+
+		cqi->setLastBundle(bundleToken != 0 ? Util::toString(bundleToken) : Util::emptyString);
+		cqi->setHubUrl(hubHint);
+
+		if (cqi->getState() == ConnectionQueueItem::WAITING || 
+			// Forcing the connection and it's not connected yet? Retry
+			(cqi->getLastAttempt() == 0 && cqi->getState() == ConnectionQueueItem::CONNECTING && find(userConnections.begin(), userConnections.end(), cqi->getToken()) == userConnections.end())
+		) {
+			if (startDown.second) {
+				cqi->setState(ConnectionQueueItem::CONNECTING);
+				bool protocolError = false;
+
+				if (!ClientManager::getInstance()->connect(cqi->getUser(), cqi->getToken(), allowUrlChange, lastError, hubHint, protocolError)) {
+					cqi->setState(ConnectionQueueItem::WAITING);
+					cqi->setErrors(protocolError ? -1 : (cqi->getErrors() + 1)); // protocol error
+					dcassert(!lastError.empty());
+					fire(ConnectionManagerListener::Failed(), cqi, lastError);
+				} else {
+					cqi->setHubUrl(hubHint);
+					fire(ConnectionManagerListener::Connecting(), cqi);
+					attempts_++;
+				}
+			} else {
+				fire(ConnectionManagerListener::Failed(), cqi, lastError);
 			}
-		} else if (cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
-			cqi->unsetFlag(ConnectionQueueItem::FLAG_REMOVE);
 		}
+	} else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + 50 * 1000 < aTick) {
+
+		cqi->setErrors(cqi->getErrors() + 1);
+		fire(ConnectionManagerListener::Failed(), cqi, STRING(CONNECTION_TIMEOUT));
+		cqi->setState(ConnectionQueueItem::WAITING);
 	}
+
+	return true;
 }
 
 
@@ -372,8 +496,8 @@ bool ConnectionManager::allowNewMCN(const ConnectionQueueItem* aCQI) {
 
 	//count the running MCN connections
 	int running = 0;
-	for(const auto& cqi: downloads) {
-		if (cqi->getUser() == aCQI->getUser() && cqi->getDownloadType() != ConnectionQueueItem::TYPE_SMALL_CONF && !cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
+	for(const auto& cqi: getUserDownloads(aCQI->getUser())) {
+		if (cqi->getDownloadType() != ConnectionQueueItem::TYPE_SMALL_CONF && !cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
 			if (cqi->getState() != ConnectionQueueItem::RUNNING && cqi->getState() != ConnectionQueueItem::ACTIVE) {
 				return false;
 			}
@@ -631,6 +755,8 @@ void ConnectionManager::on(AdcCommand::SUP, UserConnection* aSource, const AdcCo
 				aSource->setFlag(UserConnection::FLAG_UBN1);
 			} else if (feat == UserConnection::FEATURE_ADC_CPMI) {
 				aSource->setFlag(UserConnection::FLAG_CPMI);
+			} else if (feat == UserConnection::FEATURE_ADC_BFL1) {
+				aSource->setFlag(UserConnection::FLAG_SUPPORTS_BINARY_LIST);
 			}
 		}
 	}
@@ -1035,6 +1161,7 @@ void ConnectionManager::force(const string& aToken) {
 	if (i != downloads.end()) {
 		fire(ConnectionManagerListener::Forced(), *i);
 		(*i)->setLastAttempt(0);
+		scheduleDownload(*i, GET_TICK());
 	}
 }
 
@@ -1065,13 +1192,16 @@ void ConnectionManager::failDownload(const string& aToken, const string& aError,
 
 		if (cqi->isSet(ConnectionQueueItem::FLAG_MCN1) && !cqi->isSet(ConnectionQueueItem::FLAG_REMOVE)) {
 			//remove an existing waiting item, if exists
-			auto s = find_if(downloads.begin(), downloads.end(), [&](const ConnectionQueueItem* c) { 
-				return c->getUser() == cqi->getUser() && c->getDownloadType() != ConnectionQueueItem::TYPE_SMALL_CONF && c->getDownloadType() != ConnectionQueueItem::TYPE_SMALL &&
+			const auto& userCqis = getUserDownloads(cqi->getUser());
+			auto s = find_if(userCqis.begin(), userCqis.end(), [&](const ConnectionQueueItem* c) { 
+				return c->getDownloadType() != ConnectionQueueItem::TYPE_SMALL_CONF && c->getDownloadType() != ConnectionQueueItem::TYPE_SMALL &&
 					c->getState() != ConnectionQueueItem::RUNNING && c->getState() != ConnectionQueueItem::ACTIVE && c != cqi && !c->isSet(ConnectionQueueItem::FLAG_REMOVE);
 			});
 
-			if (s != downloads.end())
+			if (s != userCqis.end()) {
 				(*s)->setFlag(ConnectionQueueItem::FLAG_REMOVE);
+				scheduleDownload(*s, GET_TICK());
+			}
 		} 
 				
 		if (cqi->getDownloadType() == ConnectionQueueItem::TYPE_SMALL_CONF && cqi->getState() == ConnectionQueueItem::ACTIVE) {
@@ -1085,6 +1215,11 @@ void ConnectionManager::failDownload(const string& aToken, const string& aError,
 		cqi->setErrors(fatalError ? -1 : (cqi->getErrors() + 1));
 		cqi->setLastAttempt(GET_TICK());
 		fire(ConnectionManagerListener::Failed(), cqi, aError);
+
+		auto nextCheck = getNextDownloadCheck(cqi, cqi->getLastAttempt());
+		if (nextCheck != 0) {
+			scheduleDownload(cqi, nextCheck);
+		}
 	}
 
 	if (mcnUser)
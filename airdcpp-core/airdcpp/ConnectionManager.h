@@ -79,6 +79,7 @@ public:
 	IGETSET(State, state, State, WAITING);
 	IGETSET(uint8_t, maxConns, MaxConns, 0);
 	GETSET(ConnectionType, connType, ConnType);
+	IGETSET(uint64_t, nextCheck, NextCheck, 0); // Tick when the item is scheduled to be checked, 0 if it isn't scheduled
 
 	const string& getHubUrl() const noexcept { return user.hint; }
 	void setHubUrl(const string& aHubUrl) noexcept { user.hint = aHubUrl; }
@@ -165,6 +166,19 @@ public:
 
 	SharedMutex& getCS() { return cs; }
 
+	struct DownloadSchedulerStats {
+		// Download items waiting to be checked
+		size_t scheduled = 0;
+
+		// Items that were checked during the previous second
+		size_t checked = 0;
+
+		// Duration of the previous check in microseconds
+		uint64_t durationUs = 0;
+	};
+
+	DownloadSchedulerStats getDownloadSchedulerStats() const noexcept;
+
 	// Unsafe
 	const ConnectionQueueItem::List& getTransferConnections(bool aDownloads) const {
 		return aDownloads ? cqis[CONNECTION_TYPE_DOWNLOAD] : cqis[CONNECTION_TYPE_UPLOAD];
@@ -200,6 +214,17 @@ private:
 	/** All active connections */
 	UserConnectionList userConnections;
 
+	/** Download items by user */
+	unordered_map<UserPtr, ConnectionQueueItem::List, User::Hash> userDownloads;
+
+	/** Download items that need to be checked, ordered by the tick when the check is due */
+	typedef set<pair<uint64_t, ConnectionQueueItem*>> DownloadSchedule;
+	DownloadSchedule downloadSchedule;
+	mutable CriticalSection scheduleCS;
+
+	size_t lastCheckedDownloads = 0;
+	uint64_t lastDownloadCheckUs = 0;
+
 	StringList features;
 	StringList adcFeatures;
 
@@ -230,6 +255,17 @@ private:
 	ConnectionQueueItem* getCQI(const HintedUser& aUser, ConnectionType aConnType, const string& aToken = Util::emptyString);
 	void putCQI(ConnectionQueueItem* cqi);
 
+	// Download items of the user (unsafe)
+	const ConnectionQueueItem::List& getUserDownloads(const UserPtr& aUser) const noexcept;
+
+	// Check the download item at the given tick, unless it has been scheduled earlier already
+	void scheduleDownload(ConnectionQueueItem* aCQI, uint64_t aTick) noexcept;
+	void unscheduleDownload(ConnectionQueueItem* aCQI) noexcept;
+
+	// Returns the tick when the item should be checked next or 0 if it doesn't need to be checked
+	// before its state changes
+	static uint64_t getNextDownloadCheck(const ConnectionQueueItem* aCQI, uint64_t aTick) noexcept;
+
 	void accept(const Socket& sock, bool secure) noexcept;
 
 	bool checkKeyprint(UserConnection *aSource);
@@ -259,7 +295,12 @@ private:
 	void on(ClientManagerListener::UserDisconnected, const UserPtr& aUser, bool) noexcept { onUserUpdated(aUser); }
 
 	void onUserUpdated(const UserPtr& aUser);
+
+	// Check the download items that are due
 	void attemptDownloads(uint64_t aTick, StringList& removedTokens);
+
+	// Returns false if the item should be removed
+	bool attemptDownload(ConnectionQueueItem* aCQI, uint64_t aTick, int& attempts_);
 };
 
 } // namespace dcpp
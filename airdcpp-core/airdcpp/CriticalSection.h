@@ -30,7 +30,15 @@
 
 namespace dcpp {
 
-typedef boost::detail::spinlock	FastCriticalSection;
+// The boost spinlock is an aggregate that is left uninitialized by default (only objects with static storage are zeroed)
+struct FastCriticalSection : boost::detail::spinlock {
+	// Constant initialization keeps the static locks usable during the dynamic initialization of other statics
+	constexpr FastCriticalSection() noexcept : boost::detail::spinlock BOOST_DETAIL_SPINLOCK_INIT { }
+
+	FastCriticalSection(const FastCriticalSection&) = delete;
+	FastCriticalSection& operator=(const FastCriticalSection&) = delete;
+};
+
 typedef std::lock_guard<boost::detail::spinlock> FastLock;
 
 
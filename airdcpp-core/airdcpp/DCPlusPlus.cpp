@@ -45,6 +45,7 @@
 #include "ShareManager.h"
 #include "SearchManager.h"
 #include "SettingsManager.h"
+#include "SocketReactor.h"
 #include "ThrottleManager.h"
 #include "TransferInfoManager.h"
 #include "UpdateManager.h"
@@ -81,6 +82,9 @@ void startup(StepFunction aStepF, MessageFunction aMessageF, Callback aRunWizard
 	TimerManager::newInstance();
 	HashManager::newInstance();
 	CryptoManager::newInstance();
+#ifdef HAVE_SYS_EPOLL_H
+	SocketReactor::newInstance();
+#endif
 	SearchManager::newInstance();
 	ShareManager::newInstance();
 	ClientManager::newInstance();
@@ -229,6 +233,9 @@ void shutdown(StepFunction stepF, ProgressFunction progressF, ShutdownUnloadCall
 	UploadManager::deleteInstance();
 	PrivateChatManager::deleteInstance();
 	ConnectionManager::deleteInstance();
+#ifdef HAVE_SYS_EPOLL_H
+	SocketReactor::deleteInstance();
+#endif
 	SearchManager::deleteInstance();
 	FavoriteManager::deleteInstance();
 	ClientManager::deleteInstance();
@@ -35,6 +35,30 @@ class DbSnapshot {
 
 };
 
+// Changes that are written atomically with DbHandler::write
+class DbBatch {
+public:
+	struct Change {
+		string key;
+		string value;
+		bool remove;
+	};
+
+	void put(const void* aKey, size_t keyLen, const void* aValue, size_t valueLen) noexcept {
+		changes.push_back({ string(static_cast<const char*>(aKey), keyLen), string(static_cast<const char*>(aValue), valueLen), false });
+	}
+
+	void remove(const void* aKey, size_t keyLen) noexcept {
+		changes.push_back({ string(static_cast<const char*>(aKey), keyLen), string(), true });
+	}
+
+	const std::vector<Change>& getChanges() const noexcept { return changes; }
+	bool empty() const noexcept { return changes.empty(); }
+	size_t size() const noexcept { return changes.size(); }
+private:
+	std::vector<Change> changes;
+};
+
 // Most methods throw DbException in case of errors
 class DbHandler : boost::noncopyable {
 public:
@@ -45,10 +69,30 @@ public:
 
 	virtual void put(void* key, size_t keyLen, void* value, size_t valueLen, DbSnapshot* aSnapshot = nullptr) = 0;
 	virtual bool get(void* key, size_t keyLen, size_t initialValueLen, std::function<bool(void* aValue, size_t aValueLen)> loadF, DbSnapshot* aSnapshot = nullptr) = 0;
+
+	// Loads the values of multiple keys, the keys must be sorted in ascending (bytewise) order (duplicates are allowed)
+	// The function is called with the list index of each key that was found
+	// Returns the number of keys that were loaded successfully
+	typedef std::vector<std::pair<const void*, size_t>> KeyList;
+	virtual size_t getMultiple(const KeyList& aKeys, size_t initialValueLen, std::function<bool(size_t aIndex, void* aValue, size_t aValueLen)> loadF, DbSnapshot* aSnapshot = nullptr) {
+		size_t ret = 0;
+		for (size_t i = 0; i < aKeys.size(); ++i) {
+			if (get(const_cast<void*>(aKeys[i].first), aKeys[i].second, initialValueLen, [&](void* aValue, size_t aValueLen) { return loadF(i, aValue, aValueLen); }, aSnapshot)) {
+				ret++;
+			}
+		}
+
+		return ret;
+	}
 	virtual void remove(void* aKey, size_t keyLen, DbSnapshot* aSnapshot = nullptr) = 0;
 
 	virtual bool hasKey(void* key, size_t keyLen, DbSnapshot* aSnapshot = nullptr) = 0;
 
+	virtual void write(const DbBatch& aBatch) = 0;
+
+	// Iterates the entries in key order (only the keys starting with the prefix if one is given), return false from the function to stop
+	virtual void iterate(std::function<bool(void* aKey, size_t keyLen, void* aValue, size_t valueLen)> f, const void* aPrefix = nullptr, size_t aPrefixLen = 0, DbSnapshot* aSnapshot = nullptr) = 0;
+
 	virtual size_t size(bool thorough, DbSnapshot* aSnapshot = nullptr) = 0;
 	virtual int64_t getSizeOnDisk() = 0;
 
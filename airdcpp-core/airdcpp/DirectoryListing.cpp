@@ -22,15 +22,16 @@
 
 #include "ADLSearch.h"
 #include "AirUtil.h"
+#include "BinaryFilelist.h"
 #include "BZUtils.h"
 #include "ClientManager.h"
+#include "FilelistXmlReader.h"
 #include "FilteredFile.h"
 #include "LogManager.h"
 #include "QueueManager.h"
 #include "ResourceManager.h"
 #include "ShareManager.h"
 #include "SimpleXML.h"
-#include "SimpleXMLReader.h"
 #include "StringTokenizer.h"
 #include "User.h"
 
@@ -98,6 +99,11 @@ string DirectoryListing::getNick(bool aFirstOnly) const noexcept {
 }
 
 void stripExtensions(string& aName) noexcept {
+	if(Util::stricmp(aName.c_str() + aName.length() - 4, ".bin") == 0) {
+		aName.erase(aName.length() - 4);
+		return;
+	}
+
 	if(Util::stricmp(aName.c_str() + aName.length() - 4, ".bz2") == 0) {
 		aName.erase(aName.length() - 4);
 	}
@@ -163,7 +169,7 @@ void DirectoryListing::getPartialListInfo(int64_t& totalSize_, size_t& totalFile
 }
 
 string DirectoryListing::getNickFromFilename(const string& fileName) noexcept {
-	// General file list name format: [username].[CID].[xml|xml.bz2]
+	// General file list name format: [username].[CID].[xml|xml.bz2|bin]
 
 	string name = Util::getFileName(fileName);
 
@@ -180,7 +186,7 @@ string DirectoryListing::getNickFromFilename(const string& fileName) noexcept {
 }
 
 UserPtr DirectoryListing::getUserFromFilename(const string& fileName) noexcept {
-	// General file list name format: [username].[CID].[xml|xml.bz2]
+	// General file list name format: [username].[CID].[xml|xml.bz2|bin]
 
 	string name = Util::getFileName(fileName);
 
@@ -247,30 +253,35 @@ void DirectoryListing::loadFile() {
 		dcpp::File ff(fileName, dcpp::File::READ, dcpp::File::OPEN, dcpp::File::BUFFER_AUTO);
 		root->setLastUpdateDate(ff.getLastModified());
 		if(Util::stricmp(ext, ".bz2") == 0) {
-			FilteredInputStream<UnBZFilter, false> f(&ff);
+			FilteredInputStream<ParallelUnBZFilter, false> f(&ff);
 			loadXML(f, false, ADC_ROOT_STR, ff.getLastModified());
 		} else if(Util::stricmp(ext, ".xml") == 0) {
 			loadXML(ff, false, ADC_ROOT_STR, ff.getLastModified());
+		} else if(Util::stricmp(ext, ".bin") == 0) {
+			loadBinary(ff, ff.getLastModified());
 		}
 	}
 }
 
-class ListLoader : public SimpleXMLReader::CallBack {
+class ListLoader {
 public:
+	typedef FilelistXmlReader::Tag Tag;
+
 	ListLoader(DirectoryListing* aList, DirectoryListing::Directory* root, const string& aBase, bool aUpdating, const UserPtr& aUser, bool aCheckDupe, bool aPartialList, time_t aListDownloadDate) : 
 	  list(aList), cur(root), base(aBase), inListing(false), updating(aUpdating), user(aUser), checkDupe(aCheckDupe), partialList(aPartialList), dirsLoaded(0), listDownloadDate(aListDownloadDate) {
 	}
 
-	virtual ~ListLoader() { }
+	ListLoader(const ListLoader&) = delete;
+	ListLoader& operator=(const ListLoader&) = delete;
+
+	void load(FilelistXmlReader& aReader);
 
-	void startTag(const string& name, StringPairList& attribs, bool simple);
-	void endTag(const string& name);
+	void startTag(Tag aTag, const FilelistXmlReader& aReader, bool aSimple);
+	void endTag(Tag aTag);
 
 	//const string& getBase() const { return base; }
 	int getLoadedDirs() { return dirsLoaded; }
 private:
-	void validateName(const string& aName);
-
 	DirectoryListing* list;
 	DirectoryListing::Directory* cur;
 	UserPtr user;
@@ -292,7 +303,8 @@ int DirectoryListing::loadPartialXml(const string& aXml, const string& aBase) {
 int DirectoryListing::loadXML(InputStream& is, bool aUpdating, const string& aBase, time_t aListDate) {
 	ListLoader ll(this, root.get(), aBase, aUpdating, getUser(), !isOwnList && isClientView && SETTING(DUPES_IN_FILELIST), partialList, aListDate);
 	try {
-		dcpp::SimpleXMLReader(&ll).parse(is);
+		FilelistXmlReader reader(is);
+		ll.load(reader);
 	} catch(SimpleXMLException& e) {
 		throw AbortException(e.getError());
 	}
@@ -300,7 +312,7 @@ int DirectoryListing::loadXML(InputStream& is, bool aUpdating, const string& aBa
 	return ll.getLoadedDirs();
 }
 
-void ListLoader::validateName(const string& aName) {
+static void validateItemName(const string& aName) {
 	if (aName.empty()) {
 		throw SimpleXMLException("Name attribute missing");
 	}
@@ -314,61 +326,107 @@ void ListLoader::validateName(const string& aName) {
 	}
 }
 
-static const string sFileListing = "FileListing";
-static const string sBase = "Base";
-static const string sBaseDate = "BaseDate";
-static const string sGenerator = "Generator";
-static const string sDirectory = "Directory";
-static const string sIncomplete = "Incomplete";
-static const string sDirectories = "Directories";
-static const string sFiles = "Files";
-static const string sChildren = "Children"; // DEPRECATED
-static const string sFile = "File";
-static const string sName = "Name";
-static const string sSize = "Size";
-static const string sTTH = "TTH";
-static const string sDate = "Date";
-void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSimple) {
+void DirectoryListing::loadBinary(dcpp::File& aFile, time_t aListDate) {
+	try {
+		BinaryFilelistReader reader(aFile);
+		if (!Util::isAdcDirectoryPath(reader.getBase())) {
+			throw AbortException("Invalid base directory " + reader.getBase());
+		}
+
+		auto checkDupe = !isOwnList && isClientView && SETTING(DUPES_IN_FILELIST);
+
+		const auto& dirs = reader.getDirectories();
+		vector<Directory*> loadedDirs;
+		loadedDirs.reserve(dirs.size());
+
+		for (size_t i = 0; i < dirs.size(); ++i) {
+			if (getClosing()) {
+				throw AbortException();
+			}
+
+			const auto& d = dirs[i];
+
+			Directory* cur = nullptr;
+			if (i == 0) {
+				cur = createBaseDirectory(reader.getBase(), aListDate).get();
+				cur->setRemoteDate(d.date);
+			} else {
+				validateItemName(d.name);
+				cur = Directory::create(loadedDirs[d.parent], d.name, Directory::TYPE_NORMAL, aListDate, false, DirectoryContentInfo(0, 0), Util::emptyString, d.date).get();
+			}
+
+			loadedDirs.push_back(cur);
+
+			reader.forEachFile(i, [&](const string& aName, int64_t aSize, const TTHValue& aTTH, time_t aDate) {
+				validateItemName(aName);
+				cur->files.push_back(make_shared<File>(cur, aName, aSize, aTTH, checkDupe, aDate));
+			});
+		}
+
+		// Set the base complete only after we have finished loading (see ListLoader)
+		auto base = loadedDirs.front();
+		base->setComplete();
+		base->setContentInfo(base->getContentInfoRecursive(false));
+	} catch (const BinaryFilelistException& e) {
+		throw AbortException(e.getError());
+	} catch (const SimpleXMLException& e) {
+		throw AbortException(e.getError());
+	}
+}
+
+void ListLoader::load(FilelistXmlReader& aReader) {
+	while (aReader.next()) {
+		if (aReader.isStart()) {
+			startTag(aReader.getTag(), aReader, aReader.isSimple());
+		} else {
+			endTag(aReader.getTag());
+		}
+	}
+}
+
+void ListLoader::startTag(Tag aTag, const FilelistXmlReader& aReader, bool aSimple) {
 	if(list->getClosing()) {
 		throw AbortException();
 	}
 
 	if (inListing) {
-		if (name == sFile) {
-			const string& n = getAttrib(attribs, sName, 0);
-			validateName(n);
+		if (aTag == FilelistXmlReader::TAG_FILE) {
+			const string& n = aReader.getAttribute(FilelistXmlReader::ATTR_NAME);
+			validateItemName(n);
 
-			const string& s = getAttrib(attribs, sSize, 1);
+			const string& s = aReader.getAttribute(FilelistXmlReader::ATTR_SIZE);
 			if(s.empty())
 				return;
 
 			auto size = Util::toInt64(s);
 
-			const string& h = getAttrib(attribs, sTTH, 2);
+			const string& h = aReader.getAttribute(FilelistXmlReader::ATTR_TTH);
 			if (h.empty())
 				return;		
 
-			TTHValue tth(h); /// @todo verify validity?
+			// Decode directly from the attribute value buffer
+			TTHValue tth;
+			Encoder::fromBase32(h.c_str(), tth.data, TTHValue::BYTES); /// @todo verify validity?
 
-			auto f = make_shared<DirectoryListing::File>(cur, n, size, tth, checkDupe, Util::toTimeT(getAttrib(attribs, sDate, 3)));
+			auto f = make_shared<DirectoryListing::File>(cur, n, size, tth, checkDupe, Util::toTimeT(aReader.getAttribute(FilelistXmlReader::ATTR_DATE)));
 			cur->files.push_back(f);
-		} else if (name == sDirectory) {
-			const string& n = getAttrib(attribs, sName, 0);
-			validateName(n);
+		} else if (aTag == FilelistXmlReader::TAG_DIRECTORY) {
+			const string& n = aReader.getAttribute(FilelistXmlReader::ATTR_NAME);
+			validateItemName(n);
 
-			bool incomp = getAttrib(attribs, sIncomplete, 1) == "1";
-			auto directoriesStr = getAttrib(attribs, sDirectories, 2);
-			auto filesStr = getAttrib(attribs, sFiles, 3);
+			bool incomp = aReader.getAttribute(FilelistXmlReader::ATTR_INCOMPLETE) == "1";
+			const auto& directoriesStr = aReader.getAttribute(FilelistXmlReader::ATTR_DIRECTORIES);
+			const auto& filesStr = aReader.getAttribute(FilelistXmlReader::ATTR_FILES);
 
 			DirectoryContentInfo contentInfo;
 			if (!incomp || !filesStr.empty() || !directoriesStr.empty()) {
 				contentInfo = DirectoryContentInfo(Util::toInt(directoriesStr), Util::toInt(filesStr));
 			}
 
-			bool children = getAttrib(attribs, sChildren, 2) == "1" || contentInfo.directories > 0; // DEPRECATED
+			bool children = aReader.getAttribute(FilelistXmlReader::ATTR_CHILDREN) == "1" || contentInfo.directories > 0; // DEPRECATED
 
-			const string& size = getAttrib(attribs, sSize, 2);
-			const string& date = getAttrib(attribs, sDate, 3);
+			const string& size = aReader.getAttribute(FilelistXmlReader::ATTR_SIZE);
+			const string& date = aReader.getAttribute(FilelistXmlReader::ATTR_DATE);
 
 			DirectoryListing::Directory::Ptr d = nullptr;
 			if(updating) {
@@ -395,12 +453,12 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 
 			if (aSimple) {
 				// To handle <Directory Name="..." />
-				endTag(name);
+				endTag(aTag);
 			}
 		}
-	} else if(name == sFileListing) {
+	} else if(aTag == FilelistXmlReader::TAG_FILELISTING) {
 		if (updating) {
-			const string& b = getAttrib(attribs, sBase, 2);
+			const string& b = aReader.getAttribute(FilelistXmlReader::ATTR_BASE);
 			dcassert(Util::isAdcDirectoryPath(base));
 
 			// Validate the parsed base path
@@ -414,7 +472,7 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 
 			dcassert(list->findDirectory(base));
 
-			const string& baseDate = getAttrib(attribs, sBaseDate, 3);
+			const string& baseDate = aReader.getAttribute(FilelistXmlReader::ATTR_BASE_DATE);
 			cur->setRemoteDate(Util::toTimeT(baseDate));
 		}
 
@@ -425,16 +483,16 @@ void ListLoader::startTag(const string& name, StringPairList& attribs, bool aSim
 
 		if (aSimple) {
 			// To handle <Directory Name="..." />
-			endTag(name);
+			endTag(aTag);
 		}
 	}
 }
 
-void ListLoader::endTag(const string& name) {
+void ListLoader::endTag(Tag aTag) {
 	if(inListing) {
-		if(name == sDirectory) {
+		if(aTag == FilelistXmlReader::TAG_DIRECTORY) {
 			cur = cur->getParent();
-		} else if(name == sFileListing) {
+		} else if(aTag == FilelistXmlReader::TAG_FILELISTING) {
 			// Cur should be the loaded base path now
 
 			cur->setComplete();
@@ -290,6 +290,10 @@ private:
 	// Throws AbortException
 	int loadXML(InputStream& aXml, bool aUpdating, const string& aBase, time_t aListDate = GET_TIME());
 
+	// Load a full list in binary format
+	// Throws AbortException
+	void loadBinary(dcpp::File& aFile, time_t aListDate);
+
 	// Create and insert a base directory with the given path (or return an existing one)
 	Directory::Ptr createBaseDirectory(const string& aPath, time_t aDownloadDate = GET_TIME()) noexcept;
 
@@ -140,7 +140,9 @@ AdcCommand Download::getCommand(bool zlib, const string& mySID) const noexcept {
 	if(getType() == TYPE_PARTIAL_LIST) {
 		cmd.addParam(getListDirectoryPath());
 	} else if(getType() == TYPE_FULL_LIST) {
-		if(isSet(Download::FLAG_XML_BZ_LIST)) {
+		if(isSet(Download::FLAG_BINARY_LIST)) {
+			cmd.addParam(USER_LIST_NAME_BIN);
+		} else if(isSet(Download::FLAG_XML_BZ_LIST)) {
 			cmd.addParam(USER_LIST_NAME_BZ);
 		} else {
 			cmd.addParam(USER_LIST_NAME);
@@ -241,7 +243,9 @@ void Download::open(int64_t bytes, bool z, bool hasDownloadedBytes) {
 		auto target = getPath();
 		File::ensureDirectory(target);
 
-		if(isSet(Download::FLAG_XML_BZ_LIST)) {
+		if(isSet(Download::FLAG_BINARY_LIST)) {
+			target += ".bin";
+		} else if(isSet(Download::FLAG_XML_BZ_LIST)) {
 			target += ".xml.bz2";
 		} else {
 			target += ".xml";
@@ -48,6 +48,7 @@ public:
 		FLAG_TTH_CHECK			= 0x04,
 		FLAG_SLOWUSER			= 0x08,
 		FLAG_XML_BZ_LIST		= 0x10,
+		FLAG_BINARY_LIST		= 0x20,
 		FLAG_PARTIAL			= 0x40,
 		FLAG_OVERLAP			= 0x80,
 		FLAG_VIEW				= 0x100,
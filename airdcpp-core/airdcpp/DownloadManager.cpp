@@ -308,8 +308,12 @@ void DownloadManager::checkDownloads(UserConnection* aConn) {
 
 	aConn->setState(UserConnection::STATE_SND);
 	
-	if(aConn->isSet(UserConnection::FLAG_SUPPORTS_XML_BZLIST) && d->getType() == Transfer::TYPE_FULL_LIST) {
-		d->setFlag(Download::FLAG_XML_BZ_LIST);
+	if (d->getType() == Transfer::TYPE_FULL_LIST) {
+		if (aConn->isSet(UserConnection::FLAG_SUPPORTS_BINARY_LIST)) {
+			d->setFlag(Download::FLAG_BINARY_LIST);
+		} else if (aConn->isSet(UserConnection::FLAG_SUPPORTS_XML_BZLIST)) {
+			d->setFlag(Download::FLAG_XML_BZ_LIST);
+		}
 	}
 	
 	{
@@ -400,6 +404,14 @@ void DownloadManager::startData(UserConnection* aSource, int64_t start, int64_t
 
 	d->setStart(GET_TICK());
 	d->tick();
+
+	// Share the limited bandwidth between the bundles by their priorities
+	if (d->getBundle()) {
+		aSource->setThrottleFlow(ThrottleManager::CLASS_STANDARD, d->getBundle()->getToken(), ThrottleManager::getPriorityWeight(d->getBundle()->getPriority()));
+	} else {
+		aSource->setThrottleFlow(ThrottleManager::CLASS_MINOR, aSource->getUser()->getCID().toHash(), ThrottleManager::getPriorityWeight(Priority::NORMAL));
+	}
+
 	if (!aSource->isSet(UserConnection::FLAG_RUNNING) && aSource->isSet(UserConnection::FLAG_MCN1) && (d->getType() == Download::TYPE_FILE || d->getType() == Download::TYPE_PARTIAL_LIST)) {
 		ConnectionManager::getInstance()->addRunningMCN(aSource);
 		aSource->setFlag(UserConnection::FLAG_RUNNING);
@@ -67,17 +67,47 @@ size_t DualString::initSizeArray(size_t strLen) {
 }
 
 DualString& DualString::operator=(DualString&& rhs) {
-	assign(rhs.begin(), rhs.end());
+	string::operator=(std::move(rhs));
+
+	delete[] charSizes;
 	charSizes = rhs.charSizes;
 	rhs.charSizes = nullptr;
 	return *this; 
 }
 
-DualString::DualString(DualString&& rhs) : charSizes(rhs.charSizes) {
-	assign(rhs.begin(), rhs.end());
+DualString::DualString(DualString&& rhs) : string(std::move(rhs)), charSizes(rhs.charSizes) {
 	rhs.charSizes = nullptr;
 }
 
+size_t DualString::getHeapSize() const noexcept {
+	size_t ret = 0;
+
+	// Short strings are stored inside the object
+	auto str = static_cast<const string*>(this);
+	auto data = str->data();
+	if (data < reinterpret_cast<const char*>(str) || data >= reinterpret_cast<const char*>(str) + sizeof(string)) {
+		ret += capacity() + 1;
+	}
+
+	if (charSizes) {
+		ret += ((string::size() + ARRAY_BITS - 1) / ARRAY_BITS) * sizeof(MaskType);
+	}
+
+	return ret;
+}
+
+bool DualString::operator==(const DualString& aOther) const noexcept {
+	if (getLower() != aOther.getLower()) {
+		return false;
+	}
+
+	if (!charSizes || !aOther.charSizes) {
+		return !charSizes && !aOther.charSizes;
+	}
+
+	return memcmp(charSizes, aOther.charSizes, ((string::size() + ARRAY_BITS - 1) / ARRAY_BITS) * sizeof(MaskType)) == 0;
+}
+
 DualString::~DualString() { 
 	if (charSizes)
 		delete[] charSizes; 
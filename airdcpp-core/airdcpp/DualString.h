@@ -41,6 +41,12 @@ public:
 
 	bool lowerCaseOnly() const noexcept;
 
+	// Same lowercase string and character cases
+	bool operator==(const DualString& aOther) const noexcept;
+
+	// Bytes allocated for the string data outside of the object
+	size_t getHeapSize() const noexcept;
+
 	DualString(DualString&& rhs);
 	DualString& operator=(DualString&&);
 	DualString(const DualString&) = delete;
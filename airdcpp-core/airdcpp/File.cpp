@@ -767,6 +767,11 @@ bool File::createFile(const string& aPath, const string& aContent) noexcept {
 	}
 }
 
+File* File::getSourceFile(int64_t& aMaxBytes_) noexcept {
+	aMaxBytes_ = min(aMaxBytes_, max(getSize() - getPos(), static_cast<int64_t>(0)));
+	return this;
+}
+
 string File::read(size_t aLen) {
 	string s(aLen, 0);
 	size_t x = read(&s[0], aLen);
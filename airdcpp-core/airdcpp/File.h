@@ -124,6 +124,7 @@ public:
 
 	size_t read(void* buf, size_t& len) override;
 	size_t write(const void* buf, size_t len) override;
+	File* getSourceFile(int64_t& aMaxBytes_) noexcept override;
 
 	// This has no effect if aForce is false
 	// Generally the operating system should decide when the buffered data is written on disk
@@ -26,6 +26,13 @@
 #include "Text.h"
 #include "Util.h"
 
+#ifdef HAVE_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
 namespace dcpp {
 
 using std::make_pair;
@@ -205,6 +212,284 @@ size_t FileReader::readAsync(const string& aPath, const DataCallback& callback)
 	return *((size_t*)&over.Offset);
 }
 
+#elif defined(HAVE_IO_URING_H) && defined(__NR_io_uring_setup)
+
+namespace {
+
+// Number of reads kept in flight
+static const size_t QUEUE_DEPTH = 4;
+
+/** Minimal io_uring wrapper using the raw system calls */
+class IoUring : boost::noncopyable {
+public:
+	~IoUring() {
+		if (sqes) {
+			::munmap(sqes, sqesSize);
+		}
+
+		if (cqRing && cqRing != sqRing) {
+			::munmap(cqRing, cqRingSize);
+		}
+
+		if (sqRing) {
+			::munmap(sqRing, sqRingSize);
+		}
+
+		if (fd != -1) {
+			::close(fd);
+		}
+	}
+
+	bool init(unsigned aEntries) noexcept {
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+
+		fd = static_cast<int>(::syscall(__NR_io_uring_setup, aEntries, &params));
+		if (fd < 0) {
+			return false;
+		}
+
+		sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+		auto singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#else
+		auto singleMmap = false;
+#endif
+		if (singleMmap) {
+			sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+		}
+
+		sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+		if (!sqRing) {
+			return false;
+		}
+
+		cqRing = singleMmap ? sqRing : mapRing(cqRingSize, IORING_OFF_CQ_RING);
+		if (!cqRing) {
+			return false;
+		}
+
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+		if (!sqes) {
+			return false;
+		}
+
+		auto sq = static_cast<uint8_t*>(sqRing);
+		sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqeTail = *sqTail;
+		sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+		auto cq = static_cast<uint8_t*>(cqRing);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	// Pins the buffers for IORING_OP_READ_FIXED (fails if the memory lock limit is too low)
+	bool registerBuffers(const iovec* aBuffers, unsigned aCount) noexcept {
+		return ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, aBuffers, aCount) == 0;
+	}
+
+	// The caller must not have more entries queued than the ring was initialized with
+	io_uring_sqe* queue() noexcept {
+		auto index = sqeTail & sqMask;
+		sqArray[index] = index;
+		sqeTail++;
+
+		auto sqe = &sqes[index];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+		return sqe;
+	}
+
+	// Submits the queued entries and waits for at least one completion
+	// Entries not consumed by the kernel (partial submit) are submitted again with the next call
+	bool submitAndWait() noexcept {
+		__atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+
+		for (;;) {
+			auto toSubmit = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+			auto ret = ::syscall(__NR_io_uring_enter, fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (ret >= 0) {
+				return true;
+			}
+
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+				return false;
+			}
+		}
+	}
+
+	template<class HandlerT>
+	void forEachCompletion(HandlerT&& aHandler) noexcept {
+		auto head = *cqHead;
+		auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) {
+			aHandler(cqes[head & cqMask]);
+		}
+
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	}
+private:
+	void* mapRing(size_t aSize, off_t aOffset) noexcept {
+		auto ret = ::mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, aOffset);
+		return ret == MAP_FAILED ? nullptr : ret;
+	}
+
+	int fd = -1;
+
+	void* sqRing = nullptr;
+	size_t sqRingSize = 0;
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned sqMask = 0;
+
+	// Tail including the entries that haven't been published to the kernel yet
+	unsigned sqeTail = 0;
+
+	io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+
+	void* cqRing = nullptr;
+	size_t cqRingSize = 0;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned cqMask = 0;
+	io_uring_cqe* cqes = nullptr;
+};
+
+}
+
+size_t FileReader::readAsync(const string& aPath, const DataCallback& callback) {
+	// Logical block size of practically all devices (O_DIRECT requires aligned buffers, offsets and lengths)
+	const size_t alignment = 4096;
+
+	unique_ptr<File> f;
+	try {
+		f = make_unique<File>(aPath, File::READ, File::OPEN | File::SHARED_WRITE, File::BUFFER_NONE);
+	} catch (const FileException& e) {
+		dcdebug("Failed to open unbuffered file: %s\n", e.getError().c_str());
+		return READ_FAILED;
+	}
+
+	IoUring ring;
+	if (!ring.init(QUEUE_DEPTH)) {
+		dcdebug("Failed to set up io_uring: %s\n", Util::translateError(errno).c_str());
+		return READ_FAILED;
+	}
+
+	auto bufSize = getBlockSize(alignment);
+	buffer.resize(bufSize * QUEUE_DEPTH + alignment);
+
+	auto buf = static_cast<uint8_t*>(align(&buffer[0], alignment));
+
+	struct Read {
+		size_t bytes = 0;
+		int error = 0;
+		bool pending = false;
+	} reads[QUEUE_DEPTH];
+
+	iovec buffers[QUEUE_DEPTH];
+	for (size_t i = 0; i < QUEUE_DEPTH; ++i) {
+		buffers[i] = { buf + i * bufSize, bufSize };
+	}
+
+	// Use pre-registered buffers when allowed (avoids mapping the pages again for each read)
+	auto fixedBuffers = ring.registerBuffers(buffers, QUEUE_DEPTH);
+
+	int64_t nextOffset = 0;
+	auto queueRead = [&](size_t aIndex) {
+		reads[aIndex] = { 0, 0, true };
+
+		auto sqe = ring.queue();
+		sqe->fd = f->getNativeHandle();
+		sqe->off = static_cast<uint64_t>(nextOffset);
+		sqe->user_data = aIndex;
+		if (fixedBuffers) {
+			sqe->opcode = IORING_OP_READ_FIXED;
+			sqe->addr = reinterpret_cast<uint64_t>(buffers[aIndex].iov_base);
+			sqe->len = static_cast<uint32_t>(bufSize);
+			sqe->buf_index = static_cast<uint16_t>(aIndex);
+		} else {
+			sqe->opcode = IORING_OP_READV;
+			sqe->addr = reinterpret_cast<uint64_t>(&buffers[aIndex]);
+			sqe->len = 1;
+		}
+
+		nextOffset += bufSize;
+	};
+
+	for (size_t i = 0; i < QUEUE_DEPTH; ++i) {
+		queueRead(i);
+	}
+
+	size_t inFlight = QUEUE_DEPTH;
+	size_t next = 0; // Index of the read to process next (reads are processed in file order)
+	size_t total = 0;
+	int error = 0;
+	bool go = true;
+	while (inFlight > 0) {
+		if (!ring.submitAndWait()) {
+			throw FileException(Util::translateError(errno));
+		}
+
+		ring.forEachCompletion([&](const io_uring_cqe& aCqe) {
+			auto& r = reads[aCqe.user_data];
+			r.pending = false;
+			if (aCqe.res < 0) {
+				r.error = -aCqe.res;
+			} else {
+				r.bytes = static_cast<size_t>(aCqe.res);
+			}
+
+			inFlight--;
+		});
+
+		// Process the completed reads in order
+		while (go && error == 0 && !reads[next].pending) {
+			auto& r = reads[next];
+			if (r.error != 0) {
+				error = r.error;
+				break;
+			}
+
+			if (r.bytes > 0) {
+				go = callback(buffers[next].iov_base, r.bytes);
+				total += r.bytes;
+			}
+
+			if (r.bytes < bufSize) {
+				// End of file (the remaining reads in flight will return nothing)
+				go = false;
+			}
+
+			if (go) {
+				queueRead(next);
+				inFlight++;
+				next = (next + 1) % QUEUE_DEPTH;
+			}
+		}
+	}
+
+	if (error != 0) {
+		if (total == 0) {
+			// Direct reads are not supported by the file system or device
+			dcdebug("First io_uring read failed: %s\n", Util::translateError(error).c_str());
+			return READ_FAILED;
+		}
+
+		throw FileException(Util::translateError(error));
+	}
+
+	return total;
+}
+
 #else
 
 size_t FileReader::readAsync(const string& file, const DataCallback& callback) {
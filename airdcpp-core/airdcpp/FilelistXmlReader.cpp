@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "FilelistXmlReader.h"
+
+#include "Exception.h"
+#include "StreamBase.h"
+#include "Text.h"
+#include "Util.h"
+
+#if defined(_M_X64) || defined(__amd64__) || defined(__x86_64__) || defined(__SSE2__)
+# define FILELIST_READER_SSE2
+# include <emmintrin.h>
+#endif
+
+namespace dcpp {
+
+#define LITN(x) x, sizeof(x)-1
+
+static bool isSpace(char c) noexcept {
+	return c == 0x20 || c == 0x09 || c == 0x0d || c == 0x0a;
+}
+
+static bool isNameStartChar(char c) noexcept {
+	return c == ':' || c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static bool isNameChar(char c) noexcept {
+	return isNameStartChar(c) || c == '-' || c == '.' || (c >= '0' && c <= '9');
+}
+
+static bool isAscii(const string& aStr) noexcept {
+	for (auto c: aStr) {
+		if (static_cast<uint8_t>(c) & 0x80) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Returns the position of the first aChar1 or aChar2 in the range (or aEnd if neither was found)
+static size_t findAny(const char* aData, size_t aPos, size_t aEnd, char aChar1, char aChar2) noexcept {
+#ifdef FILELIST_READER_SSE2
+	const auto chars1 = _mm_set1_epi8(aChar1);
+	const auto chars2 = _mm_set1_epi8(aChar2);
+	for (; aPos + 16 <= aEnd; aPos += 16) {
+		auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aData + aPos));
+		auto hits = _mm_or_si128(_mm_cmpeq_epi8(block, chars1), _mm_cmpeq_epi8(block, chars2));
+
+		auto mask = static_cast<unsigned int>(_mm_movemask_epi8(hits));
+		if (mask != 0) {
+			while ((mask & 1) == 0) {
+				mask >>= 1;
+				aPos++;
+			}
+
+			return aPos;
+		}
+	}
+#endif
+
+	while (aPos < aEnd && aData[aPos] != aChar1 && aData[aPos] != aChar2) {
+		aPos++;
+	}
+
+	return aPos;
+}
+
+static const struct {
+	const char* name;
+	size_t len;
+} attributeNames[FilelistXmlReader::ATTR_LAST] = {
+	{ LITN("Name") },
+	{ LITN("Size") },
+	{ LITN("TTH") },
+	{ LITN("Date") },
+	{ LITN("Incomplete") },
+	{ LITN("Directories") },
+	{ LITN("Files") },
+	{ LITN("Children") },
+	{ LITN("Base") },
+	{ LITN("BaseDate") },
+	{ LITN("Generator") },
+};
+
+FilelistXmlReader::FilelistXmlReader(InputStream& aStream) : stream(aStream), buf(BUF_SIZE, '\0') {
+	elements.reserve(MAX_NESTING);
+}
+
+const string& FilelistXmlReader::getAttribute(Attribute aAttribute) const noexcept {
+	return (attributesSet & (1 << aAttribute)) ? values[aAttribute] : Util::emptyString;
+}
+
+void FilelistXmlReader::error(const string& aError) const {
+	throw SimpleXMLException(Util::toString(streamPos + static_cast<int64_t>(pos)) + ": " + aError);
+}
+
+FilelistXmlReader::Tag FilelistXmlReader::toTag(const char* aName, size_t aLen) noexcept {
+	if (aLen == 4 && memcmp(aName, "File", 4) == 0) {
+		return TAG_FILE;
+	} else if (aLen == 9 && memcmp(aName, "Directory", 9) == 0) {
+		return TAG_DIRECTORY;
+	} else if (aLen == 11 && memcmp(aName, "FileListing", 11) == 0) {
+		return TAG_FILELISTING;
+	}
+
+	return TAG_OTHER;
+}
+
+FilelistXmlReader::Attribute FilelistXmlReader::toAttribute(const char* aName, size_t aLen) noexcept {
+	for (int i = 0; i < ATTR_LAST; ++i) {
+		if (attributeNames[i].len == aLen && memcmp(attributeNames[i].name, aName, aLen) == 0) {
+			return static_cast<Attribute>(i);
+		}
+	}
+
+	return ATTR_LAST;
+}
+
+bool FilelistXmlReader::fill() {
+	// Discard the parsed data
+	if (pos > 0) {
+		memmove(&buf[0], &buf[pos], end - pos);
+		end -= pos;
+		streamPos += pos;
+		pos = 0;
+	}
+
+	if (end == buf.size()) {
+		// A single markup doesn't fit in the buffer
+		if (buf.size() >= MAX_MARKUP_SIZE) {
+			error("Buffer overflow");
+		}
+
+		buf.resize(buf.size() * 2);
+	}
+
+	size_t len = buf.size() - end;
+	len = stream.read(&buf[end], len);
+	end += len;
+	return len > 0;
+}
+
+bool FilelistXmlReader::next() {
+	for (;;) {
+		// memchr is vectorized by the common C libraries
+		auto p = static_cast<const char*>(memchr(buf.data() + pos, '<', end - pos));
+		if (!p) {
+			// Content isn't used in file lists
+			pos = end;
+			if (!fill()) {
+				if (!elements.empty()) {
+					error("Unexpected end of stream");
+				}
+
+				return false;
+			}
+
+			continue;
+		}
+
+		pos = p - buf.data();
+
+		auto result = parseMarkup();
+		if (result == PARSE_TAG) {
+			return true;
+		}
+
+		if (result == PARSE_MORE_DATA && !fill()) {
+			error("Unexpected end of stream");
+		}
+	}
+}
+
+FilelistXmlReader::ParseResult FilelistXmlReader::parseMarkup() {
+	if (end - pos < 2) {
+		return PARSE_MORE_DATA;
+	}
+
+	auto c = buf[pos + 1];
+	if (c == '/') {
+		return parseEndTag(pos + 2);
+	} else if (c == '?') {
+		return parseDeclaration(pos + 2);
+	} else if (c == '!') {
+		size_t after;
+		if (end - pos < 9) {
+			return PARSE_MORE_DATA;
+		} else if (buf.compare(pos, 4, "<!--") == 0) {
+			after = skipUntil(pos + 4, LITN("-->"));
+		} else if (buf.compare(pos, 9, "<![CDATA[") == 0) {
+			after = skipUntil(pos + 9, LITN("]]>"));
+		} else {
+			after = skipUntil(pos + 2, LITN(">"));
+		}
+
+		if (after == string::npos) {
+			return PARSE_MORE_DATA;
+		}
+
+		pos = after;
+		return PARSE_SKIPPED;
+	} else if (isNameStartChar(c)) {
+		return parseStartTag(pos + 1);
+	}
+
+	error("Expecting element");
+	return PARSE_SKIPPED;
+}
+
+size_t FilelistXmlReader::skipUntil(size_t aPos, const char* aTerminator, size_t aLen) const noexcept {
+	auto i = std::search(buf.begin() + aPos, buf.begin() + end, aTerminator, aTerminator + aLen);
+	if (i == buf.begin() + end) {
+		return string::npos;
+	}
+
+	return (i - buf.begin()) + aLen;
+}
+
+FilelistXmlReader::ParseResult FilelistXmlReader::parseStartTag(size_t p) {
+	auto nameStart = p;
+	while (p < end && isNameChar(buf[p])) {
+		p++;
+	}
+
+	if (p == end) {
+		return PARSE_MORE_DATA;
+	}
+
+	auto newTag = toTag(&buf[nameStart], p - nameStart);
+
+	// Parsing may be restarted if the tag isn't complete
+	attributesSet = 0;
+
+	bool isSimple = false;
+	for (;;) {
+		while (p < end && isSpace(buf[p])) {
+			p++;
+		}
+
+		if (p == end) {
+			return PARSE_MORE_DATA;
+		}
+
+		auto c = buf[p];
+		if (c == '>') {
+			p++;
+			break;
+		} else if (c == '/') {
+			if (p + 1 == end) {
+				return PARSE_MORE_DATA;
+			}
+
+			if (buf[p + 1] != '>') {
+				error("Expecting >");
+			}
+
+			isSimple = true;
+			p += 2;
+			break;
+		} else if (!isNameStartChar(c)) {
+			error("Expecting attribute | /> | >");
+		}
+
+		// Name
+		auto attrStart = p;
+		while (p < end && isNameChar(buf[p])) {
+			p++;
+		}
+
+		auto attr = toAttribute(&buf[attrStart], p - attrStart);
+
+		// =
+		while (p < end && isSpace(buf[p])) {
+			p++;
+		}
+
+		if (p == end) {
+			return PARSE_MORE_DATA;
+		}
+
+		if (buf[p] != '=') {
+			error("Expecting attribute =");
+		}
+
+		p++;
+		while (p < end && isSpace(buf[p])) {
+			p++;
+		}
+
+		if (p == end) {
+			return PARSE_MORE_DATA;
+		}
+
+		// Value
+		auto quote = buf[p];
+		if (quote != '"' && quote != '\'') {
+			error("Expecting attribute value start");
+		}
+
+		p++;
+
+		string* value = nullptr;
+		if (attr != ATTR_LAST) {
+			value = &values[attr];
+			attributesSet |= 1 << attr;
+		}
+
+		if (!readAttributeValue(p, quote, value)) {
+			return PARSE_MORE_DATA;
+		}
+	}
+
+	if (elements.size() >= MAX_NESTING) {
+		error("Max nesting exceeded");
+	}
+
+	if (!isSimple) {
+		elements.push_back(newTag);
+	}
+
+	pos = p;
+	tag = newTag;
+	start = true;
+	simple = isSimple;
+	return newTag == TAG_OTHER ? PARSE_SKIPPED : PARSE_TAG;
+}
+
+FilelistXmlReader::ParseResult FilelistXmlReader::parseEndTag(size_t p) {
+	auto nameStart = p;
+	while (p < end && isNameChar(buf[p])) {
+		p++;
+	}
+
+	auto endTag = toTag(&buf[nameStart], p - nameStart);
+
+	while (p < end && isSpace(buf[p])) {
+		p++;
+	}
+
+	if (p == end) {
+		return PARSE_MORE_DATA;
+	}
+
+	if (buf[p] != '>') {
+		error("Expecting >");
+	}
+
+	if (elements.empty() || elements.back() != endTag) {
+		error("Unexpected end tag");
+	}
+
+	elements.pop_back();
+
+	pos = p + 1;
+	tag = endTag;
+	start = false;
+	simple = false;
+	return endTag == TAG_OTHER ? PARSE_SKIPPED : PARSE_TAG;
+}
+
+FilelistXmlReader::ParseResult FilelistXmlReader::parseDeclaration(size_t p) {
+	auto after = skipUntil(p, LITN("?>"));
+	if (after == string::npos) {
+		return PARSE_MORE_DATA;
+	}
+
+	auto declEnd = after - 2;
+	if (declEnd > p + 3 && buf.compare(p, 3, "xml") == 0 && isSpace(buf[p + 3])) {
+		// Non-UTF-8 lists are still supported
+		static const string encodingName = "encoding";
+		auto i = std::search(buf.begin() + p, buf.begin() + declEnd, encodingName.begin(), encodingName.end());
+		if (i != buf.begin() + declEnd) {
+			i += encodingName.size();
+			while (i != buf.begin() + declEnd && (isSpace(*i) || *i == '=')) {
+				i++;
+			}
+
+			if (i != buf.begin() + declEnd && (*i == '"' || *i == '\'')) {
+				auto quote = *i++;
+				auto valueEnd = std::find(i, buf.begin() + declEnd, quote);
+
+				encoding = Text::toLower(string(i, valueEnd));
+				utf8 = encoding.empty() || encoding == Text::utf8;
+			}
+		}
+	}
+
+	pos = after;
+	return PARSE_SKIPPED;
+}
+
+bool FilelistXmlReader::readAttributeValue(size_t& pos_, char aQuote, string* value_) {
+	auto valueEnd = findAny(buf.data(), pos_, end, aQuote, '&');
+	if (valueEnd == end) {
+		return false;
+	}
+
+	auto hasEntities = buf[valueEnd] == '&';
+	if (hasEntities) {
+		auto p = memchr(buf.data() + valueEnd, aQuote, end - valueEnd);
+		if (!p) {
+			return false;
+		}
+
+		valueEnd = static_cast<const char*>(p) - buf.data();
+	}
+
+	if (value_) {
+		value_->assign(buf, pos_, valueEnd - pos_);
+		if (hasEntities) {
+			decodeEntities(*value_);
+		}
+
+		decodeValue(*value_);
+	}
+
+	pos_ = valueEnd + 1;
+	return true;
+}
+
+void FilelistXmlReader::decodeEntities(string& value_) const {
+	size_t out = 0;
+	for (size_t i = 0; i < value_.size();) {
+		if (value_[i] != '&') {
+			value_[out++] = value_[i++];
+			continue;
+		}
+
+		auto semicolon = value_.find(';', i);
+		if (semicolon == string::npos) {
+			error("Invalid entity");
+		}
+
+		auto name = value_.data() + i + 1;
+		auto len = semicolon - i - 1;
+		if (len == 2 && memcmp(name, "lt", 2) == 0) {
+			value_[out++] = '<';
+		} else if (len == 2 && memcmp(name, "gt", 2) == 0) {
+			value_[out++] = '>';
+		} else if (len == 3 && memcmp(name, "amp", 3) == 0) {
+			value_[out++] = '&';
+		} else if (len == 4 && memcmp(name, "quot", 4) == 0) {
+			value_[out++] = '"';
+		} else if (len == 4 && memcmp(name, "apos", 4) == 0) {
+			value_[out++] = '\'';
+		} else if (len >= 2 && len <= 6 && name[0] == '#') {
+			// Ignore &#00000 decimal and &#x0000 hex values, they wouldn't be parsed anyway
+			auto isHex = name[1] == 'x' || name[1] == 'X';
+			auto digits = isHex ? len - 2 : len - 1;
+			if (digits == 0 || digits > (isHex ? 4U : 5U) || !std::all_of(name + (isHex ? 2 : 1), name + len, [isHex](char c) { return isHex ? isxdigit(c) : isdigit(c); })) {
+				error("Invalid entity");
+			}
+		} else {
+			error("Invalid entity");
+		}
+
+		i = semicolon + 1;
+	}
+
+	value_.resize(out);
+}
+
+void FilelistXmlReader::decodeValue(string& value_) const {
+	if (!utf8) {
+		value_ = Text::toUtf8(value_, encoding);
+	} else if (!isAscii(value_) && !Text::validateUtf8(value_)) {
+		error("Malformed UTF-8 data");
+	}
+}
+
+} // namespace dcpp
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_FILELIST_XML_READER_H
+#define DCPLUSPLUS_DCPP_FILELIST_XML_READER_H
+
+#include "typedefs.h"
+
+namespace dcpp {
+
+/**
+* Pull parser for file list XML documents (FileListing/Directory/File)
+*
+* Tags are tokenized directly from the read buffer. Only the attributes used in file lists are stored,
+* and their values are decoded into buffers that are reused between the tags, so parsing doesn't
+* allocate memory after the first tags. Other elements, comments and content are skipped.
+*
+* Throws SimpleXMLException on malformed documents.
+*/
+class FilelistXmlReader {
+public:
+	enum Tag : uint8_t {
+		TAG_FILELISTING,
+		TAG_DIRECTORY,
+		TAG_FILE,
+		TAG_OTHER
+	};
+
+	enum Attribute {
+		ATTR_NAME,
+		ATTR_SIZE,
+		ATTR_TTH,
+		ATTR_DATE,
+		ATTR_INCOMPLETE,
+		ATTR_DIRECTORIES,
+		ATTR_FILES,
+		ATTR_CHILDREN,
+		ATTR_BASE,
+		ATTR_BASE_DATE,
+		ATTR_GENERATOR,
+		ATTR_LAST
+	};
+
+	FilelistXmlReader(InputStream& aStream);
+
+	FilelistXmlReader(const FilelistXmlReader&) = delete;
+	FilelistXmlReader& operator=(const FilelistXmlReader&) = delete;
+
+	// Move to the next start or end tag of a file list element
+	// Returns false when the document has ended
+	bool next();
+
+	Tag getTag() const noexcept { return tag; }
+
+	// Start tag (possibly an empty element tag) or an end tag?
+	bool isStart() const noexcept { return start; }
+
+	// Empty element tag (<Directory ... />)?
+	bool isSimple() const noexcept { return simple; }
+
+	// Attribute of the current start tag
+	// Returns an empty string if the attribute doesn't exist
+	const string& getAttribute(Attribute aAttribute) const noexcept;
+private:
+	static const size_t BUF_SIZE = 64 * 1024;
+	static const size_t MAX_MARKUP_SIZE = 1024 * 1024;
+	static const size_t MAX_NESTING = 32;
+
+	enum ParseResult {
+		PARSE_TAG,
+		PARSE_SKIPPED,
+		PARSE_MORE_DATA
+	};
+
+	// Parse the markup starting at the current position
+	ParseResult parseMarkup();
+
+	ParseResult parseStartTag(size_t aPos);
+	ParseResult parseEndTag(size_t aPos);
+	ParseResult parseDeclaration(size_t aPos);
+
+	// Returns the position after the terminator or string::npos if it wasn't found
+	size_t skipUntil(size_t aPos, const char* aTerminator, size_t aLen) const noexcept;
+
+	// Returns false if the attribute value wasn't complete
+	bool readAttributeValue(size_t& pos_, char aQuote, string* value_);
+	void decodeEntities(string& value_) const;
+	void decodeValue(string& value_) const;
+
+	// Append more data to the buffer
+	// Returns false if the stream has ended
+	bool fill();
+
+	static Tag toTag(const char* aName, size_t aLen) noexcept;
+	static Attribute toAttribute(const char* aName, size_t aLen) noexcept;
+
+	void error(const string& aError) const;
+
+	InputStream& stream;
+
+	string buf;
+	size_t pos = 0;
+	size_t end = 0;
+
+	// Number of bytes discarded from the buffer (for error messages)
+	int64_t streamPos = 0;
+
+	Tag tag = TAG_OTHER;
+	bool start = false;
+	bool simple = false;
+
+	string values[ATTR_LAST];
+	uint32_t attributesSet = 0;
+
+	// Tags of the open elements
+	vector<Tag> elements;
+
+	string encoding;
+	bool utf8 = true;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_FILELIST_XML_READER_H)
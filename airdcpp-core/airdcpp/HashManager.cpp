@@ -99,6 +99,61 @@ void HashManager::getFileInfo(const string& aFileLower, const string& aFileName,
 		throw HashException();
 	}
 }
+size_t HashManager::loadFileInfos(FileInfoCheckList& aFiles, const function<void(FileInfoCheck& aFile, const HashedFile& aInfo)>& aHandler) noexcept {
+	// The database is iterated in key order
+	vector<FileInfoCheck*> sortedFiles;
+	sortedFiles.reserve(aFiles.size());
+	for (auto& f: aFiles) {
+		dcassert(Text::isLower(f.pathLower));
+		sortedFiles.push_back(&f);
+	}
+
+	sort(sortedFiles.begin(), sortedFiles.end(), [](const FileInfoCheck* a, const FileInfoCheck* b) { return a->pathLower < b->pathLower; });
+
+	vector<const string*> paths;
+	paths.reserve(sortedFiles.size());
+	for (const auto& f: sortedFiles) {
+		paths.push_back(&f->pathLower);
+	}
+
+	return store->getFileInfos(paths, [&](size_t aIndex, const HashedFile& aInfo) {
+		aHandler(*sortedFiles[aIndex], aInfo);
+	});
+}
+
+void HashManager::checkTTHs(FileInfoCheckList& files_) {
+	loadFileInfos(files_, [](FileInfoCheck& aFile, const HashedFile& aInfo) {
+		if (aInfo.getTimeStamp() == aFile.fileInfo.getTimeStamp() && aInfo.getSize() == aFile.fileInfo.getSize()) {
+			aFile.fileInfo = aInfo;
+			aFile.found = true;
+		}
+	});
+
+	for (const auto& f: files_) {
+		if (!f.found) {
+			hashFile(f.path, f.pathLower, f.fileInfo.getSize());
+		}
+	}
+}
+
+void HashManager::getFileInfos(FileInfoCheckList& files_) {
+	loadFileInfos(files_, [](FileInfoCheck& aFile, const HashedFile& aInfo) {
+		aFile.fileInfo = aInfo;
+		aFile.found = true;
+	});
+
+	for (auto& f: files_) {
+		if (!f.found) {
+			auto size = File::getSize(f.path);
+			if (size >= 0) {
+				hashFile(f.path, f.pathLower, size);
+			}
+
+			f.fileInfo.setSize(size);
+		}
+	}
+}
+
 void HashManager::renameFileThrow(const string& aOldPath, const string& aNewPath) {
 	return store->renameFileThrow(aOldPath, aNewPath);
 }
@@ -296,7 +351,7 @@ HashManager::HashStats HashManager::getStats() const noexcept {
 
 	RLock l(Hasher::hcs);
 	for (auto i: hashers) {
-		i->getStats(stats.curFile, stats.bytesLeft, stats.filesLeft, stats.speed, stats.filesAdded, stats.bytesAdded);
+		i->getStats(stats.curFile, stats.bytesLeft, stats.filesLeft, stats.speed, stats.filesAdded, stats.bytesAdded, stats.readSpeed, stats.treeSpeed);
 		if (!i->isPaused()) {
 			stats.isPaused = false;
 		}
@@ -23,6 +23,7 @@
 #include "typedefs.h"
 
 #include "DbHandler.h"
+#include "HashedFile.h"
 #include "HashManagerListener.h"
 // #include "HashStore.h"
 #include "MerkleTree.h"
@@ -35,7 +36,6 @@ namespace dcpp {
 
 class Hasher;
 class HashStore;
-class HashedFile;
 
 class HashManager : public Singleton<HashManager>, public Speaker<HashManagerListener> {
 
@@ -48,6 +48,28 @@ public:
 	 */
 	bool checkTTH(const string& aFileLower, const string& aFileName, HashedFile& fi_);
 
+	struct FileInfoCheck {
+		FileInfoCheck(string&& aPathLower, string&& aPath, const HashedFile& aFileInfo) noexcept : pathLower(move(aPathLower)), path(move(aPath)), fileInfo(aFileInfo) { }
+
+		string pathLower;
+		string path;
+		HashedFile fileInfo;
+
+		// The file has valid hash information
+		bool found = false;
+	};
+	typedef vector<FileInfoCheck> FileInfoCheckList;
+
+	/**
+	 * Batched version of checkTTH for multiple files (e.g. the files in a directory)
+	 * The hash information is loaded with a single database pass, outdated/missing files are queued for hashing
+	 */
+	void checkTTHs(FileInfoCheckList& files_);
+
+	// Batched version of getFileInfo, missing files are queued for hashing
+	// The size of missing files is set to their current size on disk (or -1 if the size can't be read)
+	void getFileInfos(FileInfoCheckList& files_);
+
 	void stopHashing(const string& aBaseDir) noexcept;
 	void setPriority(Thread::Priority p) noexcept;
 
@@ -73,6 +95,8 @@ public:
 		int64_t speed = 0;
 		size_t filesAdded = 0;
 		int64_t bytesAdded = 0;
+		int64_t readSpeed = 0;
+		int64_t treeSpeed = 0;
 		int hashersRunning = 0;
 		bool isPaused = true;
 
@@ -84,6 +108,8 @@ public:
 				speed == rhs.speed &&
 				filesAdded == rhs.filesLeft &&
 				bytesAdded == rhs.bytesAdded &&
+				readSpeed == rhs.readSpeed &&
+				treeSpeed == rhs.treeSpeed &&
 				hashersRunning == rhs.hashersRunning &&
 				isPaused == rhs.isPaused;
 		}
@@ -138,6 +164,9 @@ private:
 	static void log(const string& aMsg, LogMessage::Severity aSeverity) noexcept;
 
 	bool hashFile(const string& filePath, const string& pathLower, int64_t size);
+
+	// Loads the hash information for the files in path order, returns the number of found files
+	size_t loadFileInfos(FileInfoCheckList& aFiles, const function<void(FileInfoCheck& aFile, const HashedFile& aInfo)>& aHandler) noexcept;
 	bool isShutdown = false;
 
 	typedef vector<Hasher*> HasherList;
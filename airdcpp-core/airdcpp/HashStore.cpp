@@ -349,6 +349,32 @@ bool HashStore::getFileInfo(const string& aFileLower, HashedFile& fi_) noexcept
 	return false;
 }
 
+size_t HashStore::getFileInfos(const vector<const string*>& aFilesLower, const FileInfoHandler& aHandler) noexcept {
+	DbHandler::KeyList keys;
+	keys.reserve(aFilesLower.size());
+	for (const auto& path: aFilesLower) {
+		// Lowercase paths aren't unique on case-sensitive file systems
+		dcassert(keys.empty() || *aFilesLower[keys.size() - 1] <= *path);
+		keys.emplace_back(path->c_str(), path->length());
+	}
+
+	try {
+		return fileDb->getMultiple(keys, sizeof(HashedFile), [&](size_t aIndex, void* aValue, size_t valueLen) {
+			HashedFile fi;
+			if (!loadFileInfo(aValue, valueLen, fi)) {
+				return false;
+			}
+
+			aHandler(aIndex, fi);
+			return true;
+		});
+	} catch (const DbException& e) {
+		log(STRING_F(READ_FAILED_X, fileDb->getNameLower() % e.getError()), LogMessage::SEV_ERROR);
+	}
+
+	return 0;
+}
+
 void HashStore::optimize(bool doVerify) noexcept {
 
 	int unusedTrees = 0;
@@ -51,6 +51,12 @@ public:
 
 	void addTree(const TigerTree& tt);
 	bool getFileInfo(const string& aFileLower, HashedFile& aFile) noexcept;
+
+	// Load the information of multiple files with a single database pass (the paths must be sorted)
+	// The handler is called with the list index of each file that was found
+	// Returns the number of files that were found
+	typedef std::function<void(size_t aIndex, const HashedFile& aFile)> FileInfoHandler;
+	size_t getFileInfos(const vector<const string*>& aFilesLower, const FileInfoHandler& aHandler) noexcept;
 	bool getTree(const TTHValue& root, TigerTree& tth);
 	bool hasTree(const TTHValue& root);
 
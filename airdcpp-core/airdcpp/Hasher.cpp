@@ -27,6 +27,7 @@
 #include "HashManager.h"
 #include "HashedFile.h"
 #include "MerkleTree.h"
+#include "ParallelTreeHasher.h"
 #include "ResourceManager.h"
 #include "TimerManager.h"
 #include "ZUtils.h"
@@ -143,14 +144,18 @@ namespace dcpp {
 		totalDirsHashed = 0;
 		totalFilesHashed = 0;
 		lastSpeed = 0;
+		lastReadSpeed = 0;
+		lastTreeSpeed = 0;
 	}
 
-	void Hasher::getStats(string& curFile_, int64_t& bytesLeft_, size_t& filesLeft_, int64_t& speed_, size_t& filesAdded_, int64_t& bytesAdded_) const noexcept {
+	void Hasher::getStats(string& curFile_, int64_t& bytesLeft_, size_t& filesLeft_, int64_t& speed_, size_t& filesAdded_, int64_t& bytesAdded_, int64_t& readSpeed_, int64_t& treeSpeed_) const noexcept {
 		curFile_ = currentFile;
 		filesLeft_ += w.size();
 		if (running) {
 			filesLeft_++;
 			speed_ += lastSpeed;
+			readSpeed_ += lastReadSpeed;
+			treeSpeed_ += lastTreeSpeed;
 		}
 
 		bytesLeft_ += totalBytesLeft;
@@ -166,7 +171,7 @@ namespace dcpp {
 		}
 	}
 
-	Hasher::Hasher(bool aIsPaused, int aHasherID) : paused(aIsPaused), hasherID(aHasherID), totalBytesLeft(0), lastSpeed(0), totalBytesAdded(0), totalFilesAdded(0) {
+	Hasher::Hasher(bool aIsPaused, int aHasherID) : paused(aIsPaused), hasherID(aHasherID), totalBytesLeft(0), lastSpeed(0), totalBytesAdded(0), totalFilesAdded(0), lastReadSpeed(0), lastTreeSpeed(0) {
 		start();
 	}
 
@@ -248,8 +253,28 @@ namespace dcpp {
 
 					uint64_t lastRead = GET_TICK();
 
-					FileReader fr(FileReader::ASYNC);
+					// Calculate the tree in worker threads for larger files
+					unique_ptr<ParallelTreeHasher> parallelHasher;
+					auto threads = SETTING(HASH_THREADS_PER_FILE);
+					if (threads > 1 && size >= static_cast<int64_t>(ParallelTreeHasher::BATCH_SIZE) * 2) {
+						parallelHasher = make_unique<ParallelTreeHasher>(threads);
+					}
+
+					// Stage statistics
+					typedef std::chrono::steady_clock StatClock;
+					uint64_t readTimeUs = 0, treeTimeUs = 0;
+					int64_t bytesRead = 0;
+					auto lastCallback = StatClock::now();
+					auto toUs = [](StatClock::duration aDuration) {
+						return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(aDuration).count());
+					};
+
+					FileReader fr(SETTING(HASH_ASYNC_READS) ? FileReader::ASYNC : FileReader::SYNC);
 					fr.read(fname, [&](const void* buf, size_t n) -> bool {
+						auto callbackStart = StatClock::now();
+						readTimeUs += toUs(callbackStart - lastCallback);
+						bytesRead += n;
+
 						if (SETTING(MAX_HASH_SPEED) > 0) {
 							uint64_t now = GET_TICK();
 							uint64_t minTime = n * 1000LL / Util::convertSize(SETTING(MAX_HASH_SPEED), Util::MB);
@@ -262,12 +287,24 @@ namespace dcpp {
 							lastRead = GET_TICK();
 						}
 
-						tt.update(buf, n);
+						if (parallelHasher) {
+							parallelHasher->update(buf, n);
+							treeTimeUs = parallelHasher->getHashTimeUs();
+						} else {
+							auto treeStart = StatClock::now();
+							tt.update(buf, n);
+							treeTimeUs += toUs(StatClock::now() - treeStart);
+						}
 
 						if (fileCRC) {
 							crc32(buf, n);
 						}
 
+						if (readTimeUs > 0)
+							lastReadSpeed = bytesRead * 1000000 / readTimeUs;
+						if (treeTimeUs > 0)
+							lastTreeSpeed = bytesRead * 1000000 / treeTimeUs;
+
 						sizeLeft -= n;
 						uint64_t end = GET_TICK();
 
@@ -276,10 +313,15 @@ namespace dcpp {
 						if (end > start)
 							lastSpeed = (size - sizeLeft) * 1000 / (end - start);
 
+						lastCallback = StatClock::now();
 						return !stopping;
 					});
 
-					tt.finalize();
+					if (parallelHasher) {
+						parallelHasher->finalize(tt);
+					} else {
+						tt.finalize();
+					}
 
 					failed = (fileCRC && crc32.getValue() != *fileCRC) || stopping;
 
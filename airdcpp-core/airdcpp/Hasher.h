@@ -51,7 +51,7 @@ namespace dcpp {
 
 		void stopHashing(const string& baseDir) noexcept;
 		int run();
-		void getStats(string& curFile_, int64_t& bytesLeft_, size_t& filesLeft_, int64_t& speed_, size_t& filesAdded_, int64_t& bytesAdded_) const noexcept;
+		void getStats(string& curFile_, int64_t& bytesLeft_, size_t& filesLeft_, int64_t& speed_, size_t& filesAdded_, int64_t& bytesAdded_, int64_t& readSpeed_, int64_t& treeSpeed_) const noexcept;
 		void shutdown();
 
 		bool hasFile(const string& aPath) const noexcept;
@@ -101,6 +101,10 @@ namespace dcpp {
 		atomic<int64_t> lastSpeed;
 		atomic<int64_t> totalFilesAdded;
 
+		// Throughput of the individual stages (file reading and tree calculation) for the current file
+		atomic<int64_t> lastReadSpeed;
+		atomic<int64_t> lastTreeSpeed;
+
 		void instantPause();
 
 		int64_t totalSizeHashed = 0;
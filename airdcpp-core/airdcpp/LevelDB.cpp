@@ -146,6 +146,44 @@ bool LevelDB::get(void* aKey, size_t keyLen, size_t /*initialValueLen*/, std::fu
 	return false;
 }
 
+size_t LevelDB::getMultiple(const KeyList& aKeys, size_t /*initialValueLen*/, std::function<bool(size_t aIndex, void* aValue, size_t aValueLen)> loadF, DbSnapshot* aSnapshot /*nullptr*/) {
+	if (aKeys.empty()) {
+		return 0;
+	}
+
+	leveldb::ReadOptions options = readoptions;
+	if (aSnapshot)
+		options.snapshot = static_cast<LevelSnapshot*>(aSnapshot)->snapshot;
+
+	// A single iterator is used for all keys
+	// Keys are usually close to each other (e.g. files in the same directory) so stepping forward is cheaper than seeking
+	size_t ret = 0;
+	auto it = unique_ptr<leveldb::Iterator>(db->NewIterator(options));
+	for (size_t i = 0; i < aKeys.size(); ++i) {
+		totalReads++;
+		leveldb::Slice key(static_cast<const char*>(aKeys[i].first), aKeys[i].second);
+		if (i == 0) {
+			it->Seek(key);
+		} else if (it->Valid() && it->key().compare(key) < 0) {
+			it->Next();
+			if (it->Valid() && it->key().compare(key) < 0) {
+				it->Seek(key);
+			}
+		}
+
+		if (!it->Valid()) {
+			break;
+		}
+
+		if (it->key() == key && loadF(i, (void*)it->value().data(), it->value().size())) {
+			ret++;
+		}
+	}
+
+	checkDbError(it->status());
+	return ret;
+}
+
 string LevelDB::getStats() {
 	string ret;
 	string value = "leveldb.stats";
@@ -175,6 +213,43 @@ void LevelDB::remove(void* aKey, size_t keyLen, DbSnapshot* /*aSnapshot*/ /*null
 	DBACTION(db->Delete(writeoptions, key));
 }
 
+void LevelDB::write(const DbBatch& aBatch) {
+	if (aBatch.empty()) {
+		return;
+	}
+
+	leveldb::WriteBatch wb;
+	for (const auto& c: aBatch.getChanges()) {
+		if (c.remove) {
+			wb.Delete(c.key);
+		} else {
+			wb.Put(c.key, c.value);
+		}
+	}
+
+	totalWrites += aBatch.size();
+	DBACTION(db->Write(writeoptions, &wb));
+}
+
+void LevelDB::iterate(std::function<bool(void* aKey, size_t keyLen, void* aValue, size_t valueLen)> f, const void* aPrefix /*nullptr*/, size_t aPrefixLen /*0*/, DbSnapshot* aSnapshot /*nullptr*/) {
+	leveldb::ReadOptions options;
+	options.fill_cache = false;
+	if (aSnapshot)
+		options.snapshot = static_cast<LevelSnapshot*>(aSnapshot)->snapshot;
+
+	leveldb::Slice prefix(static_cast<const char*>(aPrefix), aPrefix ? aPrefixLen : 0);
+
+	auto it = unique_ptr<leveldb::Iterator>(db->NewIterator(options));
+	for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+		totalReads++;
+		if (!f((void*)it->key().data(), it->key().size(), (void*)it->value().data(), it->value().size())) {
+			break;
+		}
+	}
+
+	checkDbError(it->status());
+}
+
 int64_t LevelDB::getSizeOnDisk() {
 	return File::getDirSize(getPath(), false);
 }
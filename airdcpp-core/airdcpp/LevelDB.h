@@ -38,9 +38,13 @@ public:
 
 	void put(void* aKey, size_t keyLen, void* aValue, size_t valueLen, DbSnapshot* aSnapshot /*nullptr*/);
 	bool get(void* aKey, size_t keyLen, size_t /*initialValueLen*/, std::function<bool(void* aValue, size_t aValueLen)> loadF, DbSnapshot* aSnapshot /*nullptr*/);
+	size_t getMultiple(const KeyList& aKeys, size_t /*initialValueLen*/, std::function<bool(size_t aIndex, void* aValue, size_t aValueLen)> loadF, DbSnapshot* aSnapshot /*nullptr*/);
 	void remove(void* aKey, size_t keyLen, DbSnapshot* aSnapshot /*nullptr*/);
 	bool hasKey(void* aKey, size_t keyLen, DbSnapshot* aSnapshot /*nullptr*/);
 
+	void write(const DbBatch& aBatch);
+	void iterate(std::function<bool(void* aKey, size_t keyLen, void* aValue, size_t valueLen)> f, const void* aPrefix /*nullptr*/, size_t aPrefixLen /*0*/, DbSnapshot* aSnapshot /*nullptr*/);
+
 	string getStats();
 
 	size_t size(bool /*thorough*/, DbSnapshot* aSnapshot /*nullptr*/);
@@ -65,6 +65,14 @@ public:
 		calcRoot();
 	}
 
+	/** Initialise the tree from a list of leaf hashes, calculating the root */
+	MerkleTree(int64_t aFileSize, int64_t aBlockSize, MerkleList&& aLeaves) :
+		leaves(move(aLeaves)), fileSize(aFileSize), blockSize(aBlockSize)
+	{
+		dcassert(leaves.size() == calcBlocks(aFileSize, aBlockSize));
+		calcRoot();
+	}
+
 	/** Initialise a single root tree */
 	MerkleTree(int64_t aFileSize, int64_t aBlockSize, const MerkleValue& aRoot) : root(aRoot), fileSize(aFileSize), blockSize(aBlockSize) {
 		leaves.push_back(root);
@@ -106,16 +114,27 @@ public:
 			return;
 		
 		do {
+			// Hash consecutive full blocks together
+			size_t count = min((len - i) / baseBlockSize, Hasher::MAX_LANES);
+			if(count > 1) {
+				const uint8_t* data[Hasher::MAX_LANES];
+				uint8_t results[Hasher::MAX_LANES * Hasher::BYTES];
+				for(size_t j = 0; j < count; j++)
+					data[j] = buf + i + j * baseBlockSize;
+
+				Hasher::hashMultiple(zero, data, baseBlockSize, count, results);
+				for(size_t j = 0; j < count; j++)
+					addBlock(MerkleValue(results + j * Hasher::BYTES));
+
+				i += count * baseBlockSize;
+				continue;
+			}
+
 			size_t n = min(baseBlockSize, len-i);
 			Hasher h;
 			h.update(&zero, 1);
 			h.update(buf + i, n);
-			if((int64_t)baseBlockSize < blockSize) {
-				blocks.emplace_back(MerkleValue(h.finalize()), baseBlockSize);
-				reduceBlocks();
-			} else {
-				leaves.emplace_back(h.finalize());
-			}
+			addBlock(MerkleValue(h.finalize()));
 			i += n;
 		} while(i < len);
 		fileSize += len;
@@ -159,6 +178,28 @@ public:
 		root = getHash(0, fileSize);
 	}
 
+	/**
+	 * Replace the leaves with the ones for a larger block size (which must be a power of two 
+	 * multiple of the current block size). The root hash won't change.
+	 */
+	void setLeafBlockSize(int64_t aBlockSize) {
+		dcassert(aBlockSize >= blockSize && (aBlockSize / blockSize) * blockSize == aBlockSize);
+		if (aBlockSize == blockSize) {
+			return;
+		}
+
+		MerkleList newLeaves;
+		for (int64_t pos = 0; pos < fileSize; pos += aBlockSize) {
+			newLeaves.push_back(getHash(pos, min(aBlockSize, fileSize - pos)));
+		}
+
+		if (!newLeaves.empty()) {
+			leaves.swap(newLeaves);
+		}
+
+		blockSize = aBlockSize;
+	}
+
 	ByteVector getLeafData() {
 		ByteVector buf(getLeaves().size() * BYTES);
 		uint8_t* p = &buf[0];
@@ -205,6 +246,15 @@ private:
 		return MerkleValue(h.finalize());
 	}
 
+	void addBlock(const MerkleValue& aHash) {
+		if((int64_t)baseBlockSize < blockSize) {
+			blocks.emplace_back(aHash, baseBlockSize);
+			reduceBlocks();
+		} else {
+			leaves.push_back(aHash);
+		}
+	}
+
 	void reduceBlocks() {
 		while(blocks.size() > 1) {
 			MerkleBlock& a = blocks[blocks.size()-2];
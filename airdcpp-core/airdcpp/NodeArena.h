@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_NODE_ARENA_H
+#define DCPLUSPLUS_DCPP_NODE_ARENA_H
+
+#include "debug.h"
+
+#include <boost/noncopyable.hpp>
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace dcpp {
+
+// Allocates objects of a single type from blocks without a heap header for each object
+// Freed slots are reused by later allocations and the blocks are released with the arena
+// The block size grows from MinBlockItems to MaxBlockItems so that small arenas stay small
+// Not thread-safe
+template<class T, size_t MinBlockItems = 16, size_t MaxBlockItems = 1024>
+class NodeArena : boost::noncopyable {
+public:
+	NodeArena() noexcept { }
+
+	~NodeArena() {
+		// All objects must have been destroyed
+		dcassert(count == 0);
+		for (const auto& b: blocks) {
+			::operator delete(b.first);
+		}
+	}
+
+	template<class... ArgT>
+	T* create(ArgT&&... aArgs) {
+		auto slot = allocate();
+		try {
+			return new (slot) T(std::forward<ArgT>(aArgs)...);
+		} catch (...) {
+			release(slot);
+			throw;
+		}
+	}
+
+	void destroy(T* aItem) noexcept {
+		aItem->~T();
+		release(reinterpret_cast<Slot*>(aItem));
+	}
+
+	// Number of live objects
+	size_t size() const noexcept {
+		return count;
+	}
+
+	// Bytes reserved for the blocks (including the free slots)
+	size_t getMemoryUsage() const noexcept {
+		size_t ret = blocks.capacity() * sizeof(Block);
+		for (const auto& b: blocks) {
+			ret += b.second * sizeof(Slot);
+		}
+
+		return ret;
+	}
+private:
+	union Slot {
+		Slot* next;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type item;
+	};
+
+	// Block and the number of slots in it
+	typedef std::pair<Slot*, size_t> Block;
+
+	Slot* allocate() {
+		count++;
+		if (freeSlots) {
+			auto ret = freeSlots;
+			freeSlots = ret->next;
+			return ret;
+		}
+
+		if (blocks.empty() || blockPos == blocks.back().second) {
+			auto items = blocks.empty() ? MinBlockItems : std::min(blocks.back().second * 2, MaxBlockItems);
+			try {
+				blocks.reserve(blocks.size() + 1);
+				blocks.emplace_back(static_cast<Slot*>(::operator new(items * sizeof(Slot))), items);
+			} catch (...) {
+				count--;
+				throw;
+			}
+
+			blockPos = 0;
+		}
+
+		return &blocks.back().first[blockPos++];
+	}
+
+	void release(Slot* aSlot) noexcept {
+		aSlot->next = freeSlots;
+		freeSlots = aSlot;
+		count--;
+	}
+
+	std::vector<Block> blocks;
+
+	// Next unused slot in the last block
+	size_t blockPos = 0;
+
+	Slot* freeSlots = nullptr;
+	size_t count = 0;
+};
+
+}
+
+#endif
@@ -78,7 +78,6 @@ public:
 
 
 #define GETSET_FIELD(n, x) string get##n() const { return get(x); } void set##n(const string& v) { set(x, v); }
-	GETSET_FIELD(Nick, "NI")
 	GETSET_FIELD(Description, "DE")
 	GETSET_FIELD(Ip4, "I4")
 	GETSET_FIELD(Ip6, "I6")
@@ -91,12 +90,15 @@ public:
 	GETSET_FIELD(SharedFiles, "SF")
 	GETSET_FIELD(ShareSize, "SS")
 #undef GETSET_FIELD
+	string getNick() const noexcept;
+	void setNick(const string& aNick) noexcept { set("NI", aNick); }
+
 	uint8_t getSlots() const noexcept;
 	void setBytesShared(const string& bs) noexcept { set("SS", bs); }
-	int64_t getBytesShared() const noexcept { return Util::toInt64(get("SS")); }
+	int64_t getBytesShared() const noexcept { return bytesShared; }
 	
 	void setStatus(const string& st) noexcept { set("ST", st); }
-	StatusFlags getStatus() const noexcept { return static_cast<StatusFlags>(Util::toInt(get("ST"))); }
+	StatusFlags getStatus() const noexcept { return static_cast<StatusFlags>(status.load()); }
 
 	void setOp(bool op) noexcept { set("OP", op ? "1" : Util::emptyString); }
 	void setHub(bool hub) noexcept { set("HU", hub ? "1" : Util::emptyString); }
@@ -175,10 +177,34 @@ private:
 	UserPtr user;
 	uint32_t sid;
 
-	typedef map<short, string> InfMap;
-	InfMap info;
+	static short toKey(const char* aName) noexcept {
+		short key;
+		memcpy(&key, aName, sizeof(key));
+		return key;
+	}
+
+	// Keys of the fields that are stored in parsed form
+	static const short KEY_NICK;
+	static const short KEY_SHARE_SIZE;
+	static const short KEY_CLIENT_TYPE;
+	static const short KEY_STATUS;
+
+	// Fields sorted by the key (there are only a few dozen of them at most so this is faster and more compact than a map)
+	typedef vector<pair<short, string>> InfoList;
+	InfoList info;
+
+	// Frequently used fields are stored separately in parsed form
+	// The nick is not stored in the info list
+	string nick;
+	atomic<int64_t> bytesShared { 0 };
+	atomic<int> clientType { 0 };
+	atomic<int> status { 0 };
+
+	InfoList::const_iterator findInfo(short aKey) const noexcept;
+	void updateParsedField(short aKey, const string& aValue) noexcept;
 
-	static SharedMutex cs;
+	// Protects the string fields of this identity
+	mutable FastCriticalSection cs;
 };
 
 class OnlineUser :  public FastAlloc<OnlineUser>, public intrusive_ptr_base<OnlineUser>, private boost::noncopyable {
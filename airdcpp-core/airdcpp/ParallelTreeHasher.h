@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_PARALLEL_TREE_HASHER_H
+#define DCPLUSPLUS_DCPP_PARALLEL_TREE_HASHER_H
+
+#include "typedefs.h"
+
+#include "Hasher.h"
+#include "MerkleTree.h"
+
+#include "concurrency.h"
+
+#include <chrono>
+
+namespace dcpp {
+
+/**
+* Calculates the tree leaves in worker threads while the following data is being read
+*
+* The leaves are first calculated for fixed size units, which are combined to the final block size
+* when the file has been read (the leaves and root will be identical with serial hashing)
+*/
+class ParallelTreeHasher : boost::noncopyable {
+public:
+	static constexpr size_t BATCH_SIZE = 1024 * 1024;
+
+	explicit ParallelTreeHasher(size_t aThreads) noexcept : threads(aThreads) { }
+
+	~ParallelTreeHasher() {
+		tasks.wait();
+	}
+
+	// Copies the data to be hashed
+	void update(const void* aData, size_t aLen) noexcept {
+		auto data = static_cast<const uint8_t*>(aData);
+		while (aLen > 0) {
+			if (filling.empty() || filling.back().data.size() == BATCH_SIZE) {
+				if (filling.size() == threads) {
+					startRound();
+				}
+
+				filling.push_back(getBatch());
+			}
+
+			auto& batch = filling.back();
+			auto n = min(aLen, BATCH_SIZE - batch.data.size());
+			batch.data.insert(batch.data.end(), data, data + n);
+
+			data += n;
+			aLen -= n;
+			fileSize += n;
+		}
+	}
+
+	// Waits for the remaining data to be hashed and creates the tree with the wanted block size
+	void finalize(TigerTree& tree_) noexcept {
+		startRound();
+		tasks.wait();
+		collectLeaves();
+
+		if (leaves.empty()) {
+			// Empty files have a single leaf as well
+			TigerTree tt(Hasher::MIN_BLOCK_SIZE);
+			tt.finalize();
+			leaves.push_back(tt.getRoot());
+		}
+
+		auto blockSize = tree_.getBlockSize();
+		tree_ = TigerTree(fileSize, Hasher::MIN_BLOCK_SIZE, move(leaves));
+		tree_.setLeafBlockSize(blockSize);
+	}
+
+	// Time spent for hashing per thread
+	uint64_t getHashTimeUs() const noexcept {
+		return hashTimeUs / threads;
+	}
+private:
+	struct Batch {
+		ByteVector data;
+		TigerTree::MerkleList leaves;
+	};
+
+	typedef vector<Batch> BatchList;
+
+	// Hash the filled batches while the next ones are being read
+	void startRound() noexcept {
+		tasks.wait();
+		collectLeaves();
+
+		hashing.swap(filling);
+		for (auto& b: hashing) {
+			tasks.run([this, &b] {
+				hashBatch(b);
+			});
+		}
+	}
+
+	// Append the leaves of the finished batches in file order
+	void collectLeaves() noexcept {
+		for (auto& b: hashing) {
+			leaves.insert(leaves.end(), b.leaves.begin(), b.leaves.end());
+
+			b.data.clear();
+			b.leaves.clear();
+			spare.push_back(move(b));
+		}
+
+		hashing.clear();
+	}
+
+	Batch getBatch() noexcept {
+		if (spare.empty()) {
+			Batch b;
+			b.data.reserve(BATCH_SIZE);
+			return b;
+		}
+
+		auto b = move(spare.back());
+		spare.pop_back();
+		return b;
+	}
+
+	void hashBatch(Batch& aBatch) noexcept {
+		auto start = std::chrono::steady_clock::now();
+
+		const auto len = aBatch.data.size();
+		for (size_t pos = 0; pos < len; pos += Hasher::MIN_BLOCK_SIZE) {
+			TigerTree tt(Hasher::MIN_BLOCK_SIZE);
+			tt.update(&aBatch.data[pos], min(static_cast<size_t>(Hasher::MIN_BLOCK_SIZE), len - pos));
+			tt.finalize();
+			aBatch.leaves.push_back(tt.getRoot());
+		}
+
+		hashTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	const size_t threads;
+	int64_t fileSize = 0;
+
+	BatchList filling;
+	BatchList hashing;
+	BatchList spare;
+
+	TigerTree::MerkleList leaves;
+	atomic<uint64_t> hashTimeUs { 0 };
+
+	task_group tasks;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_PARALLEL_TREE_HASHER_H)
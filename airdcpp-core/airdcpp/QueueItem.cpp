@@ -222,6 +222,8 @@ string QueueItem::getListName() const noexcept {
 	dcassert(isSet(QueueItem::FLAG_USER_LIST));
 	if (isSet(QueueItem::FLAG_PARTIAL_LIST)) {
 		return target;
+	} else if(isSet(QueueItem::FLAG_BINARY_LIST)) {
+		return target + ".bin";
 	} else if(isSet(QueueItem::FLAG_XML_BZLIST)) {
 		return target + ".xml.bz2";
 	} else {
@@ -84,6 +84,8 @@ public:
 		FLAG_TTHLIST_BUNDLE		= 0x100,
 		/** A private file that won't be added in share and it's not available via partial sharing */
 		FLAG_PRIVATE			= 0x200,
+		/** The file list downloaded was a binary list */
+		FLAG_BINARY_LIST		= 0x400,
 	};
 
 	enum Status {
@@ -104,6 +104,9 @@ void QueueManager::shutdown() noexcept {
 		std::sort(protectedFileLists.begin(), protectedFileLists.end());
 
 		StringList filelists = File::findFiles(path, "*.xml.bz2", File::TYPE_FILE);
+		auto binaryLists = File::findFiles(path, "*.bin", File::TYPE_FILE);
+		filelists.insert(filelists.end(), binaryLists.begin(), binaryLists.end());
+
 		std::sort(filelists.begin(), filelists.end());
 		std::for_each(filelists.begin(), std::set_difference(filelists.begin(), filelists.end(),
 			protectedFileLists.begin(), protectedFileLists.end(), filelists.begin()), &File::deleteFile);
@@ -1177,8 +1180,7 @@ bool QueueManager::addValidatedSource(const QueueItemPtr& qi, const HintedUser&
 		throw QueueException(STRING(DUPLICATE_SOURCE) + ": " + Util::getFileName(qi->getTarget()));
 	}
 
-	qi->addSource(aUser);
-	userQueue.addQI(qi, aUser, isBad);
+	userQueue.addSource(qi, aUser, isBad);
 
 #if defined(_WIN32) && defined(HAVE_GUI)
 	if ((!SETTING(SOURCEFILE).empty()) && (!SETTING(SOUNDS_DISABLED)))
@@ -1813,7 +1815,9 @@ void QueueManager::onFilelistDownloadCompletedHooked(const QueueItemPtr& aQI, Do
 		aQI->addFinishedSegment(Segment(0, aQI->getSize()));
 	}
 
-	if (aDownload->isSet(Download::FLAG_XML_BZ_LIST)) {
+	if (aDownload->isSet(Download::FLAG_BINARY_LIST)) {
+		aQI->setFlag(QueueItem::FLAG_BINARY_LIST);
+	} else if (aDownload->isSet(Download::FLAG_XML_BZ_LIST)) {
 		aQI->setFlag(QueueItem::FLAG_XML_BZLIST);
 	}
 
@@ -2053,8 +2057,7 @@ void QueueManager::removeFileSource(const QueueItemPtr& q, const UserPtr& aUser,
 
 		isRunning = q->isRunning();
 
-		userQueue.removeQI(q, aUser, false, aReason);
-		q->removeSource(aUser, aReason);
+		userQueue.removeSource(q, aUser, aReason);
 	}
 
 	fire(QueueManagerListener::ItemSources(), q);
@@ -2379,9 +2382,9 @@ void QueueManager::sendRemovePBD(const HintedUser& aUser, const string& aRemoteT
 	ClientManager::getInstance()->sendUDP(cmd, aUser.user->getCID(), false, true);
 }
 
-void QueueManager::saveQueue(bool aForce) noexcept {
+bool QueueManager::saveQueue(bool aForce) noexcept {
 	RLock l(cs);	
-	bundleQueue.saveQueue(aForce);
+	return bundleQueue.saveQueue(aForce);
 }
 
 class QueueLoader : public SimpleXMLReader::CallBack {
@@ -2420,29 +2423,25 @@ private:
 void QueueManager::loadQueue(StartupLoader& aLoader) noexcept {
 	setMatchers();
 
-	// migrate old bundles
-	Util::migrate(Util::getPath(Util::PATH_BUNDLES), "Bundle*");
+	auto start = GET_TICK();
 
-	// multithreaded loading
-	StringList fileList = File::findFiles(Util::getPath(Util::PATH_BUNDLES), "Bundle*", File::TYPE_FILE);
-	atomic<long> loaded(0);
-	try {
-		parallel_for_each(fileList.begin(), fileList.end(), [&](const string& path) {
-			if (Util::getFileExt(path) == ".xml") {
-				QueueLoader loader;
-				try {
-					File f(path, File::READ, File::OPEN, File::BUFFER_SEQUENTIAL, false);
-					SimpleXMLReader(&loader).parse(f);
-				} catch (const Exception& e) {
-					log(STRING_F(BUNDLE_LOAD_FAILED, path % e.getError().c_str()), LogMessage::SEV_ERROR);
-					File::deleteFile(path);
-				}
-			}
-			loaded++;
-			aLoader.progressF(static_cast<float>(loaded) / static_cast<float>(fileList.size()));
-		});
-	} catch (std::exception& e) {
-		log("Loading the queue failed: " + string(e.what()), LogMessage::SEV_INFO);
+	// The database is also opened when it has been disabled so that the bundles can be moved back to XML files
+	unique_ptr<QueueStore> store;
+	if (SETTING(QUEUE_STORE_DB) || QueueStore::exists()) {
+		try {
+			store = make_unique<QueueStore>();
+			store->open(aLoader);
+		} catch (const DbException& e) {
+			log("Failed to open the queue database, using the XML files instead: " + e.getError(), LogMessage::SEV_ERROR);
+			store.reset();
+		}
+	}
+
+	auto loadedFromStore = store && store->isMigrated();
+	if (loadedFromStore) {
+		loadStoredBundles(*store, aLoader);
+	} else {
+		loadXmlBundles(aLoader);
 	}
 
 	try {
@@ -2462,6 +2461,27 @@ void QueueManager::loadQueue(StartupLoader& aLoader) noexcept {
 		// ...
 	}
 
+	if (store) {
+		if (SETTING(QUEUE_STORE_DB)) {
+			if (loadedFromStore || migrateXmlBundles(*store)) {
+				bundleQueue.setStore(std::move(store));
+			}
+		} else if (loadedFromStore) {
+			// The database has been disabled
+			// Keep the database content until all bundles have been saved in XML files (the bundles will be loaded from the database again on the next startup)
+			if (saveQueue(true)) {
+				try {
+					store->clear();
+				} catch (const DbException& e) {
+					log(STRING_F(SAVE_FAILED_X, QueueStore::getDbPath() % e.getError()), LogMessage::SEV_ERROR);
+				}
+			}
+		}
+	}
+
+	queueLoadDuration = GET_TICK() - start;
+	dcdebug("Queue loaded in " U64_FMT " ms (%s)\n", queueLoadDuration, loadedFromStore ? "database" : "XML");
+
 	TimerManager::getInstance()->addListener(this); 
 	SearchManager::getInstance()->addListener(this);
 	ClientManager::getInstance()->addListener(this);
@@ -2478,6 +2498,110 @@ void QueueManager::loadQueue(StartupLoader& aLoader) noexcept {
 	});
 }
 
+void QueueManager::loadXmlBundles(StartupLoader& aLoader) noexcept {
+	// migrate old bundles
+	Util::migrate(Util::getPath(Util::PATH_BUNDLES), "Bundle*");
+
+	// multithreaded loading
+	StringList fileList = File::findFiles(Util::getPath(Util::PATH_BUNDLES), "Bundle*", File::TYPE_FILE);
+	atomic<long> loaded(0);
+	try {
+		parallel_for_each(fileList.begin(), fileList.end(), [&](const string& path) {
+			if (Util::getFileExt(path) == ".xml") {
+				QueueLoader loader;
+				try {
+					File f(path, File::READ, File::OPEN, File::BUFFER_SEQUENTIAL, false);
+					SimpleXMLReader(&loader).parse(f);
+				} catch (const Exception& e) {
+					log(STRING_F(BUNDLE_LOAD_FAILED, path % e.getError().c_str()), LogMessage::SEV_ERROR);
+					File::deleteFile(path);
+				}
+			}
+			loaded++;
+			aLoader.progressF(static_cast<float>(loaded) / static_cast<float>(fileList.size()));
+		});
+	} catch (std::exception& e) {
+		log("Loading the queue failed: " + string(e.what()), LogMessage::SEV_INFO);
+	}
+}
+
+void QueueManager::loadStoredBundles(QueueStore& aStore, StartupLoader& aLoader) noexcept {
+	vector<QueueStore::StoredBundle> storedBundles;
+	try {
+		storedBundles = aStore.loadBundles();
+	} catch (const DbException& e) {
+		log("Loading the queue failed: " + e.getError(), LogMessage::SEV_ERROR);
+		return;
+	}
+
+	atomic<long> loaded(0);
+	try {
+		parallel_for_each(storedBundles.begin(), storedBundles.end(), [&](const QueueStore::StoredBundle& aBundle) {
+			QueueLoader loader;
+			try {
+				QueueStore::replay(aBundle, loader);
+			} catch (const Exception& e) {
+				log(STRING_F(BUNDLE_LOAD_FAILED, Util::toString(aBundle.token) % e.getError().c_str()), LogMessage::SEV_ERROR);
+			}
+
+			loaded++;
+			aLoader.progressF(static_cast<float>(loaded) / static_cast<float>(storedBundles.size()));
+		});
+	} catch (std::exception& e) {
+		log("Loading the queue failed: " + string(e.what()), LogMessage::SEV_INFO);
+	}
+
+	// Remove the bundles that failed to load
+	for (const auto& b: storedBundles) {
+		if (!bundleQueue.findBundle(b.token)) {
+			try {
+				aStore.removeBundle(b.token);
+			} catch (const DbException& e) {
+				log(STRING_F(SAVE_FAILED_X, QueueStore::getDbPath() % e.getError()), LogMessage::SEV_ERROR);
+			}
+		}
+	}
+}
+
+bool QueueManager::migrateXmlBundles(QueueStore& aStore) noexcept {
+	try {
+		// Remove possible leftovers from an earlier attempt
+		aStore.clear();
+
+		QueueStore::Batch batch;
+		for (const auto& b: bundleQueue.getBundles() | map_values) {
+			aStore.saveBundle(*b, batch);
+			if (batch.getDataSize() >= 4 * 1024 * 1024) {
+				aStore.write(batch);
+				batch = QueueStore::Batch();
+			}
+		}
+
+		aStore.write(batch);
+		aStore.setMigrated(true);
+	} catch (const DbException& e) {
+		log(STRING_F(SAVE_FAILED_X, QueueStore::getDbPath() % e.getError()), LogMessage::SEV_ERROR);
+		return false;
+	}
+
+	for (const auto& b: bundleQueue.getBundles() | map_values) {
+		b->deleteXmlFile();
+		b->clearDirty();
+	}
+
+	return true;
+}
+
+QueueManager::QueueStorageStats QueueManager::getQueueStorageStats() const noexcept {
+	QueueStorageStats ret;
+	ret.loadDurationMs = queueLoadDuration;
+
+	RLock l(cs);
+	ret.database = bundleQueue.getStore() != nullptr;
+	ret.lastSave = bundleQueue.getSaveStats();
+	return ret;
+}
+
 static const string sFile = "File";
 static const string sBundle = "Bundle";
 static const string sName = "Name";
@@ -2906,9 +3030,7 @@ void QueueManager::on(ClientManagerListener::UserConnected, const OnlineUser& aU
 		{
 			RLock l(cs);
 			userQueue.getUserQIs(aUser.getUser(), ql);
-			auto i = userQueue.getBundleList().find(aUser.getUser());
-			if (i != userQueue.getBundleList().end())
-				bl = i->second;
+			bl = userQueue.getBundles(aUser.getUser());
 		}
 
 		for(const auto& q: ql) {
@@ -2935,9 +3057,7 @@ void QueueManager::on(ClientManagerListener::UserDisconnected, const UserPtr& aU
 	{
 		RLock l(cs);
 		userQueue.getUserQIs(aUser, ql);
-		auto i = userQueue.getBundleList().find(aUser);
-		if (i != userQueue.getBundleList().end())
-			bl = i->second;
+		bl = userQueue.getBundles(aUser);
 	}
 
 	for (const auto& q: ql)
@@ -229,7 +229,20 @@ public:
 	void loadQueue(StartupLoader& aLoader) noexcept;
 
 	// Force will force bundle to be saved even when it's not dirty (not recommended as it may take a long time with huge queues)
-	void saveQueue(bool aForce) noexcept;
+	// Returns false if any of the bundles couldn't be saved
+	bool saveQueue(bool aForce) noexcept;
+
+	struct QueueStorageStats {
+		// The queue is saved in the database instead of XML files
+		bool database = false;
+
+		// Duration of loading the queue on startup in milliseconds
+		uint64_t loadDurationMs = 0;
+
+		BundleQueue::SaveStats lastSave;
+	};
+
+	QueueStorageStats getQueueStorageStats() const noexcept;
 	void shutdown() noexcept;
 
 	void noDeleteFileList(const string& aPath) noexcept;
@@ -444,6 +457,13 @@ private:
 	void removeBundleItem(const QueueItemPtr& qi, bool finished) noexcept;
 	void addLoadedBundle(const BundlePtr& aBundle) noexcept;
 
+	void loadXmlBundles(StartupLoader& aLoader) noexcept;
+	void loadStoredBundles(QueueStore& aStore, StartupLoader& aLoader) noexcept;
+
+	// Writes all bundles in the database, returns false on errors
+	bool migrateXmlBundles(QueueStore& aStore) noexcept;
+	uint64_t queueLoadDuration = 0;
+
 	// Add a new bundle in queue or (called from inside a WLock)
 	// onBundleAdded must be called separately from outside the lock afterwards
 	void addBundle(const BundlePtr& aBundle, int aFilesAdded) noexcept;
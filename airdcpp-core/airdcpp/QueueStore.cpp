@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "QueueStore.h"
+
+#include "Bundle.h"
+#include "ClientManager.h"
+#include "DCPlusPlus.h"
+#include "File.h"
+#include "LevelDB.h"
+#include "QueueItem.h"
+#include "ResourceManager.h"
+#include "Util.h"
+
+namespace dcpp {
+
+static const string migratedKey = "QueueStoreMigrated";
+
+static const string sFile = "File";
+static const string sBundle = "Bundle";
+static const string sDownload = "Download";
+static const string sFinished = "Finished";
+static const string sSegment = "Segment";
+static const string sSource = "Source";
+
+// Record encoding: [element count] + elements
+// Element: [tag][simple][attribute count] + [name][value] pairs
+// Strings are length-prefixed and all integers are varints
+static void writeVarInt(string& buf_, uint64_t aValue) noexcept {
+	while (aValue >= 0x80) {
+		buf_ += static_cast<char>((aValue & 0x7F) | 0x80);
+		aValue >>= 7;
+	}
+
+	buf_ += static_cast<char>(aValue);
+}
+
+static uint64_t readVarInt(const string& aBuf, size_t& pos_) {
+	uint64_t ret = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos_ >= aBuf.size()) {
+			throw Exception("Unexpected end of record");
+		}
+
+		auto b = static_cast<uint8_t>(aBuf[pos_++]);
+		ret |= static_cast<uint64_t>(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			return ret;
+		}
+	}
+
+	throw Exception("Invalid integer");
+}
+
+static void writeString(string& buf_, const string& aStr) noexcept {
+	writeVarInt(buf_, aStr.size());
+	buf_ += aStr;
+}
+
+static void readString(const string& aBuf, size_t& pos_, string& str_) {
+	auto len = readVarInt(aBuf, pos_);
+	if (len > aBuf.size() - pos_) {
+		throw Exception("Unexpected end of record");
+	}
+
+	str_.assign(aBuf, pos_, static_cast<size_t>(len));
+	pos_ += static_cast<size_t>(len);
+}
+
+class RecordWriter {
+public:
+	RecordWriter(string& aRecord) : record(aRecord) {
+		record.clear();
+
+		// Element count
+		record += '\0';
+	}
+
+	void startElement(const string& aTag, bool aSimple) noexcept {
+		finishElement();
+
+		elements++;
+		writeString(record, aTag);
+		record += aSimple ? '\1' : '\0';
+	}
+
+	void addAttrib(const string& aName, const string& aValue) noexcept {
+		attribs.emplace_back(aName, aValue);
+	}
+
+	// Must be called after the last element has been added
+	void finish() noexcept {
+		finishElement();
+
+		// Replace the placeholder
+		string count;
+		writeVarInt(count, elements);
+		record.replace(0, 1, count);
+	}
+private:
+	void finishElement() noexcept {
+		if (elements == 0) {
+			return;
+		}
+
+		writeVarInt(record, attribs.size());
+		for (const auto& a: attribs) {
+			writeString(record, a.first);
+			writeString(record, a.second);
+		}
+
+		attribs.clear();
+	}
+
+	string& record;
+	StringPairList attribs;
+	size_t elements = 0;
+};
+
+void QueueStore::Batch::put(QueueToken aToken, const string& aKey, const string& aRecord, uint64_t aHash) noexcept {
+	batch.put(aKey.data(), aKey.size(), aRecord.data(), aRecord.size());
+	updates.push_back({ aToken, aKey, aHash, false });
+	dataSize += aKey.size() + aRecord.size();
+}
+
+void QueueStore::Batch::remove(QueueToken aToken, const string& aKey) noexcept {
+	batch.remove(aKey.data(), aKey.size());
+	updates.push_back({ aToken, aKey, 0, true });
+	dataSize += aKey.size();
+}
+
+QueueStore::QueueStore() {
+
+}
+
+QueueStore::~QueueStore() {
+
+}
+
+string QueueStore::getDbPath() noexcept {
+	return Util::getPath(Util::PATH_USER_CONFIG) + "QueueData" + PATH_SEPARATOR;
+}
+
+bool QueueStore::exists() noexcept {
+	return File::isDirectory(getDbPath());
+}
+
+void QueueStore::open(StartupLoader& aLoader) {
+	auto path = getDbPath();
+	File::ensureDirectory(path);
+
+	// The records are small and they are mostly read sequentially when loading the queue
+	db = make_unique<LevelDB>(path, STRING(DOWNLOAD_QUEUE), 8 * 1024 * 1024, 20, true, 16 * 1024);
+	db->open(aLoader.stepF, aLoader.messageF);
+}
+
+bool QueueStore::isMigrated() {
+	return db->hasKey((void*)migratedKey.data(), migratedKey.size());
+}
+
+void QueueStore::setMigrated(bool aMigrated) {
+	if (aMigrated) {
+		db->put((void*)migratedKey.data(), migratedKey.size(), (void*)"1", 1);
+	} else {
+		db->remove((void*)migratedKey.data(), migratedKey.size());
+	}
+}
+
+string QueueStore::getKey(QueueToken aToken, RecordType aType, uint64_t aItemHash) noexcept {
+	// Big endian token so that the records of a bundle are next to each other
+	string ret;
+	ret.reserve(ITEM_KEY_SIZE);
+	for (int i = TOKEN_SIZE - 1; i >= 0; --i) {
+		ret += static_cast<char>((aToken >> (i * 8)) & 0xFF);
+	}
+
+	ret += static_cast<char>(aType);
+	if (aType == TYPE_ITEM) {
+		for (int i = 7; i >= 0; --i) {
+			ret += static_cast<char>((aItemHash >> (i * 8)) & 0xFF);
+		}
+	}
+
+	return ret;
+}
+
+uint64_t QueueStore::getHash(const string& aData) noexcept {
+	// FNV-1a
+	uint64_t ret = 14695981039346656037ULL;
+	for (auto c: aData) {
+		ret ^= static_cast<uint8_t>(c);
+		ret *= 1099511628211ULL;
+	}
+
+	return ret;
+}
+
+void QueueStore::saveHeader(Bundle& aBundle, string& record_) noexcept {
+	RecordWriter w(record_);
+	if (aBundle.isFileBundle()) {
+		w.startElement(sFile, false);
+		w.addAttrib("Version", FILE_BUNDLE_VERSION);
+		w.addAttrib("Token", aBundle.getStringToken());
+		w.addAttrib("Date", Util::toString(aBundle.getBundleDate()));
+		w.addAttrib("AddedByAutoSearch", Util::toString(aBundle.getAddedByAutoSearch()));
+		if (aBundle.getResumeTime() > 0) {
+			w.addAttrib("ResumeTime", Util::toString(aBundle.getResumeTime()));
+		}
+	} else {
+		w.startElement(sBundle, false);
+		w.addAttrib("Version", DIR_BUNDLE_VERSION);
+		w.addAttrib("Target", aBundle.getTarget());
+		w.addAttrib("Token", aBundle.getStringToken());
+		w.addAttrib("Added", Util::toString(aBundle.getTimeAdded()));
+		w.addAttrib("Date", Util::toString(aBundle.getBundleDate()));
+		w.addAttrib("AddedByAutoSearch", Util::toString(aBundle.getAddedByAutoSearch()));
+		if (!aBundle.getAutoPriority()) {
+			w.addAttrib("Priority", Util::toString((int)aBundle.getPriority()));
+		}
+		if (aBundle.getTimeFinished() > 0) {
+			w.addAttrib("TimeFinished", Util::toString(aBundle.getTimeFinished()));
+		}
+		if (aBundle.getResumeTime() > 0) {
+			w.addAttrib("ResumeTime", Util::toString(aBundle.getResumeTime()));
+		}
+	}
+
+	w.finish();
+}
+
+void QueueStore::saveItem(const QueueItemPtr& aQI, string& record_) noexcept {
+	RecordWriter w(record_);
+	string b32tmp;
+
+	auto finished = aQI->segmentsDone();
+	w.startElement(finished ? sFinished : sDownload, finished);
+	w.addAttrib("Target", aQI->getTarget());
+	w.addAttrib("Size", Util::toString(aQI->getSize()));
+	w.addAttrib("Added", Util::toString(aQI->getTimeAdded()));
+	w.addAttrib("TTH", aQI->getTTH().toBase32(b32tmp));
+
+	if (finished) {
+		w.addAttrib("TimeFinished", Util::toString(aQI->getTimeFinished()));
+		w.addAttrib("LastSource", aQI->getLastSource());
+		w.finish();
+		return;
+	}
+
+	w.addAttrib("Priority", Util::toString((int)aQI->getPriority()));
+	if (!aQI->getDone().empty()) {
+		w.addAttrib("TempTarget", aQI->getTempTarget());
+	}
+	w.addAttrib("AutoPriority", Util::toString(aQI->getAutoPriority()));
+	w.addAttrib("MaxSegments", Util::toString(aQI->getMaxSegments()));
+
+	for (const auto& s: aQI->getDone()) {
+		w.startElement(sSegment, true);
+		w.addAttrib("Start", Util::toString(s.getStart()));
+		w.addAttrib("Size", Util::toString(s.getSize()));
+	}
+
+	for (const auto& s: aQI->getSources()) {
+		if (s.isSet(QueueItem::Source::FLAG_PARTIAL))
+			continue;
+
+		const auto& hint = s.getUser().hint;
+
+		w.startElement(sSource, true);
+		w.addAttrib("CID", s.getUser().user->getCID().toBase32());
+		w.addAttrib("Nick", ClientManager::getInstance()->getNick(s.getUser(), hint));
+		if (!hint.empty()) {
+			w.addAttrib("HubHint", hint);
+		}
+	}
+
+	w.finish();
+}
+
+QueueStore::RecordHashMap& QueueStore::getSavedRecords(QueueToken aToken) {
+	auto i = savedRecords.find(aToken);
+	if (i != savedRecords.end()) {
+		return i->second;
+	}
+
+	RecordHashMap records;
+	auto prefix = getKey(aToken, TYPE_BUNDLE).substr(0, TOKEN_SIZE);
+	db->iterate([&](void* aKey, size_t aKeyLen, void* aValue, size_t aValueLen) {
+		records.emplace(string(static_cast<const char*>(aKey), aKeyLen), getHash(string(static_cast<const char*>(aValue), aValueLen)));
+		return true;
+	}, prefix.data(), prefix.size());
+
+	return savedRecords.emplace(aToken, std::move(records)).first->second;
+}
+
+void QueueStore::saveBundle(Bundle& aBundle, Batch& batch_) {
+	auto token = aBundle.getToken();
+
+	Lock l(cs);
+	const auto& saved = getSavedRecords(token);
+	unordered_set<string> currentKeys;
+
+	string record;
+	auto addRecord = [&](string&& aKey) {
+		auto hash = getHash(record);
+		auto s = saved.find(aKey);
+		if (s == saved.end() || s->second != hash) {
+			batch_.put(token, aKey, record, hash);
+		}
+
+		currentKeys.insert(std::move(aKey));
+	};
+
+	saveHeader(aBundle, record);
+	addRecord(getKey(token, TYPE_BUNDLE));
+
+	auto saveItems = [&](const QueueItemList& aItems) {
+		for (const auto& q: aItems) {
+			saveItem(q, record);
+			addRecord(getKey(token, TYPE_ITEM, getHash(q->getTarget())));
+		}
+	};
+
+	saveItems(aBundle.getFinishedFiles());
+	saveItems(aBundle.getQueueItems());
+
+	// Removed items
+	for (const auto& s: saved) {
+		if (currentKeys.find(s.first) == currentKeys.end()) {
+			batch_.remove(token, s.first);
+		}
+	}
+}
+
+void QueueStore::write(const Batch& aBatch) {
+	if (aBatch.empty()) {
+		return;
+	}
+
+	Lock l(cs);
+	db->write(aBatch.batch);
+
+	for (const auto& u: aBatch.updates) {
+		auto& records = savedRecords[u.token];
+		if (u.removed) {
+			records.erase(u.key);
+		} else {
+			records[u.key] = u.hash;
+		}
+	}
+}
+
+void QueueStore::removeBundle(QueueToken aToken) {
+	Lock l(cs);
+
+	DbBatch batch;
+	auto prefix = getKey(aToken, TYPE_BUNDLE).substr(0, TOKEN_SIZE);
+	db->iterate([&](void* aKey, size_t aKeyLen, void* /*aValue*/, size_t /*aValueLen*/) {
+		batch.remove(aKey, aKeyLen);
+		return true;
+	}, prefix.data(), prefix.size());
+
+	db->write(batch);
+	savedRecords.erase(aToken);
+}
+
+void QueueStore::clear() {
+	Lock l(cs);
+	db->remove_if([](void* /*aKey*/, size_t /*aKeyLen*/, void* /*aValue*/, size_t /*aValueLen*/) {
+		return true;
+	});
+
+	savedRecords.clear();
+}
+
+vector<QueueStore::StoredBundle> QueueStore::loadBundles() {
+	Lock l(cs);
+
+	vector<StoredBundle> ret;
+	db->iterate([&](void* aKey, size_t aKeyLen, void* aValue, size_t aValueLen) {
+		auto key = static_cast<const uint8_t*>(aKey);
+		if ((aKeyLen != HEADER_KEY_SIZE || key[TOKEN_SIZE] != TYPE_BUNDLE) && (aKeyLen != ITEM_KEY_SIZE || key[TOKEN_SIZE] != TYPE_ITEM)) {
+			// Not a bundle record
+			return true;
+		}
+
+		QueueToken token = 0;
+		for (size_t i = 0; i < TOKEN_SIZE; ++i) {
+			token = (token << 8) | key[i];
+		}
+
+		if (ret.empty() || ret.back().token != token) {
+			ret.emplace_back();
+			ret.back().token = token;
+		}
+
+		string value(static_cast<const char*>(aValue), aValueLen);
+		savedRecords[token].emplace(string(static_cast<const char*>(aKey), aKeyLen), getHash(value));
+
+		if (key[TOKEN_SIZE] == TYPE_BUNDLE) {
+			ret.back().header = std::move(value);
+		} else {
+			ret.back().items.push_back(std::move(value));
+		}
+
+		return true;
+	});
+
+	return ret;
+}
+
+void QueueStore::replay(const StoredBundle& aBundle, SimpleXMLReader::CallBack& aLoader) {
+	if (aBundle.header.empty()) {
+		throw Exception("Missing bundle header");
+	}
+
+	string tag;
+	StringPairList attribs;
+
+	// Returns the tag of the first element if it's not a simple one
+	auto replayRecord = [&](const string& aRecord) {
+		size_t pos = 0;
+		string openTag;
+
+		auto elements = readVarInt(aRecord, pos);
+		for (uint64_t i = 0; i < elements; ++i) {
+			readString(aRecord, pos, tag);
+			if (pos >= aRecord.size()) {
+				throw Exception("Unexpected end of record");
+			}
+
+			auto simple = aRecord[pos++] != '\0';
+
+			attribs.resize(static_cast<size_t>(readVarInt(aRecord, pos)));
+			for (auto& a: attribs) {
+				readString(aRecord, pos, a.first);
+				readString(aRecord, pos, a.second);
+			}
+
+			aLoader.startTag(tag, attribs, simple);
+			if (i == 0 && !simple) {
+				openTag = tag;
+			}
+		}
+
+		return openTag;
+	};
+
+	auto bundleTag = replayRecord(aBundle.header);
+	if (bundleTag.empty()) {
+		throw Exception("Invalid bundle header");
+	}
+
+	for (const auto& item: aBundle.items) {
+		auto itemTag = replayRecord(item);
+		if (!itemTag.empty()) {
+			aLoader.endTag(itemTag);
+		}
+	}
+
+	aLoader.endTag(bundleTag);
+}
+
+} // namespace dcpp
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_QUEUE_STORE_H
+#define DCPLUSPLUS_DCPP_QUEUE_STORE_H
+
+#include "forward.h"
+#include "typedefs.h"
+
+#include "CriticalSection.h"
+#include "DbHandler.h"
+#include "QueueItemBase.h"
+#include "SimpleXMLReader.h"
+
+namespace dcpp {
+
+/**
+* Database backend for the download queue (alternative for the bundle XML files)
+*
+* Each bundle is stored as a header record and one record per queue item:
+* - [token][0]: the Bundle/File element
+* - [token][1][target hash]: the Download/Finished element with its segments and sources
+*
+* The records contain the same elements and attributes as the XML files so that they can be loaded
+* with the regular queue loader. Saving a bundle writes only the records that have changed since the
+* previous save. The changes of multiple bundles are written in a single atomic batch.
+*/
+class QueueStore {
+public:
+	// Changes of the bundles that are pending to be written
+	class Batch {
+	public:
+		size_t size() const noexcept { return batch.size(); }
+		size_t getDataSize() const noexcept { return dataSize; }
+		bool empty() const noexcept { return batch.empty(); }
+	private:
+		friend class QueueStore;
+
+		struct Update {
+			QueueToken token;
+			string key;
+			uint64_t hash;
+			bool removed;
+		};
+
+		void put(QueueToken aToken, const string& aKey, const string& aRecord, uint64_t aHash) noexcept;
+		void remove(QueueToken aToken, const string& aKey) noexcept;
+
+		DbBatch batch;
+		vector<Update> updates;
+		size_t dataSize = 0;
+	};
+
+	// A bundle read from the database
+	struct StoredBundle {
+		QueueToken token = 0;
+		string header;
+		StringList items;
+	};
+
+	QueueStore();
+	~QueueStore();
+
+	// Throws DbException
+	void open(StartupLoader& aLoader);
+
+	static bool exists() noexcept;
+
+	// The bundle XML files have been migrated to the database
+	bool isMigrated();
+
+	// Throws DbException
+	void setMigrated(bool aMigrated);
+
+	// Adds the changed records of the bundle in the batch
+	// Throws DbException
+	void saveBundle(Bundle& aBundle, Batch& batch_);
+
+	// Throws DbException
+	void write(const Batch& aBatch);
+
+	// Throws DbException
+	void removeBundle(QueueToken aToken);
+
+	// Removes all bundles and the migration flag
+	// Throws DbException
+	void clear();
+
+	// Throws DbException
+	vector<StoredBundle> loadBundles();
+
+	// Passes the stored elements to the loader in the same way as SimpleXMLReader would do when parsing the XML file
+	// Throws Exception if the stored data is invalid
+	static void replay(const StoredBundle& aBundle, SimpleXMLReader::CallBack& aLoader);
+
+	static string getDbPath() noexcept;
+private:
+	enum RecordType : uint8_t {
+		TYPE_BUNDLE = 0,
+		TYPE_ITEM = 1
+	};
+
+	static const size_t TOKEN_SIZE = sizeof(QueueToken);
+	static const size_t HEADER_KEY_SIZE = TOKEN_SIZE + 1;
+	static const size_t ITEM_KEY_SIZE = TOKEN_SIZE + 1 + sizeof(uint64_t);
+
+	static string getKey(QueueToken aToken, RecordType aType, uint64_t aItemHash = 0) noexcept;
+
+	static void saveHeader(Bundle& aBundle, string& record_) noexcept;
+	static void saveItem(const QueueItemPtr& aQI, string& record_) noexcept;
+	static uint64_t getHash(const string& aData) noexcept;
+
+	// Hashes of the saved records by record key (used for skipping unchanged records)
+	typedef unordered_map<string, uint64_t> RecordHashMap;
+
+	// Reads the record hashes of a bundle that hasn't been loaded or saved during this session (unsafe)
+	// Throws DbException
+	RecordHashMap& getSavedRecords(QueueToken aToken);
+
+	unordered_map<QueueToken, RecordHashMap> savedRecords;
+
+	unique_ptr<DbHandler> db;
+	CriticalSection cs;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_QUEUE_STORE_H)
@@ -27,6 +27,12 @@
 
 #include <openssl/err.h>
 
+// Kernel TLS offload (Linux)
+#if defined(HAVE_SYS_SENDFILE_H) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define USE_KTLS
+#include "File.h"
+#endif
+
 namespace dcpp {
 
 SSLSocket::SSLSocket(CryptoManager::SSLContext context, bool allowUntrusted, const string& expKP) : SSLSocket(context) {
@@ -66,6 +72,11 @@ bool SSLSocket::waitConnected(uint64_t millis) {
 			SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
 		} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
 
+#ifdef USE_KTLS
+		// Let the kernel encrypt the records after the handshake if it supports the negotiated cipher (allows sending files directly)
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+
 		if (!hostname.empty()) {
 			// https://github.com/openssl/openssl/issues/7147#issuecomment-419621673
 			SSL_set_tlsext_host_name(ssl, hostname.c_str());
@@ -103,6 +114,11 @@ bool SSLSocket::waitAccepted(uint64_t millis) {
 			SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
 		} else SSL_set_ex_data(ssl, CryptoManager::idxVerifyData, verifyData.get());
 
+#ifdef USE_KTLS
+		// Let the kernel encrypt the records after the handshake if it supports the negotiated cipher (allows sending files directly)
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+
 		checkSSL(SSL_set_fd(ssl, static_cast<int>(getSock())));
 	}
 
@@ -162,6 +178,40 @@ int SSLSocket::write(const void* aBuffer, int aLen) {
 	return ret;
 }
 
+#ifdef USE_KTLS
+int SSLSocket::sendFile(File& aFile, int aLen) {
+	if(!ssl) {
+		return -1;
+	}
+
+	auto ret = SSL_sendfile(ssl, aFile.getNativeHandle(), aFile.getPos(), aLen, 0);
+	if(ret == 0) {
+		// End of file
+		return 0;
+	}
+
+	ret = checkSSL(static_cast<int>(ret));
+	if(ret > 0) {
+		aFile.movePos(ret);
+		stats.totalUp += ret;
+	}
+	return static_cast<int>(ret);
+}
+
+bool SSLSocket::canSendFile() const noexcept {
+	return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+#else
+int SSLSocket::sendFile(File&, int) {
+	dcassert(0);
+	throw SSLSocketException(ENOSYS);
+}
+
+bool SSLSocket::canSendFile() const noexcept {
+	return false;
+}
+#endif
+
 int SSLSocket::checkSSL(int ret) {
 	if(!ssl) {
 		return -1;
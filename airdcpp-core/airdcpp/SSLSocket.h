@@ -52,6 +52,8 @@ public:
 
 	virtual int read(void* aBuffer, int aBufLen) override;
 	virtual int write(const void* aBuffer, int aLen) override;
+	virtual int sendFile(File& aFile, int aLen) override;
+	virtual bool canSendFile() const noexcept override;
 	virtual std::pair<bool, bool> wait(uint64_t millis, bool checkRead, bool checkWrite) override;
 	virtual void shutdown() noexcept override;
 	virtual void close() noexcept override;
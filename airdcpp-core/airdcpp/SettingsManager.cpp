@@ -238,7 +238,7 @@ const string SettingsManager::settingTags[] =
 	"FavDownloadSpeed", "SettingsProfile", "LogLines", "MaxMCNDownloads", "MaxMCNUploads",
 	"RecentBundleHours", "DisconnectMinSources", "AutoprioType", "AutoprioInterval", "AutosearchExpireDays",  "TLSMode", "UpdateMethod",
 
-	"FullListDLLimit", "LastListProfile", "MaxHashingThreads", "HashersPerVolume", "SubtractlistSkip", "BloomMode", "AwayIdleTime",
+	"FullListDLLimit", "LastListProfile", "MaxHashingThreads", "HashersPerVolume", "HashThreadsPerFile", "SubtractlistSkip", "BloomMode", "AwayIdleTime",
 	"SearchHistoryMax", "ExcludeHistoryMax", "DirectoryHistoryMax", "MinDupeCheckSize", "DbCacheSize", "DLAutoDisconnectMode", 
 	"RemovedTrees", "RemovedFiles", "MultithreadedRefresh",
 	"MaxRunningBundles", "DefaultShareProfile", "UpdateChannel",
@@ -323,7 +323,7 @@ const string SettingsManager::settingTags[] =
 	"SkipEmptyDirsShare", "RemoveExpiredAs", "AdcLogGroupCID", "ShareFollowSymlinks", "UseDefaultCertPaths", "StartupRefresh",
 	"FLReportDupeFiles", "UseUploadBundles", "LogIgnored", "RemoveFinishedBundles", "AlwaysCCPM",
 
-	"PopupBotPms", "PopupHubPms", "SortFavUsersFirst",
+	"PopupBotPms", "PopupHubPms", "SortFavUsersFirst", "ShareSearchIndex", "ShareSearchParallel", "HashAsyncReads", "QueueStoreDb", "ShareMonitoring",
 #ifdef HAVE_GUI
 	// Windows GUI
 	"BoldFinishedDownloads", "BoldFinishedUploads", "BoldHub", "BoldPm",
@@ -599,6 +599,8 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 	setDefault(MAX_HASHING_THREADS, std::thread::hardware_concurrency());
 
 	setDefault(HASHERS_PER_VOLUME, 1);
+	setDefault(HASH_THREADS_PER_FILE, 1);
+	setDefault(HASH_ASYNC_READS, true);
 
 	setDefault(MIN_DUPE_CHECK_SIZE, 512);
 	setDefault(SKIP_EMPTY_DIRS_SHARE, true);
@@ -621,6 +623,10 @@ SettingsManager::SettingsManager() : connectionRegex("(\\d+(\\.\\d+)?)")
 	setDefault(MAX_RUNNING_BUNDLES, 0);
 	setDefault(DEFAULT_SP, 0);
 	setDefault(STARTUP_REFRESH, true);
+	setDefault(SHARE_SEARCH_INDEX, false);
+	setDefault(SHARE_SEARCH_PARALLEL, false);
+	setDefault(QUEUE_STORE_DB, false);
+	setDefault(SHARE_MONITORING, false);
 	setDefault(FL_REPORT_FILE_DUPES, true);
 	setDefault(DATE_FORMAT, "%Y-%m-%d %H:%M");
 
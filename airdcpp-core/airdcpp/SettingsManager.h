@@ -133,7 +133,7 @@ public:
 		FAV_DL_SPEED, SETTINGS_PROFILE, LOG_LINES, MAX_MCN_DOWNLOADS, MAX_MCN_UPLOADS,
 		RECENT_BUNDLE_HOURS, DISCONNECT_MIN_SOURCES, AUTOPRIO_TYPE, AUTOPRIO_INTERVAL, AUTOSEARCH_EXPIRE_DAYS, TLS_MODE, UPDATE_METHOD,
 
-		FULL_LIST_DL_LIMIT, LAST_LIST_PROFILE, MAX_HASHING_THREADS, HASHERS_PER_VOLUME, SKIP_SUBTRACT, BLOOM_MODE, AWAY_IDLE_TIME,
+		FULL_LIST_DL_LIMIT, LAST_LIST_PROFILE, MAX_HASHING_THREADS, HASHERS_PER_VOLUME, HASH_THREADS_PER_FILE, SKIP_SUBTRACT, BLOOM_MODE, AWAY_IDLE_TIME,
 		HISTORY_SEARCH_MAX, HISTORY_DIR_MAX, HISTORY_EXCLUDE_MAX, MIN_DUPE_CHECK_SIZE, DB_CACHE_SIZE, DL_AUTO_DISCONNECT_MODE, 
 		CUR_REMOVED_TREES, CUR_REMOVED_FILES, REFRESH_THREADING,
 		MAX_RUNNING_BUNDLES, DEFAULT_SP, UPDATE_CHANNEL,
@@ -218,7 +218,7 @@ public:
 		SKIP_EMPTY_DIRS_SHARE, REMOVE_EXPIRED_AS, PM_LOG_GROUP_CID, SHARE_FOLLOW_SYMLINKS, USE_DEFAULT_CERT_PATHS, STARTUP_REFRESH,
 		FL_REPORT_FILE_DUPES, USE_UPLOAD_BUNDLES, LOG_IGNORED, REMOVE_FINISHED_BUNDLES, ALWAYS_CCPM,
 
-		POPUP_BOT_PMS, POPUP_HUB_PMS, SORT_FAVUSERS_FIRST,
+		POPUP_BOT_PMS, POPUP_HUB_PMS, SORT_FAVUSERS_FIRST, SHARE_SEARCH_INDEX, SHARE_SEARCH_PARALLEL, HASH_ASYNC_READS, QUEUE_STORE_DB, SHARE_MONITORING,
 #ifdef HAVE_GUI
 		// Windows GUI
 		BOLD_FINISHED_DOWNLOADS, BOLD_FINISHED_UPLOADS, BOLD_HUB, BOLD_PM,
@@ -20,6 +20,7 @@
 #include "ShareManager.h"
 
 #include "AirUtil.h"
+#include "BinaryFilelist.h"
 #include "Bundle.h"
 #include "BZUtils.h"
 #include "ClientManager.h"
@@ -32,6 +33,7 @@
 #include "ResourceManager.h"
 #include "ScopedFunctor.h"
 #include "SearchResult.h"
+#include "ShareMonitor.h"
 #include "SharePathValidator.h"
 #include "SimpleXML.h"
 #include "StringTokenizer.h"
@@ -103,8 +105,19 @@ void ShareManager::log(const string& aMsg, LogMessage::Severity aSeverity) noexc
 // Note that settings are loaded before this function is called
 // This function shouldn't initialize anything that is needed by the startup wizard
 void ShareManager::startup(StartupLoader& aLoader) noexcept {
+	if (SETTING(SHARE_SEARCH_INDEX)) {
+		WLock l(cs);
+		searchIndex = make_unique<SearchIndex>();
+		rebuildSearchIndex();
+	}
+
 	bool refreshed = false;
-	if (!loadCache(aLoader.progressF)) {
+	if (loadCache(aLoader.progressF)) {
+		WLock l(cs);
+		if (getBloomSize() > bloom->getSize()) {
+			rebuildBloom();
+		}
+	} else {
 		// Refresh involves hooks, let everything load first
 		aLoader.addPostLoadTask([this, &aLoader] {
 			aLoader.stepF(STRING(REFRESHING_SHARE));
@@ -115,6 +128,10 @@ void ShareManager::startup(StartupLoader& aLoader) noexcept {
 	}
 
 	addAsyncTask([=] {
+		if (SETTING(SHARE_MONITORING)) {
+			startMonitoring();
+		}
+
 		TimerManager::getInstance()->addListener(this);
 
 		if (SETTING(STARTUP_REFRESH) && !refreshed) {
@@ -130,9 +147,14 @@ void ShareManager::shutdown(function<void(float)> progressF) noexcept {
 		RLock l (cs);
 		//clear refs so we can delete filelists.
 		auto lists = File::findFiles(Util::getPath(Util::PATH_USER_CONFIG), "files?*.xml.bz2", File::TYPE_FILE);
+		auto binaryLists = File::findFiles(Util::getPath(Util::PATH_USER_CONFIG), "files?*.bin", File::TYPE_FILE);
+		lists.insert(lists.end(), binaryLists.begin(), binaryLists.end());
+
 		for(auto& f: shareProfiles) {
-			if(f->getProfileList() && f->getProfileList()->bzXmlRef.get()) 
-				f->getProfileList()->bzXmlRef.reset(); 
+			if(f->getProfileList()) {
+				f->getProfileList()->bzXmlRef.reset();
+				f->getProfileList()->binaryRef.reset();
+			}
 		}
 
 		for_each(lists, File::deleteFile);
@@ -140,6 +162,8 @@ void ShareManager::shutdown(function<void(float)> progressF) noexcept {
 
 	TimerManager::getInstance()->removeListener(this);
 	join();
+
+	monitor.reset();
 }
 
 void ShareManager::setProfilesDirty(const ProfileTokenSet& aProfiles, bool aIsMajorChange /*false*/) noexcept {
@@ -165,16 +189,19 @@ bool ShareManager::Directory::RootIsParentOrExact::operator()(const Directory::P
 	return AirUtil::isParentOrExactLower(aDirectory->getRoot()->getPathLower(), compareToLower, separator);
 }
 
-ShareManager::Directory::Directory(DualString&& aRealName, const ShareManager::Directory::Ptr& aParent, time_t aLastWrite, const RootDirectory::Ptr& aRoot) :
+ShareManager::Directory::Directory(DualString&& aRealName, const ShareManager::Directory::Ptr& aParent, time_t aLastWrite, const TreeArenaPtr& aArena, const RootDirectory::Ptr& aRoot) :
 	parent(aParent.get()),
 	root(aRoot),
+	arena(aArena),
 	lastWrite(aLastWrite),
 	realName(move(aRealName))
 {
 }
 
 ShareManager::Directory::~Directory() { 
-	for_each(files, DeleteFunction());
+	for (const auto& f: files) {
+		arena->destroyFile(f);
+	}
 }
 
 void ShareManager::Directory::updateModifyDate() {
@@ -236,12 +263,12 @@ const string& ShareManager::Directory::getVirtualNameLower() const noexcept {
 StringList ShareManager::getRealPaths(const TTHValue& root) const noexcept {
 	StringList ret;
 
-	RLock l(cs);
-	const auto i = tthIndex.equal_range(const_cast<TTHValue*>(&root)); 
-	for (auto f = i.first; f != i.second; ++f) {
-		ret.push_back((*f).second->getRealPath());
-	}
+	tthIndex.forEach(root, [&](const Directory::File* f) {
+		ret.push_back(f->getRealPath());
+		return true;
+	});
 
+	RLock l(tempSharesCS);
 	const auto k = tempShares.find(root);
 	if (k != tempShares.end()) {
 		ret.push_back(k->second.path);
@@ -252,8 +279,8 @@ StringList ShareManager::getRealPaths(const TTHValue& root) const noexcept {
 
 
 bool ShareManager::isTTHShared(const TTHValue& tth) const noexcept {
-	RLock l(cs);
-	return tthIndex.find(const_cast<TTHValue*>(&tth)) != tthIndex.end();
+	LookupLatency::Timer t(tthLookupLatency);
+	return tthIndex.contains(tth);
 }
 
 void ShareManager::Directory::increaseSize(int64_t aSize, int64_t& totalSize_) noexcept {
@@ -310,6 +337,7 @@ void ShareManager::Directory::copyRootProfiles(ProfileTokenSet& profiles_, bool
 }
 
 bool ShareManager::RootDirectory::hasRootProfile(const ProfileTokenSet& aProfiles) const noexcept {
+	RLock l(cs);
 	for(const auto ap: aProfiles) {
 		if (rootProfiles.find(ap) != rootProfiles.end())
 			return true;
@@ -330,6 +358,7 @@ bool ShareManager::Directory::hasProfile(const OptionalProfileToken& aProfile) c
 }
 
 bool ShareManager::RootDirectory::hasRootProfile(ProfileToken aProfile) const noexcept {
+	RLock l(cs);
 	return rootProfiles.find(aProfile) != rootProfiles.end();
 }
 
@@ -344,16 +373,32 @@ ShareManager::RootDirectory::Ptr ShareManager::RootDirectory::create(const strin
 }
 
 void ShareManager::RootDirectory::addRootProfile(ProfileToken aProfile) noexcept {
+	WLock l(cs);
 	rootProfiles.emplace(aProfile);
 }
 
 bool ShareManager::RootDirectory::removeRootProfile(ProfileToken aProfile) noexcept {
+	WLock l(cs);
 	rootProfiles.erase(aProfile);
 	return rootProfiles.empty();
 }
 
+void ShareManager::RootDirectory::setRootProfiles(const ProfileTokenSet& aProfiles) noexcept {
+	WLock l(cs);
+	rootProfiles = aProfiles;
+}
+
 string ShareManager::toVirtual(const TTHValue& tth, ProfileToken aProfile) const {
-	
+	// Shared files have the same content as a file list with the same TTH would have
+	string path;
+	if (tthIndex.find(tth, [&](const Directory::File* f) {
+		// The file may be deleted after the index has been unlocked
+		path = f->getAdcPath();
+		return true;
+	})) {
+		return path;
+	}
+
 	RLock l(cs);
 
 	FileList* fl = getFileList(aProfile);
@@ -361,11 +406,8 @@ string ShareManager::toVirtual(const TTHValue& tth, ProfileToken aProfile) const
 		return Transfer::USER_LIST_NAME_BZ;
 	} else if(tth == fl->getXmlRoot()) {
 		return Transfer::USER_LIST_NAME;
-	}
-
-	auto i = tthIndex.find(const_cast<TTHValue*>(&tth)); 
-	if (i != tthIndex.end()) {
-		return i->second->getAdcPath();
+	} else if(tth == fl->getBinaryRoot()) {
+		return Transfer::USER_LIST_NAME_BIN;
 	}
 
 	//nothing found throw;
@@ -389,6 +431,9 @@ pair<int64_t, string> ShareManager::getFileListInfo(const string& virtualFile, P
 	if(virtualFile == Transfer::USER_LIST_NAME_BZ || virtualFile == Transfer::USER_LIST_NAME) {
 		FileList* fl = generateXmlList(aProfile);
 		return { fl->getBzXmlListLen(), fl->getFileName() };
+	} else if(virtualFile == Transfer::USER_LIST_NAME_BIN) {
+		FileList* fl = generateXmlList(aProfile);
+		return { fl->getBinaryListLen(), fl->getBinaryFileName() };
 	}
 
 	throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
@@ -398,22 +443,29 @@ void ShareManager::toRealWithSize(const string& aVirtualFile, const ProfileToken
 	if(aVirtualFile.compare(0, 4, "TTH/") == 0) {
 		TTHValue tth(aVirtualFile.substr(4));
 
-		RLock l(cs);
+		LookupLatency::Timer t(tthLookupLatency);
+
+		// The share lock isn't needed, refreshes won't modify the paths or remove files that are in the TTH index
 		if(any_of(aProfiles.begin(), aProfiles.end(), [](ProfileToken s) { return s != SP_HIDDEN; })) {
-			const auto flst = tthIndex.equal_range(const_cast<TTHValue*>(&tth));
-			for(auto f = flst.first; f != flst.second; ++f) {
+			auto file = tthIndex.find(tth, [&](const Directory::File* f) {
 				noAccess_ = false; //we may throw if the file doesn't exist on the disk so always reset this to prevent invalid access denied messages
-				auto profiles = aProfiles;
-				if (f->second->getParent()->hasProfile(profiles)) {
-					path_ = f->second->getRealPath();
-					size_ = f->second->getSize();
-					return;
-				} else {
-					noAccess_ = true;
+				if (f->getParent()->hasProfile(aProfiles)) {
+					// The file may be deleted after the index has been unlocked
+					path_ = f->getRealPath();
+					size_ = f->getSize();
+					return true;
 				}
+
+				noAccess_ = true;
+				return false;
+			});
+
+			if (file) {
+				return;
 			}
 		}
 
+		RLock l(tempSharesCS);
 		const auto files = tempShares.equal_range(tth);
 		for (auto i = files.first; i != files.second; ++i) {
 			noAccess_ = false;
@@ -451,6 +503,8 @@ TTHValue ShareManager::getListTTH(const string& virtualFile, ProfileToken aProfi
 		return getFileList(aProfile)->getBzXmlRoot();
 	} else if(virtualFile == Transfer::USER_LIST_NAME) {
 		return getFileList(aProfile)->getXmlRoot();
+	} else if(virtualFile == Transfer::USER_LIST_NAME_BIN) {
+		return getFileList(aProfile)->getBinaryRoot();
 	}
 
 	throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
@@ -489,21 +543,27 @@ AdcCommand ShareManager::getFileInfo(const string& aFile, ProfileToken aProfile)
 		cmd.addParam("SI", Util::toString(fl->getBzXmlListLen()));
 		cmd.addParam("TR", fl->getBzXmlRoot().toBase32());
 		return cmd;
+	} else if(aFile == Transfer::USER_LIST_NAME_BIN) {
+		FileList* fl = generateXmlList(aProfile);
+		AdcCommand cmd(AdcCommand::CMD_RES);
+		cmd.addParam("FN", aFile);
+		cmd.addParam("SI", Util::toString(fl->getBinaryListLen()));
+		cmd.addParam("TR", fl->getBinaryRoot().toBase32());
+		return cmd;
 	}
 
 	if(aFile.compare(0, 4, "TTH/") != 0)
 		throw ShareException(UserConnection::FILE_NOT_AVAILABLE);
 
 	TTHValue val(aFile.substr(4));
-	
-	RLock l(cs);
-	auto i = tthIndex.find(const_cast<TTHValue*>(&val)); 
-	if(i != tthIndex.end()) {
-		const Directory::File* f = i->second;
-		AdcCommand cmd(AdcCommand::CMD_RES);
+
+	AdcCommand cmd(AdcCommand::CMD_RES);
+	if (tthIndex.find(val, [&](const Directory::File* f) {
 		cmd.addParam("FN", f->getAdcPath());
 		cmd.addParam("SI", Util::toString(f->getSize()));
 		cmd.addParam("TR", f->getTTH().toBase32());
+		return true;
+	})) {
 		return cmd;
 	}
 
@@ -512,7 +572,7 @@ AdcCommand ShareManager::getFileInfo(const string& aFile, ProfileToken aProfile)
 }
 
 bool ShareManager::isTempShared(const UserPtr& aUser, const TTHValue& tth) const noexcept {
-	RLock l(cs);
+	RLock l(tempSharesCS);
 	const auto fp = tempShares.equal_range(tth);
 	for (auto i = fp.first; i != fp.second; ++i) {
 		if (i->second.hasAccess(aUser)) {
@@ -530,7 +590,7 @@ TempShareInfoList ShareManager::getTempShares() const noexcept {
 	TempShareInfoList ret;
 
 	{
-		RLock l(cs);
+		RLock l(tempSharesCS);
 		boost::copy(tempShares | map_values, back_inserter(ret));
 	}
 
@@ -553,7 +613,7 @@ optional<TempShareInfo> ShareManager::addTempShare(const TTHValue& aTTH, const s
 	
 	const auto item = TempShareInfo(aName, aFilePath, aSize, aTTH, aUser);
 	{
-		WLock l(cs);
+		WLock l(tempSharesCS);
 		const auto files = tempShares.equal_range(aTTH);
 		for (auto i = files.first; i != files.second; ++i) {
 			if (i->second.hasAccess(aUser)) {
@@ -573,7 +633,7 @@ TempShareInfoList ShareManager::getTempShares(const TTHValue& aTTH) const noexce
 	TempShareInfoList ret;
 
 	{
-		RLock l(cs);
+		RLock l(tempSharesCS);
 		const auto files = tempShares.equal_range(aTTH);
 		for (auto i = files.first; i != files.second; ++i) {
 			ret.push_back(i->second);
@@ -587,7 +647,7 @@ bool ShareManager::removeTempShare(const UserPtr& aUser, const TTHValue& tth) no
 	optional<TempShareInfo> removedItem;
 
 	{
-		WLock l(cs);
+		WLock l(tempSharesCS);
 		const auto files = tempShares.equal_range(tth);
 		for (auto i = files.first; i != files.second; ++i) {
 			if (i->second.user == aUser) {
@@ -611,7 +671,7 @@ bool ShareManager::removeTempShare(TempShareToken aId) noexcept {
 	optional<TempShareInfo> removedItem;
 
 	{
-		WLock l(cs);
+		WLock l(tempSharesCS);
 		const auto i = find_if(tempShares | map_values, [aId](const TempShareInfo& ti) {
 			return ti.id == aId;
 		});
@@ -816,8 +876,9 @@ OptionalProfileToken ShareManager::getProfileByName(const string& aName) const n
 	return (*p)->getToken();
 }
 
-ShareManager::Directory::Ptr ShareManager::Directory::createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, ShareBloom& bloom) noexcept {
-	auto dir = Ptr(new Directory(move(aRealName), aParent, aLastWrite, nullptr));
+ShareManager::Directory::Ptr ShareManager::Directory::createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, ShareBloom& bloom, const TreeArenaPtr& aArena) noexcept {
+	dcassert(aParent || aArena);
+	auto dir = Ptr(new Directory(move(aRealName), aParent, aLastWrite, aParent ? aParent->arena : aArena, nullptr));
 
 	if (aParent) {
 		auto added = aParent->directories.insert_sorted(dir).second;
@@ -831,9 +892,10 @@ ShareManager::Directory::Ptr ShareManager::Directory::createNormal(DualString&&
 }
 
 ShareManager::Directory::Ptr ShareManager::Directory::createRoot(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, 
-	time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, ShareBloom& bloom, time_t aLastRefreshTime) noexcept
+	time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, ShareBloom& bloom, time_t aLastRefreshTime, const TreeArenaPtr& aArena) noexcept
 {
-	auto dir = Ptr(new Directory(Util::getLastDir(aRootPath), nullptr, aLastWrite, RootDirectory::create(aRootPath, aVname, aProfiles, aIncoming, aLastRefreshTime)));
+	auto arena = aArena ? aArena : std::make_shared<TreeArena>();
+	auto dir = Ptr(new Directory(Util::getLastDir(aRootPath), nullptr, aLastWrite, arena, RootDirectory::create(aRootPath, aVname, aProfiles, aIncoming, aLastRefreshTime)));
 
 	dcassert(rootPaths_.find(dir->getRealPath()) == rootPaths_.end());
 	rootPaths_[dir->getRealPath()] = dir;
@@ -842,7 +904,7 @@ ShareManager::Directory::Ptr ShareManager::Directory::createRoot(const string& a
 	return dir;
 }
 
-bool ShareManager::Directory::setParent(const Directory::Ptr& aDirectory, const Directory::Ptr& aParent) noexcept {
+bool ShareManager::Directory::setParent(const Directory::Ptr& aDirectory, const Directory::Ptr& aParent, bool aUpdateModifyDate) noexcept {
 	aDirectory->parent = aParent.get();
 	if (aParent) {
 		auto inserted = aParent->directories.insert_sorted(aDirectory).second;
@@ -851,18 +913,22 @@ bool ShareManager::Directory::setParent(const Directory::Ptr& aDirectory, const
 			return false;
 		}
 
-		aParent->updateModifyDate();
+		if (aUpdateModifyDate) {
+			aParent->updateModifyDate();
+		}
 	}
 
 	return true;
 }
 
-void ShareManager::Directory::cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept {
-	aDirectory.cleanIndices(sharedSize_, tthIndex_, dirNames_);
+void ShareManager::Directory::cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap* tthIndex_, Directory::MultiMap& dirNames_, SearchIndex* searchIndex_) noexcept {
+	aDirectory.cleanIndices(sharedSize_, tthIndex_, dirNames_, searchIndex_);
 
 	if (aDirectory.parent) {
 		aDirectory.parent->directories.erase_key(aDirectory.realName.getLower());
-		aDirectory.parent = nullptr;
+		if (tthIndex_) {
+			aDirectory.parent = nullptr;
+		}
 	}
 }
 
@@ -872,33 +938,63 @@ void ShareManager::Directory::File::updateIndices(ShareBloom& bloom_, int64_t& s
 	checkAddedTTHDebug(this, tthIndex_);
 #endif
 
-	tthIndex_.emplace(const_cast<TTHValue*>(&tth), this);
+	tthIndex_.insert(this);
 	bloom_.add(name.getLower());
 }
 
-void ShareManager::Directory::cleanIndices(int64_t& sharedSize_, HashFileMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept {
+void ShareManager::Directory::cleanIndices(int64_t& sharedSize_, HashFileMap* tthIndex_, Directory::MultiMap& dirNames_, SearchIndex* searchIndex_) noexcept {
 	for (auto& d : directories) {
-		d->cleanIndices(sharedSize_, tthIndex_, dirNames_);
+		d->cleanIndices(sharedSize_, tthIndex_, dirNames_, searchIndex_);
 	}
 
 	//remove from the name map
 	removeDirName(*this, dirNames_);
+	if (searchIndex_) {
+		// Token lookups would be too slow when removing large trees
+		searchIndex_->directories.removeLazy(this);
+	}
 
 	//remove all files
 	for (const auto& f : files) {
 		f->cleanIndices(sharedSize_, tthIndex_);
+		if (searchIndex_) {
+			searchIndex_->files.removeLazy(f);
+		}
 	}
 }
 
-void ShareManager::Directory::File::cleanIndices(int64_t& sharedSize_, File::TTHMap& tthIndex_) noexcept {
+void ShareManager::Directory::File::cleanIndices(int64_t& sharedSize_, File::TTHMap* tthIndex_) noexcept {
 	parent->decreaseSize(size, sharedSize_);
 
-	auto flst = tthIndex_.equal_range(const_cast<TTHValue*>(&tth));
-	auto p = find(flst | map_values, this);
-	if (p.base() != flst.second)
-		tthIndex_.erase(p.base());
-	else
+	if (tthIndex_ && !tthIndex_->erase(this)) {
 		dcassert(0);
+	}
+}
+
+void ShareManager::Directory::cleanTTHIndex(Directory& aDirectory, File::TTHMap& tthIndex_) noexcept {
+	for (const auto& d : aDirectory.directories) {
+		cleanTTHIndex(*d, tthIndex_);
+	}
+
+	for (const auto& f : aDirectory.files) {
+		if (!tthIndex_.erase(f)) {
+			dcassert(0);
+		}
+	}
+
+	// Lookups that found the files from the index may have used the parent until now
+	aDirectory.parent = nullptr;
+}
+
+// Run a batched lookup from the hash database and add it in the refresh statistics
+template<class LookupF>
+static void lookupHashStore(ShareRefreshStats& stats_, size_t aFileCount, const LookupF& aLookupF) {
+	auto start = std::chrono::steady_clock::now();
+	aLookupF();
+
+	stats_.hashStoreLookupCount += aFileCount;
+	stats_.hashStoreBatchCount++;
+	stats_.hashStoreLookupTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
 }
 
 static const string SDIRECTORY = "Directory";
@@ -926,6 +1022,7 @@ struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, pub
 			const string& date = getAttrib(attribs, DATE, 1);
 
 			if(!name.empty()) {
+				addPendingFiles();
 				curDirPath += name + PATH_SEPARATOR;
 
 				cur = ShareManager::Directory::createNormal(name, cur, Util::toTimeT(date), lowerDirNameMapNew, bloom);
@@ -948,15 +1045,10 @@ struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, pub
 				return;
 			}
 
-			try {
-				DualString name(fname);
-				HashedFile fi;
-				HashManager::getInstance()->getFileInfo(curDirPathLower + name.getLower(), curDirPath + fname, fi);
-				addFile(move(name), cur, fi, tthIndexNew, bloom, stats.addedSize);
-			} catch(Exception& e) {
-				stats.hashSize += File::getSize(curDirPath + fname);
-				dcdebug("Error loading file list %s \n", e.getError().c_str());
-			}
+			// Loaded when the directory changes
+			DualString name(fname);
+			pendingFiles.emplace_back(curDirPathLower + name.getLower(), curDirPath + fname, HashedFile());
+			pendingNames.push_back(move(name));
 		} else if (compare(aName, SHARE) == 0) {
 			int version = Util::toInt(getAttrib(attribs, SVERSION, 0));
 			if (version > Util::toInt(SHARE_CACHE_VERSION))
@@ -968,16 +1060,53 @@ struct ShareManager::ShareLoader : public SimpleXMLReader::ThreadedCallBack, pub
 	void endTag(const string& name) {
 		if(compare(name, SDIRECTORY) == 0) {
 			if(cur) {
+				addPendingFiles();
 				curDirPath = Util::getParentDir(curDirPath);
 				curDirPathLower = Util::getParentDir(curDirPathLower);
 				cur = cur->getParent();
 			}
+		} else if (compare(name, SHARE) == 0) {
+			addPendingFiles();
 		}
 	}
 
 private:
 	friend struct SizeSort;
 
+	// Add the files of the current directory with a single hash database lookup
+	void addPendingFiles() noexcept {
+		if (pendingFiles.empty()) {
+			return;
+		}
+
+		try {
+			lookupHashStore(stats, pendingFiles.size(), [this] {
+				HashManager::getInstance()->getFileInfos(pendingFiles);
+			});
+
+			for (size_t i = 0; i < pendingFiles.size(); ++i) {
+				const auto& f = pendingFiles[i];
+				if (f.found) {
+					addFile(move(pendingNames[i]), cur, f.fileInfo, tthIndexNew, bloom, stats.addedSize);
+				} else {
+					if (f.fileInfo.getSize() > 0) {
+						stats.hashSize += f.fileInfo.getSize();
+					}
+
+					dcdebug("Error loading file list: no hash information for %s\n", f.path.c_str());
+				}
+			}
+		} catch (const Exception& e) {
+			dcdebug("Error loading file list %s \n", e.getError().c_str());
+		}
+
+		pendingFiles.clear();
+		pendingNames.clear();
+	}
+
+	HashManager::FileInfoCheckList pendingFiles;
+	vector<DualString> pendingNames;
+
 	ShareManager::Directory::Ptr cur;
 
 	string curDirPathLower;
@@ -1125,6 +1254,23 @@ void ShareManager::Directory::countStats(time_t& totalAge_, size_t& totalDirs_,
 	totalFiles_ += files.size();
 }
 
+size_t ShareManager::Directory::countMemoryUsage(unordered_set<const TreeArena*>& arenas_) const noexcept {
+	size_t ret = sizeof(Directory) + realName.getHeapSize();
+	if (root) {
+		ret += sizeof(RootDirectory);
+	}
+
+	arenas_.insert(arena.get());
+	ret += files.capacity() * sizeof(File*);
+
+	ret += directories.capacity() * sizeof(Ptr);
+	for (const auto& d: directories) {
+		ret += d->countMemoryUsage(arenas_);
+	}
+
+	return ret;
+}
+
 void ShareManager::countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles_, size_t& lowerCaseFiles_, size_t& totalStrLen_, size_t& roots_) const noexcept{
 	RLock l(cs);
 	for (const auto& d : rootPaths | map_values) {
@@ -1135,18 +1281,34 @@ void ShareManager::countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& to
 }
 
 optional<ShareManager::ShareItemStats> ShareManager::getShareItemStats() const noexcept {
-	unordered_set<decltype(tthIndex)::key_type> uniqueTTHs;
+	ShareItemStats stats;
+	stats.profileCount = shareProfiles.size() - 1; // remove hidden
+	stats.uniqueFileCount = tthIndex.countUniqueTTHs();
 
 	{
 		RLock l(cs);
-		for (auto tth : tthIndex | map_keys) {
-			uniqueTTHs.insert(tth);
+		if (searchIndex) {
+			stats.searchIndexTokens = searchIndex->directories.getTokenCount() + searchIndex->files.getTokenCount();
+			stats.searchIndexEntries = searchIndex->directories.getEntryCount() + searchIndex->files.getEntryCount();
 		}
-	}
 
-	ShareItemStats stats;
-	stats.profileCount = shareProfiles.size() - 1; // remove hidden
-	stats.uniqueFileCount = uniqueTTHs.size();
+		unordered_set<const TreeArena*> arenas;
+		for (const auto& d : rootPaths | map_values) {
+			stats.treeMemoryUsage += d->countMemoryUsage(arenas);
+		}
+
+		for (const auto& a: arenas) {
+			stats.treeMemoryUsage += a->getMemoryUsage();
+			stats.pooledFileNames += a->getNameCount();
+		}
+
+		// Node (value, next pointer and cached hash) and bucket sizes of the hash maps
+		auto countMapUsage = [](const auto& aMap) {
+			return aMap.size() * (sizeof(typename std::decay_t<decltype(aMap)>::value_type) + sizeof(void*) + sizeof(size_t)) + aMap.bucket_count() * sizeof(void*);
+		};
+
+		stats.indexMemoryUsage = tthIndex.countMemoryUsage() + countMapUsage(lowerDirNameMap);
+	}
 
 	time_t totalAge = 0;
 	countStats(totalAge, stats.totalDirectoryCount, stats.totalSize, stats.totalFileCount, stats.lowerCaseFiles, stats.totalNameSize, stats.rootDirectoryCount);
@@ -1178,10 +1340,72 @@ ShareManager::ShareSearchStats ShareManager::getSearchMatchingStats() const noex
 
 	stats.autoSearches = autoSearches;
 	stats.tthSearches = tthSearches;
+	stats.indexedSearches = indexedSearches;
+
+	{
+		auto counts = tthLookupLatency.getCounts();
+		stats.tthLookups = LookupLatency::getTotal(counts, LookupLatency::Counts());
+		stats.tthLookupP99Us = LookupLatency::getPercentileUs(counts, LookupLatency::Counts(), 0.99);
+
+		stats.refreshTTHLookups = refreshTTHLookups;
+		stats.refreshTTHLookupP99Us = refreshTTHLookupP99Us;
+	}
+
+	{
+		RLock l(cs);
+		stats.bloomSize = bloom->getSize();
+		stats.bloomFillRatio = bloom->getFillRatio();
+		stats.bloomFalsePositiveRate = ShareBloom::getFalsePositiveRate(stats.bloomFillRatio);
+	}
 
 	return stats;
 }
 
+void ShareManager::LookupLatency::add(int64_t aNanoSeconds) noexcept {
+	size_t bucket = 0;
+	while (bucket + 1 < buckets.size() && (static_cast<int64_t>(1) << (bucket + 1)) <= aNanoSeconds) {
+		bucket++;
+	}
+
+	buckets[bucket].fetch_add(1, memory_order_relaxed);
+}
+
+ShareManager::LookupLatency::Counts ShareManager::LookupLatency::getCounts() const noexcept {
+	Counts ret;
+	for (size_t i = 0; i < buckets.size(); ++i) {
+		ret[i] = buckets[i].load(memory_order_relaxed);
+	}
+
+	return ret;
+}
+
+uint64_t ShareManager::LookupLatency::getTotal(const Counts& aCurrent, const Counts& aPrevious) noexcept {
+	uint64_t ret = 0;
+	for (size_t i = 0; i < aCurrent.size(); ++i) {
+		ret += aCurrent[i] - aPrevious[i];
+	}
+
+	return ret;
+}
+
+double ShareManager::LookupLatency::getPercentileUs(const Counts& aCurrent, const Counts& aPrevious, double aPercentile) noexcept {
+	auto total = getTotal(aCurrent, aPrevious);
+	if (total == 0) {
+		return 0;
+	}
+
+	auto wanted = static_cast<uint64_t>(ceil(static_cast<double>(total) * aPercentile));
+	uint64_t count = 0;
+	for (size_t i = 0; i < aCurrent.size(); ++i) {
+		count += aCurrent[i] - aPrevious[i];
+		if (count >= wanted) {
+			return static_cast<double>(static_cast<uint64_t>(1) << (i + 1)) / 1000.0;
+		}
+	}
+
+	return 0;
+}
+
 string ShareManager::printStats() const noexcept {
 	auto optionalItemStats = getShareItemStats();
 	if (!optionalItemStats) {
@@ -1199,7 +1423,10 @@ Total shared files: %d (of which %d%% are lowercase)\r\n\
 Unique TTHs: %d (%d%%)\r\n\
 Total shared directories: %d (%d files per directory)\r\n\
 Average age of a file: %s\r\n\
-Average name length of a shared item: %d bytes (total size %s)")
+Average name length of a shared item: %d bytes (total size %s)\r\n\
+Memory usage: %s for the directory tree, %s for the indices (%d bytes per file)\r\n\
+Pooled file names: %d (%d%% of the files)\r\n\
+Search index: %s")
 
 		% itemStats.profileCount
 		% itemStats.rootDirectoryCount
@@ -1210,6 +1437,10 @@ Average name length of a shared item: %d bytes (total size %s)")
 		% Util::formatTime(itemStats.averageFileAge, false, true)
 		% itemStats.averageNameLength
 		% Util::formatBytes(itemStats.totalNameSize)
+		% Util::formatBytes(itemStats.treeMemoryUsage) % Util::formatBytes(itemStats.indexMemoryUsage)
+		% Util::countAverage(itemStats.treeMemoryUsage + itemStats.indexMemoryUsage, itemStats.totalFileCount)
+		% itemStats.pooledFileNames % Util::countPercentage(itemStats.pooledFileNames, itemStats.totalFileCount)
+		% (searchIndex ? boost::str(boost::format("%d tokens, %d entries") % itemStats.searchIndexTokens % itemStats.searchIndexEntries) : "Disabled")
 	);
 
 	auto searchStats = getSearchMatchingStats();
@@ -1221,7 +1452,10 @@ Filtered text searches: %d%% (%d%% of the matched ones returned results)\r\n\
 Average search tokens (non-filtered only): %d (%d bytes per token)\r\n\
 Auto searches (text, ADC only): %d%%\r\n\
 Average time for matching a recursive search: %d ms\r\n\
-TTH searches: %d%% (hash bloom mode: %s)")
+Recursive searches matched by using the search index: %d%%\r\n\
+Name bloom: %s (%d%% filled, estimated false positive rate per 5-gram: %f%%)\r\n\
+TTH searches: %d%% (hash bloom mode: %s)\r\n\
+TTH lookups: %d (p99 latency %.1f us, %d lookups with p99 latency %.1f us during the previous full refresh)")
 
 		% searchStats.totalSearches % searchStats.totalSearchesPerSecond
 		% searchStats.recursiveSearches % searchStats.unfilteredRecursiveSearchesPerSecond
@@ -1229,8 +1463,11 @@ TTH searches: %d%% (hash bloom mode: %s)")
 		% searchStats.averageSearchTokenCount  % searchStats.averageSearchTokenLength
 		% Util::countAverage(searchStats.autoSearches, searchStats.recursiveSearches)
 		% searchStats.averageSearchMatchMs
+		% Util::countPercentage(searchStats.indexedSearches, searchStats.recursiveSearches - searchStats.filteredSearches)
+		% Util::formatBytes(searchStats.bloomSize / 8) % (searchStats.bloomFillRatio * 100.0) % (searchStats.bloomFalsePositiveRate * 100.0)
 		% Util::countPercentage(searchStats.tthSearches, searchStats.totalSearches)
 		% (SETTING(BLOOM_MODE) != SettingsManager::BLOOM_DISABLED ? "Enabled" : "Disabled") // bloom mode
+		% searchStats.tthLookups % searchStats.tthLookupP99Us % searchStats.refreshTTHLookups % searchStats.refreshTTHLookupP99Us
 	);
 
 	return ret;
@@ -1420,35 +1657,78 @@ ShareManager::Directory::Ptr ShareManager::Directory::findDirectoryByName(const
 }
 
 bool ShareManager::isFileShared(const TTHValue& aTTH) const noexcept{
-	RLock l (cs);
-	return tthIndex.find(const_cast<TTHValue*>(&aTTH)) != tthIndex.end();
+	LookupLatency::Timer t(tthLookupLatency);
+	return tthIndex.contains(aTTH);
 }
 
 bool ShareManager::isFileShared(const TTHValue& aTTH, ProfileToken aProfile) const noexcept{
-	RLock l (cs);
-	const auto files = tthIndex.equal_range(const_cast<TTHValue*>(&aTTH));
-	for(auto i = files.first; i != files.second; ++i) {
-		if(i->second->getParent()->hasProfile(aProfile)) {
-			return true;
-		}
-	}
+	LookupLatency::Timer t(tthLookupLatency);
 
-	return false;
+	return tthIndex.find(aTTH, [&](const Directory::File* f) {
+		return f->getParent()->hasProfile(aProfile);
+	}) != nullptr;
 }
 
 bool ShareManager::RefreshInfo::checkContent(const Directory::Ptr& aDirectory) noexcept {
 	if (SETTING(SKIP_EMPTY_DIRS_SHARE) && aDirectory->getDirectories().empty() && aDirectory->files.empty()) {
 		// Remove from parent
-		Directory::cleanIndices(*aDirectory.get(), stats.addedSize, tthIndexNew, lowerDirNameMapNew);
+		Directory::cleanIndices(*aDirectory.get(), stats.addedSize, &tthIndexNew, lowerDirNameMapNew);
 		return false;
 	}
 
 	return true;
 }
 
-ShareManager::ShareBuilder::ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, ShareManager* aSm) :
-	sm(*aSm), RefreshInfo(aPath, aOldRoot, aLastWrite, bloom_) {
+ShareManager::ShareBuilder::ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, const ShareManager* aSm, const RefreshPathList* aChangedDirs, int aSplitDepth, HashFileMap* aFileIndex, const TreeArenaPtr& aArena) :
+	sm(*aSm), RefreshInfo(aPath, aOldRoot, aLastWrite, bloom_, aArena), changedDirs(aChangedDirs), splitDepth(aSplitDepth), fileIndex(aFileIndex ? *aFileIndex : tthIndexNew) {
+
+}
+
+bool ShareManager::ShareBuilder::hasChanges(const string& aPath) const noexcept {
+	if (!changedDirs) {
+		return true;
+	}
 
+	// Subdirectories follow their parents in the sorted list
+	auto i = changedDirs->lower_bound(aPath);
+	return i != changedDirs->end() && i->compare(0, aPath.size(), aPath) == 0;
+}
+
+void ShareManager::ShareBuilder::copyTree(const Directory::Ptr& aOldDirectory, const Directory::Ptr& aDirectory, const bool& aStopping) {
+	vector<pair<string, HashedFile>> files;
+	vector<tuple<Directory::Ptr, string, time_t>> directories;
+
+	// The current tree may be modified by hashing while we are copying it
+	{
+		RLock l(sm.cs);
+		for (const auto& f: aOldDirectory->files) {
+			files.emplace_back(f->name.getNormal(), HashedFile(f->getTTH(), f->getLastWrite(), f->getSize()));
+		}
+
+		for (const auto& d: aOldDirectory->getDirectories()) {
+			directories.emplace_back(d, d->realName.getNormal(), d->getLastWrite());
+		}
+	}
+
+	for (const auto& f: files) {
+		addFile(DualString(f.first), aDirectory, f.second, fileIndex, bloom, stats.addedSize);
+		stats.existingFileCount++;
+	}
+
+	for (const auto& d: directories) {
+		if (aStopping) {
+			return;
+		}
+
+		auto curDir = Directory::createNormal(DualString(get<1>(d)), aDirectory, get<2>(d), lowerDirNameMapNew, bloom);
+		if (curDir) {
+			copyTree(get<0>(d), curDir, aStopping);
+			if (checkContent(curDir)) {
+				stats.existingDirectoryCount++;
+				stats.reusedDirectoryCount++;
+			}
+		}
+	}
 }
 
 bool ShareManager::ShareBuilder::buildTree(const bool& aStopping) noexcept {
@@ -1462,22 +1742,55 @@ bool ShareManager::ShareBuilder::buildTree(const bool& aStopping) noexcept {
 		return false;
 	}
 
-	return !aStopping;
+	return !aStopping && !failed;
+}
+
+void ShareManager::ShareBuilder::mergeSubtree(Subtree& aSubtree, const Directory::Ptr& aParent) noexcept {
+	auto& subtree = *aSubtree.builder;
+	if (!aSubtree.succeed) {
+		failed = true;
+		return;
+	}
+
+	if (!subtree.checkContent(subtree.newShareDirectory)) {
+		stats.merge(subtree.stats);
+		return;
+	}
+
+	// The modification date was set when listing the parent
+	// Conflicting names have been filtered before scanning the subtrees
+	if (!Directory::setParent(subtree.newShareDirectory, aParent, false)) {
+		dcassert(0);
+		return;
+	}
+
+	stats.merge(subtree.stats);
+	lowerDirNameMapNew.insert(subtree.lowerDirNameMapNew.begin(), subtree.lowerDirNameMapNew.end());
+
+	if (aSubtree.isNew) {
+		stats.newDirectoryCount++;
+	} else {
+		stats.existingDirectoryCount++;
+	}
+}
+
+void ShareManager::ShareBuilder::reportBlockedItem(const ShareValidatorException& e, const string& aPath, bool aIsDirectory, ErrorCollector& aErrorCollector) const noexcept {
+	if (SETTING(REPORT_BLOCKED_SHARE) && ShareValidatorException::isReportableError(e.getType())) {
+		if (aIsDirectory) {
+			log(STRING_F(SHARE_DIRECTORY_BLOCKED, aPath % e.getError()), LogMessage::SEV_INFO);
+		} else {
+			aErrorCollector.add(e.getError(), Util::getFileName(aPath), false);
+		}
+	}
+
+	dcdebug("Item %s won't be shared: %s\n", aPath.c_str(), e.what());
 }
 
 bool ShareManager::ShareBuilder::validateFileItem(const FileItemInfoBase& aFileItem, const string& aPath, bool aIsNew, bool aNewParent, ErrorCollector& aErrorCollector) noexcept {
 	try {
 		sm.validator->validateHooked(aFileItem, aPath, false, &sm, aIsNew, aNewParent);
 	} catch (const ShareValidatorException& e) {
-		if (SETTING(REPORT_BLOCKED_SHARE) && ShareValidatorException::isReportableError(e.getType())) {
-			if (aFileItem.isDirectory()) {
-				log(STRING_F(SHARE_DIRECTORY_BLOCKED, aPath % e.getError()), LogMessage::SEV_INFO);
-			} else {
-				aErrorCollector.add(e.getError(), Util::getFileName(aPath), false);
-			}
-		}
-
-		dcdebug("Item %s won't be shared: %s\n", aPath.c_str(), e.what());
+		reportBlockedItem(e, aPath, aFileItem.isDirectory(), aErrorCollector);
 		return false;
 	} catch (...) {
 		return false;
@@ -1486,13 +1799,68 @@ bool ShareManager::ShareBuilder::validateFileItem(const FileItemInfoBase& aFileI
 	return true;
 }
 
+void ShareManager::ShareBuilder::validateContentHooked(const string& aPath, bool aNewDirectory, PendingDirectoryList& directories_, PendingFileList& files_, ErrorCollector& aErrorCollector) noexcept {
+	if (!sm.validator->directoryContentValidationHook.hasSubscribers()) {
+		return;
+	}
+
+	ShareValidationItemList items;
+	items.reserve(directories_.size() + files_.size());
+	for (const auto& d: directories_) {
+		items.emplace_back(d.name.getNormal(), -1, true, !d.oldDirectory);
+	}
+
+	for (const auto& f: files_) {
+		items.emplace_back(f.name.getNormal(), f.size, false, f.isNew);
+	}
+
+	auto rejections = sm.validator->validateDirectoryContentHooked(aPath, items, aNewDirectory, &sm);
+	if (rejections.empty()) {
+		return;
+	}
+
+	auto isRejected = [&](const string& aName, const string& aItemPath, bool aIsDirectory) {
+		auto i = rejections.find(aName);
+		if (i == rejections.end()) {
+			return false;
+		}
+
+		reportBlockedItem(ShareValidatorException(ActionHookRejection::formatError(i->second), ShareValidatorErrorType::TYPE_HOOK), aItemPath, aIsDirectory, aErrorCollector);
+		return true;
+	};
+
+	auto removedDirectories = boost::remove_if(directories_, [&](const PendingDirectory& d) {
+		return isRejected(d.name.getNormal(), d.path, true);
+	});
+
+	stats.skippedDirectoryCount += distance(removedDirectories, directories_.end());
+	directories_.erase(removedDirectories, directories_.end());
+
+	auto removedFiles = boost::remove_if(files_, [&](const PendingFile& f) {
+		return isRejected(f.name.getNormal(), f.path, false);
+	});
+
+	stats.skippedFileCount += distance(removedFiles, files_.end());
+	files_.erase(removedFiles, files_.end());
+}
+
 void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aParent, const Directory::Ptr& aOldParent, const bool& aStopping) {
+	// Watch the directory before listing it so that changes made during the scan will be refreshed afterwards
+	// (the watches of reused subdirectories have been added by earlier refreshes)
+	if (sm.monitor) {
+		sm.monitor->addDirectory(aPath);
+	}
+
+	// The directory is listed and validated first so that the validation hooks can be run for the whole content at once
+	PendingDirectoryList directories;
+	PendingFileList files;
+
 	ErrorCollector errors;
 	FileFindIter end;
 	for(FileFindIter i(aPath, "*"); i != end && !aStopping; ++i) {
 		const auto name = i->getFileName();
 		if(name.empty()) {
-			return;
+			break;
 		}
 
 		const auto isDirectory = i->isDirectory();
@@ -1515,68 +1883,142 @@ void ShareManager::ShareBuilder::buildTree(const string& aPath, const string& aP
 				}
 			}
 
-			auto isNew = !oldDir;
+			// Validations
+			auto newParent = !aOldParent;
+			if (!validateFileItem(*i, curPath, !oldDir, newParent, errors)) {
+				stats.skippedDirectoryCount++;
+				continue;
+			}
+
+			directories.push_back({ move(dualName), move(curPath), move(curPathLower), i->getLastWriteTime(), oldDir });
+		} else {
+			// Not a directory, assume it's a file...
+
+			// Check whether it's shared already
+			auto isNew = !aOldParent;
+			if (aOldParent) {
+				RLock l(sm.cs);
+				auto fileIter = aOldParent->files.find(dualName.getLower());
+				isNew = fileIter == aOldParent->files.end();
+			}
 
 			// Validations
-			{
-				auto newParent = !aOldParent;
-				if (!validateFileItem(*i, curPath, isNew, newParent, errors)) {
-					stats.skippedDirectoryCount++;
-					continue;
-				}
+			auto newParent = !aOldParent;
+			if (!validateFileItem(*i, curPath, isNew, newParent, errors)) {
+				stats.skippedFileCount++;
+				continue;
+			}
+
+			files.push_back({ move(dualName), move(curPath), move(curPathLower), i->getLastWriteTime(), i->getSize(), isNew });
+		}
+	}
+
+	if (aStopping) {
+		return;
+	}
 
+	validateContentHooked(aPath, !aOldParent, directories, files, errors);
+
+	{
+		// Subdirectories of the top level are scanned in tasks of their own (and they will split their subdirectories further)
+		// The subtrees are merged in listing order after all subdirectories have been handled
+		deque<Subtree> subtrees;
+		unique_ptr<task_group> subtreeTasks;
+		if (splitDepth > 0 && aParent == newShareDirectory) {
+			subtreeTasks = make_unique<task_group>();
+
+			// Subtrees with a duplicate name (case-sensitive file systems) would be rejected only after they have been scanned
+			// Only the first one is shared, same as when scanning the directories in this task
+			unordered_set<string> names;
+			directories.erase(remove_if(directories.begin(), directories.end(), [&](const PendingDirectory& d) {
+				return !names.insert(d.name.getLower()).second;
+			}), directories.end());
+		}
+
+		auto subtreeSplitDepth = directories.size() > PARALLEL_SPLIT_MAX_DIRECTORIES ? 0 : splitDepth - 1;
+
+		ScopedFunctor([&] {
+			if (subtreeTasks) {
+				subtreeTasks->wait();
+			}
+		});
+
+		for (auto& d: directories) {
+			if (aStopping) {
+				break;
+			}
+
+			auto isNew = !d.oldDirectory;
+			auto reuse = !isNew && !hasChanges(d.path);
+			if (subtreeTasks && !reuse) {
+				subtrees.push_back({ std::make_shared<ShareBuilder>(d.path, d.oldDirectory, d.lastWrite, bloom, &sm, changedDirs, subtreeSplitDepth, &fileIndex, arena), isNew, false });
+
+				auto subtree = &subtrees.back();
+				subtreeTasks->run([subtree, &aStopping] {
+					subtree->succeed = subtree->builder->buildTree(aStopping);
+				});
+				continue;
 			}
 
 			// Add it
-			auto curDir = Directory::createNormal(move(dualName), aParent, i->getLastWriteTime(), lowerDirNameMapNew, bloom);
+			auto curDir = Directory::createNormal(move(d.name), aParent, d.lastWrite, lowerDirNameMapNew, bloom);
 			if (curDir) {
-				buildTree(curPath, curPathLower, curDir, oldDir, aStopping);
+				if (reuse) {
+					// Nothing has changed inside it, there's no need to scan it
+					copyTree(d.oldDirectory, curDir, aStopping);
+				} else {
+					buildTree(d.path, d.pathLower, curDir, d.oldDirectory, aStopping);
+				}
+
 				if (checkContent(curDir)) {
 					if (isNew) {
 						stats.newDirectoryCount++;
 					} else {
 						stats.existingDirectoryCount++;
+						if (reuse) {
+							stats.reusedDirectoryCount++;
+						}
 					}
 				}
 			}
-		} else {
-			// Not a directory, assume it's a file...
+		}
 
-			{
-				// Check whether it's shared already
-				auto isNew = !aOldParent;
-				if (aOldParent) {
-					RLock l(sm.cs);
-					auto fileIter = aOldParent->files.find(dualName.getLower());
-					isNew = fileIter == aOldParent->files.end();
-				}
+		if (subtreeTasks) {
+			subtreeTasks->wait();
+			for (auto& subtree: subtrees) {
+				mergeSubtree(subtree, aParent);
+			}
+		}
+	}
 
+	if (!files.empty() && !aStopping) {
+		// The hash information of all files is loaded with a single lookup
+		HashManager::FileInfoCheckList fileChecks;
+		fileChecks.reserve(files.size());
+		for (auto& f: files) {
+			if (f.isNew) {
+				stats.newFileCount++;
+			} else {
+				stats.existingFileCount++;
+			}
 
-				// Validations
-				auto newParent = !aOldParent;
-				if (!validateFileItem(*i, curPath, isNew, newParent, errors)) {
-					stats.skippedFileCount++;
-					continue;
-				}
+			fileChecks.emplace_back(move(f.pathLower), move(f.path), HashedFile(f.lastWrite, f.size));
+		}
 
-				if (isNew) {
-					stats.newFileCount++;
-				} else {
-					stats.existingFileCount++;
-				}
-			}
+		try {
+			lookupHashStore(stats, fileChecks.size(), [&] {
+				HashManager::getInstance()->checkTTHs(fileChecks);
+			});
 
-			// Add it
-			auto size = i->getSize();
-			try {
-				HashedFile fi(i->getLastWriteTime(), size);
-				if(HashManager::getInstance()->checkTTH(aPathLower + dualName.getLower(), aPath + name, fi)) {
-					addFile(move(dualName), aParent, fi, tthIndexNew, bloom, stats.addedSize);
+			for (size_t i = 0; i < fileChecks.size(); ++i) {
+				const auto& f = fileChecks[i];
+				if (f.found) {
+					addFile(move(files[i].name), aParent, f.fileInfo, fileIndex, bloom, stats.addedSize);
 				} else {
-					stats.hashSize += size;
+					stats.hashSize += f.fileInfo.getSize();
 				}
-			} catch(const HashException&) {
 			}
+		} catch (const HashException&) {
 		}
 	}
 
@@ -1599,9 +2041,7 @@ void ShareManager::checkAddedDirNameDebug(const Directory::Ptr& aDir, Directory:
 }
 
 void ShareManager::checkAddedTTHDebug(const Directory::File* aFile, HashFileMap& aTTHIndex) noexcept {
-	auto flst = aTTHIndex.equal_range(const_cast<TTHValue*>(&aFile->getTTH()));
-	auto p = find(flst | map_values, aFile);
-	dcassert(p.base() == flst.second);
+	dcassert(!aTTHIndex.find(aFile->getTTH(), [&](const Directory::File* f) { return f == aFile; }));
 }
 
 void ShareManager::validateDirectoryTreeDebug() noexcept {
@@ -1620,9 +2060,9 @@ void ShareManager::validateDirectoryTreeDebug() noexcept {
 	StringList filesDiff, directoriesDiff;
 	if (files.size() != tthIndex.size()) {
 		OrderedStringSet indexed;
-		for (const auto& f : tthIndex | map_values) {
+		tthIndex.forEach([&](const Directory::File* f) {
 			indexed.insert(f->getRealPath());
-		}
+		});
 
 		set_symmetric_difference(files.begin(), files.end(), indexed.begin(), indexed.end(), back_inserter(filesDiff));
 	}
@@ -1658,10 +2098,15 @@ void ShareManager::validateDirectoryRecursiveDebug(const Directory::Ptr& aDir, O
 
 	int64_t realDirectorySize = 0;
 	for (const auto& f : aDir->files) {
-		auto flst = tthIndex.equal_range(const_cast<TTHValue*>(&f->getTTH()));
-		dcassert(boost::count_if(flst | map_values, [&](const Directory::File* aFile) {
-			return aFile->getRealPath() == f->getRealPath();
-		}) == 1);
+		int matches = 0;
+		tthIndex.forEach(f->getTTH(), [&](const Directory::File* aFile) {
+			if (aFile->getRealPath() == f->getRealPath()) {
+				matches++;
+			}
+
+			return true;
+		});
+		dcassert(matches == 1);
 
 		dcassert(bloom->match(f->name.getLower()));
 		auto res = filePaths_.insert(f->getRealPath());
@@ -1715,8 +2160,8 @@ ShareManager::RefreshTaskQueueInfo ShareManager::refresh(ShareRefreshType aType,
 	return addRefreshTask(aPriority, dirs, aType, Util::emptyString, progressF);
 }
 
-ShareRefreshTask::ShareRefreshTask(ShareRefreshTaskToken aToken, const RefreshPathList& aDirs, const string& aDisplayName, ShareRefreshType aRefreshType, ShareRefreshPriority aPriority) :
-	token(aToken), dirs(aDirs), displayName(aDisplayName), type(aRefreshType), priority(aPriority) { }
+ShareRefreshTask::ShareRefreshTask(ShareRefreshTaskToken aToken, const RefreshPathList& aDirs, const string& aDisplayName, ShareRefreshType aRefreshType, ShareRefreshPriority aPriority, const RefreshPathList& aChangedDirs) :
+	token(aToken), dirs(aDirs), displayName(aDisplayName), type(aRefreshType), priority(aPriority), changedDirs(aChangedDirs) { }
 
 void ShareManager::addAsyncTask(AsyncF aF) noexcept {
 	tasks.add(ASYNC, make_unique<AsyncTask>(aF));
@@ -1750,10 +2195,11 @@ void ShareManager::validateRefreshTask(StringList& dirs_) noexcept {
 	const auto& tq = tasks.getTasks();
 
 	// Remove the exact directories that have already been queued for refreshing
+	// (monitoring tasks don't scan all directories inside the paths)
 	for (const auto& i : tq) {
 		if (i.first != ASYNC) {
 			auto t = static_cast<ShareRefreshTask*>(i.second.get());
-			if (!t->canceled) {
+			if (!t->canceled && t->type != ShareRefreshType::MONITORING) {
 				dirs_.erase(
 					boost::remove_if(dirs_, [t](const string& p) {
 						return boost::find(t->dirs, p) != t->dirs.end();
@@ -1797,7 +2243,7 @@ void ShareManager::reportPendingRefresh(ShareRefreshType aType, const RefreshPat
 	}
 }
 
-ShareManager::RefreshTaskQueueInfo ShareManager::addRefreshTask(ShareRefreshPriority aPriority, const StringList& aDirs, ShareRefreshType aRefreshType, const string& aDisplayName, function<void(float)> aProgressF) noexcept {
+ShareManager::RefreshTaskQueueInfo ShareManager::addRefreshTask(ShareRefreshPriority aPriority, const StringList& aDirs, ShareRefreshType aRefreshType, const string& aDisplayName, function<void(float)> aProgressF, const RefreshPathList& aChangedDirs) noexcept {
 	/*if (aDirs.empty()) {
 		return {
 			nullopt,
@@ -1824,7 +2270,7 @@ ShareManager::RefreshTaskQueueInfo ShareManager::addRefreshTask(ShareRefreshPrio
 
 
 	{
-		auto task = make_unique<ShareRefreshTask>(token, paths, aDisplayName, aRefreshType, aPriority);
+		auto task = make_unique<ShareRefreshTask>(token, paths, aDisplayName, aRefreshType, aPriority, aChangedDirs);
 		fire(ShareManagerListener::RefreshQueued(), *task.get());
 
 		tasks.add(TaskType::REFRESH, std::move(task));
@@ -1961,7 +2407,10 @@ bool ShareManager::addRootDirectory(const ShareDirectoryInfoPtr& aDirectoryInfo)
 			dcassert(find_if(rootPaths | map_keys, IsParentOrExact(path, PATH_SEPARATOR)).base() == rootPaths.end());
 
 			// It's a new parent, will be handled in the task thread
-			Directory::createRoot(path, aDirectoryInfo->virtualName, aDirectoryInfo->profiles, aDirectoryInfo->incoming, File::getLastModified(path), rootPaths, lowerDirNameMap, *bloom.get(), 0);
+			auto root = Directory::createRoot(path, aDirectoryInfo->virtualName, aDirectoryInfo->profiles, aDirectoryInfo->incoming, File::getLastModified(path), rootPaths, lowerDirNameMap, *bloom.get(), 0);
+			if (searchIndex) {
+				searchIndex->addDirectory(root.get());
+			}
 		}
 	}
 
@@ -1994,11 +2443,16 @@ bool ShareManager::removeRootDirectory(const string& aPath) noexcept {
 		rootPaths.erase(k);
 
 		// Remove the root
-		Directory::cleanIndices(*sd, sharedSize, tthIndex, lowerDirNameMap);
+		Directory::cleanIndices(*sd, sharedSize, &tthIndex, lowerDirNameMap, searchIndex.get());
+		if (searchIndex) {
+			searchIndex->flush();
+		}
+
 		File::deleteFile(sd->getRoot()->getCacheXmlPath());
 	}
 
 	HashManager::getInstance()->stopHashing(aPath);
+	updateMonitoring(aPath);
 
 	log(STRING_F(SHARED_DIR_REMOVED, aPath), LogMessage::SEV_INFO);
 
@@ -2035,8 +2489,16 @@ bool ShareManager::updateRootDirectory(const ShareDirectoryInfoPtr& aDirectoryIn
 			dirtyProfiles.insert(rootDirectory->getRootProfiles().begin(), rootDirectory->getRootProfiles().end());
 
 			removeDirName(*p->second, lowerDirNameMap);
+			if (searchIndex) {
+				searchIndex->removeDirectory(p->second.get());
+			}
+
 			rootDirectory->setName(vName);
+
 			addDirName(p->second, lowerDirNameMap, *bloom.get());
+			if (searchIndex) {
+				searchIndex->addDirectory(p->second.get());
+			}
 
 			rootDirectory->setIncoming(aDirectoryInfo->incoming);
 			rootDirectory->setRootProfiles(aDirectoryInfo->profiles);
@@ -2100,6 +2562,10 @@ void ShareManager::reportTaskStatus(const ShareRefreshTask& aTask, bool aFinishe
 			if (aFinished)
 				msg = STRING_F(BUNDLE_X_SHARED, aTask.displayName); //show the whole path so that it can be opened from the system log
 			break;
+		case(ShareRefreshType::MONITORING):
+			if (aFinished)
+				msg = STRING_F(SHARE_CHANGES_REFRESHED, aTask.changedDirs.size());
+			break;
 	};
 
 	if (!msg.empty()) {
@@ -2119,19 +2585,22 @@ int ShareManager::run() {
 }
 
 ShareManager::RefreshInfo::~RefreshInfo() {
-
+	if (ownArena) {
+		// Files may still be added in the tree after it has been applied but the name index isn't needed anymore
+		arena->finishBuild();
+	}
 }
 
-ShareManager::RefreshInfo::RefreshInfo(const string& aPath, const Directory::Ptr& aOldShareDirectory, time_t aLastWrite, ShareBloom& bloom_) :
-	path(aPath), oldShareDirectory(aOldShareDirectory), bloom(bloom_) {
+ShareManager::RefreshInfo::RefreshInfo(const string& aPath, const Directory::Ptr& aOldShareDirectory, time_t aLastWrite, ShareBloom& bloom_, const TreeArenaPtr& aArena) :
+	path(aPath), oldShareDirectory(aOldShareDirectory), bloom(bloom_), arena(aArena ? aArena : std::make_shared<TreeArena>()), ownArena(!aArena) {
 
 	// Use a different directory for building the tree
 	if (aOldShareDirectory && aOldShareDirectory->getRoot()) {
 		newShareDirectory = Directory::createRoot(aPath, aOldShareDirectory->getVirtualName(), aOldShareDirectory->getRoot()->getRootProfiles(), aOldShareDirectory->getRoot()->getIncoming(),
-			aLastWrite, rootPathsNew, lowerDirNameMapNew, bloom_, aOldShareDirectory->getRoot()->getLastRefreshTime());
+			aLastWrite, rootPathsNew, lowerDirNameMapNew, bloom_, aOldShareDirectory->getRoot()->getLastRefreshTime(), arena);
 	} else {
 		// We'll set the parent later
-		newShareDirectory = Directory::createNormal(Util::getLastDir(aPath), nullptr, aLastWrite, lowerDirNameMapNew, bloom_);
+		newShareDirectory = Directory::createNormal(Util::getLastDir(aPath), nullptr, aLastWrite, lowerDirNameMapNew, bloom_, arena);
 	}
 }
 
@@ -2191,14 +2660,22 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 
 	ShareBuilderSet refreshDirs;
 
-	ShareBloom* refreshBloom = aTask.type == ShareRefreshType::REFRESH_ALL ? new ShareBloom(1 << 20) : bloom.get();
+	ShareBloom* refreshBloom = bloom.get();
+
+	// Large roots are split in subdirectory tasks as well
+	auto multithreaded = SETTING(REFRESH_THREADING) == SettingsManager::MULTITHREAD_ALWAYS || (SETTING(REFRESH_THREADING) == SettingsManager::MULTITHREAD_MANUAL && aTask.priority == ShareRefreshPriority::MANUAL);
 
 	// Get refresh infos for each path
 	{
 		RLock l(cs);
+		if (aTask.type == ShareRefreshType::REFRESH_ALL) {
+			refreshBloom = new ShareBloom(getBloomSize());
+		}
+
 		for (auto& refreshPath : dirs) {
 			auto directory = findDirectory(refreshPath);
-			refreshDirs.insert(std::make_shared<ShareBuilder>(refreshPath, directory, File::getLastModified(refreshPath), *refreshBloom, this));
+			refreshDirs.insert(std::make_shared<ShareBuilder>(refreshPath, directory, File::getLastModified(refreshPath), *refreshBloom, this,
+				aTask.type == ShareRefreshType::MONITORING ? &aTask.changedDirs : nullptr, multithreaded ? ShareBuilder::PARALLEL_SPLIT_DEPTH : 0));
 		}
 	}
 
@@ -2213,6 +2690,9 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 	// Refresh
 	atomic<long> progressCounter(0);
 
+	// Collect the TTH lookup latency during full refreshes
+	auto lookupCountsStart = tthLookupLatency.getCounts();
+
 	ShareRefreshStats totalStats;
 	// int64_t totalHash = 0;
 	ProfileTokenSet dirtyProfiles;
@@ -2233,6 +2713,7 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 					applyRefreshChanges(ri, &dirtyProfiles);
 				}
 
+				updateMonitoring(ri.path);
 				totalStats.merge(ri.stats);
 			} else {
 				allBuildersSucceed = false;
@@ -2252,7 +2733,7 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 	};
 
 	try {
-		if (SETTING(REFRESH_THREADING) == SettingsManager::MULTITHREAD_ALWAYS || (SETTING(REFRESH_THREADING) == SettingsManager::MULTITHREAD_MANUAL && aTask.priority == ShareRefreshPriority::MANUAL)) {
+		if (multithreaded) {
 			TaskScheduler s;
 			parallel_for_each(refreshDirs.begin(), refreshDirs.end(), doRefresh);
 		} else {
@@ -2264,16 +2745,30 @@ void ShareManager::runRefreshTask(const ShareRefreshTask& aTask, function<void(f
 	}
 
 	if (allBuildersSucceed) {
-		if (aTask.type == ShareRefreshType::REFRESH_ALL) {
-			// Reset the bloom so that removed files are nulled (which won't happen with partial refreshes)
-
+		{
 			WLock l(cs);
-			bloom.reset(refreshBloom);
+			if (aTask.type == ShareRefreshType::REFRESH_ALL) {
+				// Reset the bloom so that removed files are nulled (which won't happen with partial refreshes)
+				bloom.reset(refreshBloom);
+			} else if (getBloomSize() > bloom->getSize() * 2) {
+				// The bloom can't be grown and it would become too crowded
+				rebuildBloom();
+			}
 		}
 
 		setProfilesDirty(dirtyProfiles, aTask.priority == ShareRefreshPriority::MANUAL || aTask.type == ShareRefreshType::REFRESH_ALL || aTask.type == ShareRefreshType::BUNDLE);
 	}
 
+	if (aTask.type == ShareRefreshType::REFRESH_ALL) {
+		auto lookupCounts = tthLookupLatency.getCounts();
+		refreshTTHLookups = LookupLatency::getTotal(lookupCounts, lookupCountsStart);
+		refreshTTHLookupP99Us = LookupLatency::getPercentileUs(lookupCounts, lookupCountsStart, 0.99);
+		dcdebug("TTH lookups during the refresh: " U64_FMT " (p99 latency %.1f us)\n", refreshTTHLookups.load(), refreshTTHLookupP99Us.load());
+	}
+
+	dcdebug("Hash database lookups during the refresh: %d files in %d batches (" U64_FMT " us)\n",
+		static_cast<int>(totalStats.hashStoreLookupCount), static_cast<int>(totalStats.hashStoreBatchCount), totalStats.hashStoreLookupTimeUs);
+
 	reportTaskStatus(aTask, true, &totalStats);
 	fire(ShareManagerListener::RefreshCompleted(), aTask, allBuildersSucceed, totalStats);
 }
@@ -2290,21 +2785,37 @@ void ShareRefreshStats::merge(const ShareRefreshStats& aOther) noexcept {
 
 	existingFileCount += aOther.existingFileCount;
 	existingDirectoryCount += aOther.existingDirectoryCount;
+
+	reusedDirectoryCount += aOther.reusedDirectoryCount;
+
+	hashStoreLookupCount += aOther.hashStoreLookupCount;
+	hashStoreBatchCount += aOther.hashStoreBatchCount;
+	hashStoreLookupTimeUs += aOther.hashStoreLookupTimeUs;
 }
 
-void ShareManager::RefreshInfo::applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles_) noexcept {
+void ShareManager::RefreshInfo::applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles_, SearchIndex* searchIndex_) noexcept {
 #ifdef _DEBUG
 	for (const auto& d: lowerDirNameMapNew | map_values) {
 		checkAddedDirNameDebug(d, lowerDirNameMap_);
 	}
 
-	for (const auto& f : tthIndexNew | map_values) {
+	tthIndexNew.forEach([&](const Directory::File* f) {
 		checkAddedTTHDebug(f, tthIndex_);
-	}
+	});
 #endif
 
 	lowerDirNameMap_.insert(lowerDirNameMapNew.begin(), lowerDirNameMapNew.end());
-	tthIndex_.insert(tthIndexNew.begin(), tthIndexNew.end());
+	tthIndex_.insert(tthIndexNew);
+
+	if (searchIndex_) {
+		for (const auto& d : lowerDirNameMapNew | map_values) {
+			searchIndex_->addDirectory(d.get());
+		}
+
+		tthIndexNew.forEach([&](const Directory::File* f) {
+			searchIndex_->addFile(f);
+		});
+	}
 
 	for (const auto& rp : rootPathsNew) {
 		//dcassert(rootPaths_.find(rp.first) == rootPaths_.end());
@@ -2398,7 +2909,23 @@ bool ShareManager::abortRefresh(optional<ShareRefreshTaskToken> aToken) noexcept
 bool ShareManager::applyRefreshChanges(RefreshInfo& ri, ProfileTokenSet* aDirtyProfiles) {
 	Directory::Ptr parent = nullptr;
 
-	// Recursively remove the content of this dir from TTHIndex and directory name map
+	// Purge the removed items from the search index
+	ScopedFunctor([this] {
+		if (searchIndex) {
+			searchIndex->flush();
+		}
+	});
+
+	// TTH lookups don't use the share lock, keep the old files in the TTH index until the new ones have been added
+	// so that the files existing in both trees won't be seen as unshared
+	Directory::Ptr removedDirectory;
+	ScopedFunctor([&] {
+		if (removedDirectory) {
+			Directory::cleanTTHIndex(*removedDirectory, tthIndex);
+		}
+	});
+
+	// Recursively remove the content of this dir from the directory name map
 	if (ri.oldShareDirectory) {
 		// Root removed while refreshing?
 		if (ri.oldShareDirectory->isRoot() && rootPaths.find(ri.path) == rootPaths.end()) {
@@ -2408,7 +2935,8 @@ bool ShareManager::applyRefreshChanges(RefreshInfo& ri, ProfileTokenSet* aDirtyP
 		parent = ri.oldShareDirectory->getParent();
 
 		// Remove the old directory
-		Directory::cleanIndices(*ri.oldShareDirectory, sharedSize, tthIndex, lowerDirNameMap);
+		Directory::cleanIndices(*ri.oldShareDirectory, sharedSize, nullptr, lowerDirNameMap, searchIndex.get());
+		removedDirectory = ri.oldShareDirectory;
 	}
 
 	// Set the parent for refreshed subdirectories
@@ -2433,16 +2961,169 @@ bool ShareManager::applyRefreshChanges(RefreshInfo& ri, ProfileTokenSet* aDirtyP
 		}
 	}
 
-	ri.applyRefreshChanges(lowerDirNameMap, rootPaths, tthIndex, sharedSize, aDirtyProfiles);
+	ri.applyRefreshChanges(lowerDirNameMap, rootPaths, tthIndex, sharedSize, aDirtyProfiles, searchIndex.get());
 	dcdebug("Share changes applied for the directory %s\n", ri.path.c_str());
 	return true;
 }
 
+void ShareManager::startMonitoring() noexcept {
+	if (!ShareMonitor::isSupported()) {
+		log(STRING(SHARE_MONITORING_NOT_SUPPORTED), LogMessage::SEV_WARNING);
+		return;
+	}
+
+	try {
+		monitor = make_unique<ShareMonitor>();
+	} catch (const Exception& e) {
+		log(STRING_F(SHARE_MONITORING_FAILED, e.getError()), LogMessage::SEV_WARNING);
+		return;
+	}
+
+	StringList roots;
+	getRootPaths(roots);
+	for (const auto& path: roots) {
+		updateMonitoring(path);
+	}
+
+	auto failed = monitor->getFailedCount();
+	if (failed > 0) {
+		log(STRING_F(SHARE_MONITORING_WATCHES_FAILED, failed), LogMessage::SEV_WARNING);
+	}
+}
+
+void ShareManager::updateMonitoring(const string& aPath) noexcept {
+	if (!monitor) {
+		return;
+	}
+
+	StringList paths;
+
+	{
+		RLock l(cs);
+		auto directory = findDirectory(aPath);
+		if (directory) {
+			std::function<void(const Directory::Ptr&, const string&)> addPaths;
+			addPaths = [&](const Directory::Ptr& aDirectory, const string& aDirectoryPath) {
+				paths.push_back(aDirectoryPath);
+				for (const auto& d: aDirectory->getDirectories()) {
+					addPaths(d, aDirectoryPath + d->realName.getNormal() + PATH_SEPARATOR);
+				}
+			};
+
+			addPaths(directory, aPath);
+		}
+	}
+
+	monitor->setDirectories(aPath, paths);
+}
+
+RefreshPathList ShareManager::findModifiedDirectories() const noexcept {
+	vector<pair<string, time_t>> directories;
+
+	{
+		RLock l(cs);
+		std::function<void(const Directory::Ptr&, const string&)> addDirectories;
+		addDirectories = [&](const Directory::Ptr& aDirectory, const string& aPath) {
+			directories.emplace_back(aPath, aDirectory->getLastWrite());
+			for (const auto& d: aDirectory->getDirectories()) {
+				addDirectories(d, aPath + d->realName.getNormal() + PATH_SEPARATOR);
+			}
+		};
+
+		for (const auto& d: rootPaths | map_values) {
+			addDirectories(d, d->getRoot()->getPath());
+		}
+	}
+
+	// Only the directories are checked (not the files)
+	RefreshPathList ret;
+	for (const auto& d: directories) {
+		if (File::getLastModified(d.first) != d.second) {
+			ret.insert(d.first);
+		}
+	}
+
+	dcdebug("ShareManager: %d/%d shared directories have been modified\n", static_cast<int>(ret.size()), static_cast<int>(directories.size()));
+	return ret;
+}
+
+void ShareManager::refreshMonitoredChanges(const RefreshPathList& aChangedDirs) noexcept {
+	// Removed directories are refreshed via their parents
+	RefreshPathList changedDirs;
+	for (auto path: aChangedDirs) {
+		while (!path.empty() && !Util::fileExists(path)) {
+			path = Util::getParentDir(path);
+		}
+
+		if (!path.empty()) {
+			changedDirs.insert(path);
+		}
+	}
+
+	// Subdirectories are refreshed with their parents (they follow their parents in the sorted list)
+	StringList refreshPaths;
+	for (const auto& path: changedDirs) {
+		if (!refreshPaths.empty() && AirUtil::isParentOrExactLocal(refreshPaths.back(), path)) {
+			continue;
+		}
+
+		try {
+			validatePathHooked(path, false, this);
+		} catch (const Exception& e) {
+			dcdebug("ShareManager: changed directory %s won't be refreshed (%s)\n", path.c_str(), e.getError().c_str());
+			continue;
+		}
+
+		refreshPaths.push_back(path);
+	}
+
+	if (!refreshPaths.empty()) {
+		addRefreshTask(ShareRefreshPriority::SCHEDULED, refreshPaths, ShareRefreshType::MONITORING, Util::emptyString, nullptr, changedDirs);
+	}
+}
+
+void ShareManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept {
+	if (!monitor) {
+		return;
+	}
+
+	auto changes = monitor->takeChanges(aTick, MONITOR_SETTLE_TIME);
+	if (changes.directories.empty() && !changes.overflow) {
+		return;
+	}
+
+	// Validation hooks may take a while
+	addAsyncTask([=] {
+		auto changedDirs = changes.directories;
+		if (changes.overflow) {
+			log(STRING(SHARE_MONITORING_OVERFLOW), LogMessage::SEV_WARNING);
+
+			auto modifiedDirs = findModifiedDirectories();
+			changedDirs.insert(modifiedDirs.begin(), modifiedDirs.end());
+		}
+
+		refreshMonitoredChanges(changedDirs);
+	});
+}
+
 void ShareManager::on(TimerManagerListener::Minute, uint64_t aTick) noexcept {
 	if(lastSave == 0 || lastSave + 15*60*1000 <= aTick) {
 		saveXmlList();
 	}
 
+	if (monitor && monitor->getFailedCount() == 0) {
+		// The changes are refreshed by the monitor, only catch the ones that it may have missed (without rehashing everything)
+		if (SETTING(AUTO_REFRESH_TIME) > 0 && lastFullUpdate + SETTING(AUTO_REFRESH_TIME) * 60 * 1000 <= aTick) {
+			lastIncomingUpdate = aTick;
+			lastFullUpdate = aTick;
+			addAsyncTask([this] {
+				refreshMonitoredChanges(findModifiedDirectories());
+			});
+		}
+
+		return;
+	}
+
 	if(SETTING(AUTO_REFRESH_TIME) > 0 && lastFullUpdate + SETTING(AUTO_REFRESH_TIME) * 60 * 1000 <= aTick) {
 		lastIncomingUpdate = aTick;
 		lastFullUpdate = aTick;
@@ -2494,10 +3175,11 @@ ShareDirectoryInfoList ShareManager::getRootInfos() const noexcept {
 }
 		
 void ShareManager::getBloom(HashBloom& bloom_) const noexcept {
-	RLock l(cs);
-	for(const auto tth: tthIndex | map_keys)
-		bloom_.add(*tth);
+	tthIndex.forEach([&](const Directory::File* f) {
+		bloom_.add(f->getTTH());
+	});
 
+	RLock l(tempSharesCS);
 	for(const auto& tth: tempShares | map_keys)
 		bloom_.add(tth);
 }
@@ -2546,7 +3228,7 @@ FileList* ShareManager::generateXmlList(ProfileToken aProfile, bool forced /*fal
 					File bz(fl->getFileName(), File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
 					// We don't care about the leaves...
 					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> bzTree(&bz);
-					FilteredOutputStream<BZFilter, false> bzipper(&bzTree);
+					FilteredOutputStream<ParallelBZFilter, false> bzipper(&bzTree);
 					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> newXmlFile(&bzipper);
 
 					newXmlFile.write(f.read());
@@ -2559,6 +3241,17 @@ FileList* ShareManager::generateXmlList(ProfileToken aProfile, bool forced /*fal
 					fl->setBzXmlRoot(bzTree.getFilter().getTree().getRoot());
 				}
 
+				{
+					File bin(fl->getBinaryFileName(), File::WRITE, File::TRUNCATE | File::CREATE, File::BUFFER_SEQUENTIAL, false);
+					CalcOutputStream<TTFilter<1024 * 1024 * 1024>, false> binTree(&bin);
+
+					toBinaryFilelist(binTree, aProfile);
+					binTree.flushBuffers(false);
+
+					binTree.getFilter().getTree().finalize();
+					fl->setBinaryRoot(binTree.getFilter().getTree().getRoot());
+				}
+
 				fl->saveList();
 				fl->generationFinished(false);
 			} catch (const Exception& e) {
@@ -2646,6 +3339,23 @@ void ShareManager::toFilelist(OutputStream& os_, const string& aVirtualPath, con
 	os_.write("</FileListing>");
 }
 
+void ShareManager::toBinaryFilelist(OutputStream& os_, ProfileToken aProfile) const {
+	FilelistDirectory listRoot(Util::emptyString, 0);
+	Directory::List childDirectories;
+
+	RLock l(cs);
+	getRoots(aProfile, childDirectories);
+
+	for (const auto& d : childDirectories) {
+		d->toFileList(listRoot, true);
+		listRoot.date = max(listRoot.date, d->getLastWrite());
+	}
+
+	BinaryFilelistWriter writer(os_, ADC_ROOT_STR, listRoot.date, shortVersionString);
+	listRoot.toBinary(writer, 0);
+	writer.finish();
+}
+
 void ShareManager::Directory::toFileList(FilelistDirectory& aListDir, bool aRecursive) {
 	FilelistDirectory* newListDir = nullptr;
 	auto pos = aListDir.listDirs.find(const_cast<string*>(&getVirtualNameLower()));
@@ -2723,7 +3433,7 @@ void ShareManager::FilelistDirectory::toXml(OutputStream& xmlFile, string& inden
 	}
 }
 
-void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const {
+int ShareManager::FilelistDirectory::forEachFile(const function<void(const Directory::File*)>& aHandler) const {
 	bool filesAdded = false;
 	int dupeFiles = 0;
 	for(auto di = shareDirs.begin(); di != shareDirs.end(); ++di) {
@@ -2731,7 +3441,7 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 			for(const auto& fi: (*di)->files) {
 				//go through the dirs that we have added already
 				if (none_of(shareDirs.begin(), di, [&fi](const Directory::Ptr& d) { return d->files.find(fi->name.getLower()) != d->files.end(); })) {
-					fi->toXml(xmlFile, indent, tmp2, addDate);
+					aHandler(fi);
 				} else {
 					dupeFiles++;
 				}
@@ -2739,10 +3449,18 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 		} else if (!(*di)->files.empty()) {
 			filesAdded = true;
 			for(const auto& f: (*di)->files)
-				f->toXml(xmlFile, indent, tmp2, addDate);
+				aHandler(f);
 		}
 	}
 
+	return dupeFiles;
+}
+
+void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const {
+	auto dupeFiles = forEachFile([&](const Directory::File* f) {
+		f->toXml(xmlFile, indent, tmp2, addDate);
+	});
+
 	if (dupeFiles > 0 && SETTING(FL_REPORT_FILE_DUPES) && shareDirs.size() > 1) {
 		StringList paths;
 		for (const auto& d : shareDirs)
@@ -2752,6 +3470,18 @@ void ShareManager::FilelistDirectory::filesToXml(OutputStream& xmlFile, string&
 	}
 }
 
+void ShareManager::FilelistDirectory::toBinary(BinaryFilelistWriter& aWriter, size_t aIndex) const {
+	// Dates aren't included in full XML lists either
+	forEachFile([&](const Directory::File* f) {
+		aWriter.addFile(f->name.lowerCaseOnly() ? f->name.getLower() : f->name.getNormal(), f->getSize(), f->getTTH(), 0);
+	});
+
+	for (const auto& d: listDirs | map_values) {
+		auto index = aWriter.addDirectory(aIndex, d->name, d->date);
+		d->toBinary(aWriter, index);
+	}
+}
+
 void ShareManager::Directory::filesToXmlList(OutputStream& xmlFile, string& indent, string& tmp2) const {
 	for(const auto& f: files) {
 		xmlFile.write(indent);
@@ -2761,8 +3491,8 @@ void ShareManager::Directory::filesToXmlList(OutputStream& xmlFile, string& inde
 	}
 }
 
-ShareManager::Directory::File::File(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) : 
-	size(aFileInfo.getSize()), parent(aParent.get()), tth(aFileInfo.getRoot()), lastWrite(aFileInfo.getTimeStamp()), name(move(aName)) {
+ShareManager::Directory::File::File(const DualString& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) : 
+	size(aFileInfo.getSize()), parent(aParent.get()), tth(aFileInfo.getRoot()), lastWrite(aFileInfo.getTimeStamp()), name(aName) {
 	
 }
 
@@ -2770,6 +3500,56 @@ ShareManager::Directory::File::~File() {
 
 }
 
+ShareManager::Directory::File* ShareManager::TreeArena::createFile(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) {
+	FastLock l(cs);
+	if (building) {
+		auto i = nameIndex.find(&aName);
+		if (i != nameIndex.end()) {
+			return files.create(**i, aParent, aFileInfo);
+		}
+	}
+
+	names.push_back(move(aName));
+	if (building) {
+		nameIndex.insert(&names.back());
+	}
+
+	return files.create(names.back(), aParent, aFileInfo);
+}
+
+ShareManager::Directory::File* ShareManager::TreeArena::createFile(const DualString& aPooledName, const Directory::Ptr& aParent, const HashedFile& aFileInfo) {
+	FastLock l(cs);
+	return files.create(aPooledName, aParent, aFileInfo);
+}
+
+void ShareManager::TreeArena::destroyFile(Directory::File* aFile) noexcept {
+	FastLock l(cs);
+	files.destroy(aFile);
+}
+
+void ShareManager::TreeArena::finishBuild() noexcept {
+	FastLock l(cs);
+	building = false;
+	decltype(nameIndex)().swap(nameIndex);
+}
+
+size_t ShareManager::TreeArena::getMemoryUsage() const noexcept {
+	FastLock l(cs);
+	auto ret = sizeof(TreeArena) + files.getMemoryUsage() + names.size() * sizeof(DualString);
+	for (const auto& n: names) {
+		ret += n.getHeapSize();
+	}
+
+	// Node (pointer, next pointer and cached hash) and bucket sizes
+	ret += nameIndex.size() * 3 * sizeof(void*) + nameIndex.bucket_count() * sizeof(void*);
+	return ret;
+}
+
+size_t ShareManager::TreeArena::getNameCount() const noexcept {
+	FastLock l(cs);
+	return names.size();
+}
+
 void ShareManager::Directory::File::toXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const {
 	xmlFile.write(indent);
 	xmlFile.write(LITERAL("<File Name=\""));
@@ -2792,6 +3572,7 @@ string ShareManager::RootDirectory::getCacheXmlPath() const noexcept {
 }
 
 void ShareManager::RootDirectory::setName(const string& aName) noexcept {
+	WLock l(cs);
 	virtualName.reset(new DualString(aName));
 }
 
@@ -2988,7 +3769,12 @@ void ShareManager::nmdcSearch(SearchResultList& l, const string& nmdcString, int
 * but not the parents...
 */
 
-void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuery& aStrings, int aLevel) const noexcept{
+void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuery& aStrings, int aLevel, const SearchCandidates* aCandidates) const noexcept{
+	// Without partial matches from the parents, nothing can be matched from subtrees that don't contain any of the search terms
+	if (aCandidates && !aStrings.recursion && aCandidates->directories.find(this) == aCandidates->directories.end()) {
+		return;
+	}
+
 	const auto& dirName = getVirtualNameLower();
 	if (aStrings.isExcludedLower(dirName)) {
 		return;
@@ -3039,6 +3825,11 @@ void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuer
 	// Match files
 	if(aStrings.itemType != SearchQuery::TYPE_DIRECTORY) {
 		for(const auto& f: files) {
+			if (aCandidates && !aStrings.recursion && aCandidates->files.find(f) == aCandidates->files.end()) {
+				// Not all search terms can be matched from the name
+				continue;
+			}
+
 			if (!aStrings.matchesFileLower(f->name.getLower(), f->getSize(), f->getLastWrite())) {
 				continue;
 			}
@@ -3051,7 +3842,7 @@ void ShareManager::Directory::search(SearchResultInfo::Set& results_, SearchQuer
 
 	// Match directories
 	for(const auto& d: directories) {
-		d->search(results_, aStrings, aLevel);
+		d->search(results_, aStrings, aLevel, aCandidates);
 	}
 
 	// Moving to a lower level
@@ -3073,14 +3864,21 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 	RLock l(cs);
 	if(srch.root) {
 		tthSearches++;
-		const auto i = tthIndex.equal_range(const_cast<TTHValue*>(&(*srch.root)));
-		for(auto& f: i | map_values) {
-			if (f->hasProfile(aProfile) && AirUtil::isParentOrExactAdc(aDir, f->getAdcPath())) {
-				f->addSR(results, srch.addParents);
-				return;
-			}
+
+		const Directory::File* file = nullptr;
+		{
+			LookupLatency::Timer t(tthLookupLatency);
+			file = tthIndex.find(*srch.root, [&](const Directory::File* f) {
+				return f->hasProfile(aProfile) && AirUtil::isParentOrExactAdc(aDir, f->getAdcPath());
+			});
 		}
 
+		if (file) {
+			file->addSR(results, srch.addParents);
+			return;
+		}
+
+		RLock tl(tempSharesCS);
 		const auto files = tempShares.equal_range(*srch.root);
 		for(const auto& f: files | map_values) {
 			if(!f.user || f.user->getCID() == cid) {
@@ -3113,10 +3911,41 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 
 	auto start = GET_TICK();
 
+	// Find the candidates from the index (if possible) so that the unrelated subtrees can be skipped
+	optional<Directory::SearchCandidates> candidates;
+	if (searchIndex) {
+		candidates.emplace();
+
+		// Walking through the tree is cheaper with searches matching a large portion of the share
+		auto maxCandidates = (tthIndex.size() + lowerDirNameMap.size()) / 8;
+		if (searchIndex->getCandidates(srch, maxCandidates, *candidates)) {
+			indexedSearches++;
+		} else {
+			candidates.reset();
+		}
+	}
+
 	// go them through recursively
 	Directory::SearchResultInfo::Set resultInfos;
-	for (const auto& d: roots) {
-		d->search(resultInfos, srch, 0);
+	if (roots.size() > 1 && SETTING(SHARE_SEARCH_PARALLEL)) {
+		// Each root is matched with a separate copy of the query state
+		vector<Directory::SearchResultInfo::Set> rootResults(roots.size());
+		vector<size_t> rootIndexes(roots.size());
+		iota(rootIndexes.begin(), rootIndexes.end(), 0);
+
+		parallel_for_each(rootIndexes.begin(), rootIndexes.end(), [&](size_t aIndex) {
+			auto rootSearch = srch;
+			roots[aIndex]->search(rootResults[aIndex], rootSearch, 0, candidates ? &(*candidates) : nullptr);
+		});
+
+		// Merge in the original root order so that equally relevant items are kept in the same order as with sequential searching
+		for (auto& r: rootResults) {
+			resultInfos.merge(r);
+		}
+	} else {
+		for (const auto& d: roots) {
+			d->search(resultInfos, srch, 0, candidates ? &(*candidates) : nullptr);
+		}
 	}
 
 	// update statistics
@@ -3141,6 +3970,94 @@ void ShareManager::adcSearch(SearchResultList& results, SearchQuery& srch, const
 		recursiveSearchesResponded++;
 }
 
+void ShareManager::SearchIndex::addDirectory(const Directory* aDirectory) noexcept {
+	directories.add(aDirectory->getVirtualNameLower(), aDirectory);
+}
+
+void ShareManager::SearchIndex::removeDirectory(const Directory* aDirectory) noexcept {
+	directories.remove(aDirectory->getVirtualNameLower(), aDirectory);
+}
+
+void ShareManager::SearchIndex::addFile(const Directory::File* aFile) noexcept {
+	files.add(aFile->name.getLower(), aFile);
+}
+
+void ShareManager::SearchIndex::removeFile(const Directory::File* aFile) noexcept {
+	files.remove(aFile->name.getLower(), aFile);
+}
+
+void ShareManager::SearchIndex::flush() noexcept {
+	directories.flush();
+	files.flush();
+}
+
+bool ShareManager::SearchIndex::getCandidates(const SearchQuery& aSearch, size_t aMaxItems, Directory::SearchCandidates& candidates_) const noexcept {
+	// All items matching any of the search terms must be found from the index
+	const auto& patterns = aSearch.include.getPatterns();
+	if (patterns.empty() || any_of(patterns.begin(), patterns.end(), [](const StringSearch::Pattern& p) { return !TokenIndex<const Directory*>::isIndexable(p.str()); })) {
+		return false;
+	}
+
+	auto addDirectory = [&candidates_](const Directory* aDirectory) {
+		// Stop when reaching a parent that has been added already
+		auto d = aDirectory;
+		while (d && candidates_.directories.insert(d).second) {
+			d = d->getParent();
+		}
+	};
+
+	auto addFile = [&](const Directory::File* aFile) {
+		candidates_.files.insert(aFile);
+		addDirectory(aFile->getParent());
+	};
+
+	for (const auto& p : patterns) {
+		if (!directories.find(p, aMaxItems, addDirectory) || !files.find(p, aMaxItems, addFile)) {
+			return false;
+		}
+
+		if (candidates_.directories.size() + candidates_.files.size() > aMaxItems) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ShareManager::rebuildSearchIndex() noexcept {
+	searchIndex->directories.clear();
+	searchIndex->files.clear();
+
+	for (const auto& d : lowerDirNameMap | map_values) {
+		searchIndex->addDirectory(d.get());
+	}
+
+	tthIndex.forEach([&](const Directory::File* f) {
+		searchIndex->addFile(f);
+	});
+
+	searchIndex->flush();
+}
+
+size_t ShareManager::getBloomSize() const noexcept {
+	// Most of the n-grams are shared between different names, expect only a few unique ones for each item
+	return ShareBloom::getOptimalSize((tthIndex.size() + lowerDirNameMap.size()) * 4, 1 << 20, 1 << 28);
+}
+
+void ShareManager::rebuildBloom() noexcept {
+	auto newBloom = make_unique<ShareBloom>(getBloomSize());
+
+	for (const auto& d : lowerDirNameMap | map_values) {
+		newBloom->add(d->getVirtualNameLower());
+	}
+
+	tthIndex.forEach([&](const Directory::File* f) {
+		newBloom->add(f->name.getLower());
+	});
+
+	bloom = move(newBloom);
+}
+
 void ShareManager::addDirName(const Directory::Ptr& aDir, Directory::MultiMap& aDirNames, ShareBloom& aBloom) noexcept {
 	const auto& nameLower = aDir->getVirtualNameLower();
 
@@ -3260,6 +4177,9 @@ ShareManager::Directory::Ptr ShareManager::getDirectory(const string& aRealPath)
 	for (const auto& curName : tokens) {
 		curDir->updateModifyDate();
 		curDir = Directory::createNormal(DualString(curName), curDir, File::getLastModified(curDir->getRealPath()), lowerDirNameMap, *bloom.get());
+		if (searchIndex) {
+			searchIndex->addDirectory(curDir.get());
+		}
 	}
 
 	return curDir;
@@ -3280,25 +4200,41 @@ void ShareManager::onFileHashed(const string& fname, HashedFile& fileInfo) noexc
 			return;
 		}
 
-		addFile(Util::getFileName(fname), d, fileInfo, tthIndex, *bloom.get(), sharedSize, &dirtyProfiles);
+		addFile(Util::getFileName(fname), d, fileInfo, tthIndex, *bloom.get(), sharedSize, &dirtyProfiles, searchIndex.get());
 	}
 
 	setProfilesDirty(dirtyProfiles, false);
 }
 
-void ShareManager::addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& aFileInfo, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_) noexcept {
+void ShareManager::addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& aFileInfo, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_, SearchIndex* searchIndex_) noexcept {
+	auto& arena = aDir->getArena();
+
+	// Pooled names stay valid until the arena is released
+	const DualString* pooledName = nullptr;
 	{
 		auto i = aDir->files.find(aName.getLower());
 		if (i != aDir->files.end()) {
 			// Get rid of false constness...
-			(*i)->cleanIndices(sharedSize_, tthIndex_);
-			delete *i;
+			(*i)->cleanIndices(sharedSize_, &tthIndex_);
+			if (searchIndex_) {
+				searchIndex_->removeFile(*i);
+			}
+
+			if ((*i)->name == aName) {
+				pooledName = &(*i)->name;
+			}
+
+			arena.destroyFile(*i);
 			aDir->files.erase(i);
 		}
 	}
 
-	auto it = aDir->files.insert_sorted(new Directory::File(move(aName), aDir, aFileInfo)).first;
+	auto file = pooledName ? arena.createFile(*pooledName, aDir, aFileInfo) : arena.createFile(move(aName), aDir, aFileInfo);
+	auto it = aDir->files.insert_sorted(file).first;
 	(*it)->updateIndices(aBloom_, sharedSize_, tthIndex_);
+	if (searchIndex_) {
+		searchIndex_->addFile(*it);
+	}
 
 	if (dirtyProfiles_) {
 		aDir->copyRootProfiles(*dirtyProfiles_, true);
@@ -34,6 +34,7 @@
 #include "HashedFile.h"
 #include "Message.h"
 #include "MerkleTree.h"
+#include "NodeArena.h"
 #include "Pointer.h"
 #include "SearchQuery.h"
 #include "ShareDirectoryInfo.h"
@@ -44,6 +45,8 @@
 #include "TaskQueue.h"
 #include "Thread.h"
 #include "TimerManager.h"
+#include "TokenIndex.h"
+#include "TTHIndex.h"
 #include "UserConnection.h"
 
 namespace dcpp {
@@ -54,6 +57,7 @@ class OutputStream;
 class MemoryInputStream;
 class SearchQuery;
 class SharePathValidator;
+class ShareValidatorException;
 
 class FileList;
 
@@ -83,6 +87,16 @@ struct ShareRefreshStats {
 	size_t skippedDirectoryCount = 0;
 	size_t skippedFileCount = 0;
 
+	// Existing directories that were reused without scanning them (monitoring refreshes)
+	size_t reusedDirectoryCount = 0;
+
+	// File information lookups from the hash database (one batch per directory)
+	size_t hashStoreLookupCount = 0;
+	size_t hashStoreBatchCount = 0;
+
+	// Summed over all refresh threads
+	uint64_t hashStoreLookupTimeUs = 0;
+
 	void merge(const ShareRefreshStats& aOther) noexcept;
 };
 
@@ -92,7 +106,8 @@ enum class ShareRefreshType : uint8_t {
 	REFRESH_INCOMING,
 	REFRESH_ALL,
 	STARTUP,
-	BUNDLE
+	BUNDLE,
+	MONITORING
 };
 
 enum class ShareRefreshPriority : uint8_t {
@@ -103,7 +118,7 @@ enum class ShareRefreshPriority : uint8_t {
 };
 
 struct ShareRefreshTask : public Task {
-	ShareRefreshTask(ShareRefreshTaskToken aToken, const RefreshPathList& aDirs, const string& aDisplayName, ShareRefreshType aRefreshType, ShareRefreshPriority aPriority);
+	ShareRefreshTask(ShareRefreshTaskToken aToken, const RefreshPathList& aDirs, const string& aDisplayName, ShareRefreshType aRefreshType, ShareRefreshPriority aPriority, const RefreshPathList& aChangedDirs = RefreshPathList());
 
 	const ShareRefreshTaskToken token;
 	const RefreshPathList dirs;
@@ -111,6 +126,10 @@ struct ShareRefreshTask : public Task {
 	const ShareRefreshType type;
 	const ShareRefreshPriority priority;
 
+	// Directories known to have changed (monitoring refreshes)
+	// Other directories inside the refreshed paths are reused from the current tree without scanning them
+	const RefreshPathList changedDirs;
+
 	bool canceled = false;
 	bool running = false;
 };
@@ -138,7 +157,7 @@ public:
 	string toVirtual(const TTHValue& aTTH, ProfileToken aProfile) const;
 
 	// Returns size and file name of a filelist
-	// virtualFile = name requested by the other user (Transfer::USER_LIST_NAME_BZ or Transfer::USER_LIST_NAME)
+	// virtualFile = name requested by the other user (Transfer::USER_LIST_NAME_BIN, Transfer::USER_LIST_NAME_BZ or Transfer::USER_LIST_NAME)
 	// Throws ShareException
 	pair<int64_t, string> getFileListInfo(const string& virtualFile, ProfileToken aProfile);
 
@@ -148,7 +167,7 @@ public:
 	void toRealWithSize(const string& virtualFile, const ProfileTokenSet& aProfiles, const HintedUser& aUser, string& path_, int64_t& size_, bool& noAccess_);
 
 	// Returns TTH value for a file list (not very useful but the ADC specs...)
-	// virtualFile = name requested by the other user (Transfer::USER_LIST_NAME_BZ or Transfer::USER_LIST_NAME)
+	// virtualFile = name requested by the other user (Transfer::USER_LIST_NAME_BIN, Transfer::USER_LIST_NAME_BZ or Transfer::USER_LIST_NAME)
 	// Throws ShareException
 	TTHValue getListTTH(const string& virtualFile, ProfileToken aProfile) const;
 
@@ -229,6 +248,9 @@ public:
 	MemoryInputStream* getTree(const string& virtualFile, ProfileToken aProfile) const noexcept;
 	void toFilelist(OutputStream& os_, const string& aVirtualPath, const OptionalProfileToken& aProfile, bool aRecursive) const;
 
+	// Write the full list of the profile in binary format
+	void toBinaryFilelist(OutputStream& os_, ProfileToken aProfile) const;
+
 	void saveXmlList(function<void (float)> progressF = nullptr) noexcept;	//for filelist caching
 
 	// Throws ShareException
@@ -291,6 +313,16 @@ public:
 		double averageNameLength = 0;
 		size_t totalNameSize = 0;
 		time_t averageFileAge = 0;
+
+		size_t searchIndexTokens = 0;
+		size_t searchIndexEntries = 0;
+
+		// Approximate memory usage of the share tree and the name/TTH indices
+		size_t treeMemoryUsage = 0;
+		size_t indexMemoryUsage = 0;
+
+		// File names stored in the name pools of the tree (identical names of a refreshed tree are stored once)
+		size_t pooledFileNames = 0;
 	};
 	optional<ShareItemStats> getShareItemStats() const noexcept;
 
@@ -307,6 +339,19 @@ public:
 		double averageSearchTokenLength = 0;
 
 		uint64_t autoSearches = 0, tthSearches = 0;
+		uint64_t indexedSearches = 0;
+
+		// TTH lookups (uploads, TTH searches and dupe checks)
+		uint64_t tthLookups = 0;
+		double tthLookupP99Us = 0;
+
+		// TTH lookups performed during the previous full refresh
+		uint64_t refreshTTHLookups = 0;
+		double refreshTTHLookupP99Us = 0;
+
+		size_t bloomSize = 0;
+		double bloomFillRatio = 0;
+		double bloomFalsePositiveRate = 0;
 	};
 	ShareSearchStats getSearchMatchingStats() const noexcept;
 
@@ -369,6 +414,9 @@ public:
 private:
 	TempShareMap tempShares;
 
+	// Temp shares are checked from the upload requests without the share lock
+	mutable SharedMutex tempSharesCS;
+
 	void countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles, size_t& lowerCaseFiles, size_t& totalStrLen_, size_t& roots_) const noexcept;
 
 	uint64_t totalSearches = 0;
@@ -380,6 +428,7 @@ private:
 	uint64_t searchTokenCount = 0;
 	uint64_t searchTokenLength = 0;
 	uint64_t autoSearches = 0;
+	uint64_t indexedSearches = 0;
 	typedef BloomFilter<5> ShareBloom;
 
 	class RootDirectory : boost::noncopyable {
@@ -389,7 +438,12 @@ private:
 
 			static Ptr create(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastRefreshTime) noexcept;
 
-			GETSET(ProfileTokenSet, rootProfiles, RootProfiles);
+			// Requires the share lock (the profiles may change when it isn't held)
+			const ProfileTokenSet& getRootProfiles() const noexcept {
+				return rootProfiles;
+			}
+
+			void setRootProfiles(const ProfileTokenSet& aProfiles) noexcept;
 			IGETSET(bool, cacheDirty, CacheDirty, false);
 			IGETSET(bool, incoming, Incoming, false);
 			IGETSET(RefreshState, refreshState, RefreshState, RefreshState::STATE_NORMAL);
@@ -402,9 +456,11 @@ private:
 			bool removeRootProfile(ProfileToken aProfile) noexcept;
 
 			inline string getName() const noexcept{
+				RLock l(cs);
 				return virtualName->getNormal();
 			}
 
+			// Requires the share lock (the name may change when it isn't held)
 			inline const string& getNameLower() const noexcept{
 				return virtualName->getLower();
 			}
@@ -425,12 +481,22 @@ private:
 			unique_ptr<DualString> virtualName;
 			const string path;
 			const string pathLower;
+			ProfileTokenSet rootProfiles;
+
+			// Changes to the profiles and the virtual name are also made while holding this lock
+			// so that files can be resolved from the TTH index without the share lock
+			mutable SharedMutex cs;
 	};
 
 	typedef vector<RootDirectory::Ptr> RootDirectoryList;
 	unique_ptr<ShareBloom> bloom;
 
 	struct FilelistDirectory;
+	class SearchIndex;
+
+	class TreeArena;
+	typedef shared_ptr<TreeArena> TreeArenaPtr;
+
 	class Directory : public intrusive_ptr_base<Directory> {
 	public:
 		typedef boost::intrusive_ptr<Directory> Ptr;
@@ -451,9 +517,10 @@ private:
 
 			//typedef set<File, FileLess> Set;
 			typedef SortedVector<File*, std::vector, string, Compare, NameLower> Set;
-			typedef unordered_multimap<TTHValue*, const Directory::File*> TTHMap;
+			typedef TTHIndex<const Directory::File*> TTHMap;
 
-			File(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo);
+			// The name must be stored in the tree arena of the parent
+			File(const DualString& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo);
 			~File();
 		
 			inline string getAdcPath() const noexcept{ return parent->getAdcPath() + name.getNormal(); }
@@ -468,10 +535,12 @@ private:
 			GETSET(time_t, lastWrite, LastWrite);
 			GETSET(TTHValue, tth, TTH);
 
-			DualString name;
+			// Pooled name (possibly shared with other files)
+			const DualString& name;
 
 			void updateIndices(ShareBloom& aBloom_, int64_t& sharedSize_, File::TTHMap& tthIndex_) noexcept;
-			void cleanIndices(int64_t& sharedSize_, TTHMap& tthIndex_) noexcept;
+			// The file is kept in the TTH index if no index is given
+			void cleanIndices(int64_t& sharedSize_, TTHMap* tthIndex_) noexcept;
 		};
 
 		class SearchResultInfo {
@@ -507,18 +576,32 @@ private:
 			double scores;
 		};
 
+		// Items found from the search index, including the parents of all matching items
+		struct SearchCandidates {
+			unordered_set<const Directory*> directories;
+			unordered_set<const File*> files;
+		};
+
 		typedef SortedVector<Ptr, std::vector, string, Compare, NameLower> Set;
 		File::Set files;
 
-		static Ptr createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, ShareBloom& bloom) noexcept;
-		static Ptr createRoot(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, ShareBloom& bloom_, time_t aLastRefreshTime) noexcept;
+		// The directory uses the arena of the parent (an arena must be given for directories without a parent)
+		static Ptr createNormal(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, Directory::MultiMap& dirNameMap_, ShareBloom& bloom, const TreeArenaPtr& aArena = nullptr) noexcept;
+
+		// A new arena is created if none is given
+		static Ptr createRoot(const string& aRootPath, const string& aVname, const ProfileTokenSet& aProfiles, bool aIncoming, time_t aLastWrite, Map& rootPaths_, Directory::MultiMap& dirNameMap_, ShareBloom& bloom_, time_t aLastRefreshTime, const TreeArenaPtr& aArena = nullptr) noexcept;
 
 		// Set a new parent for the directory
 		// Possible directories with the same name must be removed from the parent first
-		static bool setParent(const Directory::Ptr& aDirectory, const Directory::Ptr& aParent) noexcept;
+		static bool setParent(const Directory::Ptr& aDirectory, const Directory::Ptr& aParent, bool aUpdateModifyDate = true) noexcept;
 
 		// Remove directory from possible parent and all shared containers
-		static void cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& aDirNames_) noexcept;
+		// The files are kept in the TTH index if no index is given (use cleanTTHIndex to remove them afterwards)
+		// The directory will still point to the old parent in that case so that the kept files can be resolved
+		static void cleanIndices(Directory& aDirectory, int64_t& sharedSize_, File::TTHMap* tthIndex_, Directory::MultiMap& aDirNames_, SearchIndex* searchIndex_ = nullptr) noexcept;
+
+		// Recursively remove the files from the TTH index and detach the directories from their parents
+		static void cleanTTHIndex(Directory& aDirectory, File::TTHMap& tthIndex_) noexcept;
 
 		struct HasRootProfile {
 			HasRootProfile(const OptionalProfileToken& aProfile) : profile(aProfile) { }
@@ -549,7 +632,8 @@ private:
 
 		void getProfileInfo(ProfileToken aProfile, int64_t& totalSize, size_t& filesCount) const noexcept;
 
-		void search(SearchResultInfo::Set& aResults, SearchQuery& aStrings, int aLevel) const noexcept;
+		// Subtrees without search candidates are skipped when candidates are provided
+		void search(SearchResultInfo::Set& aResults, SearchQuery& aStrings, int aLevel, const SearchCandidates* aCandidates = nullptr) const noexcept;
 
 		void toFileList(FilelistDirectory& aListDir, bool aRecursive);
 		void toTTHList(OutputStream& tthList, string& tmp2, bool recursive) const;
@@ -568,6 +652,10 @@ private:
 		//void addBloom(ShareBloom& aBloom) const noexcept;
 
 		void countStats(time_t& totalAge_, size_t& totalDirs_, int64_t& totalSize_, size_t& totalFiles, size_t& lowerCaseFiles, size_t& totalStrLen_) const noexcept;
+
+		// Approximate number of bytes used by the directories of this tree (excluding the global indices)
+		// The arenas used by the directories are added in the set and they should be counted separately
+		size_t countMemoryUsage(unordered_set<const TreeArena*>& arenas_) const noexcept;
 		DualString realName;
 
 		// check for an updated modify date from filesystem
@@ -577,6 +665,10 @@ private:
 		Directory& operator=(Directory&) = delete;
 
 		const RootDirectory::Ptr& getRoot() const noexcept { return root; }
+
+		// Storage for the files
+		TreeArena& getArena() const noexcept { return *arena; }
+
 		void increaseSize(int64_t aSize, int64_t& totalSize_) noexcept;
 		void decreaseSize(int64_t aSize, int64_t& totalSize_) noexcept;
 
@@ -607,7 +699,7 @@ private:
 			const char separator;
 		};
 	private:
-		void cleanIndices(int64_t& sharedSize_, File::TTHMap& tthIndex_, Directory::MultiMap& dirNames_) noexcept;
+		void cleanIndices(int64_t& sharedSize_, File::TTHMap* tthIndex_, Directory::MultiMap& dirNames_, SearchIndex* searchIndex_) noexcept;
 
 		Directory* parent;
 		Set directories;
@@ -616,12 +708,85 @@ private:
 		int64_t size = 0;
 		RootDirectory::Ptr root;
 
-		Directory(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, const RootDirectory::Ptr& aRoot = nullptr);
+		// Shared by the directories that were created by the same refresh (it must outlive the files)
+		const TreeArenaPtr arena;
+
+		Directory(DualString&& aRealName, const Ptr& aParent, time_t aLastWrite, const TreeArenaPtr& aArena, const RootDirectory::Ptr& aRoot = nullptr);
 		friend void intrusive_ptr_release(intrusive_ptr_base<Directory>*);
 
 		string getRealPath(const string& path) const noexcept;
 	};
 
+	// File nodes and file names of the directories created by a single refresh (the subtree builders use the same arena)
+	// Identical names are stored only once while the tree is being built (the name index is released after that)
+	// Names of removed files are kept until the arena is released with the last directory using it
+	class TreeArena : boost::noncopyable {
+	public:
+		// Create a file and add the name in the pool
+		Directory::File* createFile(DualString&& aName, const Directory::Ptr& aParent, const HashedFile& aFileInfo);
+
+		// Create a file with a name that is already in the pool
+		Directory::File* createFile(const DualString& aPooledName, const Directory::Ptr& aParent, const HashedFile& aFileInfo);
+
+		void destroyFile(Directory::File* aFile) noexcept;
+
+		// Stop deduplicating the added names
+		void finishBuild() noexcept;
+
+		size_t getMemoryUsage() const noexcept;
+		size_t getNameCount() const noexcept;
+	private:
+		struct NameHash {
+			size_t operator()(const DualString* a) const noexcept { return std::hash<string>()(a->getLower()); }
+		};
+
+		struct NameEq {
+			bool operator()(const DualString* a, const DualString* b) const noexcept { return *a == *b; }
+		};
+
+		NodeArena<Directory::File> files;
+		deque<DualString> names;
+		unordered_set<const DualString*, NameHash, NameEq> nameIndex;
+		bool building = true;
+
+		// Used by the parallel subtree builders and files may be released from any thread
+		mutable FastCriticalSection cs;
+	};
+
+	// Name token index for finding search candidates without walking through the whole share
+	class SearchIndex : boost::noncopyable {
+	public:
+		void addDirectory(const Directory* aDirectory) noexcept;
+		void removeDirectory(const Directory* aDirectory) noexcept;
+
+		void addFile(const Directory::File* aFile) noexcept;
+		void removeFile(const Directory::File* aFile) noexcept;
+
+		// Purge items that have been removed lazily
+		void flush() noexcept;
+
+		// Returns false if the query can't be matched by using the index (or if there are too many candidates)
+		bool getCandidates(const SearchQuery& aSearch, size_t aMaxItems, Directory::SearchCandidates& candidates_) const noexcept;
+
+		TokenIndex<const Directory*> directories;
+		TokenIndex<const Directory::File*> files;
+	};
+
+	// Exists only if the index has been enabled
+	unique_ptr<SearchIndex> searchIndex;
+
+	// Create the search index from the current directories and files
+	// Unsafe
+	void rebuildSearchIndex() noexcept;
+
+	// Table size for the name bloom, based on the current number of directories and files
+	// Unsafe
+	size_t getBloomSize() const noexcept;
+
+	// Create a new name bloom (sized for the current share) from the current directories and files
+	// Unsafe
+	void rebuildBloom() noexcept;
+
 	struct FilelistDirectory {
 		typedef unordered_map<string*, FilelistDirectory*, noCaseStringHash, noCaseStringEq> Map;
 		Directory::List shareDirs;
@@ -636,6 +801,13 @@ private:
 
 		void toXml(OutputStream& xmlFile, string& indent, string& tmp2, bool fullList) const;
 		void filesToXml(OutputStream& xmlFile, string& indent, string& tmp2, bool addDate) const;
+
+		// Writes the files and the child directories recursively
+		void toBinary(BinaryFilelistWriter& aWriter, size_t aIndex) const;
+
+		// Calls the handler for each file in the merged share directories
+		// Returns the number of skipped files that exist in multiple share directories
+		int forEachFile(const function<void(const Directory::File*)>& aHandler) const;
 	};
 
 	ShareDirectoryInfoPtr getRootInfo(const Directory::Ptr& aDir) const noexcept;
@@ -647,8 +819,41 @@ private:
 
 	friend class Singleton<ShareManager>;
 
+	// Can be accessed without holding the share lock (the files must not be accessed without it though)
 	typedef Directory::File::TTHMap HashFileMap;
 	HashFileMap tthIndex;
+
+	// Latency histogram with power of two buckets (nanoseconds)
+	class LookupLatency {
+	public:
+		typedef array<uint64_t, 40> Counts;
+
+		class Timer : boost::noncopyable {
+		public:
+			Timer(LookupLatency& aLatency) noexcept : latency(aLatency), start(std::chrono::steady_clock::now()) { }
+			~Timer() noexcept {
+				latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			}
+		private:
+			LookupLatency& latency;
+			const std::chrono::steady_clock::time_point start;
+		};
+
+		void add(int64_t aNanoSeconds) noexcept;
+		Counts getCounts() const noexcept;
+
+		// Returns the upper bound of the bucket containing the percentile for the lookups performed between the count snapshots
+		static double getPercentileUs(const Counts& aCurrent, const Counts& aPrevious, double aPercentile) noexcept;
+		static uint64_t getTotal(const Counts& aCurrent, const Counts& aPrevious) noexcept;
+	private:
+		array<atomic<uint64_t>, tuple_size<Counts>::value> buckets = {};
+	};
+
+	mutable LookupLatency tthLookupLatency;
+
+	// Lookup latency during the previous full refresh
+	atomic<uint64_t> refreshTTHLookups { 0 };
+	atomic<double> refreshTTHLookupP99Us { 0 };
 	
 	ShareManager();
 	~ShareManager();
@@ -691,9 +896,14 @@ private:
 
 	class RefreshInfo : boost::noncopyable {
 	public:
-		RefreshInfo(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_);
+		// A new arena is created for the tree if none is given
+		RefreshInfo(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, const TreeArenaPtr& aArena = nullptr);
 		~RefreshInfo();
 
+		// Storage for the files of the new directories
+		const TreeArenaPtr arena;
+		const bool ownArena;
+
 		Directory::Ptr oldShareDirectory;
 		Directory::Ptr newShareDirectory;
 
@@ -707,19 +917,79 @@ private:
 
 		ShareManager::ShareBloom& bloom;
 
-		void applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles) noexcept;
+		void applyRefreshChanges(Directory::MultiMap& lowerDirNameMap_, Directory::Map& rootPaths_, HashFileMap& tthIndex_, int64_t& sharedBytes_, ProfileTokenSet* dirtyProfiles, SearchIndex* searchIndex_) noexcept;
 		bool checkContent(const Directory::Ptr& aDirectory) noexcept;
 	};
 
 	class ShareBuilder : public RefreshInfo {
 	public:
-		ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, ShareManager* sm);
+		// Only the changed directories (and their parents) are scanned if a list of changed directories is given
+		// Subdirectories on the first aSplitDepth levels are scanned in parallel tasks
+		// The files are added in aFileIndex and aArena if given (instead of the own index and arena of the builder)
+		ShareBuilder(const string& aPath, const Directory::Ptr& aOldRoot, time_t aLastWrite, ShareBloom& bloom_, const ShareManager* sm, const RefreshPathList* aChangedDirs = nullptr, int aSplitDepth = 0, HashFileMap* aFileIndex = nullptr, const TreeArenaPtr& aArena = nullptr);
 
 		// Recursive function for building a new share tree from a path
 		bool buildTree(const bool& aStopping) noexcept;
+
+		// Directory levels to scan in parallel tasks for multithreaded refreshes
+		static const int PARALLEL_SPLIT_DEPTH = 3;
+
+		// The subdirectories of a level with more directories than this aren't split further (there are enough tasks already)
+		static const size_t PARALLEL_SPLIT_MAX_DIRECTORIES = 16;
 	private:
 		void buildTree(const string& aPath, const string& aPathLower, const Directory::Ptr& aCurrentDirectory, const Directory::Ptr& aOldDirectory, const bool& aStopping);
 
+		// Subdirectory scanned by a separate builder
+		struct Subtree {
+			shared_ptr<ShareBuilder> builder;
+			bool isNew;
+			bool succeed;
+		};
+
+		// Add the subdirectory tree and the related directory index/statistics in this tree
+		void mergeSubtree(Subtree& aSubtree, const Directory::Ptr& aParent) noexcept;
+
+		// Copy the content of an unchanged directory from the current tree
+		void copyTree(const Directory::Ptr& aOldDirectory, const Directory::Ptr& aDirectory, const bool& aStopping);
+
+		// Whether the directory or any of its subdirectories has changed
+		bool hasChanges(const string& aPath) const noexcept;
+
+		// Listed directory content that has passed the item validations
+		struct PendingDirectory {
+			DualString name;
+			string path;
+			string pathLower;
+			time_t lastWrite;
+			Directory::Ptr oldDirectory;
+		};
+
+		struct PendingFile {
+			DualString name;
+			string path;
+			string pathLower;
+			time_t lastWrite;
+			int64_t size;
+			bool isNew;
+		};
+
+		typedef vector<PendingDirectory> PendingDirectoryList;
+		typedef vector<PendingFile> PendingFileList;
+
+		// Run the batched validation hooks for the directory content and remove the rejected items
+		void validateContentHooked(const string& aPath, bool aNewDirectory, PendingDirectoryList& directories_, PendingFileList& files_, ErrorCollector& aErrorCollector) noexcept;
+
+		void reportBlockedItem(const ShareValidatorException& e, const string& aPath, bool aIsDirectory, ErrorCollector& aErrorCollector) const noexcept;
+
+		const RefreshPathList* changedDirs;
+		const int splitDepth;
+
+		// TTH index of the top level builder (the index is thread-safe so that each file is inserted only once)
+		HashFileMap& fileIndex;
+
+		// Scanning of a subtree failed
+		bool failed = false;
+
 		bool validateFileItem(const FileItemInfoBase& aFileItem, const string& aPath, bool aIsNew, bool aNewParent, ErrorCollector& aErrorCollector) noexcept;
 
 		const ShareManager& sm;
@@ -734,7 +1004,7 @@ private:
 	void reportPendingRefresh(ShareRefreshType aTask, const RefreshPathList& aDirectories, const string& displayName) const noexcept;
 
 	// Add directories for refresh
-	RefreshTaskQueueInfo addRefreshTask(ShareRefreshPriority aPriority, const StringList& aDirs, ShareRefreshType aRefreshType, const string& displayName = Util::emptyString, function<void(float)> progressF = nullptr) noexcept;
+	RefreshTaskQueueInfo addRefreshTask(ShareRefreshPriority aPriority, const StringList& aDirs, ShareRefreshType aRefreshType, const string& displayName = Util::emptyString, function<void(float)> progressF = nullptr, const RefreshPathList& aChangedDirs = RefreshPathList()) noexcept;
 
 	// Remove directories that have already been queued for refresh
 	void validateRefreshTask(StringList& dirs_) noexcept;
@@ -743,7 +1013,7 @@ private:
 	// Safe to call with non-root directories
 	void setRefreshState(const string& aPath, RefreshState aState, bool aUpdateRefreshTime, const optional<ShareRefreshTaskToken>& aRefreshTaskToken) noexcept;
 
-	static void addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& fi, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_ = nullptr) noexcept;
+	static void addFile(DualString&& aName, const Directory::Ptr& aDir, const HashedFile& fi, HashFileMap& tthIndex_, ShareBloom& aBloom_, int64_t& sharedSize_, ProfileTokenSet* dirtyProfiles_ = nullptr, SearchIndex* searchIndex_ = nullptr) noexcept;
 
 	static void addDirName(const Directory::Ptr& dir, Directory::MultiMap& aDirNames, ShareBloom& aBloom) noexcept;
 	static void removeDirName(const Directory& dir, Directory::MultiMap& aDirNames) noexcept;
@@ -845,8 +1115,26 @@ private:
 	void on(SettingsManagerListener::LoadCompleted, bool aFileLoaded) noexcept override;
 	
 	// TimerManagerListener
+	void on(TimerManagerListener::Second, uint64_t aTick) noexcept override;
 	void on(TimerManagerListener::Minute, uint64_t aTick) noexcept override;
 
+	// Directory monitoring
+	// Directories must have been quiet for this long before they are refreshed
+	static const uint64_t MONITOR_SETTLE_TIME = 5 * 1000;
+
+	unique_ptr<ShareMonitor> monitor;
+
+	void startMonitoring() noexcept;
+
+	// Watch the shared directories in the path (after the path has been refreshed or removed)
+	void updateMonitoring(const string& aPath) noexcept;
+
+	// Queue a refresh for the changed directories
+	void refreshMonitoredChanges(const RefreshPathList& aChangedDirs) noexcept;
+
+	// Compare the modification dates of all shared directories with the disk (after monitoring events have been lost)
+	RefreshPathList findModifiedDirectories() const noexcept;
+
 	void load(SimpleXML& aXml);
 	void loadProfile(SimpleXML& aXml, const string& aName, ProfileToken aToken);
 	void save(SimpleXML& aXml);
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "ShareMonitor.h"
+
+#include "Exception.h"
+#include "File.h"
+#include "TimerManager.h"
+#include "Util.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace dcpp {
+
+ShareMonitor::Changes ShareMonitor::takeChanges(uint64_t aTick, uint64_t aSettleTime) noexcept {
+	Changes ret;
+
+	Lock l(cs);
+	for (auto i = pendingChanges.begin(); i != pendingChanges.end();) {
+		if (i->second.lastTick + aSettleTime <= aTick || i->second.firstTick + MAX_CHANGE_DELAY <= aTick) {
+			ret.directories.insert(i->first);
+			i = pendingChanges.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	ret.overflow = overflow;
+	overflow = false;
+	return ret;
+}
+
+size_t ShareMonitor::getWatchCount() const noexcept {
+	Lock l(cs);
+	return watchPaths.size();
+}
+
+size_t ShareMonitor::getFailedCount() const noexcept {
+	Lock l(cs);
+	return failedPaths.size();
+}
+
+void ShareMonitor::addChange(const string& aPath, uint64_t aTick) noexcept {
+	auto i = pendingChanges.find(aPath);
+	if (i == pendingChanges.end()) {
+		pendingChanges.emplace(aPath, PendingChange({ aTick, aTick }));
+	} else {
+		i->second.lastTick = aTick;
+	}
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+ShareMonitor::ShareMonitor() {
+	notifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (notifyFd == -1) {
+		throw Exception(Util::translateError(errno));
+	}
+
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wakeFd == -1) {
+		::close(notifyFd);
+		throw Exception(Util::translateError(errno));
+	}
+
+	try {
+		start();
+	} catch (const ThreadException&) {
+		::close(wakeFd);
+		::close(notifyFd);
+		throw;
+	}
+}
+
+ShareMonitor::~ShareMonitor() {
+	uint64_t value = 1;
+	if (::write(wakeFd, &value, sizeof(value)) == sizeof(value)) {
+		join();
+	}
+
+	::close(wakeFd);
+	::close(notifyFd);
+}
+
+bool ShareMonitor::isSupported() noexcept {
+	return true;
+}
+
+void ShareMonitor::addDirectory(const string& aPath) noexcept {
+	Lock l(cs);
+	addWatch(aPath);
+}
+
+size_t ShareMonitor::setDirectories(const string& aPath, const StringList& aDirectories) noexcept {
+	set<string> wanted(aDirectories.begin(), aDirectories.end());
+
+	Lock l(cs);
+
+	// Remove the watches that are no longer needed
+	for (auto i = pathWatches.lower_bound(aPath); i != pathWatches.end() && i->first.compare(0, aPath.size(), aPath) == 0;) {
+		if (wanted.erase(i->first) == 0 && (aDirectories.empty() || !Util::fileExists(i->first))) {
+			removeWatch(i);
+		} else {
+			++i;
+		}
+	}
+
+	for (auto i = failedPaths.lower_bound(aPath); i != failedPaths.end() && i->compare(0, aPath.size(), aPath) == 0;) {
+		i = failedPaths.erase(i);
+	}
+
+	// Add the new ones
+	size_t failed = 0;
+	for (const auto& path: wanted) {
+		if (!addWatch(path)) {
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+bool ShareMonitor::addWatch(const string& aPath) noexcept {
+	auto wd = inotify_add_watch(notifyFd, aPath.c_str(), WATCH_MASK);
+	if (wd == -1) {
+		dcdebug("ShareMonitor: failed to watch %s (%s)\n", aPath.c_str(), Util::translateError(errno).c_str());
+		failedPaths.insert(aPath);
+		return false;
+	}
+
+	// The same directory may be reachable via multiple paths (links), use the latest one
+	auto i = watchPaths.find(wd);
+	if (i != watchPaths.end()) {
+		if (i->second == aPath) {
+			return true;
+		}
+
+		pathWatches.erase(i->second);
+		i->second = aPath;
+	} else {
+		watchPaths.emplace(wd, aPath);
+	}
+
+	pathWatches[aPath] = wd;
+	failedPaths.erase(aPath);
+	return true;
+}
+
+void ShareMonitor::removeWatch(map<string, int>::iterator& aPos) noexcept {
+	inotify_rm_watch(notifyFd, aPos->second);
+	watchPaths.erase(aPos->second);
+	aPos = pathWatches.erase(aPos);
+}
+
+void ShareMonitor::removeWatches(const string& aPath) noexcept {
+	for (auto i = pathWatches.lower_bound(aPath); i != pathWatches.end() && i->first.compare(0, aPath.size(), aPath) == 0;) {
+		removeWatch(i);
+	}
+
+	for (auto i = pendingChanges.lower_bound(aPath); i != pendingChanges.end() && i->first.compare(0, aPath.size(), aPath) == 0;) {
+		i = pendingChanges.erase(i);
+	}
+}
+
+void ShareMonitor::addWatchesRecursive(const string& aPath) noexcept {
+	if (!addWatch(aPath)) {
+		return;
+	}
+
+	// Files may have been added before the watch was created
+	addChange(aPath, GET_TICK());
+
+	try {
+		FileFindIter end;
+		for (FileFindIter i(aPath, "*"); i != end; ++i) {
+			if (i->isDirectory() && !i->isLink()) {
+				addWatchesRecursive(aPath + i->getFileName() + PATH_SEPARATOR);
+			}
+		}
+	} catch (const FileException&) {
+		// Removed already?
+	}
+}
+
+void ShareMonitor::handleEvent(int aWatch, uint32_t aMask, const string& aName, uint64_t aTick) noexcept {
+	if (aMask & IN_Q_OVERFLOW) {
+		dcdebug("ShareMonitor: event queue overflow\n");
+		overflow = true;
+		return;
+	}
+
+	auto i = watchPaths.find(aWatch);
+	if (i == watchPaths.end()) {
+		// Removed already
+		return;
+	}
+
+	const auto path = i->second;
+	if (aMask & IN_IGNORED) {
+		// The directory was removed (or the watch was removed by us)
+		auto p = pathWatches.find(path);
+		if (p != pathWatches.end() && p->second == aWatch) {
+			pathWatches.erase(p);
+		}
+
+		watchPaths.erase(i);
+		return;
+	}
+
+	if (aMask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+		// The parent will also receive an event if it's being watched
+		removeWatches(path);
+		addChange(Util::getParentDir(path), aTick);
+		return;
+	}
+
+	if (aMask & IN_ISDIR) {
+		auto dirPath = path + aName + PATH_SEPARATOR;
+		if (aMask & (IN_CREATE | IN_MOVED_TO)) {
+			addWatchesRecursive(dirPath);
+		} else if (aMask & (IN_DELETE | IN_MOVED_FROM)) {
+			removeWatches(dirPath);
+		}
+	}
+
+	addChange(path, aTick);
+}
+
+int ShareMonitor::run() {
+	const size_t BUF_SIZE = 64 * 1024;
+	alignas(inotify_event) char buf[BUF_SIZE];
+
+	pollfd fds[2];
+	fds[0].fd = notifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = wakeFd;
+	fds[1].events = POLLIN;
+
+	while (true) {
+		auto count = poll(fds, 2, -1);
+		if (count == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			dcdebug("ShareMonitor: poll failed (%s)\n", Util::translateError(errno).c_str());
+			break;
+		}
+
+		if (fds[1].revents != 0) {
+			// Shutting down
+			break;
+		}
+
+		auto len = ::read(notifyFd, buf, BUF_SIZE);
+		if (len <= 0) {
+			continue;
+		}
+
+		auto tick = GET_TICK();
+
+		Lock l(cs);
+		for (auto p = buf; p < buf + len;) {
+			auto event = reinterpret_cast<const inotify_event*>(p);
+			handleEvent(event->wd, event->mask, event->len > 0 ? string(event->name) : Util::emptyString, tick);
+			p += sizeof(inotify_event) + event->len;
+		}
+	}
+
+	return 0;
+}
+
+#else
+
+ShareMonitor::ShareMonitor() {
+	throw Exception(Util::translateError(ENOSYS));
+}
+
+ShareMonitor::~ShareMonitor() { }
+
+bool ShareMonitor::isSupported() noexcept { return false; }
+void ShareMonitor::addDirectory(const string&) noexcept { }
+size_t ShareMonitor::setDirectories(const string&, const StringList& aDirectories) noexcept { return aDirectories.size(); }
+int ShareMonitor::run() { return 0; }
+
+#endif // HAVE_SYS_INOTIFY_H
+
+} // namespace dcpp
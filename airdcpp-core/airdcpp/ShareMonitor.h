@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SHARE_MONITOR_H
+#define DCPLUSPLUS_DCPP_SHARE_MONITOR_H
+
+#include "forward.h"
+#include "typedefs.h"
+
+#include "CriticalSection.h"
+#include "Thread.h"
+
+namespace dcpp {
+
+/**
+ * Watches the shared directories for changes (inotify)
+ *
+ * Each shared directory has a watch of its own. The directories with changes are collected until
+ * they have been quiet for a while so that files being copied won't cause a refresh for each written file.
+ * New subdirectories are watched as soon as they are created.
+ *
+ * If the kernel event queue overflows, the events are lost and the monitor is marked as overflown. The owner
+ * is then responsible for finding the changed directories in some other way.
+ *
+ * The monitor is only available on platforms supporting inotify.
+ */
+class ShareMonitor : public Thread {
+public:
+	struct Changes {
+		// Real paths of the directories that have changed
+		RefreshPathList directories;
+
+		// Events have been lost since the previous call
+		bool overflow = false;
+	};
+
+	// Throws Exception if monitoring isn't supported
+	ShareMonitor();
+	~ShareMonitor();
+
+	static bool isSupported() noexcept;
+
+	// Watch a directory that is about to be scanned so that changes made during the scan won't be missed
+	void addDirectory(const string& aPath) noexcept;
+
+	// Sync the watched directories in the given path (including the path itself) with the shared ones
+	// Watches of unshared directories are kept as long as they exist on disk as they may be shared
+	// by a refresh that is still running (pass an empty list to remove all watches in the path)
+	// Returns the number of directories that couldn't be watched
+	size_t setDirectories(const string& aPath, const StringList& aDirectories) noexcept;
+
+	// Returns the changed directories that have had no events during the settle time
+	// Directories with continuous changes are returned after MAX_CHANGE_DELAY
+	Changes takeChanges(uint64_t aTick, uint64_t aSettleTime) noexcept;
+
+	size_t getWatchCount() const noexcept;
+
+	// Number of directories that couldn't be watched (e.g. the system watch limit was reached)
+	size_t getFailedCount() const noexcept;
+private:
+	static const uint64_t MAX_CHANGE_DELAY = 60 * 1000;
+
+	int run() override;
+
+	void handleEvent(int aWatch, uint32_t aMask, const string& aName, uint64_t aTick) noexcept;
+
+	// Unsafe
+	bool addWatch(const string& aPath) noexcept;
+	void removeWatches(const string& aPath) noexcept;
+	void addWatchesRecursive(const string& aPath) noexcept;
+	void removeWatch(map<string, int>::iterator& aPos) noexcept;
+	void addChange(const string& aPath, uint64_t aTick) noexcept;
+
+	struct PendingChange {
+		uint64_t firstTick;
+		uint64_t lastTick;
+	};
+
+	int notifyFd = -1;
+	int wakeFd = -1;
+
+	unordered_map<int, string> watchPaths;
+
+	// Ordered so that the watches for a subtree can be found
+	map<string, int> pathWatches;
+
+	set<string> failedPaths;
+
+	map<string, PendingChange> pendingChanges;
+	bool overflow = false;
+
+	mutable CriticalSection cs;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SHARE_MONITOR_H)
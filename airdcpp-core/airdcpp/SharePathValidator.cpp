@@ -243,6 +243,27 @@ void SharePathValidator::validateHooked(const FileItemInfoBase& aFileItem, const
 	}
 }
 
+ShareValidationRejectionMap SharePathValidator::validateDirectoryContentHooked(const string& aPath, const ShareValidationItemList& aItems, bool aNewDirectory, const void* aCaller) const noexcept {
+	ShareValidationRejectionMap ret;
+	if (aItems.empty() || !directoryContentValidationHook.hasSubscribers()) {
+		return ret;
+	}
+
+	try {
+		auto results = directoryContentValidationHook.runHooksDataThrow(aCaller, aPath, aItems, aNewDirectory);
+		for (const auto& result: results) {
+			// Keep the first rejection for each item
+			ret.insert(result->data.begin(), result->data.end());
+		}
+	} catch (const HookRejectException& e) {
+		for (const auto& item: aItems) {
+			ret.emplace(item.name, e.getRejection());
+		}
+	}
+
+	return ret;
+}
+
 void SharePathValidator::validateRootPath(const string& aRealPath) const {
 	if (aRealPath.empty()) {
 		throw ShareException(STRING(NO_DIRECTORY_SPECIFIED));
@@ -55,6 +55,23 @@ private:
 	const ShareValidatorErrorType type;
 };
 
+// Directory content item for batched validations
+struct ShareValidationItem {
+	ShareValidationItem(const string& aName, int64_t aSize, bool aIsDirectory, bool aIsNew) noexcept : name(aName), size(aSize), isDirectory(aIsDirectory), isNew(aIsNew) {}
+
+	string name;
+	int64_t size;
+	bool isDirectory;
+
+	// Not in share yet
+	bool isNew;
+};
+
+typedef vector<ShareValidationItem> ShareValidationItemList;
+
+// Rejected content items by name
+typedef map<string, ActionHookRejectionPtr> ShareValidationRejectionMap;
+
 class SharePathValidator {
 public:
 	ActionHook<nullptr_t, const string&, int64_t> fileValidationHook;
@@ -62,6 +79,9 @@ public:
 	ActionHook<nullptr_t, const string&, bool /* aNewParent */> newDirectoryValidationHook;
 	ActionHook<nullptr_t, const string&, int64_t, bool /* aNewParent */> newFileValidationHook;
 
+	// Batched validation of the directory content (one call per directory)
+	ActionHook<ShareValidationRejectionMap, const string& /* aDirectoryPath */, const ShareValidationItemList&, bool /* aNewDirectory */> directoryContentValidationHook;
+
 	SharePathValidator();
 
 	// Get a list of excluded real paths
@@ -99,6 +119,11 @@ public:
 	// Throws ShareValidatorException/QueueException in case of errors
 	// FileException is thrown if the file doesn't exist
 	void validateNewPathHooked(const string& aPath, bool aSkipQueueCheck, bool aNewParent, const void* aCaller) const;
+
+	// Run the batched validation hooks for the content of a directory
+	// The items should have passed validateHooked already
+	// Returns the rejected items (a rejection of the whole directory content applies to all items)
+	ShareValidationRejectionMap validateDirectoryContentHooked(const string& aPath, const ShareValidationItemList& aItems, bool aNewDirectory, const void* aCaller) const noexcept;
 private:
 	// Comprehensive check for a directory/file whether it is valid to be added in share
 	// Use validateRootPath for new root directories instead
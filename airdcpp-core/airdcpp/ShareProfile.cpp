@@ -32,6 +32,10 @@ string FileList::getFileName() const noexcept {
 	return Util::getPath(Util::PATH_USER_CONFIG) + "files_" + Util::toString(profile) + "_" + Util::toString(listN) + ".xml.bz2";
 }
 
+string FileList::getBinaryFileName() const noexcept {
+	return Util::getPath(Util::PATH_USER_CONFIG) + "files_" + Util::toString(profile) + "_" + Util::toString(listN) + ".bin";
+}
+
 bool FileList::allowGenerateNew(bool aForced) noexcept {
 	bool dirty = (aForced && xmlDirty) || forceXmlRefresh || (xmlDirty && (lastXmlUpdate + 15 * 60 * 1000 < GET_TICK()));
 	if (!dirty) {
@@ -54,12 +58,21 @@ void FileList::saveList() {
 	bzXmlRef.reset(new File(getFileName(), File::READ, File::OPEN, File::BUFFER_SEQUENTIAL, false));
 	bzXmlListLen = File::getSize(getFileName());
 
+	binaryRef.reset(new File(getBinaryFileName(), File::READ, File::OPEN, File::BUFFER_SEQUENTIAL, false));
+	binaryListLen = File::getSize(getBinaryFileName());
+
 	//cleanup old filelists we failed to delete before due to uploading them.
 	StringList list = File::findFiles(Util::getPath(Util::PATH_USER_CONFIG), "files_" + Util::toString(profile) + "?*.xml.bz2");
 	for (auto& f : list) {
 		if (f != getFileName())
 			File::deleteFile(f);
 	}
+
+	list = File::findFiles(Util::getPath(Util::PATH_USER_CONFIG), "files_" + Util::toString(profile) + "?*.bin");
+	for (auto& f : list) {
+		if (f != getBinaryFileName())
+			File::deleteFile(f);
+	}
 }
 
 ShareProfileInfo::ShareProfileInfo(const string& aName, ProfileToken aToken /*rand*/, State aState /*STATE_NORMAL*/) : name(aName), token(aToken), state(aState) {}
@@ -42,16 +42,20 @@ class FileList {
 
 		GETSET(TTHValue, xmlRoot, XmlRoot);
 		GETSET(TTHValue, bzXmlRoot, BzXmlRoot);
+		GETSET(TTHValue, binaryRoot, BinaryRoot);
 		GETSET(ProfileToken, profile, Profile);
 
 		IGETSET(int64_t, xmlListLen, XmlListLen, 0);
 		IGETSET(int64_t, bzXmlListLen, BzXmlListLen, 0);
+		IGETSET(int64_t, binaryListLen, BinaryListLen, 0);
 		IGETSET(uint64_t, lastXmlUpdate, LastXmlUpdate, 0);
 		IGETSET(bool, xmlDirty, XmlDirty, true);
 		IGETSET(bool, forceXmlRefresh, ForceXmlRefresh, true); /// bypass the 15-minutes guard
 
 		unique_ptr<File> bzXmlRef;
+		unique_ptr<File> binaryRef;
 		string getFileName() const noexcept;
+		string getBinaryFileName() const noexcept;
 
 		bool allowGenerateNew(bool aForce = false) noexcept;
 		void generationFinished(bool aFailed) noexcept;
@@ -25,6 +25,15 @@
 #include "TimerManager.h"
 #include "ResourceManager.h"
 
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#include "File.h"
+#endif
+
 /// @todo remove when MinGW has this
 #ifdef __MINGW32__
 #ifndef EADDRNOTAVAIL
@@ -116,40 +125,89 @@ inline int setSocketOpt2(socket_t sock, int level, int option, int val) {
 	return ::setsockopt(sock, level, option, (char*)&val, len);
 }
 
-inline bool isConnected(socket_t sock) {
-	fd_set wfd;
-	struct timeval tv = { 0 };
+struct SocketPoll {
+	SocketPoll() { }
+	SocketPoll(socket_t aSock, bool aRead, bool aWrite) : sock(aSock), read(aRead), write(aWrite) { }
 
+	socket_t sock = INVALID_SOCKET;
+	bool read = false;
+	bool write = false;
+
+	bool readable = false;
+	bool writable = false;
+};
+
+/**
+ * Waits until any of the sockets is ready for the requested operations (at most 2 sockets)
+ * select can't be used on POSIX systems because descriptors above FD_SETSIZE would overflow the sets
+ * (WSAPoll on the other hand doesn't report failed connection attempts on older Windows versions)
+ */
+inline int pollSockets(SocketPoll* aSockets, size_t aCount, uint64_t aMillis) {
+	dcassert(aCount <= 2);
+
+#ifdef _WIN32
+	timeval tv;
+	tv.tv_sec = static_cast<long>(aMillis / 1000);
+	tv.tv_usec = (aMillis % 1000) * 1000;
+
+	fd_set rfd, wfd;
+	FD_ZERO(&rfd);
 	FD_ZERO(&wfd);
-	FD_SET(sock, &wfd);
+	for (size_t i = 0; i < aCount; ++i) {
+		if (aSockets[i].read)
+			FD_SET(aSockets[i].sock, &rfd);
+		if (aSockets[i].write)
+			FD_SET(aSockets[i].sock, &wfd);
+	}
 
-    if(::select(static_cast<int>(sock) + 1, NULL, &wfd, NULL, &tv) == 1) {
-        if (getSocketOptInt2(sock, SO_ERROR) == 0) {
-            return true;
-        }
-    }
+	auto ret = check([&] { return ::select(0, &rfd, &wfd, NULL, &tv); });
+	for (size_t i = 0; i < aCount; ++i) {
+		aSockets[i].readable = aSockets[i].read && FD_ISSET(aSockets[i].sock, &rfd);
+		aSockets[i].writable = aSockets[i].write && FD_ISSET(aSockets[i].sock, &wfd);
+	}
+#else
+	pollfd fds[2];
+	for (size_t i = 0; i < aCount; ++i) {
+		fds[i].fd = aSockets[i].sock;
+		fds[i].events = static_cast<short>((aSockets[i].read ? POLLIN : 0) | (aSockets[i].write ? POLLOUT : 0));
+		fds[i].revents = 0;
+	}
+
+	auto timeout = static_cast<int>(std::min<uint64_t>(aMillis, std::numeric_limits<int>::max()));
+	auto ret = check([&] { return ::poll(fds, static_cast<nfds_t>(aCount), timeout); });
+	for (size_t i = 0; i < aCount; ++i) {
+		// Errors and hangups are reported as readiness by select as well (the following call will fail)
+		auto events = fds[i].revents;
+		aSockets[i].readable = aSockets[i].read && (events & (POLLIN | POLLERR | POLLHUP));
+		aSockets[i].writable = aSockets[i].write && (events & (POLLOUT | POLLERR | POLLHUP));
+	}
+#endif
+
+	return ret;
+}
+
+inline bool isConnected(socket_t sock) {
+	SocketPoll p(sock, false, true);
+	if (pollSockets(&p, 1, 0) == 1 && p.writable) {
+		if (getSocketOptInt2(sock, SO_ERROR) == 0) {
+			return true;
+		}
+	}
 
 	return false;
 }
 
 inline socket_t readable(socket_t sock0, socket_t sock1) {
-	// FD_SET for an invalid socket can cause a buffer overflow (at least on Linux)
 	if (sock0 == INVALID_SOCKET) {
 		return sock1;
 	} else if (sock1 == INVALID_SOCKET) {
 		return sock0;
 	}
 
-	fd_set rfd;
-	struct timeval tv = { 0 };
-
-	FD_ZERO(&rfd);
-	FD_SET(sock0, &rfd);
-	FD_SET(sock1, &rfd);
-
-    if(::select(static_cast<int>(std::max(sock0, sock1)) + 1, &rfd, NULL, NULL, &tv) > 0) {
-        return static_cast<int>(FD_ISSET(sock0, &rfd) ? sock0 : sock1);
-    }
+	SocketPoll p[2] = { SocketPoll(sock0, true, false), SocketPoll(sock1, true, false) };
+	if (pollSockets(p, 2, 0) > 0) {
+		return p[0].readable ? sock0 : sock1;
+	}
 
 	return sock0;
 }
@@ -665,6 +723,30 @@ int Socket::write(const void* aBuffer, int aLen) {
 	return sent;
 }
 
+#ifdef HAVE_SYS_SENDFILE_H
+int Socket::sendFile(File& aFile, int aLen) {
+	// The file offset is updated by the kernel
+	auto sent = check([&] { return ::sendfile(getSock(), aFile.getNativeHandle(), nullptr, aLen); }, true);
+	if(sent > 0) {
+		stats.totalUp += sent;
+	}
+	return static_cast<int>(sent);
+}
+
+bool Socket::canSendFile() const noexcept {
+	return true;
+}
+#else
+int Socket::sendFile(File&, int) {
+	dcassert(0);
+	throw SocketException(ENOSYS);
+}
+
+bool Socket::canSendFile() const noexcept {
+	return false;
+}
+#endif
+
 /**
  * Sends data, will block until all data has been sent or an exception occurs
  * @param aBuffer Buffer with data
@@ -748,70 +830,40 @@ void Socket::writeTo(const string& aAddr, const string& aPort, const void* aBuff
  * @throw SocketException Select or the connection attempt failed.
  */
 std::pair<bool, bool> Socket::wait(uint64_t millis, bool checkRead, bool checkWrite) {
-	timeval tv;
-	tv.tv_sec = static_cast<long>(millis / 1000);
-	tv.tv_usec = (millis % 1000) * 1000;
-	fd_set rfd, wfd;
-	fd_set *rfdp = NULL, *wfdp = NULL;
-
-	int nfds = -1;
-
-	if(checkRead) {
-		rfdp = &rfd;
-		FD_ZERO(rfdp);
-		if(sock4.valid()) {
-			FD_SET(sock4, &rfd);
-			nfds = std::max((int)sock4, nfds);
-		}
-
-		if(sock6.valid()) {
-			FD_SET(sock6, &rfd);
-			nfds = std::max((int)sock6, nfds);
-		}
+	SocketPoll p[2];
+	size_t count = 0;
+	if(sock4.valid()) {
+		p[count++] = SocketPoll(sock4, checkRead, checkWrite);
 	}
 
-	if(checkWrite) {
-		wfdp = &wfd;
-		FD_ZERO(wfdp);
-		if(sock4.valid()) {
-			FD_SET(sock4, &wfd);
-			nfds = std::max((int)sock4, nfds);
-		}
-
-		if(sock6.valid()) {
-			FD_SET(sock6, &wfd);
-			nfds = std::max((int)sock6, nfds);
-		}
+	if(sock6.valid()) {
+		p[count++] = SocketPoll(sock6, checkRead, checkWrite);
 	}
 
-	check([&] { return ::select(nfds + 1, rfdp, wfdp, NULL, &tv); });
+	pollSockets(p, count, millis);
 
 	return std::make_pair(
-		rfdp && ((sock4.valid() && FD_ISSET(sock4, rfdp)) || (sock6.valid() && FD_ISSET(sock6, rfdp))),
-		wfdp && ((sock4.valid() && FD_ISSET(sock4, wfdp)) || (sock6.valid() && FD_ISSET(sock6, wfdp))));
+		p[0].readable || p[1].readable,
+		p[0].writable || p[1].writable);
 }
 
 bool Socket::waitConnected(uint64_t millis) {
-	timeval tv;
-	tv.tv_sec = static_cast<long>(millis / 1000);
-	tv.tv_usec = (millis % 1000) * 1000;
-	fd_set fd;
-	FD_ZERO(&fd);
-
-	int nfds = -1;
+	SocketPoll p[2];
+	size_t count = 0;
 	if(sock4.valid()) {
-		FD_SET(sock4, &fd);
-		nfds = static_cast<int>(sock4);
+		p[count++] = SocketPoll(sock4, false, true);
 	}
 
 	if(sock6.valid()) {
-		FD_SET(sock6, &fd);
-		nfds = std::max(static_cast<int>(sock6), nfds);
+		p[count++] = SocketPoll(sock6, false, true);
 	}
 
-	check([&] { return ::select(nfds + 1, NULL, &fd, NULL, &tv); });
+	pollSockets(p, count, millis);
+
+	auto sock4Ready = sock4.valid() && p[0].writable;
+	auto sock6Ready = sock6.valid() && p[count - 1].writable;
 
-	if(sock6.valid() && FD_ISSET(sock6, &fd)) {
+	if(sock6Ready) {
 		int err6 = getSocketOptInt2(sock6, SO_ERROR);
 		if(err6 == 0) {
 			sock4.reset(); // We won't be needing this any more...
@@ -825,7 +877,7 @@ bool Socket::waitConnected(uint64_t millis) {
 		sock6.reset();
 	}
 
-	if(sock4.valid() && FD_ISSET(sock4, &fd)) {
+	if(sock4Ready) {
 		int err4 = getSocketOptInt2(sock4, SO_ERROR);
 		if(err4 == 0) {
 			sock6.reset(); // We won't be needing this any more...
@@ -113,6 +113,16 @@ public:
 
 	virtual int write(const void* aBuffer, int aLen);
 	int write(const string& aData) { return write(aData.data(), (int)aData.length()); }
+
+	/**
+	 * Sends up to aLen bytes from the current position of the file without copying the data through the user space.
+	 * The file position is moved by the number of bytes sent.
+	 * @return Number of bytes sent, 0 at the end of file and -1 if the call would block.
+	 * @throw SocketException On any failure.
+	 */
+	virtual int sendFile(File& aFile, int aLen);
+	/** Whether sendFile is supported by the socket */
+	virtual bool canSendFile() const noexcept;
 	virtual void writeTo(const string& aIp, const string& aPort, const void* aBuffer, int aLen);
 	void writeTo(const string& aIp, const string& aPort, const string& aData) { writeTo(aIp, aPort, aData.data(), (int)aData.length()); }
 	virtual void shutdown() noexcept;
@@ -186,6 +196,8 @@ public:
 	}
 
 	bool isV6Valid() const noexcept;
+	socket_t getSock() const;
+
 	static string resolveName(const sockaddr* sa, socklen_t sa_len, int flags = NI_NUMERICHOST);
 protected:
 	typedef union {
@@ -195,8 +207,6 @@ protected:
 		sockaddr_storage sas;
 	} addr;
 
-	socket_t getSock() const;
-
 	mutable SocketHandle sock4;
 	mutable SocketHandle sock6;
 
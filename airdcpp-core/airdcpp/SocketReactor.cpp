@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "stdinc.h"
+#include "SocketReactor.h"
+
+#include "TimerManager.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+namespace dcpp {
+
+void SocketReactor::schedule(Client* aClient) noexcept {
+	unique_lock<mutex> l(queueMutex);
+	dcassert(!stopping);
+	queue.push_back(aClient);
+
+	if (queue.size() <= idleWorkers) {
+		l.unlock();
+		queueCond.notify_one();
+		return;
+	}
+
+	// All workers are busy (or blocking), start a new one
+	workers.erase(remove_if(workers.begin(), workers.end(), [](const unique_ptr<Worker>& w) {
+		if (!w->isFinished()) {
+			return false;
+		}
+
+		w->join();
+		return true;
+	}), workers.end());
+
+	auto worker = make_unique<Worker>(this);
+	try {
+		worker->start();
+	} catch (const ThreadException& e) {
+		// Someone else will have to handle it
+		dcdebug("SocketReactor: failed to start a worker (%s)\n", e.getError().c_str());
+		return;
+	}
+
+	runningWorkers++;
+	workers.push_back(move(worker));
+}
+
+SocketReactor::Client* SocketReactor::waitClient() noexcept {
+	unique_lock<mutex> l(queueMutex);
+	while (queue.empty() && !stopping) {
+		idleWorkers++;
+		auto status = queueCond.wait_for(l, chrono::seconds(WORKER_IDLE_TIMEOUT));
+		idleWorkers--;
+
+		if (status == cv_status::timeout && queue.empty() && runningWorkers > MIN_WORKERS) {
+			break;
+		}
+	}
+
+	if (queue.empty() || stopping) {
+		runningWorkers--;
+		return nullptr;
+	}
+
+	auto client = queue.front();
+	queue.pop_front();
+	return client;
+}
+
+int SocketReactor::Worker::run() {
+	while (auto client = reactor->waitClient()) {
+		client->process();
+	}
+
+	finished = true;
+	return 0;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+SocketReactor::SocketReactor() {
+	pollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (pollFd == -1) {
+		throw ThreadException(Util::translateError(errno));
+	}
+
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wakeFd == -1) {
+		::close(pollFd);
+		throw ThreadException(Util::translateError(errno));
+	}
+
+	// The wake event has no client
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+	epoll_ctl(pollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+	start();
+}
+
+SocketReactor::~SocketReactor() {
+	{
+		unique_lock<mutex> l(queueMutex);
+		dcassert(queue.empty());
+		stopping = true;
+	}
+
+	queueCond.notify_all();
+	for (auto& w: workers) {
+		w->join();
+	}
+
+	// Stop the poller
+	wakePoller();
+	join();
+
+	::close(wakeFd);
+	::close(pollFd);
+}
+
+bool SocketReactor::watch(Client* aClient, socket_t aSock, bool aRead, bool aWrite) noexcept {
+	epoll_event ev = {};
+	ev.events = EPOLLRDHUP | EPOLLONESHOT;
+	if (aRead) {
+		ev.events |= EPOLLIN;
+	}
+
+	if (aWrite) {
+		ev.events |= EPOLLOUT;
+	}
+
+	ev.data.ptr = aClient;
+
+	lock_guard<mutex> l(watchMutex);
+	auto i = watches.find(aClient);
+	if (i != watches.end()) {
+		if (i->second == aSock && epoll_ctl(pollFd, EPOLL_CTL_MOD, aSock, &ev) == 0) {
+			return true;
+		}
+
+		epoll_ctl(pollFd, EPOLL_CTL_DEL, i->second, nullptr);
+		watches.erase(i);
+	}
+
+	if (epoll_ctl(pollFd, EPOLL_CTL_ADD, aSock, &ev) != 0) {
+		return false;
+	}
+
+	watches.emplace(aClient, aSock);
+	return true;
+}
+
+void SocketReactor::unwatch(Client* aClient) noexcept {
+	lock_guard<mutex> l(watchMutex);
+	removeTimer(aClient);
+
+	auto i = watches.find(aClient);
+	if (i == watches.end()) {
+		return;
+	}
+
+	epoll_ctl(pollFd, EPOLL_CTL_DEL, i->second, nullptr);
+	watches.erase(i);
+}
+
+void SocketReactor::setTimer(Client* aClient, uint64_t aMillis) noexcept {
+	lock_guard<mutex> l(watchMutex);
+	removeTimer(aClient);
+
+	auto expires = GET_TICK() + aMillis;
+	auto wake = timers.empty() || expires < timers.begin()->first;
+	clientTimers.emplace(aClient, timers.emplace(expires, aClient));
+
+	if (wake) {
+		// The poller needs a shorter timeout
+		wakePoller();
+	}
+}
+
+void SocketReactor::removeTimer(Client* aClient) noexcept {
+	auto i = clientTimers.find(aClient);
+	if (i != clientTimers.end()) {
+		timers.erase(i->second);
+		clientTimers.erase(i);
+	}
+}
+
+void SocketReactor::wakePoller() noexcept {
+	uint64_t value = 1;
+	if (::write(wakeFd, &value, sizeof(value)) != sizeof(value)) {
+		// The counter is full, the poller will wake up anyway
+	}
+}
+
+int SocketReactor::getPollTimeout(uint64_t aTick) const noexcept {
+	if (timers.empty()) {
+		return -1;
+	}
+
+	auto expires = timers.begin()->first;
+	return expires <= aTick ? 0 : static_cast<int>(min<uint64_t>(expires - aTick, numeric_limits<int>::max()));
+}
+
+void SocketReactor::runTimers(uint64_t aTick) noexcept {
+	while (!timers.empty() && timers.begin()->first <= aTick) {
+		auto client = timers.begin()->second;
+		clientTimers.erase(client);
+		timers.erase(timers.begin());
+
+		client->onReady();
+	}
+}
+
+int SocketReactor::run() {
+	const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+
+	while (true) {
+		int timeout;
+		{
+			lock_guard<mutex> l(watchMutex);
+			timeout = getPollTimeout(GET_TICK());
+		}
+
+		auto count = epoll_wait(pollFd, events, MAX_EVENTS, timeout);
+		if (count == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			dcdebug("SocketReactor: epoll_wait failed (%s)\n", Util::translateError(errno).c_str());
+			break;
+		}
+
+		for (int i = 0; i < count; ++i) {
+			auto client = static_cast<Client*>(events[i].data.ptr);
+			if (!client) {
+				uint64_t value;
+				if (::read(wakeFd, &value, sizeof(value)) != sizeof(value)) {
+					// Someone else has reset the counter
+				}
+
+				lock_guard<mutex> l(queueMutex);
+				if (stopping) {
+					return 0;
+				}
+
+				// The timers have changed
+				continue;
+			}
+
+			// The client may have been removed after the event was received
+			lock_guard<mutex> l(watchMutex);
+			if (watches.find(client) != watches.end()) {
+				client->onReady();
+			}
+		}
+
+		lock_guard<mutex> l(watchMutex);
+		runTimers(GET_TICK());
+	}
+
+	return 0;
+}
+
+#else
+
+// Sockets will use threads of their own
+SocketReactor::SocketReactor() { }
+SocketReactor::~SocketReactor() { }
+
+bool SocketReactor::watch(Client*, socket_t, bool, bool) noexcept { errno = ENOSYS; return false; }
+void SocketReactor::setTimer(Client*, uint64_t) noexcept { }
+void SocketReactor::unwatch(Client*) noexcept { }
+int SocketReactor::run() { return 0; }
+
+#endif // HAVE_SYS_EPOLL_H
+
+} // namespace dcpp
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_SOCKET_REACTOR_H
+#define DCPLUSPLUS_DCPP_SOCKET_REACTOR_H
+
+#include "typedefs.h"
+
+#include "Singleton.h"
+#include "Socket.h"
+#include "Thread.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace dcpp {
+
+/**
+ * Runs socket state machines in a shared worker pool instead of giving each socket a thread of its own.
+ *
+ * Idle sockets are watched with a single epoll instance. When a watched socket becomes readable (or
+ * other work is queued for it), the client is scheduled for a worker that will process it until
+ * there is nothing left to do. A client is never processed by multiple workers at the same time.
+ *
+ * Clients may also wait for the socket to become writable or for a timer (e.g. when the transfer
+ * is throttled) without occupying a worker.
+ *
+ * Clients may still block while processing (connecting, reading files...), in which case a new
+ * worker is started for other clients. Workers that have been idle for a while will exit.
+ *
+ * The reactor is only created on platforms supporting epoll.
+ */
+class SocketReactor : public Singleton<SocketReactor>, public Thread {
+public:
+	class Client {
+	public:
+		/** Process the queued work. Called from a worker thread. */
+		virtual void process() noexcept = 0;
+
+		/** The watched socket became ready or the timer expired. Called from the poller thread, must not block. */
+		virtual void onReady() noexcept = 0;
+	protected:
+		~Client() { }
+	};
+
+	/** Queue the client for processing */
+	void schedule(Client* aClient) noexcept;
+
+	/**
+	 * Call onReady once the socket has data (or an error) to read or, if aWrite is set, can be written to.
+	 * The watch must be renewed after each notification.
+	 * Returns false if the socket can't be watched (errno is set).
+	 */
+	bool watch(Client* aClient, socket_t aSock, bool aRead = true, bool aWrite = false) noexcept;
+
+	/** Call onReady after aMillis. Replaces the previous timer of the client. */
+	void setTimer(Client* aClient, uint64_t aMillis) noexcept;
+
+	/** Stop watching the client's socket and remove its timer. Must be called before the socket is closed. */
+	void unwatch(Client* aClient) noexcept;
+private:
+	friend class Singleton<SocketReactor>;
+
+	class Worker : public Thread {
+	public:
+		Worker(SocketReactor* aReactor) : reactor(aReactor) { }
+
+		bool isFinished() const noexcept { return finished; }
+	private:
+		int run() override;
+
+		SocketReactor* reactor;
+		atomic<bool> finished = { false };
+	};
+
+	SocketReactor();
+	~SocketReactor();
+
+	int run() override;
+
+	// Returns the next client to process or nullptr if the worker should exit
+	Client* waitClient() noexcept;
+
+	// Poller
+	int pollFd = -1;
+	int wakeFd = -1;
+	unordered_map<Client*, socket_t> watches;
+
+	typedef multimap<uint64_t, Client*> TimerMap;
+	TimerMap timers;
+	unordered_map<Client*, TimerMap::iterator> clientTimers;
+	mutable mutex watchMutex;
+
+	// Wakes up the poller (unsafe)
+	void wakePoller() noexcept;
+
+	// Returns the time until the next timer expires, -1 if there are no timers (unsafe)
+	int getPollTimeout(uint64_t aTick) const noexcept;
+
+	// Calls onReady for the expired timers (unsafe)
+	void runTimers(uint64_t aTick) noexcept;
+	void removeTimer(Client* aClient) noexcept;
+
+	// Workers
+	static constexpr int WORKER_IDLE_TIMEOUT = 30; // seconds
+	static constexpr size_t MIN_WORKERS = 2;
+
+	deque<Client*> queue;
+	vector<unique_ptr<Worker>> workers;
+	size_t runningWorkers = 0;
+	size_t idleWorkers = 0;
+	bool stopping = false;
+	mutable mutex queueMutex;
+	condition_variable queueCond;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_SOCKET_REACTOR_H)
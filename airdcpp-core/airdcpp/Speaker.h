@@ -20,6 +20,9 @@
 #define DCPLUSPLUS_DCPP_SPEAKER_H
 
 #include <boost/range/algorithm/find.hpp>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -31,6 +34,14 @@ namespace dcpp {
 using std::vector;
 using boost::range::find;
 
+/**
+* Listener list that can be fired from multiple threads concurrently
+*
+* Firing reads an immutable snapshot of the listeners without locking. Adding and removing listeners copies the list
+* and publishes the new snapshot. The old snapshot is released after all fires that may still use it have completed.
+* Removing a listener outside of the listener callbacks also waits for the fires running in other threads,
+* so the removed listener won't be called after removeListener has returned.
+*/
 template<typename Listener>
 class Speaker {
 	typedef vector<Listener*> ListenerList;
@@ -38,44 +49,146 @@ class Speaker {
 public:
 	Speaker() noexcept { }
 	virtual ~Speaker() { 
-		dcassert(listeners.empty());
+		dcassert(listeners.load()->empty());
+		delete listeners.load();
+		for (auto l: retired) {
+			delete l;
+		}
 	}
 
+	Speaker(const Speaker&) = delete;
+	Speaker& operator=(const Speaker&) = delete;
+
 	template<typename... ArgT>
 	void fire(ArgT&&... args) noexcept {
-		Lock l(listenerCS);
-		tmpListeners = listeners;
-		for(auto listener: tmpListeners) {
+		auto readerIndex = static_cast<int>(epoch.load() & 1);
+		readers[readerIndex]++;
+
+		auto& activeFires = getActiveFires();
+		activeFires.push_back(this);
+
+		for (auto listener: *listeners.load()) {
 			listener->on(std::forward<ArgT>(args)...);
 		}
+
+		activeFires.pop_back();
+		readers[readerIndex]--;
 	}
 
 	void addListener(Listener* aListener) noexcept {
-		Lock l(listenerCS);
-		if(find(listeners, aListener) == listeners.end())
-			listeners.push_back(aListener);
+		const ListenerList* old = nullptr;
+
+		{
+			Lock l(listenerCS);
+			auto cur = listeners.load();
+			if (find(*cur, aListener) != cur->end())
+				return;
+
+			auto updated = new ListenerList(*cur);
+			updated->push_back(aListener);
+			old = listeners.exchange(updated);
+		}
+
+		release(old);
 	}
 
 	void removeListener(Listener* aListener) noexcept {
-		Lock l(listenerCS);
-		auto it = find(listeners, aListener);
-		if(it != listeners.end())
-			listeners.erase(it);
+		const ListenerList* old = nullptr;
+
+		{
+			Lock l(listenerCS);
+			auto cur = listeners.load();
+			auto it = find(*cur, aListener);
+			if (it == cur->end())
+				return;
+
+			auto updated = new ListenerList(*cur);
+			updated->erase(updated->begin() + (it - cur->begin()));
+			old = listeners.exchange(updated);
+		}
+
+		release(old);
 	}
 
 	bool hasListener(Listener* aListener) const noexcept {
 		Lock l(listenerCS);
-		return find(listeners, aListener) != listeners.end();
+		auto cur = listeners.load();
+		return find(*cur, aListener) != cur->end();
 	}
 
-	void removeListeners() noexcept {
+	size_t getListenerCount() const noexcept {
 		Lock l(listenerCS);
-		listeners.clear();
+		return listeners.load()->size();
+	}
+
+	void removeListeners() noexcept {
+		const ListenerList* old = nullptr;
+
+		{
+			Lock l(listenerCS);
+			if (listeners.load()->empty())
+				return;
+
+			old = listeners.exchange(new ListenerList());
+		}
+
+		release(old);
 	}
 	
-protected:
-	ListenerList listeners;
-	ListenerList tmpListeners;
+private:
+	// Speakers that are being fired in the current thread
+	static vector<const void*>& getActiveFires() noexcept {
+		static thread_local vector<const void*> activeFires;
+		return activeFires;
+	}
+
+	bool isFiring() const noexcept {
+		return find(getActiveFires(), this) != getActiveFires().end();
+	}
+
+	// Releases the replaced snapshot after the fires that may have loaded it have completed
+	void release(const ListenerList* aOld) noexcept {
+		if (isFiring()) {
+			// Called from a listener callback, waiting for the fires in other threads could deadlock
+			// The snapshot will be released by the next call that is made outside of the callbacks
+			Lock l(listenerCS);
+			retired.push_back(aOld);
+			return;
+		}
+
+		vector<const ListenerList*> released;
+
+		{
+			Lock l(listenerCS);
+			released.swap(retired);
+		}
+
+		released.push_back(aOld);
+
+		{
+			// The reader index is switched twice so that new fires can't prevent the old ones from draining
+			std::lock_guard<std::mutex> l(syncMutex);
+			for (int i = 0; i < 2; ++i) {
+				auto readerIndex = static_cast<int>(epoch.fetch_add(1) & 1);
+				while (readers[readerIndex].load() > 0) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		for (auto l: released) {
+			delete l;
+		}
+	}
+
+	std::atomic<const ListenerList*> listeners { new ListenerList() };
+	std::atomic<int> readers[2] = { { 0 }, { 0 } };
+	std::atomic<unsigned> epoch { 0 };
+
+	// Replaced snapshots that are waiting to be released
+	vector<const ListenerList*> retired;
+
+	std::mutex syncMutex;
 	mutable CriticalSection listenerCS;
 };
 
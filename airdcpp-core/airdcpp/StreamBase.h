@@ -79,6 +79,13 @@ public:
 	/* This only works for file streams */
 	virtual void setPos(int64_t /*pos*/) noexcept { }
 	virtual InputStream* releaseRootStream() { return this; }
+
+	/**
+		* Returns the file that the remaining data can be read from without going through the stream
+		* (used for zero-copy uploads) or nullptr if the data is filtered.
+		* aMaxBytes_ is lowered to the number of bytes that can be read from the file.
+		*/
+	virtual File* getSourceFile(int64_t& /*aMaxBytes_*/) noexcept { return nullptr; }
 };
 
 class IOStream : public InputStream, public OutputStream {
@@ -115,6 +115,10 @@ public:
 		auto as = s.release();
 		return as->releaseRootStream();
 	}
+	File* getSourceFile(int64_t& aMaxBytes_) noexcept override {
+		aMaxBytes_ = min(aMaxBytes_, maxBytes);
+		return s->getSourceFile(aMaxBytes_);
+	}
 private:
 	unique_ptr<InputStream> s;
 	int64_t maxBytes;
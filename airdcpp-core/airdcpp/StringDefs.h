@@ -766,6 +766,7 @@ enum Strings { // @DontAdd
 	MAX_UPLOAD_RATE, // "Maximum upload rate (0 = infinite)"
 	MAX_USERS, // "Max users"
 	MAX_VOL_HASHERS, // "Maximum number of hashers per volume"
+	MAX_FILE_HASH_THREADS, // "Threads for calculating the hash of a single file"
 	MBITS, // "Mbit/s"
 	MBITSPS, // "MBits/s"
 	MBPS, // "MB/s"
@@ -1350,6 +1351,7 @@ enum Strings { // @DontAdd
 	SETTINGS_GENERAL, // "General"
 	SETTINGS_GET_USER_COUNTRY, // "Get user country"
 	SETTINGS_SHOW_IP_COUNTRY_CHAT, // "Show user IP and country in chat when available"
+	SETTINGS_HASH_ASYNC_READS, // "Read files asynchronously without the system file cache when hashing"
 	SETTINGS_HIGH_PRIO_FILES, // "High priority files (separate files with '|', wildcards allowed)"
 	SETTINGS_HTTP_PROXY, // "HTTP Proxy"
 	SETTINGS_HUB_USER_COMMANDS, // "Accept custom user commands from hub"
@@ -1421,6 +1423,7 @@ enum Strings { // @DontAdd
 	SETTINGS_PUBLIC_HUB_LIST, // "Public hubs list"
 	SETTINGS_PUBLIC_HUB_LIST_URL, // "Public hubs list URL"
 	SETTINGS_QUEUE, // "Queue"
+	SETTINGS_QUEUE_STORE_DB, // "Save the download queue in a database instead of XML files (requires restart)"
 	SETTINGS_RECENT_HOURS, // "Maximum age for a bundle to consider it as recent"
 	SETTINGS_REPORT_ADDED_SOURCES, // "Show added bundle sources"
 	SETTINGS_REQUIRES_RESTART, // "Note; most of these options require that you restart AirDC++"
@@ -1440,7 +1443,10 @@ enum Strings { // @DontAdd
 	SETTINGS_SERVER_COMMANDS, // "Show server commands as status messages"
 	SETTINGS_SHARED_DIRECTORIES, // "Shared directories"
 	SETTINGS_SHARE_HIDDEN, // "Share hidden files"
+	SETTINGS_SHARE_MONITORING, // "Monitor the shared directories for changes instead of refreshing them periodically (local filesystems only, requires restart)"
 	SETTINGS_SHARE_PROFILE_NOTE, // "Note; Added share profiles can only be used in ADC hubs. NMDC hubs are forced to use the default profile."
+	SETTINGS_SHARE_SEARCH_INDEX, // "Use a name index for matching incoming searches (uses more memory, requires restart)"
+	SETTINGS_SHARE_SEARCH_PARALLEL, // "Match incoming searches against multiple share roots in parallel"
 	SETTINGS_SHARINGPAGE, // "Sharing"
 	SETTINGS_SHARING_OPTIONS, // "Sharing options"
 	SETTINGS_SHOW_INFO_TIPS, // "Show infotips in lists"
@@ -1518,9 +1524,14 @@ enum Strings { // @DontAdd
 	SHARED_FILE_ADDED, // "The file %1% has been added in share"
 	SHARE, // "Share"
 	SHARE_CACHE_FILE_MISSING, // "Cache file missing for root %1%"
+	SHARE_CHANGES_REFRESHED, // "Changes in %1% shared directories have been refreshed"
 	SHARE_FILES_BLOCKED, // "Some of the files from directory %1% won't be shared: %2%"
 	SHARE_DIRECTORY_BLOCKED, // "Directory %1% won't be shared: %2%"
 	SHARE_HIDDEN, // "Share hidden"
+	SHARE_MONITORING_FAILED, // "Failed to start monitoring the shared directories: %1%"
+	SHARE_MONITORING_NOT_SUPPORTED, // "Monitoring the shared directories isn't supported on this platform"
+	SHARE_MONITORING_OVERFLOW, // "Some of the changes in shared directories were missed, checking the directories for modifications"
+	SHARE_MONITORING_WATCHES_FAILED, // "%1% shared directories can't be monitored for changes (the system limit for watches may have been reached), scheduled refreshes will still be performed"
 	SHARE_PROFILE, // "Share profile"
 	SHARE_PROFILES, // "Share profiles"
 	SHELL_MENU, // "Shell menu"
@@ -21,6 +21,13 @@
 
 #include "Text.h"
 
+#include <boost/container/small_vector.hpp>
+
+#if defined(_M_X64) || defined(__amd64__) || defined(__x86_64__) || defined(__SSE2__)
+# define STRING_SEARCH_SSE2
+# include <emmintrin.h>
+#endif
+
 namespace dcpp {
 
 StringSearch::Pattern::Pattern(const string& aPattern) noexcept : pattern(Text::toLower(aPattern)), plen(aPattern.length()) {
@@ -87,31 +94,263 @@ size_t StringSearch::Pattern::matchLower(const string& aText, int aStartPos) con
 	return string::npos;
 }
 
+void StringSearch::Automaton::compile(const PatternList& aPatterns) noexcept {
+	transitions.clear();
+	outputStart.clear();
+	outputs.clear();
+	patternLengths.clear();
+	startByteList.clear();
+	startPairList.clear();
+	fill_n(classes, 256, 0);
+	fill_n(startBytes, 256, false);
+	classCount = 0;
+
+	if (aPatterns.empty()) {
+		return;
+	}
+
+	// Input classes (class 0 is used for bytes that aren't part of any pattern)
+	classCount = 1;
+	for (const auto& p: aPatterns) {
+		for (auto c: p.str()) {
+			auto& cls = classes[static_cast<uint8_t>(c)];
+			if (cls == 0) {
+				cls = static_cast<uint16_t>(classCount++);
+			}
+		}
+	}
+
+	// Trie (state 0 is the root, which can't be a target of the goto function)
+	vector<vector<uint32_t>> stateOutputs(1);
+	transitions.assign(classCount, 0);
+	for (uint32_t i = 0; i < aPatterns.size(); ++i) {
+		const auto& str = aPatterns[i].str();
+
+		uint32_t state = 0;
+		for (auto c: str) {
+			auto pos = state * classCount + classes[static_cast<uint8_t>(c)];
+			if (transitions[pos] == 0) {
+				transitions[pos] = static_cast<uint32_t>(stateOutputs.size());
+				stateOutputs.emplace_back();
+				transitions.resize(transitions.size() + classCount, 0);
+			}
+
+			state = transitions[pos];
+		}
+
+		stateOutputs[state].push_back(i);
+		patternLengths.push_back(str.size());
+	}
+
+	// Failure links, processed in breadth-first order so that the failure states are always complete
+	vector<uint32_t> fail(stateOutputs.size(), 0);
+	vector<uint32_t> order;
+	order.reserve(stateOutputs.size());
+
+	for (size_t cls = 0; cls < classCount; ++cls) {
+		if (transitions[cls] != 0) {
+			order.push_back(transitions[cls]);
+		}
+	}
+
+	for (size_t i = 0; i < order.size(); ++i) {
+		auto state = order[i];
+		for (size_t cls = 0; cls < classCount; ++cls) {
+			auto& next = transitions[state * classCount + cls];
+			auto failNext = transitions[fail[state] * classCount + cls];
+			if (next != 0) {
+				fail[next] = failNext;
+				order.push_back(next);
+			} else {
+				next = failNext;
+			}
+		}
+
+		// The failure state has been handled already
+		const auto& failOutputs = stateOutputs[fail[state]];
+		stateOutputs[state].insert(stateOutputs[state].end(), failOutputs.begin(), failOutputs.end());
+	}
+
+	// Flatten the outputs
+	outputStart.reserve(stateOutputs.size() + 1);
+	for (const auto& o: stateOutputs) {
+		outputStart.push_back(static_cast<uint32_t>(outputs.size()));
+		outputs.insert(outputs.end(), o.begin(), o.end());
+	}
+
+	outputStart.push_back(static_cast<uint32_t>(outputs.size()));
+
+	// Store the transitions as table offsets with a flag for states having outputs
+	for (auto& t: transitions) {
+		auto hasOutputs = !stateOutputs[t].empty();
+		t = static_cast<uint32_t>(t * classCount) | (hasOutputs ? OUTPUT_FLAG : 0);
+	}
+
+	// Bytes that may start a match
+	for (int c = 0; c < 256; ++c) {
+		if ((transitions[classes[c]] & ~OUTPUT_FLAG) != 0) {
+			startBytes[c] = true;
+			startByteList.push_back(static_cast<char>(c));
+		}
+	}
+
+	// Byte pairs that may start a match (these produce far less false positives than single bytes)
+	for (const auto& p: aPatterns) {
+		const auto& str = p.str();
+		if (str.size() < 2) {
+			startPairList.clear();
+			break;
+		}
+
+		auto exists = false;
+		for (size_t i = 0; i < startPairList.size(); i += 2) {
+			if (startPairList.compare(i, 2, str, 0, 2) == 0) {
+				exists = true;
+				break;
+			}
+		}
+
+		if (!exists) {
+			startPairList.append(str, 0, 2);
+		}
+	}
+
+	// Don't bother if there are too many prefixes as there would be hits in most blocks anyway
+	if (startPairList.size() > MAX_SIMD_PREFIXES * 2) {
+		startPairList.clear();
+	}
+}
+
+size_t StringSearch::Automaton::findStart(const uint8_t* aText, size_t aPos, size_t aLen) const noexcept {
+#ifdef STRING_SEARCH_SSE2
+	// Compare 16 positions at once against the first two bytes of each pattern
+	if (!startPairList.empty()) {
+		for (; aPos + 17 <= aLen; aPos += 16) {
+			auto block1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aText + aPos));
+			auto block2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aText + aPos + 1));
+
+			auto hits = _mm_setzero_si128();
+			for (size_t i = 0; i < startPairList.size(); i += 2) {
+				auto firstHits = _mm_cmpeq_epi8(block1, _mm_set1_epi8(startPairList[i]));
+				auto secondHits = _mm_cmpeq_epi8(block2, _mm_set1_epi8(startPairList[i + 1]));
+				hits = _mm_or_si128(hits, _mm_and_si128(firstHits, secondHits));
+			}
+
+			auto mask = static_cast<unsigned int>(_mm_movemask_epi8(hits));
+			if (mask != 0) {
+				while ((mask & 1) == 0) {
+					mask >>= 1;
+					aPos++;
+				}
+
+				return aPos;
+			}
+		}
+	} else if (startByteList.size() <= MAX_SIMD_PREFIXES) {
+		// Compare 16 bytes at once against each possible start byte
+		for (; aPos + 16 <= aLen; aPos += 16) {
+			auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aText + aPos));
+
+			auto hits = _mm_setzero_si128();
+			for (auto c: startByteList) {
+				hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+			}
+
+			auto mask = static_cast<unsigned int>(_mm_movemask_epi8(hits));
+			if (mask != 0) {
+				while ((mask & 1) == 0) {
+					mask >>= 1;
+					aPos++;
+				}
+
+				return aPos;
+			}
+		}
+	}
+#endif
+
+	while (aPos < aLen && !startBytes[aText[aPos]]) {
+		aPos++;
+	}
+
+	return aPos;
+}
+
+template<class HandlerT>
+void StringSearch::Automaton::scan(const string& aText, HandlerT&& aHandler) const noexcept {
+	if (transitions.empty()) {
+		return;
+	}
+
+	// uint8_t to avoid problems with signed char pointer arithmetic
+	auto tx = reinterpret_cast<const uint8_t*>(aText.data());
+	const auto len = aText.size();
+
+	uint32_t row = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (row == 0 && len - i >= 16) {
+			i = findStart(tx, i, len);
+			if (i == len) {
+				break;
+			}
+		}
+
+		auto next = transitions[row + classes[tx[i]]];
+		row = next & ~OUTPUT_FLAG;
+		if (next & OUTPUT_FLAG) {
+			auto state = row / classCount;
+			for (auto o = outputStart[state]; o < outputStart[state + 1]; ++o) {
+				auto pattern = outputs[o];
+				if (!aHandler(pattern, i + 1 - patternLengths[pattern])) {
+					return;
+				}
+			}
+		}
+	}
+}
 
 void StringSearch::addString(const string& aStr) {
-	if (!aStr.empty())
+	if (!aStr.empty()) {
 		patterns.emplace_back(Text::toLower(aStr));
+		automaton.compile(patterns);
+	}
 }
 
 bool StringSearch::match_all(const string& aText) const {
-	auto text = Text::toLower(aText);
-	for (const auto& p : patterns) {
-		if (p.matchLower(text) == string::npos) {
-			return false;
-		}
+	return match_all_lower(Text::toLower(aText));
+}
+
+bool StringSearch::match_all_lower(const string& aText) const {
+	if (patterns.size() == 1) {
+		return patterns.front().matchLower(aText) != string::npos;
 	}
 
-	return true;
+	boost::container::small_vector<bool, 16> found(patterns.size(), false);
+	size_t foundCount = 0;
+	automaton.scan(aText, [&](uint32_t aPattern, size_t) {
+		if (!found[aPattern]) {
+			found[aPattern] = true;
+			foundCount++;
+		}
+
+		return foundCount < patterns.size();
+	});
+
+	return foundCount == patterns.size();
 }
 
 bool StringSearch::match_any_lower(const string& aText) const {
-	for (const auto& p : patterns) {
-		if (p.matchLower(aText) != string::npos) {
-			return true;
-		}
+	if (patterns.size() == 1) {
+		return patterns.front().matchLower(aText) != string::npos;
 	}
 
-	return false;
+	bool found = false;
+	automaton.scan(aText, [&](uint32_t, size_t) {
+		found = true;
+		return false;
+	});
+
+	return found;
 }
 
 bool StringSearch::match_any(const string& aText) const {
@@ -119,39 +358,54 @@ bool StringSearch::match_any(const string& aText) const {
 }
 
 int StringSearch::matchLower(const string& aText, bool aResumeOnNoMatch, ResultList* results_) const {
-	int matches = 0, listPos = 0;
-	for (const auto& p: patterns) {
-		size_t addPos = string::npos;
-		for (;;) {
-			size_t curPos = p.matchLower(aText, addPos == string::npos ? 0 : addPos + 1);
-			if (curPos != string::npos) {
-				if (results_ && listPos > 0) {
-					// prefer sequential match order if this isn't the first pattern
-					if ((*results_)[listPos - 1] != string::npos && (*results_)[listPos - 1] > curPos) {
-						addPos = curPos;
-						continue; // keep on searching
-					}
-				}
-
-				// use this match
-				addPos = curPos;
+	// Find the first occurrence of each pattern
+	boost::container::small_vector<size_t, 8> firstPositions(patterns.size(), string::npos);
+	if (patterns.size() == 1) {
+		firstPositions.front() = patterns.front().matchLower(aText);
+	} else {
+		size_t found = 0;
+		automaton.scan(aText, [&](uint32_t aPattern, size_t aPos) {
+			auto& pos = firstPositions[aPattern];
+			if (pos == string::npos) {
+				pos = aPos;
+				found++;
 			}
 
-			if (addPos != string::npos) {
-				matches++;
-				if (results_) {
-					(*results_)[listPos] = addPos;
-				}
-			} else if (!aResumeOnNoMatch) {
-				if (results_) {
-					fill_n((*results_).begin(), listPos, string::npos);
+			return found < patterns.size();
+		});
+	}
+
+	int matches = 0;
+	for (size_t listPos = 0; listPos < patterns.size(); ++listPos) {
+		auto addPos = firstPositions[listPos];
+		if (addPos != string::npos && results_ && listPos > 0) {
+			// prefer sequential match order if this isn't the first pattern
+			auto prevPos = (*results_)[listPos - 1];
+			if (prevPos != string::npos && prevPos > addPos) {
+				// use the first match after the previous pattern (or the last match if there are no such matches)
+				const auto& p = patterns[listPos];
+				auto curPos = p.matchLower(aText, static_cast<int>(prevPos));
+				if (curPos == string::npos) {
+					for (auto nextPos = addPos; nextPos != string::npos; nextPos = p.matchLower(aText, static_cast<int>(addPos + 1))) {
+						addPos = nextPos;
+					}
+				} else {
+					addPos = curPos;
 				}
-				return 0;
 			}
+		}
 
-			break;
+		if (addPos != string::npos) {
+			matches++;
+			if (results_) {
+				(*results_)[listPos] = addPos;
+			}
+		} else if (!aResumeOnNoMatch) {
+			if (results_) {
+				fill_n((*results_).begin(), listPos, string::npos);
+			}
+			return 0;
 		}
-		listPos++;
 	}
 
 	return matches;
@@ -159,6 +413,7 @@ int StringSearch::matchLower(const string& aText, bool aResumeOnNoMatch, ResultL
 
 void StringSearch::clear() {
 	patterns.clear();
+	automaton.compile(patterns);
 }
 
 }
\ No newline at end of file
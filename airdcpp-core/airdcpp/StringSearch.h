@@ -24,11 +24,11 @@
 namespace dcpp {
 
 /**
-* A class that implements a fast substring search algo suited for matching
-* one pattern against many strings (currently Quick Search, a variant of
+* A class that implements fast substring search algos suited for matching
+* patterns against many strings. Single patterns use Quick Search (a variant of
 * Boyer-Moore. Code based on "A very fast substring search algorithm" by
-* D. Sunday).
-* @todo Perhaps find an algo suitable for matching multiple substrings.
+* D. Sunday) while the pattern lists are matched in a single pass with an
+* Aho-Corasick automaton.
 */
 class StringSearch {
 public:
@@ -65,6 +65,7 @@ public:
 	typedef vector<Pattern> PatternList;
 
 	bool match_all(const string& aText) const;
+	bool match_all_lower(const string& aText) const;
 	bool match_any(const string& aText) const;
 	bool match_any_lower(const string& aText) const;
 
@@ -76,7 +77,43 @@ public:
 	inline bool empty() const { return patterns.empty(); }
 	inline const PatternList& getPatterns() const { return patterns; }
 private:
+	/**
+	* Aho-Corasick automaton (DFA) for finding all occurrences of the patterns in a single pass.
+	* Bytes that don't appear in any of the patterns share the same input class in order to keep
+	* the transition table small.
+	*/
+	class Automaton {
+	public:
+		void compile(const PatternList& aPatterns) noexcept;
+
+		// Calls aHandler(patternIndex, startPos) for each pattern occurrence (ordered by the end position)
+		// Scanning is stopped if the handler returns false
+		template<class HandlerT>
+		void scan(const string& aText, HandlerT&& aHandler) const noexcept;
+	private:
+		// Returns the position of the next byte that may start a pattern (or aLen if there are none)
+		size_t findStart(const uint8_t* aText, size_t aPos, size_t aLen) const noexcept;
+
+		// Transitions are stored as offsets of the target rows, states having outputs are flagged
+		static const uint32_t OUTPUT_FLAG = 1u << 31;
+
+		// Maximum number of different pattern prefixes for the vectorized prefilter
+		static const size_t MAX_SIMD_PREFIXES = 8;
+
+		uint16_t classes[256] = {};
+		bool startBytes[256] = {};
+		string startByteList;
+		string startPairList;
+		size_t classCount = 0;
+
+		vector<uint32_t> transitions;
+		vector<uint32_t> outputStart;
+		vector<uint32_t> outputs;
+		vector<size_t> patternLengths;
+	};
+
 	PatternList patterns;
+	Automaton automaton;
 };
 
 } // namespace dcpp
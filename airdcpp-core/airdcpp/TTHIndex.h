@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_TTH_INDEX_H
+#define DCPLUSPLUS_DCPP_TTH_INDEX_H
+
+#include "typedefs.h"
+
+#include "CriticalSection.h"
+#include "MerkleTree.h"
+
+namespace dcpp {
+
+/**
+* Multimap from TTH values to items (pointers of objects having getTTH())
+*
+* The index is split in shards by the TTH prefix and each shard has its own lock, so that lookups only
+* wait for modifications of the same shard rather than for the whole index. The shards are open addressing tables
+* (linear probing) keyed by the first 8 bytes of the TTH, full TTHs are compared only for matching keys.
+*
+* The items must stay alive until they have been removed from the index.
+*/
+template<class T>
+class TTHIndex : boost::noncopyable {
+public:
+	static const size_t SHARD_COUNT = 64;
+
+	void insert(const T& aItem) noexcept {
+		auto key = getKey(aItem->getTTH());
+		auto& shard = getShard(key);
+
+		WLock l(shard.cs);
+		shard.insert(key, aItem);
+	}
+
+	// Returns false if the item wasn't found
+	bool erase(const T& aItem) noexcept {
+		auto key = getKey(aItem->getTTH());
+		auto& shard = getShard(key);
+
+		WLock l(shard.cs);
+		return shard.erase(key, aItem);
+	}
+
+	// Adds all items from another index (locks each shard only once)
+	void insert(const TTHIndex& aOther) noexcept {
+		for (size_t i = 0; i < SHARD_COUNT; ++i) {
+			auto& source = aOther.shards[i];
+			auto& target = shards[i];
+
+			RLock ls(source.cs);
+			if (source.count == 0) {
+				continue;
+			}
+
+			WLock lt(target.cs);
+			target.reserve(target.count + source.count);
+			for (const auto& slot : source.slots) {
+				if (slot.item) {
+					target.insert(slot.key, slot.item);
+				}
+			}
+		}
+	}
+
+	void clear() noexcept {
+		for (auto& shard : shards) {
+			WLock l(shard.cs);
+			shard.slots = SlotList();
+			shard.count = 0;
+		}
+	}
+
+	// Returns the first item with the TTH that matches the predicate (or nullptr)
+	// The predicate is called while holding the shard lock
+	template<class PredT>
+	T find(const TTHValue& aTTH, const PredT& aPred) const noexcept {
+		T ret = nullptr;
+		forEach(aTTH, [&](const T& aItem) {
+			if (!aPred(aItem)) {
+				return true;
+			}
+
+			ret = aItem;
+			return false;
+		});
+
+		return ret;
+	}
+
+	T find(const TTHValue& aTTH) const noexcept {
+		return find(aTTH, [](const T&) { return true; });
+	}
+
+	bool contains(const TTHValue& aTTH) const noexcept {
+		return find(aTTH) != nullptr;
+	}
+
+	// Calls the handler for each item with the TTH until the handler returns false
+	// The handler is called while holding the shard lock
+	template<class HandlerT>
+	void forEach(const TTHValue& aTTH, const HandlerT& aHandler) const noexcept {
+		auto key = getKey(aTTH);
+		auto& shard = getShard(key);
+
+		RLock l(shard.cs);
+		if (shard.count == 0) {
+			return;
+		}
+
+		auto mask = shard.slots.size() - 1;
+		for (auto i = key & mask; shard.slots[i].item; i = (i + 1) & mask) {
+			const auto& slot = shard.slots[i];
+			if (slot.key == key && slot.item->getTTH() == aTTH && !aHandler(slot.item)) {
+				return;
+			}
+		}
+	}
+
+	// Calls the handler for all items (shard by shard)
+	template<class HandlerT>
+	void forEach(const HandlerT& aHandler) const noexcept {
+		for (const auto& shard : shards) {
+			RLock l(shard.cs);
+			for (const auto& slot : shard.slots) {
+				if (slot.item) {
+					aHandler(slot.item);
+				}
+			}
+		}
+	}
+
+	size_t size() const noexcept {
+		size_t ret = 0;
+		for (const auto& shard : shards) {
+			RLock l(shard.cs);
+			ret += shard.count;
+		}
+
+		return ret;
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	size_t countUniqueTTHs() const noexcept {
+		size_t ret = 0;
+		vector<const TTHValue*> tths;
+		for (const auto& shard : shards) {
+			RLock l(shard.cs);
+			tths.clear();
+			for (const auto& slot : shard.slots) {
+				if (slot.item) {
+					tths.push_back(&slot.item->getTTH());
+				}
+			}
+
+			// Equal TTHs are always in the same shard
+			sort(tths.begin(), tths.end(), [](const TTHValue* a, const TTHValue* b) { return *a < *b; });
+			ret += distance(tths.begin(), unique(tths.begin(), tths.end(), [](const TTHValue* a, const TTHValue* b) { return *a == *b; }));
+		}
+
+		return ret;
+	}
+
+	size_t countMemoryUsage() const noexcept {
+		size_t ret = sizeof(TTHIndex);
+		for (const auto& shard : shards) {
+			RLock l(shard.cs);
+			ret += shard.slots.capacity() * sizeof(Slot);
+		}
+
+		return ret;
+	}
+private:
+	struct Slot {
+		uint64_t key = 0;
+		T item = nullptr;
+	};
+
+	typedef vector<Slot> SlotList;
+
+	// Aligned to avoid false sharing of the locks
+	struct alignas(64) Shard {
+		mutable SharedMutex cs;
+		SlotList slots;
+		size_t count = 0;
+
+		void insert(uint64_t aKey, const T& aItem) noexcept {
+			reserve(count + 1);
+
+			auto mask = slots.size() - 1;
+			auto i = aKey & mask;
+			while (slots[i].item) {
+				i = (i + 1) & mask;
+			}
+
+			slots[i].key = aKey;
+			slots[i].item = aItem;
+			count++;
+		}
+
+		bool erase(uint64_t aKey, const T& aItem) noexcept {
+			if (count == 0) {
+				return false;
+			}
+
+			auto mask = slots.size() - 1;
+			for (auto i = aKey & mask; slots[i].item; i = (i + 1) & mask) {
+				if (slots[i].item == aItem) {
+					eraseSlot(i);
+					count--;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// Keeps the load factor below 0.7
+		void reserve(size_t aCount) noexcept {
+			if (aCount * 10 <= slots.size() * 7) {
+				return;
+			}
+
+			size_t newSize = slots.empty() ? 16 : slots.size();
+			while (aCount * 10 > newSize * 7) {
+				newSize *= 2;
+			}
+
+			SlotList oldSlots(newSize);
+			oldSlots.swap(slots);
+
+			auto mask = newSize - 1;
+			for (const auto& slot : oldSlots) {
+				if (slot.item) {
+					auto i = slot.key & mask;
+					while (slots[i].item) {
+						i = (i + 1) & mask;
+					}
+
+					slots[i] = slot;
+				}
+			}
+		}
+
+		// Backward shift deletion (no tombstones are needed)
+		void eraseSlot(size_t aPos) noexcept {
+			auto mask = slots.size() - 1;
+			auto hole = aPos;
+			for (auto i = (hole + 1) & mask; slots[i].item; i = (i + 1) & mask) {
+				// Items whose home slot is cyclically within (hole, i] must stay in place
+				auto home = slots[i].key & mask;
+				auto stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+				if (!stays) {
+					slots[hole] = slots[i];
+					hole = i;
+				}
+			}
+
+			slots[hole] = Slot();
+		}
+	};
+
+	static uint64_t getKey(const TTHValue& aTTH) noexcept {
+		uint64_t key;
+		memcpy(&key, aTTH.data, sizeof(key));
+		return key;
+	}
+
+	// Shards use the highest bits of the key and the slot positions the lowest ones
+	Shard& getShard(uint64_t aKey) noexcept {
+		return shards[aKey >> 58];
+	}
+
+	const Shard& getShard(uint64_t aKey) const noexcept {
+		return shards[aKey >> 58];
+	}
+
+	static_assert(SHARD_COUNT == 1 << 6, "Shard selection expects 64 shards");
+	array<Shard, SHARD_COUNT> shards;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_TTH_INDEX_H)
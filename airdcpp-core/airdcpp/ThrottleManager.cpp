@@ -19,17 +19,23 @@
 #include "stdinc.h"
 #include "ThrottleManager.h"
 
-#include "DownloadManager.h"
 #include "Socket.h"
 #include "TimerManager.h"
-#include "UploadManager.h"
 
 namespace dcpp {
-	// The actual limiting code is from StrongDC++
-	// Bandwidth limiting in DC++ is broken: https://www.airdcpp.net/forum/viewtopic.php?f=7&t=4485&p=8856#p8856
-
 	#define CONDWAIT_TIMEOUT		250
 
+	// Buckets may hold tokens for this long (ms) so that unused bandwidth can't accumulate
+	#define GROUP_BURST_MS			50
+	#define GLOBAL_BURST_MS			100
+
+	// Bytes
+	#define MIN_BURST				4096
+	#define MIN_CHUNK				1024
+
+	// Groups that haven't transferred data for this long (ms) won't get a share of the bandwidth
+	#define IDLE_TIMEOUT			2000
+
 	// constructor
 	ThrottleManager::ThrottleManager(void)
 	{
@@ -41,79 +47,328 @@ namespace dcpp {
 	{
 		TimerManager::getInstance()->removeListener(this);
 
-		// release conditional variables on exit
-		downCond.notify_all();
-		upCond.notify_all();
+		// release waiting sockets on exit
+		{
+			lock_guard<mutex> lock(waitMutex);
+			stopping = true;
+		}
+
+		waitCond.notify_all();
+	}
+
+	ThrottleManager::Flow::Flow() noexcept : trafficClass(CLASS_STANDARD), group(reinterpret_cast<uintptr_t>(this)), weight(getPriorityWeight(Priority::NORMAL)) {
+
+	}
+
+	void ThrottleManager::Flow::set(TrafficClass aClass, uint64_t aGroup, int aWeight) noexcept {
+		trafficClass = aClass;
+		group = aGroup;
+		weight = max(aWeight, 1);
+	}
+
+	int ThrottleManager::getPriorityWeight(Priority aPriority) noexcept {
+		// Each priority level doubles the weight
+		auto prio = max(static_cast<int>(aPriority), static_cast<int>(Priority::LOWEST));
+		return 1 << (prio - static_cast<int>(Priority::LOWEST));
+	}
+
+	int ThrottleManager::Scheduler::getClassWeight(TrafficClass aClass) noexcept {
+		return aClass == CLASS_STANDARD ? 3 : 1;
+	}
+
+	void ThrottleManager::Scheduler::Bucket::refill(uint64_t aTick) noexcept {
+		if (aTick > lastRefill) {
+			tokens = min(burst, tokens + rate * static_cast<double>(aTick - lastRefill));
+			lastRefill = aTick;
+		}
+	}
+
+	void ThrottleManager::Scheduler::Bucket::add(double aTokens) noexcept {
+		tokens = min(burst, tokens + aTokens);
+	}
+
+	size_t ThrottleManager::Scheduler::acquire(const Flow& aFlow, size_t aWanted, int64_t aLimit, uint64_t aTick) noexcept {
+		lock_guard<mutex> l(cs);
+		setLimit(aLimit, aTick);
+
+		auto& group = getGroup(aFlow, aTick);
+		group.lastActive = aTick;
+
+		global.refill(aTick);
+		group.bucket.refill(aTick);
+
+		// Avoid tiny packets
+		auto minChunk = min(static_cast<double>(aWanted), static_cast<double>(MIN_CHUNK));
+
+		// Borrow bandwidth that the other groups aren't using when the own share isn't enough
+		auto available = max(min(group.bucket.tokens, global.tokens), getSpareTokens(group, aTick));
+		auto granted = floor(min(static_cast<double>(aWanted), available));
+		if (granted < minChunk) {
+			return 0;
+		}
+
+		// The borrowed part isn't taken from the own bucket
+		group.bucket.tokens = max(group.bucket.tokens - granted, 0.0);
+		global.tokens -= granted;
+		return static_cast<size_t>(granted);
+	}
+
+	void ThrottleManager::Scheduler::release(const Flow& aFlow, size_t aUnused) noexcept {
+		lock_guard<mutex> l(cs);
+		auto group = findGroup(aFlow);
+		if (group) {
+			group->bucket.add(static_cast<double>(aUnused));
+		}
+
+		global.add(static_cast<double>(aUnused));
+	}
+
+	size_t ThrottleManager::Scheduler::getAvailable(const Flow& aFlow, int64_t aLimit, uint64_t aTick) noexcept {
+		lock_guard<mutex> l(cs);
+		setLimit(aLimit, aTick);
+
+		global.refill(aTick);
+
+		auto& group = getGroup(aFlow, aTick);
+		group.bucket.refill(aTick);
+
+		auto available = max(min(group.bucket.tokens, global.tokens), getSpareTokens(group, aTick));
+		return available > 0 ? static_cast<size_t>(available) : 0;
+	}
+
+	uint64_t ThrottleManager::Scheduler::getWaitTime(const Flow& aFlow, uint64_t aTick) noexcept {
+		lock_guard<mutex> l(cs);
+		auto group = findGroup(aFlow);
+		if (!group || global.rate <= 0 || group->bucket.rate <= 0) {
+			return CONDWAIT_TIMEOUT;
+		}
+
+		global.refill(aTick);
+		group->bucket.refill(aTick);
+
+		auto groupWait = (MIN_CHUNK - group->bucket.tokens) / group->bucket.rate;
+		auto globalWait = (MIN_CHUNK - global.tokens) / global.rate;
+
+		auto waitTime = static_cast<uint64_t>(max(ceil(max(groupWait, globalWait)), 1.0));
+		return min(waitTime, static_cast<uint64_t>(CONDWAIT_TIMEOUT));
+	}
+
+	void ThrottleManager::Scheduler::removeIdle(uint64_t aTick) noexcept {
+		lock_guard<mutex> l(cs);
+
+		auto removed = false;
+		for (auto& c : classes) {
+			for (auto i = c.groups.begin(); i != c.groups.end();) {
+				if (i->second.lastActive + IDLE_TIMEOUT < aTick) {
+					c.totalWeight -= i->second.weight;
+					i = c.groups.erase(i);
+					removed = true;
+				} else {
+					++i;
+				}
+			}
+		}
+
+		if (removed) {
+			updateRates(aTick);
+		}
+	}
+
+	size_t ThrottleManager::Scheduler::getGroupCount() const noexcept {
+		lock_guard<mutex> l(cs);
+
+		size_t ret = 0;
+		for (const auto& c : classes) {
+			ret += c.groups.size();
+		}
+
+		return ret;
+	}
+
+	ThrottleManager::Scheduler::Group* ThrottleManager::Scheduler::findGroup(const Flow& aFlow) noexcept {
+		auto& groups = classes[aFlow.getClass()].groups;
+		auto i = groups.find(aFlow.getGroup());
+		return i != groups.end() ? &i->second : nullptr;
+	}
+
+	ThrottleManager::Scheduler::Group& ThrottleManager::Scheduler::getGroup(const Flow& aFlow, uint64_t aTick) noexcept {
+		auto& c = classes[aFlow.getClass()];
+		auto weight = aFlow.getWeight();
+
+		auto res = c.groups.emplace(aFlow.getGroup(), Group());
+		auto& group = res.first->second;
+		if (res.second) {
+			group.bucket.lastRefill = aTick;
+			group.lastActive = aTick;
+			group.weight = weight;
+			c.totalWeight += weight;
+			updateRates(aTick);
+		} else if (group.weight != weight) {
+			c.totalWeight += weight - group.weight;
+			group.weight = weight;
+			updateRates(aTick);
+		}
+
+		return group;
+	}
+
+	double ThrottleManager::Scheduler::getSpareTokens(const Group& aGroup, uint64_t aTick) noexcept {
+		auto reserved = 0.0;
+		for (auto& c : classes) {
+			for (auto& g : c.groups | map_values) {
+				if (&g != &aGroup) {
+					g.bucket.refill(aTick);
+					reserved += g.bucket.tokens;
+				}
+			}
+		}
+
+		return global.tokens - reserved;
+	}
+
+	void ThrottleManager::Scheduler::setLimit(int64_t aLimit, uint64_t aTick) noexcept {
+		if (limit != aLimit) {
+			limit = aLimit;
+			updateRates(aTick);
+		}
+	}
+
+	void ThrottleManager::Scheduler::updateRates(uint64_t aTick) noexcept {
+		// Refill with the previous rates first
+		global.refill(aTick);
+		for (auto& c : classes) {
+			for (auto& g : c.groups | map_values) {
+				g.bucket.refill(aTick);
+			}
+		}
+
+		global.rate = static_cast<double>(limit) / 1000.0;
+		global.burst = max(global.rate * GLOBAL_BURST_MS, static_cast<double>(MIN_BURST));
+		global.tokens = min(global.tokens, global.burst);
+
+		auto activeWeight = 0;
+		for (size_t i = 0; i < classes.size(); ++i) {
+			if (!classes[i].groups.empty()) {
+				activeWeight += getClassWeight(static_cast<TrafficClass>(i));
+			}
+		}
+
+		for (size_t i = 0; i < classes.size(); ++i) {
+			auto& c = classes[i];
+			if (c.groups.empty()) {
+				continue;
+			}
+
+			auto classRate = global.rate * getClassWeight(static_cast<TrafficClass>(i)) / activeWeight;
+			for (auto& g : c.groups | map_values) {
+				g.bucket.rate = classRate * g.weight / c.totalWeight;
+				g.bucket.burst = max(g.bucket.rate * GROUP_BURST_MS, static_cast<double>(MIN_BURST));
+				g.bucket.tokens = min(g.bucket.tokens, g.bucket.burst);
+			}
+		}
 	}
 
 	/*
 	 * Limits a traffic and reads a packet from the network
 	 */
-	int ThrottleManager::read(Socket* sock, void* buffer, size_t len)
+	int ThrottleManager::read(Socket* sock, void* buffer, size_t len, const Flow& aFlow)
 	{
-		size_t downs = DownloadManager::getInstance()->getTotalDownloadConnectionCount();
-		if (getDownLimit() == 0 || downs == 0)
+		auto limit = getDownLimit();
+		if (limit == 0)
 			return sock->read(buffer, len);
 
-		unique_lock<mutex> lock(downMutex);
-
-
-		if(downTokens > 0)
-		{
-			size_t slice = (getDownLimit() * 1024) / downs;
-			size_t readSize = min(slice, min(len, downTokens));
-				
-			// read from socket
-			readSize = sock->read(buffer, readSize);
-				
-			if(readSize > 0)
-				downTokens -= readSize;
-
-			// next code can't be in critical section, so we must unlock here
-			lock.unlock();
+		auto readSize = downScheduler.acquire(aFlow, len, static_cast<int64_t>(limit) * 1024, GET_TICK());
+		if (readSize == 0) {
+			// no tokens, wait for them
+			waitTokens(downScheduler, aFlow);
+			return -1;	// from BufferedSocket: -1 = retry, 0 = connection close
+		}
 
-			// give a chance to other transfers to get a token
-			Thread::yield();
-			return readSize;
+		// read from socket
+		auto ret = sock->read(buffer, readSize);
+		if (ret < static_cast<int>(readSize)) {
+			downScheduler.release(aFlow, readSize - max(ret, 0));
 		}
 
-		// no tokens, wait for them
-		downCond.wait_for(lock, std::chrono::milliseconds(CONDWAIT_TIMEOUT));
-		return -1;	// from BufferedSocket: -1 = retry, 0 = connection close
+		return ret;
 	}
 	
 	/*
 	 * Limits a traffic and writes a packet to the network
 	 * We must handle this a little bit differently than downloads, because of that stupidity in OpenSSL
 	 */		
-	int ThrottleManager::write(Socket* sock, void* buffer, size_t& len)
+	int ThrottleManager::write(Socket* sock, void* buffer, size_t& len, const Flow& aFlow)
 	{
-		size_t ups = UploadManager::getInstance()->getUploadCount();
-		if(getUpLimit() == 0 || ups == 0)
-			return sock->write(buffer, len);
-		
-		unique_lock<mutex> lock(upMutex);
-		
-		if(upTokens > 0)
-		{
-			size_t slice = (getUpLimit() * 1024) / ups;
-			len = min(slice, min(len, upTokens));
-			upTokens -= len;
+		return throttleUpload(len, aFlow, [&](size_t aLen) { return sock->write(buffer, static_cast<int>(aLen)); });
+	}
 
-			// next code can't be in critical section, so we must unlock here
-			lock.unlock();
+	/*
+	 * Limits a traffic and sends a part of the file to the network
+	 */
+	int ThrottleManager::sendFile(Socket* sock, File& aFile, size_t& len, const Flow& aFlow)
+	{
+		return throttleUpload(len, aFlow, [&](size_t aLen) { return sock->sendFile(aFile, static_cast<int>(aLen)); });
+	}
 
-			// write to socket			
-			int sent = sock->write(buffer, len);
+	int ThrottleManager::throttleUpload(size_t& len, const Flow& aFlow, const function<int (size_t)>& aSendF)
+	{
+		auto limit = getUpLimit();
+		if (limit == 0)
+			return aSendF(len);
 
-			// give a chance to other transfers to get a token
-			Thread::yield();
-			return sent;
+		auto granted = upScheduler.acquire(aFlow, len, static_cast<int64_t>(limit) * 1024, GET_TICK());
+		if (granted == 0) {
+			// no tokens, wait for them
+			waitTokens(upScheduler, aFlow);
+			return 0;	// from BufferedSocket: -1 = failed, 0 = retry
 		}
-		
-		// no tokens, wait for them
-		upCond.wait_for(lock, std::chrono::milliseconds(CONDWAIT_TIMEOUT));
-		return 0;	// from BufferedSocket: -1 = failed, 0 = retry
+
+		len = granted;
+		int sent = aSendF(len);
+
+		// Failed writes are retried with the same size without the limiter (OpenSSL), keep those tokens consumed
+		if (sent >= 0 && sent < static_cast<int>(len)) {
+			upScheduler.release(aFlow, len - sent);
+		}
+
+		return sent;
+	}
+
+	void ThrottleManager::waitTokens(Scheduler& aScheduler, const Flow& aFlow) noexcept {
+		auto waitTime = aScheduler.getWaitTime(aFlow, GET_TICK());
+
+		unique_lock<mutex> lock(waitMutex);
+		if (!stopping) {
+			waitCond.wait_for(lock, std::chrono::milliseconds(waitTime));
+		}
+	}
+
+	size_t ThrottleManager::acquireDownload(const Flow& aFlow, size_t aWanted) noexcept {
+		auto limit = getDownLimit();
+		return limit == 0 ? aWanted : downScheduler.acquire(aFlow, aWanted, static_cast<int64_t>(limit) * 1024, GET_TICK());
+	}
+
+	size_t ThrottleManager::acquireUpload(const Flow& aFlow, size_t aWanted) noexcept {
+		auto limit = getUpLimit();
+		return limit == 0 ? aWanted : upScheduler.acquire(aFlow, aWanted, static_cast<int64_t>(limit) * 1024, GET_TICK());
+	}
+
+	size_t ThrottleManager::getAvailableDownload(const Flow& aFlow) noexcept {
+		auto limit = getDownLimit();
+		return limit == 0 ? numeric_limits<size_t>::max() : downScheduler.getAvailable(aFlow, static_cast<int64_t>(limit) * 1024, GET_TICK());
+	}
+
+	size_t ThrottleManager::getAvailableUpload(const Flow& aFlow) noexcept {
+		auto limit = getUpLimit();
+		return limit == 0 ? numeric_limits<size_t>::max() : upScheduler.getAvailable(aFlow, static_cast<int64_t>(limit) * 1024, GET_TICK());
+	}
+
+	uint64_t ThrottleManager::getDownloadWaitTime(const Flow& aFlow) noexcept {
+		return downScheduler.getWaitTime(aFlow, GET_TICK());
+	}
+
+	uint64_t ThrottleManager::getUploadWaitTime(const Flow& aFlow) noexcept {
+		return upScheduler.getWaitTime(aFlow, GET_TICK());
 	}
 
 	void ThrottleManager::setSetting(SettingsManager::IntSetting setting, int value) noexcept {
@@ -164,24 +419,9 @@ namespace dcpp {
 	}
 
 	// TimerManagerListener
-	void ThrottleManager::on(TimerManagerListener::Second, uint64_t /*aTick*/) noexcept {
-		auto downLimit = getDownLimit() * 1024;
-		auto upLimit = getUpLimit() * 1024;
-		
-		// readd tokens
-		if(downLimit > 0)
-		{
-			lock_guard<mutex> lock(downMutex);
-			downTokens = downLimit;
-			downCond.notify_all();
-		}
-			
-		if(upLimit > 0)
-		{
-			lock_guard<mutex> lock(upMutex);
-			upTokens = upLimit;
-			upCond.notify_all();
-		}
+	void ThrottleManager::on(TimerManagerListener::Second, uint64_t aTick) noexcept {
+		downScheduler.removeIdle(aTick);
+		upScheduler.removeIdle(aTick);
 	}
 
 
@@ -19,6 +19,7 @@
 #ifndef DCPLUSPLUS_DCPP_THROTTLEMANAGER_H
 #define DCPLUSPLUS_DCPP_THROTTLEMANAGER_H
 
+#include "Priority.h"
 #include "Singleton.h"
 #include "SettingsManager.h"
 #include "TimerManagerListener.h"
@@ -32,23 +33,140 @@ namespace dcpp
 	
 	/**
 	 * Manager for throttling traffic flow speed.
-	 * Inspired by Token Bucket algorithm: http://en.wikipedia.org/wiki/Token_bucket
+	 * 
+	 * The bandwidth of each direction is shared with hierarchical token buckets: global limit -> traffic class -> group (user or bundle).
+	 * The limit is split between the active classes and groups by their weights and the buckets are refilled continuously.
+	 * Capacity that isn't used by the active groups can be borrowed by others.
 	 */
 	class ThrottleManager :
 		public Singleton<ThrottleManager>, private TimerManagerListener
 	{
 	public:
+		enum TrafficClass : uint8_t {
+			CLASS_STANDARD, // Regular transfers
+			CLASS_MINOR,	// Small files, file lists, extra slots
+			CLASS_LAST
+		};
+
+		/*
+		 * Throttling group of a connection, may be changed at any time
+		 */
+		class Flow : boost::noncopyable {
+		public:
+			// Each connection is in a group of its own by default
+			Flow() noexcept;
+
+			// Connections in the same group (e.g. user or bundle) share the bandwidth of the group
+			void set(TrafficClass aClass, uint64_t aGroup, int aWeight) noexcept;
+
+			TrafficClass getClass() const noexcept { return trafficClass; }
+			uint64_t getGroup() const noexcept { return group; }
+			int getWeight() const noexcept { return weight; }
+		private:
+			atomic<TrafficClass> trafficClass;
+			atomic<uint64_t> group;
+			atomic<int> weight;
+		};
+
+		/*
+		 * Token bucket scheduler for a single direction
+		 */
+		class Scheduler : boost::noncopyable {
+		public:
+			// Returns the number of bytes that the flow may transfer (0 if it should wait)
+			// aLimit is in bytes per second
+			size_t acquire(const Flow& aFlow, size_t aWanted, int64_t aLimit, uint64_t aTick) noexcept;
+
+			// Returns the bytes that were acquired but not transferred
+			void release(const Flow& aFlow, size_t aUnused) noexcept;
+
+			// Returns the number of bytes that the flow could transfer without waiting
+			size_t getAvailable(const Flow& aFlow, int64_t aLimit, uint64_t aTick) noexcept;
+
+			// Returns the time (ms) until the flow can transfer data again
+			uint64_t getWaitTime(const Flow& aFlow, uint64_t aTick) noexcept;
+
+			// Removes groups that haven't transferred data recently
+			void removeIdle(uint64_t aTick) noexcept;
+
+			size_t getGroupCount() const noexcept;
+		private:
+			struct Bucket {
+				double tokens = 0;
+				double rate = 0; // bytes per ms
+				double burst = 0;
+				uint64_t lastRefill = 0;
+
+				void refill(uint64_t aTick) noexcept;
+				void add(double aTokens) noexcept;
+			};
+
+			struct Group {
+				Bucket bucket;
+				int weight = 1;
+				uint64_t lastActive = 0;
+			};
+
+			struct Class {
+				unordered_map<uint64_t, Group> groups;
+				int totalWeight = 0;
+			};
+
+			// Finds or adds the group for the flow (unsafe)
+			Group& getGroup(const Flow& aFlow, uint64_t aTick) noexcept;
+			Group* findGroup(const Flow& aFlow) noexcept;
+
+			// Tokens of the global bucket that aren't reserved by the other groups (unsafe)
+			double getSpareTokens(const Group& aGroup, uint64_t aTick) noexcept;
+
+			// Splits the limit between the active classes and groups (unsafe)
+			void updateRates(uint64_t aTick) noexcept;
+			void setLimit(int64_t aLimit, uint64_t aTick) noexcept;
+
+			static int getClassWeight(TrafficClass aClass) noexcept;
+
+			Bucket global;
+			array<Class, CLASS_LAST> classes;
+			int64_t limit = 0;
+			mutable mutex cs;
+		};
 
 		/*
 		 * Limits a traffic and reads a packet from the network
+		 * Blocks the calling thread while waiting for tokens (use the non-blocking functions with event-driven sockets)
 		 */
-		int read(Socket* sock, void* buffer, size_t len);
+		int read(Socket* sock, void* buffer, size_t len, const Flow& aFlow);
 		
 		/*
 		 * Limits a traffic and writes a packet to the network
 		 * We must handle this a little bit differently than downloads, because of that stupidity in OpenSSL
 		 */		
-		int write(Socket* sock, void* buffer, size_t& len);
+		int write(Socket* sock, void* buffer, size_t& len, const Flow& aFlow);
+
+		/*
+		 * Limits a traffic and sends a part of the file to the network (without copying it through the user space)
+		 */
+		int sendFile(Socket* sock, File& aFile, size_t& len, const Flow& aFlow);
+
+		/*
+		 * Non-blocking access to the limiters (for event-driven sockets)
+		 * Acquired bytes that aren't transferred should be released
+		 */
+		size_t acquireDownload(const Flow& aFlow, size_t aWanted) noexcept;
+		size_t acquireUpload(const Flow& aFlow, size_t aWanted) noexcept;
+		void releaseDownload(const Flow& aFlow, size_t aUnused) noexcept { downScheduler.release(aFlow, aUnused); }
+		void releaseUpload(const Flow& aFlow, size_t aUnused) noexcept { upScheduler.release(aFlow, aUnused); }
+
+		// Returns the number of bytes that can be transferred immediately
+		size_t getAvailableDownload(const Flow& aFlow) noexcept;
+		size_t getAvailableUpload(const Flow& aFlow) noexcept;
+
+		// Returns the time (ms) until the flow may transfer data again
+		uint64_t getDownloadWaitTime(const Flow& aFlow) noexcept;
+		uint64_t getUploadWaitTime(const Flow& aFlow) noexcept;
+
+		// Returns the weight of a download group with the priority
+		static int getPriorityWeight(Priority aPriority) noexcept;
 
 		/*
 		 * Returns current download limit.
@@ -65,16 +183,15 @@ namespace dcpp
 
 		static const int MAX_LIMIT = 1024 * 1024; // 1 GiB/s
 	private:
-		
-		// download limiter
-		size_t						downTokens = 0;
-		condition_variable	downCond;
-		mutex				downMutex;
-		
-		// upload limiter
-		size_t						upTokens = 0;
-		condition_variable	upCond;
-		mutex				upMutex;
+		Scheduler downScheduler;
+		Scheduler upScheduler;
+
+		// used for waiting for tokens (released on exit)
+		condition_variable	waitCond;
+		mutex				waitMutex;
+		bool				stopping = false;
+
+		void waitTokens(Scheduler& aScheduler, const Flow& aFlow) noexcept;
 			
 		friend class Singleton<ThrottleManager>;
 		
@@ -84,6 +201,9 @@ namespace dcpp
 		// destructor
 		~ThrottleManager();
 		
+		// Grants upload tokens for the packet and sends it with aSendF
+		int throttleUpload(size_t& len, const Flow& aFlow, const function<int (size_t)>& aSendF);
+
 		// TimerManagerListener
 		void on(TimerManagerListener::Second, uint64_t aTick) noexcept;
 				
@@ -34,6 +34,8 @@
 
 #include "debug.h"
 
+#include <chrono>
+
 #ifdef BOOST_BIG_ENDIAN
 #define TIGER_BIG_ENDIAN
 #endif
@@ -42,6 +44,12 @@
 #define TIGER_ARCH64
 #endif
 
+// Vector kernels for hashing multiple messages in parallel (selected at runtime)
+#if defined(TIGER_ARCH64) && !defined(TIGER_BIG_ENDIAN) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__amd64__))
+#define TIGER_MULTI_SIMD
+#include <immintrin.h>
+#endif
+
 namespace dcpp {
 
 #define PASSES 3
@@ -249,6 +257,382 @@ uint8_t* TigerHash::finalize() {
 	return getResult();
 }
 
+/*
+ * Multi-buffer compression
+ *
+ * The rounds of a single Tiger compression depend on each other and the S box lookups leave most
+ * of the execution units idle. Compressing blocks of independent messages (such as the leaves of
+ * a hash tree) together hides the latencies: the scalar kernels interleave the lanes so that the
+ * compiler can schedule them in parallel, while the vector kernels fetch the S box values of
+ * all lanes with a single gather instruction.
+ *
+ * Kernels take MAX_LANES blocks (8 words each) and states (3 words each) stored lane after lane.
+ */
+
+#ifndef TIGER_BIG_ENDIAN
+typedef void (*MultiCompressF)(const uint64_t* sbox, const uint64_t* blocks, uint64_t* states, size_t count);
+
+#define lane_sbox(n, v, shift) (sbox[(n) * 256 + (((v) >> (shift)) & 0xFF)])
+
+template<size_t N>
+static inline void laneRound(const uint64_t* sbox, uint64_t (&a)[N], uint64_t (&b)[N], uint64_t (&c)[N], const uint64_t (&x)[N], uint64_t mul) {
+	for (size_t l = 0; l < N; ++l) {
+		c[l] ^= x[l];
+		a[l] -= lane_sbox(0, c[l], 0) ^ lane_sbox(1, c[l], 16) ^ lane_sbox(2, c[l], 32) ^ lane_sbox(3, c[l], 48);
+		b[l] += lane_sbox(3, c[l], 8) ^ lane_sbox(2, c[l], 24) ^ lane_sbox(1, c[l], 40) ^ lane_sbox(0, c[l], 56);
+		b[l] *= mul;
+	}
+}
+
+template<size_t N>
+static inline void lanePass(const uint64_t* sbox, uint64_t (&a)[N], uint64_t (&b)[N], uint64_t (&c)[N], const uint64_t (&x)[8][N], uint64_t mul) {
+	laneRound(sbox, a, b, c, x[0], mul);
+	laneRound(sbox, b, c, a, x[1], mul);
+	laneRound(sbox, c, a, b, x[2], mul);
+	laneRound(sbox, a, b, c, x[3], mul);
+	laneRound(sbox, b, c, a, x[4], mul);
+	laneRound(sbox, c, a, b, x[5], mul);
+	laneRound(sbox, a, b, c, x[6], mul);
+	laneRound(sbox, b, c, a, x[7], mul);
+}
+
+template<size_t N>
+static inline void laneKeySchedule(uint64_t (&x)[8][N]) {
+	for (size_t l = 0; l < N; ++l) {
+		x[0][l] -= x[7][l] ^ _ULL(0xA5A5A5A5A5A5A5A5);
+		x[1][l] ^= x[0][l];
+		x[2][l] += x[1][l];
+		x[3][l] -= x[2][l] ^ ((~x[1][l]) << 19);
+		x[4][l] ^= x[3][l];
+		x[5][l] += x[4][l];
+		x[6][l] -= x[5][l] ^ ((~x[4][l]) >> 23);
+		x[7][l] ^= x[6][l];
+		x[0][l] += x[7][l];
+		x[1][l] -= x[0][l] ^ ((~x[7][l]) << 19);
+		x[2][l] ^= x[1][l];
+		x[3][l] += x[2][l];
+		x[4][l] -= x[3][l] ^ ((~x[2][l]) >> 23);
+		x[5][l] ^= x[4][l];
+		x[6][l] += x[5][l];
+		x[7][l] -= x[6][l] ^ _ULL(0x0123456789ABCDEF);
+	}
+}
+
+template<size_t N>
+static void compressLanes(const uint64_t* sbox, const uint64_t* blocks, uint64_t* states) {
+	uint64_t a[N], b[N], c[N], aa[N], bb[N], cc[N];
+	uint64_t x[8][N];
+
+	for (size_t l = 0; l < N; ++l) {
+		aa[l] = a[l] = states[l * 3];
+		bb[l] = b[l] = states[l * 3 + 1];
+		cc[l] = c[l] = states[l * 3 + 2];
+		for (size_t i = 0; i < 8; ++i) {
+			x[i][l] = blocks[l * 8 + i];
+		}
+	}
+
+	lanePass(sbox, a, b, c, x, 5);
+	laneKeySchedule(x);
+	lanePass(sbox, c, a, b, x, 7);
+	laneKeySchedule(x);
+	lanePass(sbox, b, c, a, x, 9);
+
+	for (size_t l = 0; l < N; ++l) {
+		states[l * 3] = a[l] ^ aa[l];
+		states[l * 3 + 1] = b[l] - bb[l];
+		states[l * 3 + 2] = c[l] + cc[l];
+	}
+}
+
+// Interleaves up to four lanes (more lanes would run out of registers)
+static void compressScalar(const uint64_t* sbox, const uint64_t* blocks, uint64_t* states, size_t count) {
+	for (; count >= 4; count -= 4, blocks += 4 * 8, states += 4 * 3) {
+		compressLanes<4>(sbox, blocks, states);
+	}
+
+	if (count >= 2) {
+		compressLanes<2>(sbox, blocks, states);
+		count -= 2, blocks += 2 * 8, states += 2 * 3;
+	}
+
+	if (count == 1) {
+		compressLanes<1>(sbox, blocks, states);
+	}
+}
+
+#undef lane_sbox
+
+#ifdef TIGER_MULTI_SIMD
+
+// Multiplications by 5, 7 and 9 (there is no 64 bit vector multiplication in AVX2)
+#define simd_mul(v, add, sub, slli, shift, op) op(slli(v, shift), v)
+#define simd_mul5(v, add, sub, slli) simd_mul(v, add, sub, slli, 2, add)
+#define simd_mul7(v, add, sub, slli) simd_mul(v, add, sub, slli, 3, sub)
+#define simd_mul9(v, add, sub, slli) simd_mul(v, add, sub, slli, 3, add)
+
+#define simd_round(a,b,c,x,mul, V) \
+	c = V##_xor(c, x); \
+	a = V##_sub(a, V##_xor(V##_xor(V##_sbox(0, c, 0), V##_sbox(1, c, 16)), V##_xor(V##_sbox(2, c, 32), V##_sbox(3, c, 48)))); \
+	b = V##_add(b, V##_xor(V##_xor(V##_sbox(3, c, 8), V##_sbox(2, c, 24)), V##_xor(V##_sbox(1, c, 40), V##_sbox(0, c, 56)))); \
+	b = simd_##mul(b, V##_add, V##_sub, V##_slli);
+
+#define simd_pass(a,b,c,mul, V) \
+	simd_round(a,b,c,x0,mul, V) \
+	simd_round(b,c,a,x1,mul, V) \
+	simd_round(c,a,b,x2,mul, V) \
+	simd_round(a,b,c,x3,mul, V) \
+	simd_round(b,c,a,x4,mul, V) \
+	simd_round(c,a,b,x5,mul, V) \
+	simd_round(a,b,c,x6,mul, V) \
+	simd_round(b,c,a,x7,mul, V)
+
+#define simd_key_schedule(V) \
+	x0 = V##_sub(x0, V##_xor(x7, V##_set1(_ULL(0xA5A5A5A5A5A5A5A5)))); \
+	x1 = V##_xor(x1, x0); \
+	x2 = V##_add(x2, x1); \
+	x3 = V##_sub(x3, V##_xor(x2, V##_slli(V##_not(x1), 19))); \
+	x4 = V##_xor(x4, x3); \
+	x5 = V##_add(x5, x4); \
+	x6 = V##_sub(x6, V##_xor(x5, V##_srli(V##_not(x4), 23))); \
+	x7 = V##_xor(x7, x6); \
+	x0 = V##_add(x0, x7); \
+	x1 = V##_sub(x1, V##_xor(x0, V##_slli(V##_not(x7), 19))); \
+	x2 = V##_xor(x2, x1); \
+	x3 = V##_add(x3, x2); \
+	x4 = V##_sub(x4, V##_xor(x3, V##_srli(V##_not(x2), 23))); \
+	x5 = V##_xor(x5, x4); \
+	x6 = V##_add(x6, x5); \
+	x7 = V##_sub(x7, V##_xor(x6, V##_set1(_ULL(0x0123456789ABCDEF))));
+
+#define simd_compress(V) \
+	aa = a; bb = b; cc = c; \
+	simd_pass(a,b,c,mul5, V) \
+	simd_key_schedule(V) \
+	simd_pass(c,a,b,mul7, V) \
+	simd_key_schedule(V) \
+	simd_pass(b,c,a,mul9, V) \
+	a = V##_xor(a, aa); \
+	b = V##_sub(b, bb); \
+	c = V##_add(c, cc);
+
+#define avx2_xor _mm256_xor_si256
+#define avx2_add _mm256_add_epi64
+#define avx2_sub _mm256_sub_epi64
+#define avx2_slli _mm256_slli_epi64
+#define avx2_srli _mm256_srli_epi64
+#define avx2_set1(v) _mm256_set1_epi64x((long long)(v))
+#define avx2_not(v) _mm256_xor_si256(v, _mm256_set1_epi64x(-1))
+#define avx2_sbox(n, v, shift) _mm256_i64gather_epi64((const long long*)(sbox + (n) * 256), _mm256_and_si256(_mm256_srli_epi64(v, shift), byteMask), 8)
+#define avx2_lanes(p, stride, i) _mm256_set_epi64x((long long)(p)[3 * (stride) + (i)], (long long)(p)[2 * (stride) + (i)], (long long)(p)[(stride) + (i)], (long long)(p)[i])
+
+__attribute__((target("avx2")))
+static void compressAvx2(const uint64_t* sbox, const uint64_t* blocks, uint64_t* states, size_t count) {
+	const __m256i byteMask = _mm256_set1_epi64x(0xFF);
+	for (size_t lane = 0; lane < count; lane += 4, blocks += 4 * 8, states += 4 * 3) {
+		__m256i a = avx2_lanes(states, 3, 0), b = avx2_lanes(states, 3, 1), c = avx2_lanes(states, 3, 2);
+		__m256i aa, bb, cc;
+		__m256i x0 = avx2_lanes(blocks, 8, 0), x1 = avx2_lanes(blocks, 8, 1), x2 = avx2_lanes(blocks, 8, 2), x3 = avx2_lanes(blocks, 8, 3),
+			x4 = avx2_lanes(blocks, 8, 4), x5 = avx2_lanes(blocks, 8, 5), x6 = avx2_lanes(blocks, 8, 6), x7 = avx2_lanes(blocks, 8, 7);
+
+		simd_compress(avx2)
+
+		alignas(32) uint64_t res[3][4];
+		_mm256_store_si256((__m256i*)res[0], a);
+		_mm256_store_si256((__m256i*)res[1], b);
+		_mm256_store_si256((__m256i*)res[2], c);
+		for (size_t l = 0; l < 4; ++l) {
+			for (size_t i = 0; i < 3; ++i) {
+				states[l * 3 + i] = res[i][l];
+			}
+		}
+	}
+}
+
+#define avx512_xor _mm512_xor_si512
+#define avx512_add _mm512_add_epi64
+#define avx512_sub _mm512_sub_epi64
+#define avx512_slli(v, shift) _mm512_maskz_slli_epi64(0xFF, v, shift)
+#define avx512_srli(v, shift) _mm512_maskz_srli_epi64(0xFF, v, shift)
+#define avx512_set1(v) _mm512_set1_epi64((long long)(v))
+#define avx512_not(v) _mm512_xor_si512(v, _mm512_set1_epi64(-1))
+#define avx512_gather(indexes, p) _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xFF, indexes, (const void*)(p), 8)
+#define avx512_sbox(n, v, shift) avx512_gather(_mm512_and_si512(avx512_srli(v, shift), byteMask), sbox + (n) * 256)
+
+__attribute__((target("avx512f")))
+static void compressAvx512(const uint64_t* sbox, const uint64_t* blocks, uint64_t* states, size_t /*count*/) {
+	const __m512i byteMask = _mm512_set1_epi64(0xFF);
+
+	// Transpose with gathers as well
+	const __m512i blockIndexes = _mm512_set_epi64(7 * 8, 6 * 8, 5 * 8, 4 * 8, 3 * 8, 2 * 8, 1 * 8, 0);
+	const __m512i stateIndexes = _mm512_set_epi64(7 * 3, 6 * 3, 5 * 3, 4 * 3, 3 * 3, 2 * 3, 1 * 3, 0);
+
+#define avx512_lanes(p, indexes, i) avx512_gather(indexes, (p) + (i))
+	__m512i a = avx512_lanes(states, stateIndexes, 0), b = avx512_lanes(states, stateIndexes, 1), c = avx512_lanes(states, stateIndexes, 2);
+	__m512i aa, bb, cc;
+	__m512i x0 = avx512_lanes(blocks, blockIndexes, 0), x1 = avx512_lanes(blocks, blockIndexes, 1), x2 = avx512_lanes(blocks, blockIndexes, 2),
+		x3 = avx512_lanes(blocks, blockIndexes, 3), x4 = avx512_lanes(blocks, blockIndexes, 4), x5 = avx512_lanes(blocks, blockIndexes, 5),
+		x6 = avx512_lanes(blocks, blockIndexes, 6), x7 = avx512_lanes(blocks, blockIndexes, 7);
+#undef avx512_lanes
+
+	simd_compress(avx512)
+
+	_mm512_i64scatter_epi64((void*)states, stateIndexes, a, 8);
+	_mm512_i64scatter_epi64((void*)(states + 1), stateIndexes, b, 8);
+	_mm512_i64scatter_epi64((void*)(states + 2), stateIndexes, c, 8);
+}
+
+#endif
+
+// Kernels supported by the CPU, the interleaved scalar one is always the first one
+static const vector<MultiCompressF>& getMultiKernels() noexcept {
+	static const vector<MultiCompressF> kernels = [] {
+		vector<MultiCompressF> ret = { compressScalar };
+
+#ifdef TIGER_MULTI_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			ret.push_back(compressAvx2);
+		}
+
+		if (__builtin_cpu_supports("avx512f")) {
+			ret.push_back(compressAvx512);
+		}
+#endif
+
+		return ret;
+	}();
+
+	return kernels;
+}
+
+// Gather throughput varies a lot between CPU models (the vector kernels may even be slower than
+// the interleaved scalar one), so each supported kernel is timed with a short run
+static MultiCompressF selectMultiKernel(const uint64_t* sbox) noexcept {
+	const auto& kernels = getMultiKernels();
+	if (kernels.size() == 1) {
+		return kernels.front();
+	}
+
+	alignas(64) uint64_t blocks[TigerHash::MAX_LANES * 8];
+	uint64_t states[TigerHash::MAX_LANES * 3] = { 0 };
+	for (size_t i = 0; i < TigerHash::MAX_LANES * 8; ++i) {
+		blocks[i] = i * _ULL(0x9E3779B97F4A7C15);
+	}
+
+	auto best = kernels.front();
+	auto bestTime = chrono::steady_clock::duration::max();
+	for (auto kernel: kernels) {
+		auto kernelTime = chrono::steady_clock::duration::max();
+		for (int run = 0; run < 3; ++run) {
+			auto start = chrono::steady_clock::now();
+			for (int i = 0; i < 64; ++i) {
+				kernel(sbox, blocks, states, TigerHash::MAX_LANES);
+			}
+
+			kernelTime = min(kernelTime, chrono::steady_clock::now() - start);
+		}
+
+		if (kernelTime < bestTime) {
+			best = kernel;
+			bestTime = kernelTime;
+		}
+	}
+
+	return best;
+}
+
+static void hashMultipleWith(MultiCompressF aCompress, const uint64_t* aSbox, uint8_t aPrefix, const uint8_t* const* aData, size_t aLen, size_t aCount, uint8_t* aResults_) noexcept {
+	const size_t BLOCK_SIZE = 512 / 8;
+
+	alignas(64) uint64_t blocks[TigerHash::MAX_LANES * 8] = { 0 };
+	uint64_t states[TigerHash::MAX_LANES * 3];
+	for (size_t l = 0; l < TigerHash::MAX_LANES; ++l) {
+		states[l * 3] = _ULL(0x0123456789ABCDEF);
+		states[l * 3 + 1] = _ULL(0xFEDCBA9876543210);
+		states[l * 3 + 2] = _ULL(0xF096A5B4C3B2E187);
+	}
+
+	// Message: prefix byte, data, 0x01 terminator, zero padding, length in bits
+	const size_t messageLen = aLen + 1;
+	const size_t blockCount = (messageLen + 1 + sizeof(uint64_t) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	for (size_t blockNum = 0; blockNum < blockCount; ++blockNum) {
+		const size_t blockStart = blockNum * BLOCK_SIZE;
+		const size_t dataStart = max(blockStart, static_cast<size_t>(1));
+		const size_t dataEnd = min(blockStart + BLOCK_SIZE, messageLen);
+		const size_t dataLen = dataEnd > dataStart ? dataEnd - dataStart : 0;
+		const bool isFinal = blockNum == blockCount - 1;
+
+		for (size_t l = 0; l < aCount; ++l) {
+			auto block = reinterpret_cast<uint8_t*>(blocks + l * 8);
+			if (dataLen < BLOCK_SIZE) {
+				memzero(block, BLOCK_SIZE);
+			}
+
+			if (blockStart == 0) {
+				block[0] = aPrefix;
+			}
+
+			memcpy(block + dataStart - blockStart, aData[l] + dataStart - 1, dataLen);
+
+			if (messageLen >= blockStart && messageLen < blockStart + BLOCK_SIZE) {
+				block[messageLen - blockStart] = 0x01;
+			}
+
+			if (isFinal) {
+				blocks[l * 8 + 7] = static_cast<uint64_t>(messageLen) << 3;
+			}
+		}
+
+		aCompress(aSbox, blocks, states, aCount);
+	}
+
+	memcpy(aResults_, states, aCount * TigerHash::BYTES);
+}
+#endif
+
+#ifdef TIGER_BIG_ENDIAN
+// The kernels expect little endian words
+static void hashSerial(uint8_t aPrefix, const uint8_t* const* aData, size_t aLen, size_t aCount, uint8_t* aResults_) noexcept {
+	for (size_t l = 0; l < aCount; ++l) {
+		TigerHash h;
+		h.update(&aPrefix, 1);
+		h.update(aData[l], aLen);
+		memcpy(aResults_ + l * TigerHash::BYTES, h.finalize(), TigerHash::BYTES);
+	}
+}
+#endif
+
+void TigerHash::hashMultiple(uint8_t aPrefix, const uint8_t* const* aData, size_t aLen, size_t aCount, uint8_t* aResults_) noexcept {
+	dcassert(aCount > 0 && aCount <= MAX_LANES);
+
+#ifdef TIGER_BIG_ENDIAN
+	hashSerial(aPrefix, aData, aLen, aCount, aResults_);
+#else
+	static const MultiCompressF compressMultiple = selectMultiKernel(table);
+	hashMultipleWith(compressMultiple, table, aPrefix, aData, aLen, aCount, aResults_);
+#endif
+}
+
+size_t TigerHash::getMultiKernelCount() noexcept {
+#ifdef TIGER_BIG_ENDIAN
+	return 1;
+#else
+	return getMultiKernels().size();
+#endif
+}
+
+void TigerHash::hashMultiple(size_t aKernel, uint8_t aPrefix, const uint8_t* const* aData, size_t aLen, size_t aCount, uint8_t* aResults_) noexcept {
+	dcassert(aKernel < getMultiKernelCount());
+	dcassert(aCount > 0 && aCount <= MAX_LANES);
+
+#ifdef TIGER_BIG_ENDIAN
+	hashSerial(aPrefix, aData, aLen, aCount, aResults_);
+#else
+	hashMultipleWith(getMultiKernels()[aKernel], table, aPrefix, aData, aLen, aCount, aResults_);
+#endif
+}
+
 uint64_t TigerHash::table[4*256] = {
 	_ULL(0x02AAB17CF7E90C5E)   /*    0 */,    _ULL(0xAC424B03E243A8EC)   /*    1 */,
 		_ULL(0x72CD5BE30DD5FCD3)   /*    2 */,    _ULL(0x6D019B93F6F97F3A)   /*    3 */,
@@ -42,6 +42,9 @@ public:
 	static const size_t BITS = 192;
 	static const size_t BYTES = BITS / 8;
 
+	/** Maximum number of messages that can be hashed with a single hashMultiple call */
+	static constexpr size_t MAX_LANES = 8;
+
 	TigerHash() {
 		res[0]=_ULL(0x0123456789ABCDEF);
 		res[1]=_ULL(0xFEDCBA9876543210);
@@ -57,6 +60,20 @@ public:
 	uint8_t* finalize();
 
 	uint8_t* getResult() const noexcept { return (uint8_t*) res; }
+
+	/**
+	 * Calculates the hashes of aCount (at most MAX_LANES) independent messages of equal length,
+	 * each consisting of aPrefix followed by aLen bytes from aData. The blocks of all messages
+	 * are compressed together with the fastest multi-buffer kernel supported by the CPU.
+	 * @param aResults_ Receives aCount hashes of BYTES bytes, stored consecutively
+	 */
+	static void hashMultiple(uint8_t aPrefix, const uint8_t* const* aData, size_t aLen, size_t aCount, uint8_t* aResults_) noexcept;
+
+	/** Number of multi-buffer kernels supported by the CPU (the interleaved scalar kernel is always available) */
+	static size_t getMultiKernelCount() noexcept;
+
+	/** Same as above but with a specific kernel (index below getMultiKernelCount), mainly for testing */
+	static void hashMultiple(size_t aKernel, uint8_t aPrefix, const uint8_t* const* aData, size_t aLen, size_t aCount, uint8_t* aResults_) noexcept;
 private:
 	enum { BLOCK_SIZE = 512/8 };
 	/** 512 bit blocks for the compress function */
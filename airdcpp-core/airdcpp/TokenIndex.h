@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_DCPP_TOKEN_INDEX_H
+#define DCPLUSPLUS_DCPP_TOKEN_INDEX_H
+
+#include "typedefs.h"
+
+#include "StringSearch.h"
+#include "Text.h"
+
+namespace dcpp {
+
+/**
+* Inverted index that maps name tokens (runs of non-separator characters) to the items having them.
+*
+* A pattern without separator characters can only be found inside a single token, which means that
+* all items containing the pattern can be found by matching the pattern against the (much smaller)
+* token vocabulary instead of every indexed name.
+*
+* The suffixes of the vocabulary tokens are kept in a sorted list so that the tokens containing a pattern
+* can be found with a binary search. New tokens are merged in the list in batches (at the latest when calling
+* flush()) and tokens without items are purged only when compacting the list, lookups skip them meanwhile.
+*/
+template<class T>
+class TokenIndex {
+public:
+	typedef vector<T> ItemList;
+	typedef unordered_map<string, ItemList> TokenMap;
+
+	// Returns false if the pattern may span multiple tokens (and can't be searched from the index)
+	static bool isIndexable(const string& aPatternLower) noexcept {
+		return !aPatternLower.empty() && none_of(aPatternLower.begin(), aPatternLower.end(), [](char c) { return Text::isSeparator(c); });
+	}
+
+	void add(const string& aNameLower, const T& aItem) noexcept {
+		if (!removed.empty() && removed.find(aItem) != removed.end()) {
+			// The same item (or address) is being re-added before the previous removal has been purged
+			flush();
+		}
+
+		forEachToken(aNameLower, [&](string&& aToken) {
+			auto i = tokens.find(aToken);
+			if (i == tokens.end()) {
+				i = tokens.emplace(move(aToken), ItemList()).first;
+				newTokens.push_back(&*i);
+			} else if (i->second.empty()) {
+				// Purged token, the suffixes are still listed
+				emptyTokens--;
+			} else if (i->second.back() == aItem) {
+				// Repeated token in the same name
+				return;
+			}
+
+			i->second.push_back(aItem);
+			entryCount++;
+		});
+
+		if (newTokens.size() > max(MIN_MERGED_TOKENS, sortedTokens / 4)) {
+			mergeNewTokens();
+		}
+	}
+
+	void remove(const string& aNameLower, const T& aItem) noexcept {
+		forEachToken(aNameLower, [&](string&& aToken) {
+			auto i = tokens.find(aToken);
+			if (i == tokens.end()) {
+				return;
+			}
+
+			eraseItem(i, aItem);
+		});
+	}
+
+	// Mark the item as removed without token lookups (use flush() to purge the removed items after bulk operations)
+	// Removed items are ignored by lookups
+	void removeLazy(const T& aItem) noexcept {
+		removed.insert(aItem);
+	}
+
+	// Purges the lazily removed items and sorts the new tokens
+	void flush() noexcept {
+		if (!removed.empty()) {
+			for (auto& t: tokens) {
+				auto& items = t.second;
+				if (items.empty()) {
+					continue;
+				}
+
+				auto newEnd = std::remove_if(items.begin(), items.end(), [this](const T& aItem) { return removed.find(aItem) != removed.end(); });
+				entryCount -= distance(newEnd, items.end());
+				items.erase(newEnd, items.end());
+
+				if (items.empty()) {
+					emptyTokens++;
+				}
+			}
+
+			removed.clear();
+		}
+
+		if (emptyTokens > 0) {
+			compact();
+		}
+
+		if (!newTokens.empty()) {
+			mergeNewTokens();
+		}
+	}
+
+	// Calls aHandler for each item having a token that contains the pattern
+	// The same item may be reported multiple times
+	// Returns false if more than aMaxItems entries were found (the handler won't be called after that)
+	template<class HandlerT>
+	bool find(const StringSearch::Pattern& aPattern, size_t aMaxItems, HandlerT&& aHandler) const noexcept {
+		dcassert(isIndexable(aPattern.str()));
+
+		const auto& pattern = aPattern.str();
+
+		size_t found = 0;
+		auto handleToken = [&](const Token* aToken) {
+			for (const auto& item: aToken->second) {
+				if (!removed.empty() && removed.find(item) != removed.end()) {
+					continue;
+				}
+
+				if (++found > aMaxItems) {
+					return false;
+				}
+
+				aHandler(item);
+			}
+
+			return true;
+		};
+
+		// All suffixes starting with the pattern are next to each other
+		auto i = lower_bound(suffixes.begin(), suffixes.end(), pattern, [](const Suffix& aSuffix, const string& aPattern) {
+			return aSuffix.token->first.compare(aSuffix.pos, string::npos, aPattern) < 0;
+		});
+
+		for (; i != suffixes.end() && i->token->first.compare(i->pos, pattern.size(), pattern) == 0; ++i) {
+			if (i->token->first.find(pattern) < i->pos) {
+				// Reported with an earlier suffix of the same token
+				continue;
+			}
+
+			if (!handleToken(i->token)) {
+				return false;
+			}
+		}
+
+		for (const auto& t: newTokens) {
+			if (t->first.find(pattern) != string::npos && !handleToken(t)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void clear() noexcept {
+		tokens.clear();
+		removed.clear();
+		suffixes.clear();
+		newTokens.clear();
+		entryCount = 0;
+		emptyTokens = 0;
+		sortedTokens = 0;
+	}
+
+	size_t getTokenCount() const noexcept { return tokens.size() - emptyTokens; }
+	size_t getEntryCount() const noexcept { return entryCount; }
+private:
+	// Merge the new tokens in the suffix list when there are more than this many of them (or more than 1/4 of the sorted ones)
+	static constexpr size_t MIN_MERGED_TOKENS = 1024;
+
+	// Tokens with no items are purged when there are more than this many of them (or more than 1/4 of all tokens)
+	static constexpr size_t MIN_PURGED_TOKENS = 1024;
+
+	typedef typename TokenMap::value_type Token;
+
+	struct Suffix {
+		const Token* token;
+		uint32_t pos;
+
+		bool operator<(const Suffix& rhs) const noexcept {
+			return token->first.compare(pos, string::npos, rhs.token->first, rhs.pos, string::npos) < 0;
+		}
+	};
+
+	void mergeNewTokens() noexcept {
+		auto sortedSize = suffixes.size();
+		for (const auto& t: newTokens) {
+			for (uint32_t pos = 0; pos < t->first.size(); ++pos) {
+				suffixes.push_back({ t, pos });
+			}
+		}
+
+		sort(suffixes.begin() + sortedSize, suffixes.end());
+		inplace_merge(suffixes.begin(), suffixes.begin() + sortedSize, suffixes.end());
+
+		sortedTokens += newTokens.size();
+		newTokens.clear();
+	}
+
+	// Erases the tokens without items
+	void compact() noexcept {
+		auto isEmpty = [](const Token* aToken) {
+			return aToken->second.empty();
+		};
+
+		suffixes.erase(std::remove_if(suffixes.begin(), suffixes.end(), [&](const Suffix& aSuffix) { return isEmpty(aSuffix.token); }), suffixes.end());
+
+		auto newTokensSize = newTokens.size();
+		newTokens.erase(std::remove_if(newTokens.begin(), newTokens.end(), isEmpty), newTokens.end());
+		sortedTokens -= emptyTokens - (newTokensSize - newTokens.size());
+
+		for (auto i = tokens.begin(); i != tokens.end();) {
+			if (i->second.empty()) {
+				i = tokens.erase(i);
+			} else {
+				++i;
+			}
+		}
+
+		emptyTokens = 0;
+	}
+
+	template<class HandlerT>
+	static void forEachToken(const string& aNameLower, HandlerT&& aHandler) noexcept {
+		string::size_type start = 0;
+		for (string::size_type i = 0; i <= aNameLower.size(); ++i) {
+			if (i == aNameLower.size() || Text::isSeparator(aNameLower[i])) {
+				if (i > start) {
+					aHandler(aNameLower.substr(start, i - start));
+				}
+
+				start = i + 1;
+			}
+		}
+	}
+
+	void eraseItem(typename TokenMap::iterator i, const T& aItem) noexcept {
+		auto& items = i->second;
+		auto p = std::find(items.begin(), items.end(), aItem);
+		if (p == items.end()) {
+			return;
+		}
+
+		// Order of the items doesn't matter
+		*p = items.back();
+		items.pop_back();
+		entryCount--;
+
+		if (items.empty()) {
+			// The token is still referenced by the suffix list
+			emptyTokens++;
+			if (emptyTokens > max(MIN_PURGED_TOKENS, tokens.size() / 4)) {
+				compact();
+			}
+		}
+	}
+
+	// Tokens without items are kept until the next compaction
+	TokenMap tokens;
+	unordered_set<T> removed;
+	size_t entryCount = 0;
+	size_t emptyTokens = 0;
+
+	// Sorted suffixes of the merged tokens
+	vector<Suffix> suffixes;
+	size_t sortedTokens = 0;
+
+	// Tokens that haven't been merged in the suffix list yet
+	vector<const Token*> newTokens;
+};
+
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_DCPP_TOKEN_INDEX_H)
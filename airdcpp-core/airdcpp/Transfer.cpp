@@ -32,6 +32,7 @@ const string Transfer::names[] = {
 
 const string Transfer::USER_LIST_NAME = "files.xml";
 const string Transfer::USER_LIST_NAME_BZ = "files.xml.bz2";
+const string Transfer::USER_LIST_NAME_BIN = "files.bin";
 
 Transfer::Transfer(UserConnection& conn, const string& path_, const TTHValue& tth_) : segment(0, -1),
 	path(path_), tth(tth_), userConnection(conn) { }
@@ -42,6 +42,7 @@ public:
 
 	static const string USER_LIST_NAME;
 	static const string USER_LIST_NAME_BZ;
+	static const string USER_LIST_NAME_BIN;
 
 	Transfer(UserConnection& conn, const string& path, const TTHValue& tth);
 	virtual ~Transfer() { };
@@ -103,7 +103,7 @@ bool UploadManager::prepareFile(UserConnection& aSource, const string& aType, co
 
 	/*check if the user deserves a slot before any filesystem access*/
 
-	bool userlist = (aFile == Transfer::USER_LIST_NAME_BZ || aFile == Transfer::USER_LIST_NAME);
+	bool userlist = (aFile == Transfer::USER_LIST_NAME_BZ || aFile == Transfer::USER_LIST_NAME || aFile == Transfer::USER_LIST_NAME_BIN);
 	bool miniSlot = userlist;
 	bool partialFileSharing = false;
 	
@@ -438,6 +438,10 @@ void UploadManager::UpdateSlotCounts(UserConnection& aSource, uint8_t slotType){
 		// user got a slot
 		aSource.setSlotType(slotType);
 
+		// Small files and extra slots get a separate share of the limited bandwidth
+		auto throttleClass = slotType == UserConnection::STDSLOT || slotType == UserConnection::MCNSLOT ? ThrottleManager::CLASS_STANDARD : ThrottleManager::CLASS_MINOR;
+		aSource.setThrottleFlow(throttleClass, aSource.getUser()->getCID().toHash(), ThrottleManager::getPriorityWeight(Priority::NORMAL));
+
 		// set new slot count
 		switch(slotType) {
 			case UserConnection::STDSLOT:
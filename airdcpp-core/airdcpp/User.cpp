@@ -34,7 +34,10 @@
 
 namespace dcpp {
 
-SharedMutex Identity::cs;
+const short Identity::KEY_NICK = Identity::toKey("NI");
+const short Identity::KEY_SHARE_SIZE = Identity::toKey("SS");
+const short Identity::KEY_CLIENT_TYPE = Identity::toKey("CT");
+const short Identity::KEY_STATUS = Identity::toKey("ST");
 
 OnlineUser::OnlineUser(const UserPtr& ptr, const ClientPtr& client_, uint32_t sid_) : identity(ptr, sid_), client(client_) {
 }
@@ -123,12 +126,10 @@ uint8_t Identity::getSlots() const noexcept {
 }
 
 void Identity::getParams(ParamMap& sm, const string& prefix, bool compatibility) const noexcept {
-	{
-		RLock l(cs);
-		for(auto& i: info) {
-			sm[prefix + string((char*)(&i.first), 2)] = i.second;
-		}
+	for(auto& i: getInfo()) {
+		sm[prefix + i.first] = i.second;
 	}
+
 	if(user) {
 		sm[prefix + "NI"] = getNick();
 		sm[prefix + "SID"] = getSIDString();
@@ -158,8 +159,7 @@ void Identity::getParams(ParamMap& sm, const string& prefix, bool compatibility)
 }
 
 bool Identity::isClientType(ClientType ct) const noexcept {
-	int type = Util::toInt(get("CT"));
-	return (type & ct) == ct;
+	return (clientType & ct) == ct;
 }
 
 string Identity::getTag() const noexcept {
@@ -195,11 +195,29 @@ Identity::Identity(const Identity& rhs) : Flags(), sid(0) {
 }
 
 Identity& Identity::operator = (const Identity& rhs) {
-	WLock l(cs);
+	if (this == &rhs) {
+		return *this;
+	}
+
+	// Copy the fields first so that both identities don't need to be locked at the same time
+	InfoList rhsInfo;
+	string rhsNick;
+
+	{
+		FastLock l(rhs.cs);
+		rhsInfo = rhs.info;
+		rhsNick = rhs.nick;
+	}
+
+	FastLock l(cs);
 	*static_cast<Flags*>(this) = rhs;
 	user = rhs.user;
 	sid = rhs.sid;
-	info = rhs.info;
+	info.swap(rhsInfo);
+	nick.swap(rhsNick);
+	bytesShared = rhs.bytesShared.load();
+	clientType = rhs.clientType.load();
+	status = rhs.status.load();
 	adcTcpConnectMode = rhs.adcTcpConnectMode;
 	return *this;
 }
@@ -224,25 +242,71 @@ string Identity::getCountry() const noexcept {
 	return GeoManager::getInstance()->getCountry(v6 ? getIp6() : getIp4());
 }
 
+Identity::InfoList::const_iterator Identity::findInfo(short aKey) const noexcept {
+	auto i = lower_bound(info.begin(), info.end(), aKey, [](const InfoList::value_type& aInfo, short aKey) { return aInfo.first < aKey; });
+	return i != info.end() && i->first == aKey ? i : info.end();
+}
+
+string Identity::getNick() const noexcept {
+	FastLock l(cs);
+	return nick;
+}
+
 string Identity::get(const char* name) const noexcept {
-	RLock l(cs);
-	auto i = info.find(*(short*)name);
+	auto key = toKey(name);
+
+	FastLock l(cs);
+	if (key == KEY_NICK) {
+		return nick;
+	}
+
+	auto i = findInfo(key);
 	return i == info.end() ? Util::emptyString : i->second;
 }
 
 bool Identity::isSet(const char* name) const noexcept {
-	RLock l(cs);
-	auto i = info.find(*(short*)name);
-	return i != info.end();
+	auto key = toKey(name);
+
+	FastLock l(cs);
+	if (key == KEY_NICK) {
+		return !nick.empty();
+	}
+
+	return findInfo(key) != info.end();
 }
 
+void Identity::updateParsedField(short aKey, const string& aValue) noexcept {
+	if (aKey == KEY_SHARE_SIZE) {
+		bytesShared = Util::toInt64(aValue);
+	} else if (aKey == KEY_CLIENT_TYPE) {
+		clientType = Util::toInt(aValue);
+	} else if (aKey == KEY_STATUS) {
+		status = Util::toInt(aValue);
+	}
+}
 
 void Identity::set(const char* name, const string& val) noexcept {
-	WLock l(cs);
-	if(val.empty())
-		info.erase(*(short*)name);
-	else
-		info[*(short*)name] = val;
+	auto key = toKey(name);
+
+	FastLock l(cs);
+	if (key == KEY_NICK) {
+		nick = val;
+		return;
+	}
+
+	updateParsedField(key, val);
+
+	auto i = lower_bound(info.begin(), info.end(), key, [](const InfoList::value_type& aInfo, short aKey) { return aInfo.first < aKey; });
+	auto found = i != info.end() && i->first == key;
+	if (val.empty()) {
+		if (found) {
+			info.erase(i);
+		}
+	} else if (found) {
+		i->second = val;
+	} else {
+		info.emplace(i, key, val);
+	}
 }
 
 StringList Identity::getSupports() const noexcept {
@@ -266,11 +330,15 @@ bool Identity::isMe() const noexcept {
 std::map<string, string> Identity::getInfo() const noexcept {
 	std::map<string, string> ret;
 
-	RLock l(cs);
+	FastLock l(cs);
 	for(const auto& i: info) {
 		ret[string((char*)(&i.first), 2)] = i.second;
 	}
 
+	if (!nick.empty()) {
+		ret["NI"] = nick;
+	}
+
 	return ret;
 }
 
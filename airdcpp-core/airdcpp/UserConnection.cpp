@@ -47,6 +47,7 @@ const string UserConnection::FEATURE_ADC_TIGR = "TIGR";
 const string UserConnection::FEATURE_ADC_MCN1 = "MCN1";
 const string UserConnection::FEATURE_ADC_UBN1 = "UBN1";
 const string UserConnection::FEATURE_ADC_CPMI = "CPMI";
+const string UserConnection::FEATURE_ADC_BFL1 = "BFL1";
 
 const string UserConnection::FILE_NOT_AVAILABLE = "File Not Available";
 
@@ -179,6 +180,12 @@ void UserConnection::setThreadPriority(Thread::Priority aPriority) {
 	socket->setThreadPriority(aPriority);
 }
 
+void UserConnection::setThrottleFlow(ThrottleManager::TrafficClass aClass, uint64_t aGroup, int aWeight) noexcept {
+	if (socket) {
+		socket->getThrottleFlow().set(aClass, aGroup, aWeight);
+	}
+}
+
 void UserConnection::setUser(const UserPtr& aUser) noexcept {
 	user = aUser;
 	if (aUser && socket) {
@@ -50,6 +50,7 @@ public:
 	static const string FEATURE_ADC_MCN1;
 	static const string FEATURE_ADC_UBN1;
 	static const string FEATURE_ADC_CPMI;
+	static const string FEATURE_ADC_BFL1;
 
 	static const string FILE_NOT_AVAILABLE;
 	static const string FEATURE_AIRDC;
@@ -78,7 +79,8 @@ public:
 		FLAG_SMALL_SLOT				= FLAG_MCN1 << 1,
 		FLAG_UBN1					= FLAG_SMALL_SLOT << 1,
 		FLAG_CPMI					= FLAG_UBN1 << 1,
-		FLAG_TRUSTED				= FLAG_CPMI << 1
+		FLAG_TRUSTED				= FLAG_CPMI << 1,
+		FLAG_SUPPORTS_BINARY_LIST	= FLAG_TRUSTED << 1
 
 	};
 	
@@ -207,6 +209,9 @@ public:
 	const BufferedSocket* getSocket() const noexcept { return socket; }
 
 	void setThreadPriority(Thread::Priority aPriority) ;
+
+	// Sets the group that shares the limited bandwidth with this connection
+	void setThrottleFlow(ThrottleManager::TrafficClass aClass, uint64_t aGroup, int aWeight) noexcept;
 private:
 	int64_t chunkSize = 0;
 	BufferedSocket* socket = nullptr;
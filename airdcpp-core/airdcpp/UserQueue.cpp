@@ -42,14 +42,21 @@ void UserQueue::addQI(const QueueItemPtr& qi, const HintedUser& aUser, bool aIsB
 	BundlePtr bundle = qi->getBundle();
 	if (bundle) {
 		aUser.user->addQueued(qi->getSize());
-		if (bundle->addUserQueue(qi, aUser, aIsBadSource)) {
-			addBundle(bundle, aUser);
-		} else {
-			dcassert(userBundleQueue.find(aUser.user) != userBundleQueue.end());
-		}
+		bundle->addUserQueue(qi, aUser, aIsBadSource);
+		addBundle(bundle, aUser);
 	}
 }
 
+void UserQueue::addSource(const QueueItemPtr& qi, const HintedUser& aUser, bool aIsBadSource /*false*/) noexcept {
+	qi->addSource(aUser);
+	addQI(qi, aUser, aIsBadSource);
+}
+
+void UserQueue::removeSource(const QueueItemPtr& qi, const UserPtr& aUser, Flags::MaskType aReason) noexcept {
+	removeQI(qi, aUser, false, aReason);
+	qi->removeSource(aUser, aReason);
+}
+
 void UserQueue::getUserQIs(const UserPtr& aUser, QueueItemList& ql) noexcept{
 	/* Returns all queued items from an user */
 
@@ -61,11 +68,8 @@ void UserQueue::getUserQIs(const UserPtr& aUser, QueueItemList& ql) noexcept{
 	}
 
 	/* Bundles */
-	auto s = userBundleQueue.find(aUser);
-	if(s != userBundleQueue.end()) {
-		dcassert(!s->second.empty());
-		for(auto& b: s->second)
-			b->getItems(aUser, ql);
+	for (const auto& b: getBundles(aUser)) {
+		b->getItems(aUser, ql);
 	}
 }
 
@@ -111,36 +115,57 @@ QueueItemPtr UserQueue::getNextBundleQI(const UserPtr& aUser, const QueueTokenSe
 
 	lastError_ = Util::emptyString;
 
-	auto bundleLimit = SETTING(MAX_RUNNING_BUNDLES);
 	auto i = userBundleQueue.find(aUser);
-	if(i != userBundleQueue.end()) {
-		dcassert(!i->second.empty());
-		for (auto& b: i->second) {
-			if (bundleLimit > 0 && static_cast<int>(runningBundles.size()) >= bundleLimit && runningBundles.find(b->getToken()) == runningBundles.end()) {
-				hasDownload = true;
-				lastError_ = STRING(MAX_BUNDLES_RUNNING);
-				continue;
-			}
+	if (i == userBundleQueue.end()) {
+		return nullptr;
+	}
+
+	const auto& bundles = i->second;
+	dcassert(!bundles.empty());
 
+	auto getBundleQI = [&](const BundlePtr& b) {
+		return b->getNextQI(aUser, onlineHubs, lastError_, minPrio, wantedSize, lastSpeed, aType, allowOverlap);
+	};
+
+	auto bundleLimit = SETTING(MAX_RUNNING_BUNDLES);
+	if (bundleLimit > 0 && static_cast<int>(runningBundles.size()) >= bundleLimit) {
+		// Only the running bundles can be downloaded from
+		BundleList running;
+		bundles.getBundles(runningBundles, running);
+		if (running.size() < bundles.size()) {
+			hasDownload = true;
+			lastError_ = STRING(MAX_BUNDLES_RUNNING);
+		}
+
+		for (const auto& b: running) {
 			if (b->getPriority() < minPrio) {
 				break;
 			}
 
-			auto qi = b->getNextQI(aUser, onlineHubs, lastError_, minPrio, wantedSize, lastSpeed, aType, allowOverlap);
+			auto qi = getBundleQI(b);
 			if (qi) {
 				return qi;
 			}
 		}
+
+		return nullptr;
 	}
-	return nullptr;
+
+	return bundles.findFirst(aType, minPrio, getBundleQI);
 }
 
 void UserQueue::addDownload(const QueueItemPtr& qi, Download* d) noexcept {
 	qi->addDownload(d);
+	if (qi->getBundle() && qi->getDownloads().size() == 1) {
+		updateBundle(qi);
+	}
 }
 
 void UserQueue::removeDownload(const QueueItemPtr& qi, const string& aToken) noexcept {
 	qi->removeDownload(aToken);
+	if (qi->getBundle() && qi->isWaiting()) {
+		updateBundle(qi);
+	}
 }
 
 void UserQueue::setQIPriority(const QueueItemPtr& qi, Priority p) noexcept {
@@ -157,13 +182,17 @@ void UserQueue::removeQI(const QueueItemPtr& qi, bool removeRunning /*true*/) no
 
 void UserQueue::removeQI(const QueueItemPtr& qi, const UserPtr& aUser, bool removeRunning /*true*/, Flags::MaskType reason) noexcept{
 
+	BundlePtr bundle = qi->getBundle();
 	if(removeRunning) {
+		auto wasWaiting = qi->isWaiting();
 		qi->removeDownloads(aUser);
+		if (bundle && !wasWaiting && qi->isWaiting()) {
+			updateBundle(qi);
+		}
 	}
 
 	dcassert(qi->isSource(aUser));
 
-	BundlePtr bundle = qi->getBundle();
 	if (bundle) {
 		if (!bundle->isSource(aUser)) {
 			return;
@@ -173,7 +202,8 @@ void UserQueue::removeQI(const QueueItemPtr& qi, const UserPtr& aUser, bool remo
 		if (qi->getBundle()->removeUserQueue(qi, aUser, reason)) {
 			removeBundle(bundle, aUser);
 		} else {
-			dcassert(userBundleQueue.find(aUser) != userBundleQueue.end());
+			// Re-index with the remaining items
+			addBundle(bundle, aUser);
 		}
 	}
 
@@ -198,8 +228,7 @@ void UserQueue::removeQI(const QueueItemPtr& qi, const UserPtr& aUser, bool remo
 }
 
 void UserQueue::addBundle(const BundlePtr& aBundle, const UserPtr& aUser) noexcept{
-	auto& s = userBundleQueue[aUser];
-	s.insert(upper_bound(s.begin(), s.end(), aBundle, Bundle::SortOrder()), aBundle);
+	userBundleQueue[aUser].update(aBundle, aUser);
 }
 
 void UserQueue::removeBundle(const BundlePtr& aBundle, const UserPtr& aUser) noexcept {
@@ -209,17 +238,34 @@ void UserQueue::removeBundle(const BundlePtr& aBundle, const UserPtr& aUser) noe
 		return;
 	}
 
-	auto& l = j->second;
-	auto s = find(l.begin(), l.end(), aBundle);
-	dcassert(s != l.end());
-	if (s == l.end()) {
-		return;
+	auto removed = j->second.remove(aBundle);
+	dcassert(removed);
+	if (removed && j->second.empty()) {
+		userBundleQueue.erase(j);
 	}
+}
 
-	l.erase(s);
-	if(l.empty()) {
-		userBundleQueue.erase(j);
+void UserQueue::updateBundle(const QueueItemPtr& qi) noexcept {
+	const auto& bundle = qi->getBundle();
+	bundle->updateUserQueue(qi);
+
+	for (const auto& s: qi->getSources()) {
+		auto i = userBundleQueue.find(s.getUser());
+		if (i != userBundleQueue.end()) {
+			i->second.update(bundle, s.getUser());
+		}
+	}
+}
+
+BundleList UserQueue::getBundles(const UserPtr& aUser) const noexcept {
+	BundleList ret;
+
+	auto i = userBundleQueue.find(aUser);
+	if (i != userBundleQueue.end()) {
+		i->second.getBundles(ret);
 	}
+
+	return ret;
 }
 
 void UserQueue::setBundlePriority(const BundlePtr& aBundle, Priority p) noexcept {
@@ -237,4 +283,83 @@ void UserQueue::setBundlePriority(const BundlePtr& aBundle, Priority p) noexcept
 		addBundle(aBundle, u);
 }
 
+bool UserQueue::UserBundleQueue::BundleLess::operator()(const BundlePtr& a, const BundlePtr& b) const noexcept {
+	if (a->getPriority() != b->getPriority() || a->getTimeAdded() != b->getTimeAdded()) {
+		return Bundle::SortOrder()(a, b);
+	}
+
+	return a->getToken() < b->getToken();
+}
+
+UserQueue::UserBundleQueue::BundleSet* UserQueue::UserBundleQueue::Lane::getSet(Bundle::UserQueueState aState) noexcept {
+	switch (aState) {
+		case Bundle::USER_QUEUE_WAITING: return &waiting;
+		case Bundle::USER_QUEUE_RUNNING: return &running;
+		default: return nullptr;
+	}
+}
+
+void UserQueue::UserBundleQueue::update(const BundlePtr& aBundle, const UserPtr& aUser) noexcept {
+	auto& entry = bundles.emplace(aBundle->getToken(), Entry{ aBundle, { Bundle::USER_QUEUE_EMPTY, Bundle::USER_QUEUE_EMPTY } }).first->second;
+	dcassert(entry.bundle == aBundle);
+
+	for (int i = 0; i < LANE_LAST; ++i) {
+		auto state = aBundle->getUserQueueState(aUser, i == LANE_SMALL);
+		if (state == entry.states[i]) {
+			continue;
+		}
+
+		auto& lane = lanes[i];
+		auto oldSet = lane.getSet(entry.states[i]);
+		if (oldSet) {
+			oldSet->erase(aBundle);
+		}
+
+		auto newSet = lane.getSet(state);
+		if (newSet) {
+			newSet->insert(aBundle);
+		}
+
+		entry.states[i] = state;
+	}
+}
+
+bool UserQueue::UserBundleQueue::remove(const BundlePtr& aBundle) noexcept {
+	auto i = bundles.find(aBundle->getToken());
+	if (i == bundles.end()) {
+		return false;
+	}
+
+	for (int j = 0; j < LANE_LAST; ++j) {
+		auto s = lanes[j].getSet(i->second.states[j]);
+		if (s) {
+			s->erase(aBundle);
+		}
+	}
+
+	bundles.erase(i);
+	return true;
+}
+
+void UserQueue::UserBundleQueue::getBundles(BundleList& bundles_) const noexcept {
+	auto start = bundles_.size();
+	for (const auto& b: bundles | map_values) {
+		bundles_.push_back(b.bundle);
+	}
+
+	sort(bundles_.begin() + start, bundles_.end(), BundleLess());
+}
+
+void UserQueue::UserBundleQueue::getBundles(const QueueTokenSet& aTokens, BundleList& bundles_) const noexcept {
+	auto start = bundles_.size();
+	for (auto token: aTokens) {
+		auto i = bundles.find(token);
+		if (i != bundles.end()) {
+			bundles_.push_back(i->second.bundle);
+		}
+	}
+
+	sort(bundles_.begin() + start, bundles_.end(), BundleLess());
+}
+
 } //dcpp
\ No newline at end of file
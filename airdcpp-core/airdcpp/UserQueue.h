@@ -21,6 +21,7 @@
 
 #include "forward.h"
 #include "typedefs.h"
+#include "Bundle.h"
 #include "HintedUser.h"
 #include "QueueItem.h"
 
@@ -33,6 +34,10 @@ public:
 	void addQI(const QueueItemPtr& qi, const HintedUser& aUser, bool aIsBadSource = false) noexcept;
 	void getUserQIs(const UserPtr& aUser, QueueItemList& ql) noexcept;
 
+	// Adds the user as a source for the item and queues the item for the user
+	void addSource(const QueueItemPtr& qi, const HintedUser& aUser, bool aIsBadSource = false) noexcept;
+	void removeSource(const QueueItemPtr& qi, const UserPtr& aUser, Flags::MaskType aReason) noexcept;
+
 	QueueItemPtr getNext(const UserPtr& aUser, const QueueTokenSet& runningBundles, const OrderedStringSet& onlineHubs, string& lastError_, bool& hasDownload,
 		Priority minPrio = Priority::LOWEST, int64_t wantedSize = 0, int64_t lastSpeed = 0, QueueItemBase::DownloadType aType = QueueItem::TYPE_ANY, bool allowOverlap = false) noexcept;
 	QueueItemPtr getNextPrioQI(const UserPtr& aUser, const OrderedStringSet& onlineHubs, int64_t wantedSize, int64_t lastSpeed, 
@@ -48,15 +53,117 @@ public:
 	void removeQI(const QueueItemPtr& qi, const UserPtr& aUser, bool removeRunning = true, Flags::MaskType reason = 0) noexcept;
 	void setQIPriority(const QueueItemPtr& qi, Priority p) noexcept;
 
-	void addBundle(const BundlePtr& aBundle, const UserPtr& aUser) noexcept;
-	void removeBundle(const BundlePtr& aBundle, const UserPtr& aUser) noexcept;
 	void setBundlePriority(const BundlePtr& aBundle, Priority p) noexcept;
 
-	unordered_map<UserPtr, BundleList, User::Hash>& getBundleList()  { return userBundleQueue; }
+	// Bundles of the user in the download order
+	BundleList getBundles(const UserPtr& aUser) const noexcept;
 	unordered_map<UserPtr, QueueItemList, User::Hash>& getPrioList()  { return userPrioQueue; }
 private:
+	/*
+	* Bundles of a single user in the download order
+	*
+	* The bundles are indexed by the state of the user's items in each lane (see Bundle::UserItemQueue). The first bundle with
+	* waiting items normally has something to download, so only the bundles with running items before it need to be checked.
+	*/
+	class UserBundleQueue {
+	public:
+		// Adds the bundle or re-indexes it after the user's items in it have changed
+		void update(const BundlePtr& aBundle, const UserPtr& aUser) noexcept;
+		bool remove(const BundlePtr& aBundle) noexcept;
+
+		// Returns the item from the first bundle in the download order that has a downloadable item for the connection type
+		// Bundles with a lower priority than aMinPrio aren't checked
+		template<class NextItemF>
+		QueueItemPtr findFirst(QueueItemBase::DownloadType aType, Priority aMinPrio, const NextItemF& aNextItemF) const {
+			const BundlePtr* first = nullptr;
+			QueueItemPtr ret;
+			for (int i = 0; i < LANE_LAST; ++i) {
+				if ((i == LANE_SMALL && aType == QueueItemBase::TYPE_MCN_NORMAL) || (i == LANE_NORMAL && aType == QueueItemBase::TYPE_SMALL)) {
+					continue;
+				}
+
+				auto p = lanes[i].findFirst(aMinPrio, aNextItemF);
+				if (p.first && (!first || BundleLess()(*p.first, *first))) {
+					first = p.first;
+					ret = p.second;
+				}
+			}
+
+			return ret;
+		}
+
+		// Bundles in the download order
+		void getBundles(BundleList& bundles_) const noexcept;
+		void getBundles(const QueueTokenSet& aTokens, BundleList& bundles_) const noexcept;
+
+		size_t size() const noexcept { return bundles.size(); }
+		bool empty() const noexcept { return bundles.empty(); }
+	private:
+		enum LaneType {
+			LANE_NORMAL,
+			LANE_SMALL,
+			LANE_LAST
+		};
+
+		struct BundleLess {
+			bool operator()(const BundlePtr& a, const BundlePtr& b) const noexcept;
+		};
+
+		typedef set<BundlePtr, BundleLess> BundleSet;
+
+		struct Lane {
+			BundleSet waiting;
+			BundleSet running;
+
+			template<class NextItemF>
+			pair<const BundlePtr*, QueueItemPtr> findFirst(Priority aMinPrio, const NextItemF& aNextItemF) const {
+				pair<const BundlePtr*, QueueItemPtr> firstWaiting = { nullptr, nullptr };
+				for (const auto& b: waiting) {
+					if (b->getPriority() < aMinPrio) {
+						break;
+					}
+
+					auto qi = aNextItemF(b);
+					if (qi) {
+						firstWaiting = { &b, qi };
+						break;
+					}
+				}
+
+				for (const auto& b: running) {
+					if (b->getPriority() < aMinPrio || (firstWaiting.first && !BundleLess()(b, *firstWaiting.first))) {
+						break;
+					}
+
+					auto qi = aNextItemF(b);
+					if (qi) {
+						return { &b, qi };
+					}
+				}
+
+				return firstWaiting;
+			}
+
+			BundleSet* getSet(Bundle::UserQueueState aState) noexcept;
+		};
+
+		struct Entry {
+			BundlePtr bundle;
+			Bundle::UserQueueState states[LANE_LAST];
+		};
+
+		Lane lanes[LANE_LAST];
+		unordered_map<QueueToken, Entry> bundles;
+	};
+
+	void addBundle(const BundlePtr& aBundle, const UserPtr& aUser) noexcept;
+	void removeBundle(const BundlePtr& aBundle, const UserPtr& aUser) noexcept;
+
+	// Re-index the bundle for all sources of the item after its downloads have changed
+	void updateBundle(const QueueItemPtr& qi) noexcept;
+
 	/** Bundles by priority and user (this is where the download order is determined) */
-	unordered_map<UserPtr, BundleList, User::Hash> userBundleQueue;
+	unordered_map<UserPtr, UserBundleQueue, User::Hash> userBundleQueue;
 	/** High priority QueueItems by user (this is where the download order is determined) */
 	unordered_map<UserPtr, QueueItemList, User::Hash> userPrioQueue;
 };
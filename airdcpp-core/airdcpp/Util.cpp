@@ -1464,7 +1464,7 @@ string Util::getTimeStamp(time_t t) noexcept {
 }
 
 string Util::toAdcFile(const string& file) noexcept {
-	if(file == "files.xml.bz2" || file == "files.xml")
+	if(file == "files.xml.bz2" || file == "files.xml" || file == "files.bin")
 		return file;
 
 	string ret;
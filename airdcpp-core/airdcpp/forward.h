@@ -59,6 +59,8 @@ class SearchQuery;
 
 class ADLSearch;
 
+class BinaryFilelistWriter;
+
 class BufferedSocket;
 
 struct BundleFileInfo;
@@ -176,6 +178,8 @@ typedef std::vector<GroupedSearchResultPtr> GroupedSearchResultList;
 
 class ServerSocket;
 
+class ShareMonitor;
+
 class ShareProfile;
 typedef std::shared_ptr<ShareProfile> ShareProfilePtr;
 typedef vector<ShareProfilePtr> ShareProfileList;
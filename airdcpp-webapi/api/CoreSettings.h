@@ -56,6 +56,7 @@ namespace webserver {
 		{ "allow_slow_overlap", SettingsManager::OVERLAP_SLOW_SOURCES, ResourceManager::SETTINGS_OVERLAP_SLOW_SOURCES },
 		{ "finished_remove_exit", SettingsManager::REMOVE_FINISHED_BUNDLES, ResourceManager::BUNDLES_REMOVE_EXIT },
 		{ "use_partial_sharing", SettingsManager::USE_PARTIAL_SHARING, ResourceManager::PARTIAL_SHARING },
+		{ "queue_store_db", SettingsManager::QUEUE_STORE_DB, ResourceManager::SETTINGS_QUEUE_STORE_DB },
 
 		//{ ResourceManager::SETTINGS_SKIPPING_OPTIONS },
 		{ "dont_download_shared", SettingsManager::DONT_DL_ALREADY_SHARED, ResourceManager::SETTINGS_DONT_DL_ALREADY_SHARED },
@@ -143,6 +144,8 @@ namespace webserver {
 		{ "max_hash_speed", SettingsManager::MAX_HASH_SPEED, ResourceManager::SETTINGS_MAX_HASHER_SPEED, ApiSettingItem::TYPE_LAST, ResourceManager::Strings::MBPS },
 		{ "max_total_hashers", SettingsManager::MAX_HASHING_THREADS, ResourceManager::MAX_HASHING_THREADS },
 		{ "max_volume_hashers", SettingsManager::HASHERS_PER_VOLUME, ResourceManager::MAX_VOL_HASHERS },
+		{ "hash_threads_per_file", SettingsManager::HASH_THREADS_PER_FILE, ResourceManager::MAX_FILE_HASH_THREADS },
+		{ "hash_async_reads", SettingsManager::HASH_ASYNC_READS, ResourceManager::SETTINGS_HASH_ASYNC_READS },
 
 		//{ ResourceManager::REFRESH_OPTIONS },
 		{ "refresh_time", SettingsManager::AUTO_REFRESH_TIME, ResourceManager::SETTINGS_AUTO_REFRESH_TIME, ApiSettingItem::TYPE_LAST, ResourceManager::Strings::MINUTES_LOWER },
@@ -158,6 +161,9 @@ namespace webserver {
 		{ "share_no_zero_byte", SettingsManager::NO_ZERO_BYTE, ResourceManager::SETTINGS_NO_ZERO_BYTE },
 		{ "share_max_size", SettingsManager::MAX_FILE_SIZE_SHARED, ResourceManager::DONT_SHARE_BIGGER_THAN, ApiSettingItem::TYPE_LAST, ResourceManager::Strings::MiB },
 		{ "share_follow_symlinks", SettingsManager::SHARE_FOLLOW_SYMLINKS, ResourceManager::FOLLOW_SYMLINKS },
+		{ "share_search_index", SettingsManager::SHARE_SEARCH_INDEX, ResourceManager::SETTINGS_SHARE_SEARCH_INDEX },
+		{ "share_search_parallel", SettingsManager::SHARE_SEARCH_PARALLEL, ResourceManager::SETTINGS_SHARE_SEARCH_PARALLEL },
+		{ "share_monitoring", SettingsManager::SHARE_MONITORING, ResourceManager::SETTINGS_SHARE_MONITORING },
 
 		//{ ResourceManager::SETTINGS_LOGGING },
 		{ "log_directory", SettingsManager::LOG_DIRECTORY, ResourceManager::SETTINGS_LOG_DIR, ApiSettingItem::TYPE_DIRECTORY_PATH },
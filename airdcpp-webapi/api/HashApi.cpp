@@ -87,6 +87,8 @@ namespace webserver {
 	json HashApi::serializeHashStatistics(const HashManager::HashStats& aStats) noexcept {
 		return {
 			{ "hash_speed", aStats.speed },
+			{ "hash_read_speed", aStats.readSpeed },
+			{ "hash_tree_speed", aStats.treeSpeed },
 			{ "hash_bytes_left", aStats.bytesLeft },
 			{ "hash_files_left", aStats.filesLeft },
 			{ "hash_bytes_added", aStats.bytesAdded },
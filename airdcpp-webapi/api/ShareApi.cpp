@@ -104,6 +104,12 @@ namespace webserver {
 			ShareManager::getInstance()->getValidator().newFileValidationHook.removeSubscriber(aId);
 		});
 
+		createHook("share_directory_content_validation_hook", [this](ActionHookSubscriber&& aSubscriber) {
+			return ShareManager::getInstance()->getValidator().directoryContentValidationHook.addSubscriber(std::move(aSubscriber), HOOK_HANDLER(ShareApi::directoryContentValidationHook));
+		}, [this](const string& aId) {
+			ShareManager::getInstance()->getValidator().directoryContentValidationHook.removeSubscriber(aId);
+		});
+
 		ShareManager::getInstance()->addListener(this);
 	}
 
@@ -159,6 +165,69 @@ namespace webserver {
 		);
 	}
 
+	ActionHookResult<ShareValidationRejectionMap> ShareApi::directoryContentValidationHook(const string& aPath, const ShareValidationItemList& aItems, bool aNewDirectory, const ActionHookResultGetter<ShareValidationRejectionMap>& aResultGetter) noexcept {
+		vector<JsonCallback> batches;
+		for (size_t pos = 0; pos < aItems.size(); pos += CONTENT_VALIDATION_BATCH_SIZE) {
+			batches.push_back([&, pos]() {
+				auto items = json::array();
+				for (auto i = pos; i < min(pos + CONTENT_VALIDATION_BATCH_SIZE, aItems.size()); ++i) {
+					const auto& item = aItems[i];
+					items.push_back({
+						{ "name", item.name },
+						{ "type", item.isDirectory ? "directory" : "file" },
+						{ "size", item.size },
+						{ "new", item.isNew },
+					});
+				}
+
+				return json({
+					{ "path", aPath },
+					{ "new_directory", aNewDirectory },
+					{ "items", items },
+				});
+			});
+		}
+
+		auto completionDataList = fireHooks("share_directory_content_validation_hook", WEBCFG(SHARE_DIRECTORY_VALIDATION_HOOK_TIMEOUT).num(), batches);
+
+		ShareValidationRejectionMap rejections;
+		for (size_t batch = 0; batch < completionDataList.size(); ++batch) {
+			auto result = HookCompletionData::toResult<ShareValidationRejectionMap>(
+				completionDataList[batch],
+				aResultGetter,
+				[](const json& aData, const ActionHookResultGetter<ShareValidationRejectionMap>& aResultGetter) {
+					ShareValidationRejectionMap ret;
+					if (aData.is_null()) {
+						return ret;
+					}
+
+					for (const auto& item: JsonUtil::getOptionalArrayField("rejected_items", aData)) {
+						auto rejection = aResultGetter.getRejection(
+							JsonUtil::getField<string>("reject_id", item, false),
+							JsonUtil::getField<string>("message", item, false)
+						);
+
+						ret.emplace(JsonUtil::getField<string>("name", item, false), rejection.error);
+					}
+
+					return ret;
+				}
+			);
+
+			if (result.data) {
+				rejections.insert(result.data->data.begin(), result.data->data.end());
+			} else if (result.error && !result.error->isDataError) {
+				// The whole batch was rejected
+				auto batchEnd = min((batch + 1) * CONTENT_VALIDATION_BATCH_SIZE, aItems.size());
+				for (auto i = batch * CONTENT_VALIDATION_BATCH_SIZE; i < batchEnd; ++i) {
+					rejections.emplace(aItems[i].name, result.error);
+				}
+			}
+		}
+
+		return aResultGetter.getData(rejections);
+	}
+
 	json ShareApi::serializeShareItem(const SearchResultPtr& aSR) noexcept {
 		auto isDirectory = aSR->getType() == SearchResult::TYPE_DIRECTORY;
 		auto path = aSR->getAdcPath();
@@ -473,6 +542,11 @@ namespace webserver {
 			{ "average_file_age", itemStats.averageFileAge },
 			{ "profile_count", itemStats.profileCount },
 			{ "root_count", itemStats.rootDirectoryCount },
+			{ "search_index_tokens", itemStats.searchIndexTokens },
+			{ "search_index_entries", itemStats.searchIndexEntries },
+			{ "tree_memory_usage", itemStats.treeMemoryUsage },
+			{ "index_memory_usage", itemStats.indexMemoryUsage },
+			{ "pooled_file_names", itemStats.pooledFileNames },
 
 			{ "total_searches", searchStats.totalSearches },
 			{ "total_searches_per_second", searchStats.totalSearchesPerSecond },
@@ -486,6 +560,16 @@ namespace webserver {
 			{ "recursive_searches", searchStats.recursiveSearches },
 			{ "recursive_searches_responded", searchStats.recursiveSearchesResponded },
 			{ "average_match_ms", searchStats.averageSearchMatchMs },
+			{ "indexed_searches", searchStats.indexedSearches },
+
+			{ "tth_lookups", searchStats.tthLookups },
+			{ "tth_lookup_p99_us", searchStats.tthLookupP99Us },
+			{ "refresh_tth_lookups", searchStats.refreshTTHLookups },
+			{ "refresh_tth_lookup_p99_us", searchStats.refreshTTHLookupP99Us },
+
+			{ "bloom_size", searchStats.bloomSize },
+			{ "bloom_fill_ratio", searchStats.bloomFillRatio },
+			{ "bloom_false_positive_rate", searchStats.bloomFalsePositiveRate },
 
 			{ "average_search_token_count", searchStats.averageSearchTokenCount },
 			{ "average_search_token_length", searchStats.averageSearchTokenLength },
@@ -581,6 +665,7 @@ namespace webserver {
 			case ShareRefreshType::REFRESH_DIRS: return "refresh_directories";
 			case ShareRefreshType::REFRESH_INCOMING: return "refresh_incoming";
 			case ShareRefreshType::BUNDLE: return "add_bundle";
+			case ShareRefreshType::MONITORING: return "monitoring";
 		}
 
 		dcassert(0);
@@ -629,6 +714,7 @@ namespace webserver {
 						{ "skipped", aStats.skippedDirectoryCount },
 						{ "existing", aStats.existingDirectoryCount },
 						{ "new", aStats.newDirectoryCount },
+						{ "reused", aStats.reusedDirectoryCount },
 					}},
 					{ "file_counts", {
 						{ "skipped", aStats.skippedFileCount },
@@ -636,6 +722,11 @@ namespace webserver {
 						{ "new", aStats.newFileCount },
 					}},
 					{ "hash_bytes_queued", aStats.hashSize },
+					{ "hash_database", {
+						{ "lookups", aStats.hashStoreLookupCount },
+						{ "batches", aStats.hashStoreBatchCount },
+						{ "duration_us", aStats.hashStoreLookupTimeUs },
+					}},
 				}},
 				{ "real_paths", aTask.dirs }, // DEPRECATED 
 				{ "type", refreshTypeToString(aTask.type) }, // DEPRECATED
@@ -24,6 +24,7 @@
 #include <airdcpp/typedefs.h>
 #include <airdcpp/ShareManager.h>
 #include <airdcpp/ShareManagerListener.h>
+#include <airdcpp/SharePathValidator.h>
 
 namespace webserver {
 	class ShareApi : public HookApiModule, private ShareManagerListener {
@@ -35,6 +36,11 @@ namespace webserver {
 		ActionHookResult<> directoryValidationHook(const string& aPath, const ActionHookResultGetter<>& aResultGetter) noexcept;
 		ActionHookResult<> newDirectoryValidationHook(const string& aPath, bool aNewParent, const ActionHookResultGetter<>& aResultGetter) noexcept;
 		ActionHookResult<> newFileValidationHook(const string& aPath, int64_t aSize, bool aNewParent, const ActionHookResultGetter<>& aResultGetter) noexcept;
+		ActionHookResult<ShareValidationRejectionMap> directoryContentValidationHook(const string& aPath, const ShareValidationItemList& aItems, bool aNewDirectory, const ActionHookResultGetter<ShareValidationRejectionMap>& aResultGetter) noexcept;
+
+		// Maximum number of items to send in a single directory content validation action
+		// Larger directories are split in multiple actions that are sent without waiting for the previous responses
+		static constexpr size_t CONTENT_VALIDATION_BATCH_SIZE = 500;
 
 		api_return handleRefreshShare(ApiRequest& aRequest);
 		api_return handleRefreshPaths(ApiRequest& aRequest);
@@ -153,6 +153,9 @@ namespace webserver {
 			upSpeed = 0;
 		}
 
+		auto schedulerStats = ConnectionManager::getInstance()->getDownloadSchedulerStats();
+		auto queueStorageStats = QueueManager::getInstance()->getQueueStorageStats();
+
 		return {
 			{ "speed_down", downSpeed },
 			{ "speed_up", upSpeed },
@@ -165,6 +168,18 @@ namespace webserver {
 			{ "queued_bytes", QueueManager::getInstance()->getTotalQueueSize() },
 			{ "session_downloaded", Socket::getTotalDown() },
 			{ "session_uploaded", Socket::getTotalUp() },
+			{ "download_connection_checks", {
+				{ "scheduled", schedulerStats.scheduled },
+				{ "checked", schedulerStats.checked },
+				{ "duration_us", schedulerStats.durationUs },
+			} },
+			{ "queue_storage", {
+				{ "database", queueStorageStats.database },
+				{ "load_duration_ms", queueStorageStats.loadDurationMs },
+				{ "last_save_bundles", queueStorageStats.lastSave.bundles },
+				{ "last_save_records", queueStorageStats.lastSave.records },
+				{ "last_save_duration_ms", queueStorageStats.lastSave.durationMs },
+			} },
 		};
 	}
 
@@ -27,6 +27,7 @@ namespace webserver {
 	HookApiModule::HookApiModule(Session* aSession, Access aSubscriptionAccess, const StringList& aSubscriptions, Access aHookAccess) :
 		SubscribableApiModule(aSession, aSubscriptionAccess, aSubscriptions) 
 	{
+		METHOD_HANDLER(aHookAccess, METHOD_GET, (EXACT_PARAM("hooks")), HookApiModule::handleGetHooks);
 		METHOD_HANDLER(aHookAccess, METHOD_POST, (EXACT_PARAM("hooks"), STR_PARAM(LISTENER_PARAM_ID)), HookApiModule::handleAddHook);
 		METHOD_HANDLER(aHookAccess, METHOD_DELETE, (EXACT_PARAM("hooks"), STR_PARAM(LISTENER_PARAM_ID)), HookApiModule::handleRemoveHook);
 		METHOD_HANDLER(aHookAccess, METHOD_POST, (EXACT_PARAM("hooks"), STR_PARAM(LISTENER_PARAM_ID), TOKEN_PARAM, EXACT_PARAM("resolve")), HookApiModule::handleResolveHookAction);
@@ -89,6 +90,7 @@ namespace webserver {
 		}
 
 		subscriberId = id;
+		stats = HookStats();
 		active = true;
 		return true;
 	}
@@ -102,6 +104,36 @@ namespace webserver {
 		active = false;
 	}
 
+	api_return HookApiModule::handleGetHooks(ApiRequest& aRequest) {
+		auto ret = json::array();
+
+		{
+			RLock l(cs);
+			for (const auto& h: hooks) {
+				auto pending = count_if(pendingHookActions.begin(), pendingHookActions.end(), [&](const PendingHookActionMap::value_type& aAction) {
+					return aAction.second.subscription == h.first;
+				});
+
+				const auto& stats = h.second.stats;
+				ret.push_back({
+					{ "id", h.first },
+					{ "active", h.second.isActive() },
+					{ "subscriber_id", h.second.getSubscriberId() },
+					{ "stats", {
+						{ "pending", pending },
+						{ "completed", stats.completed },
+						{ "timed_out", stats.timedOut },
+						{ "average_latency_ms", stats.completed == 0 ? 0 : stats.totalLatencyMs / stats.completed },
+						{ "max_latency_ms", stats.maxLatencyMs },
+					} },
+				});
+			}
+		}
+
+		aRequest.setResponseBody(ret);
+		return websocketpp::http::status_code::ok;
+	}
+
 	api_return HookApiModule::handleAddHook(ApiRequest& aRequest) {
 		if (!SubscribableApiModule::getSocket()) {
 			aRequest.setResponseErrorStr("Socket required");
@@ -157,6 +189,10 @@ namespace webserver {
 
 		auto& action = h->second;
 		action.completionData = std::make_shared<HookCompletionData>(aRejected, aRequest.getRequestBody());
+
+		auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - action.sent).count();
+		hooks.at(action.subscription).stats.addLatency(static_cast<uint64_t>(latency));
+
 		action.semaphore.signal();
 		return websocketpp::http::status_code::no_content;
 	}
@@ -170,53 +206,72 @@ namespace webserver {
 	}
 
 	HookApiModule::HookCompletionDataPtr HookApiModule::fireHook(const string& aSubscription, int aTimeoutSeconds, JsonCallback&& aJsonCallback) {
+		return fireHooks(aSubscription, aTimeoutSeconds, { std::move(aJsonCallback) }).front();
+	}
+
+	HookApiModule::HookCompletionDataList HookApiModule::fireHooks(const string& aSubscription, int aTimeoutSeconds, const vector<JsonCallback>& aJsonCallbacks) {
+		HookCompletionDataList ret(aJsonCallbacks.size());
 		if (!hookActive(aSubscription)) {
-			return nullptr;
+			return ret;
 		}
 
-#ifdef _DEBUG
-		auto start = std::chrono::system_clock::now();
-#endif
-
-		// Add a pending entry
-		decltype(pendingHookIdCounter) id;
+		// Notify the subscriber about all actions before waiting for the responses
 		Semaphore completionSemaphore;
+		vector<decltype(pendingHookIdCounter)> ids;
+		size_t sentCount = 0;
+		for (const auto& jsonCallback: aJsonCallbacks) {
+			// Add a pending entry
+			decltype(pendingHookIdCounter) id;
 
-		{
-			WLock l(cs);
-			id = getActionId();
-			pendingHookActions.emplace(id, PendingAction({ completionSemaphore, nullptr }));
-			//dcdebug("Adding action %d for hook %s, total pending count %d\n", id, aSubscription.c_str(), pendingHookActions.size());
+			{
+				WLock l(cs);
+				id = getActionId();
+				pendingHookActions.emplace(id, PendingAction({ completionSemaphore, nullptr, hooks.find(aSubscription)->first, std::chrono::steady_clock::now() }));
+				//dcdebug("Adding action %d for hook %s, total pending count %d\n", id, aSubscription.c_str(), pendingHookActions.size());
+			}
+
+			ids.push_back(id);
+			if (send({
+				{ "event", aSubscription },
+				{ "completion_id", id },
+				{ "data", jsonCallback() },
+			})) {
+				sentCount++;
+			}
 		}
 
-		// Notify the subscriber
-		if (send({
-			{ "event", aSubscription },
-			{ "completion_id", id },
-			{ "data", aJsonCallback() },
-		})) {
-			completionSemaphore.wait(aTimeoutSeconds * 1000);
+		// Each completion signals the semaphore once
+		auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(aTimeoutSeconds);
+		for (size_t i = 0; i < sentCount; ++i) {
+			auto timeLeft = std::chrono::duration_cast<std::chrono::milliseconds>(timeout - std::chrono::steady_clock::now()).count();
+			if (timeLeft <= 0 || !completionSemaphore.wait(static_cast<uint32_t>(timeLeft))) {
+				break;
+			}
 		}
 
 		// Clean up
-		HookCompletionDataPtr completionData = nullptr;
+		size_t timedOutCount = 0;
 
 		{
 			WLock l(cs);
-			completionData = pendingHookActions.at(id).completionData;
-			pendingHookActions.erase(id);
+			for (size_t i = 0; i < ids.size(); ++i) {
+				ret[i] = pendingHookActions.at(ids[i]).completionData;
+				pendingHookActions.erase(ids[i]);
+
+				if (!ret[i]) {
+					timedOutCount++;
+				}
+			}
+
+			hooks.at(aSubscription).stats.timedOut += timedOutCount;
 		}
 
-		if (!completionData) {
-			session->reportError("Action " + aSubscription + " timed out for subscriber " + session->getUser()->getUserName() + "\n");
-			dcdebug("Action %s (id %d) timed out\n", aSubscription.c_str(), id);
-#ifdef _DEBUG
-		} else {
-			std::chrono::duration<double> ellapsed = std::chrono::system_clock::now() - start;
-			dcdebug("Action %s (id %d) completed in %f s\n", aSubscription.c_str(), id, ellapsed.count());
-#endif
+		if (timedOutCount > 0) {
+			session->reportError("Action " + aSubscription + " timed out for subscriber " + session->getUser()->getUserName() + 
+				(ids.size() > 1 ? " (" + std::to_string(timedOutCount) + "/" + std::to_string(ids.size()) + " batches)" : "") + "\n");
+			dcdebug("Action %s timed out (%d/%d)\n", aSubscription.c_str(), static_cast<int>(timedOutCount), static_cast<int>(ids.size()));
 		}
 
-		return completionData;
+		return ret;
 	}
 }
\ No newline at end of file
@@ -34,6 +34,21 @@ namespace webserver {
 		typedef std::function<bool(ActionHookSubscriber&& aSubscriber)> HookAddF;
 		typedef std::function<void(const string& aSubscriberId)> HookRemoveF;
 
+		// Response statistics of the current subscriber
+		struct HookStats {
+			uint64_t completed = 0;
+			uint64_t timedOut = 0;
+
+			uint64_t totalLatencyMs = 0;
+			uint64_t maxLatencyMs = 0;
+
+			void addLatency(uint64_t aLatencyMs) noexcept {
+				completed++;
+				totalLatencyMs += aLatencyMs;
+				maxLatencyMs = max(maxLatencyMs, aLatencyMs);
+			}
+		};
+
 		class HookSubscriber {
 		public:
 			HookSubscriber(HookAddF&& aAddHandler, HookRemoveF&& aRemoveF) : addHandler(std::move(aAddHandler)), removeHandler(aRemoveF) {}
@@ -48,6 +63,9 @@ namespace webserver {
 			const string& getSubscriberId() const noexcept {
 				return subscriberId;
 			}
+
+			// Use the module lock for access
+			HookStats stats;
 		private:
 			bool active = false;
 
@@ -97,11 +115,18 @@ namespace webserver {
 		virtual bool hookActive(const string& aSubscription) const noexcept;
 
 		virtual HookCompletionDataPtr fireHook(const string& aSubscription, int aTimeoutSeconds, JsonCallback&& aJsonCallback);
+
+		// Send multiple actions to the subscriber without waiting for the previous ones to complete
+		// The timeout applies to the whole call
+		// Returns the completion data for each action (nullptr if the action failed or timed out)
+		typedef vector<HookCompletionDataPtr> HookCompletionDataList;
+		virtual HookCompletionDataList fireHooks(const string& aSubscription, int aTimeoutSeconds, const vector<JsonCallback>& aJsonCallbacks);
 	protected:
 		HookSubscriber& getHookSubscriber(ApiRequest& aRequest);
 
 		virtual void on(SessionListener::SocketDisconnected) noexcept override;
 
+		virtual api_return handleGetHooks(ApiRequest& aRequest);
 		virtual api_return handleAddHook(ApiRequest& aRequest);
 		virtual api_return handleRemoveHook(ApiRequest& aRequest);
 		virtual api_return handleResolveHookAction(ApiRequest& aRequest);
@@ -112,6 +137,9 @@ namespace webserver {
 		struct PendingAction {
 			Semaphore& semaphore;
 			HookCompletionDataPtr completionData;
+
+			const string& subscription;
+			const std::chrono::steady_clock::time_point sent;
 		};
 
 		typedef map<int, PendingAction> PendingHookActionMap;
@@ -0,0 +1,327 @@
+/*
+* Copyright (C) 2011-2021 AirDC++ Project
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DCPLUSPLUS_WEBSERVER_INDEXED_ITEM_LIST_H
+#define DCPLUSPLUS_WEBSERVER_INDEXED_ITEM_LIST_H
+
+#include <airdcpp/typedefs.h>
+
+
+namespace webserver {
+
+	// Ordered item list with logarithmic insertions, removals and position lookups
+	//
+	// The items are stored in an order statistic tree (treap with subtree sizes). Tree nodes are also indexed by item
+	// so that items can be located without comparisons, which allows removing items after their sort values have changed.
+	// Items with changed sort values must be removed before inserting other items as their positions are no longer valid.
+	// Items must be unique.
+	template<class T>
+	class IndexedItemList {
+	public:
+		typedef std::vector<T> ItemList;
+
+		IndexedItemList() { }
+		~IndexedItemList() {
+			clear();
+		}
+
+		IndexedItemList(const IndexedItemList&) = delete;
+		IndexedItemList& operator=(const IndexedItemList&) = delete;
+
+		size_t size() const noexcept {
+			return nodes.size();
+		}
+
+		bool empty() const noexcept {
+			return nodes.empty();
+		}
+
+		bool contains(const T& aItem) const noexcept {
+			return nodes.find(aItem) != nodes.end();
+		}
+
+		// Returns -1 if the item isn't in the list
+		int64_t getPosition(const T& aItem) const noexcept {
+			auto i = nodes.find(aItem);
+			if (i == nodes.end()) {
+				return -1;
+			}
+
+			return static_cast<int64_t>(getPosition(i->second));
+		}
+
+		// Insert the item after all items that aren't sorted after it
+		// Returns the position of the item
+		template<class LessT>
+		size_t insert(const T& aItem, const LessT& aLess) noexcept {
+			dcassert(!contains(aItem));
+
+			auto node = new Node(aItem, nextPriority());
+
+			Node* parent = nullptr;
+			bool isLeft = false;
+			size_t pos = 0;
+			for (auto cur = root; cur;) {
+				cur->count++;
+				parent = cur;
+
+				isLeft = aLess(aItem, cur->item);
+				if (isLeft) {
+					cur = cur->left;
+				} else {
+					pos += getCount(cur->left) + 1;
+					cur = cur->right;
+				}
+			}
+
+			node->parent = parent;
+			if (!parent) {
+				root = node;
+			} else if (isLeft) {
+				parent->left = node;
+			} else {
+				parent->right = node;
+			}
+
+			while (node->parent && node->priority > node->parent->priority) {
+				rotateUp(node);
+			}
+
+			nodes.emplace(aItem, node);
+			return pos;
+		}
+
+		// Returns the previous position of the item or -1 if the item wasn't found
+		int64_t remove(const T& aItem) noexcept {
+			auto i = nodes.find(aItem);
+			if (i == nodes.end()) {
+				return -1;
+			}
+
+			auto node = i->second;
+			nodes.erase(i);
+
+			auto pos = getPosition(node);
+
+			// Move the node to a leaf
+			while (node->left || node->right) {
+				auto child = !node->right || (node->left && node->left->priority > node->right->priority) ? node->left : node->right;
+				rotateUp(child);
+			}
+
+			replaceChild(node->parent, node, nullptr);
+			for (auto p = node->parent; p; p = p->parent) {
+				p->count--;
+			}
+
+			delete node;
+			return static_cast<int64_t>(pos);
+		}
+
+		// Replace the content with items in the given order
+		void assign(const ItemList& aItems) noexcept {
+			clear();
+
+			// Build the tree from the right spine in linear time
+			std::vector<Node*> spine;
+			for (const auto& item : aItems) {
+				auto node = new Node(item, nextPriority());
+
+				Node* last = nullptr;
+				while (!spine.empty() && spine.back()->priority < node->priority) {
+					last = spine.back();
+					spine.pop_back();
+				}
+
+				node->left = last;
+				if (last) {
+					last->parent = node;
+				}
+
+				if (!spine.empty()) {
+					spine.back()->right = node;
+					node->parent = spine.back();
+				}
+
+				spine.push_back(node);
+				nodes.emplace(item, node);
+			}
+
+			root = spine.empty() ? nullptr : spine.front();
+			updateCounts(root);
+
+			dcassert(nodes.size() == aItems.size());
+		}
+
+		// Returns up to aCount items starting from position aStart
+		ItemList getRange(size_t aStart, size_t aCount) const noexcept {
+			ItemList ret;
+			if (aStart >= size()) {
+				return ret;
+			}
+
+			ret.reserve(std::min(aCount, size() - aStart));
+			for (auto node = getNode(aStart); node && ret.size() < aCount; node = getNext(node)) {
+				ret.push_back(node->item);
+			}
+
+			return ret;
+		}
+
+		ItemList getItems() const noexcept {
+			return getRange(0, size());
+		}
+
+		void clear() noexcept {
+			for (const auto& n : nodes) {
+				delete n.second;
+			}
+
+			nodes.clear();
+			root = nullptr;
+		}
+	private:
+		struct Node {
+			Node(const T& aItem, uint32_t aPriority) : item(aItem), priority(aPriority) { }
+
+			T item;
+			Node* left = nullptr;
+			Node* right = nullptr;
+			Node* parent = nullptr;
+
+			const uint32_t priority;
+
+			// Number of nodes in the subtree
+			size_t count = 1;
+		};
+
+		static size_t getCount(const Node* aNode) noexcept {
+			return aNode ? aNode->count : 0;
+		}
+
+		static size_t updateCounts(Node* aNode) noexcept {
+			if (!aNode) {
+				return 0;
+			}
+
+			aNode->count = 1 + updateCounts(aNode->left) + updateCounts(aNode->right);
+			return aNode->count;
+		}
+
+		static size_t getPosition(const Node* aNode) noexcept {
+			auto pos = getCount(aNode->left);
+			for (auto n = aNode; n->parent; n = n->parent) {
+				if (n->parent->right == n) {
+					pos += getCount(n->parent->left) + 1;
+				}
+			}
+
+			return pos;
+		}
+
+		const Node* getNode(size_t aPos) const noexcept {
+			auto n = root;
+			while (n) {
+				auto leftCount = getCount(n->left);
+				if (aPos < leftCount) {
+					n = n->left;
+				} else if (aPos == leftCount) {
+					break;
+				} else {
+					aPos -= leftCount + 1;
+					n = n->right;
+				}
+			}
+
+			return n;
+		}
+
+		static const Node* getNext(const Node* aNode) noexcept {
+			if (aNode->right) {
+				auto n = aNode->right;
+				while (n->left) {
+					n = n->left;
+				}
+
+				return n;
+			}
+
+			auto n = aNode;
+			while (n->parent && n->parent->right == n) {
+				n = n->parent;
+			}
+
+			return n->parent;
+		}
+
+		void replaceChild(Node* aParent, Node* aOld, Node* aNew) noexcept {
+			if (!aParent) {
+				root = aNew;
+			} else if (aParent->left == aOld) {
+				aParent->left = aNew;
+			} else {
+				aParent->right = aNew;
+			}
+
+			if (aNew) {
+				aNew->parent = aParent;
+			}
+		}
+
+		// Rotate the node above its parent
+		void rotateUp(Node* aNode) noexcept {
+			auto parent = aNode->parent;
+			auto grandParent = parent->parent;
+			if (parent->left == aNode) {
+				parent->left = aNode->right;
+				if (parent->left) {
+					parent->left->parent = parent;
+				}
+
+				aNode->right = parent;
+			} else {
+				parent->right = aNode->left;
+				if (parent->right) {
+					parent->right->parent = parent;
+				}
+
+				aNode->left = parent;
+			}
+
+			parent->parent = aNode;
+			replaceChild(grandParent, parent, aNode);
+
+			parent->count = 1 + getCount(parent->left) + getCount(parent->right);
+			aNode->count = 1 + getCount(aNode->left) + getCount(aNode->right);
+		}
+
+		uint32_t nextPriority() noexcept {
+			// xorshift32
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			return seed;
+		}
+
+		Node* root = nullptr;
+		std::unordered_map<T, Node*> nodes;
+		uint32_t seed = 2463534242;
+	};
+}
+
+#endif
@@ -27,6 +27,8 @@
 #include <airdcpp/TimerManager.h>
 
 #include <api/base/ApiModule.h>
+#include <api/common/IndexedItemList.h>
+#include <api/common/ListViewTaskHandler.h>
 #include <api/common/PropertyFilter.h>
 #include <api/common/Serializer.h>
 #include <api/common/ViewTasks.h>
@@ -256,7 +258,7 @@ namespace webserver {
 
 			{
 				WLock l(cs);
-				matchingItems.swap(itemsNew);
+				matchingItems.assign(itemsNew);
 				itemListChanged = true;
 				currentValues.set(IntCollector::TYPE_RANGE_START, 0);
 			}
@@ -366,16 +368,17 @@ namespace webserver {
 
 		int initItems() {
 			WLock l(cs);
-			matchingItems = itemListF();
+			auto items = itemListF();
 
 			if (sourceFilter) {
 				auto matcher = PropertyFilter::Matcher<PropertyFilter*>(sourceFilter.get());
-				matchingItems.erase(remove_if(matchingItems.begin(), matchingItems.end(), [&](const T& aItem) {
+				items.erase(remove_if(items.begin(), items.end(), [&](const T& aItem) {
 					return !matchesFilter<PropertyFilter*>(aItem, matcher);
-				}), matchingItems.end());
+				}), items.end());
 			}
 
-			sourceItems.insert(matchingItems.begin(), matchingItems.end());
+			sourceItems.insert(items.begin(), items.end());
+			matchingItems.assign(items);
 
 			itemListChanged = true;
 			return static_cast<int>(matchingItems.size());
@@ -414,17 +417,33 @@ namespace webserver {
 			return aSortAscending == 1 ? res < 0 : res > 0;
 		}
 
+		auto getItemSorter(int aSortProperty, int aSortAscending) const noexcept {
+			return [this, aSortProperty, aSortAscending](const T& t1, const T& t2) {
+				return itemSort(t1, t2, itemHandler, aSortProperty, aSortAscending);
+			};
+		}
+
 		api_return handleGetItems(ApiRequest& aRequest) {
 			auto start = aRequest.getRangeParam(START_POS);
-			auto end = aRequest.getRangeParam(MAX_COUNT);
-			decltype(matchingItems) matchingItemsCopy;
+			auto count = aRequest.getRangeParam(MAX_COUNT) - start;
+
+			// Copy the requested items only
+			ItemList items;
+			int listSize = 0;
 
 			{
 				RLock l(cs);
-				matchingItemsCopy = matchingItems;
+				listSize = static_cast<int>(matchingItems.size());
+				if (start < listSize && count > 0) {
+					items = matchingItems.getRange(start, count);
+				}
 			}
 
-			auto j = Serializer::serializeFromPosition(start, end - start, matchingItemsCopy, [&](const T& i) {
+			if (listSize > 0 && (start >= listSize || count <= 0)) {
+				throw std::domain_error("Invalid range");
+			}
+
+			auto j = Serializer::serializeList(items, [&](const T& i) {
 				return Serializer::serializeItem(i, itemHandler);
 			});
 
@@ -432,27 +451,6 @@ namespace webserver {
 			return websocketpp::http::status_code::ok;
 		}
 
-		typename ItemList::iterator findItem(const T& aItem, ItemList& aItems) noexcept {
-			return find(aItems.begin(), aItems.end(), aItem);
-		}
-
-		typename ItemList::const_iterator findItem(const T& aItem, const ItemList& aItems) const noexcept {
-			return find(aItems.begin(), aItems.end(), aItem);
-		}
-
-		bool isInList(const T& aItem, const ItemList& aItems) const noexcept {
-			return findItem(aItem, aItems) != aItems.end();
-		}
-
-		int64_t getPosition(const T& aItem, const ItemList& aItems) const noexcept {
-			auto i = findItem(aItem, aItems);
-			if (i == aItems.end()) {
-				return -1;
-			}
-
-			return distance(aItems.begin(), i);
-		}
-
 		// TASKS START
 		void runTasks() {
 			typename ItemTasks<T>::TaskMap currentTasks;
@@ -479,7 +477,7 @@ namespace webserver {
 				return;
 			}
 
-			maybeSort(updatedProperties, sortProperty, sortAscending);
+			maybeSort(sortProperty, sortAscending);
 
 			// Start position
 			auto newStart = updateValues[IntCollector::TYPE_RANGE_START];
@@ -487,7 +485,7 @@ namespace webserver {
 			json j;
 
 			// Go through the tasks
-			auto updatedItems = handleTasks(currentTasks, sortProperty, sortAscending, newStart);
+			auto updatedItems = taskHandler.handleTasks(currentTasks, sortProperty, getItemSorter(sortProperty, sortAscending), newStart);
 
 			ItemList nextViewportItems;
 			if (newStart >= 0) {
@@ -524,30 +522,7 @@ namespace webserver {
 			sendJson(j);
 		}
 
-		typedef std::map<T, const PropertyIdSet&> ItemPropertyIdMap;
-		ItemPropertyIdMap handleTasks(const typename ItemTasks<T>::TaskMap& aTaskList, int aSortProperty, int aSortAscending, int& rangeStart_) {
-			ItemPropertyIdMap updatedItems;
-			for (auto& t : aTaskList) {
-				switch (t.second.type) {
-				case ADD_ITEM: {
-					handleAddItemTask(t.first, aSortProperty, aSortAscending, rangeStart_);
-					break;
-				}
-				case REMOVE_ITEM: {
-					handleRemoveItemTask(t.first, rangeStart_);
-					break;
-				}
-				case UPDATE_ITEM: {
-					if (handleUpdateItemTask(t.first, aSortProperty, aSortAscending, rangeStart_)) {
-						updatedItems.emplace(t.first, t.second.updatedProperties);
-					}
-					break;
-				}
-				}
-			}
-
-			return updatedItems;
-		}
+		typedef typename ListViewTaskHandler<T>::ItemPropertyIdMap ItemPropertyIdMap;
 
 		void updateViewItems(const ItemPropertyIdMap& aUpdatedItems, json& json_, int& newStart_, int aMaxCount, ItemList& nextViewportItems_) {
 			// Get the new visible items
@@ -563,14 +538,7 @@ namespace webserver {
 					return;
 				}
 
-
-				auto startIter = matchingItems.begin();
-				std::advance(startIter, newStart_);
-
-				auto endIter = startIter;
-				std::advance(endIter, count);
-
-				std::copy(startIter, endIter, back_inserter(nextViewportItems_));
+				nextViewportItems_ = matchingItems.getRange(newStart_, count);
 				currentItemsCopy = currentViewportItems;
 			}
 
@@ -579,7 +547,7 @@ namespace webserver {
 			// List items
 			int pos = 0;
 			for (const auto& item : nextViewportItems_) {
-				if (!isInList(item, currentItemsCopy)) {
+				if (find(currentItemsCopy.begin(), currentItemsCopy.end(), item) == currentItemsCopy.end()) {
 					appendItemFull(item, json_, pos);
 				} else {
 					// append position
@@ -595,9 +563,9 @@ namespace webserver {
 			}
 		}
 
-		void maybeSort(const PropertyIdSet& aUpdatedProperties, int aSortProperty, int aSortAscending) {
-			bool needSort = aUpdatedProperties.find(aSortProperty) != aUpdatedProperties.end() ||
-				prevValues[IntCollector::TYPE_SORT_ASCENDING] != aSortAscending ||
+		// Items with updated sort values are repositioned when handling the tasks
+		void maybeSort(int aSortProperty, int aSortAscending) {
+			bool needSort = prevValues[IntCollector::TYPE_SORT_ASCENDING] != aSortAscending ||
 				prevValues[IntCollector::TYPE_SORT_PROPERTY] != aSortProperty ||
 				itemListChanged;
 
@@ -607,14 +575,9 @@ namespace webserver {
 				auto start = GET_TICK();
 
 				WLock l(cs);
-				std::stable_sort(matchingItems.begin(), matchingItems.end(),
-					std::bind(&ListViewController::itemSort,
-						std::placeholders::_1,
-						std::placeholders::_2,
-						itemHandler,
-						aSortProperty,
-						aSortAscending
-						));
+				auto items = matchingItems.getItems();
+				std::stable_sort(items.begin(), items.end(), getItemSorter(aSortProperty, aSortAscending));
+				matchingItems.assign(items);
 
 				dcdebug("Table %s sorted in " U64_FMT " ms\n", viewName.c_str(), GET_TICK() - start);
 			}
@@ -640,26 +603,6 @@ namespace webserver {
 			}
 		}
 
-		void handleAddItemTask(const T& aItem, int aSortProperty, int aSortAscending, int& rangeStart_) {
-			if (!matchesSourceFilter(aItem)) {
-				return;
-			}
-
-			auto matchesFilters = matchesFilter(aItem, getFilterMatcherList());
-
-			WLock l(cs);
-			sourceItems.emplace(aItem);
-			if (matchesFilters) {
-				addMatchingItemUnsafe(aItem, aSortProperty, aSortAscending, rangeStart_);
-			}
-		}
-
-		void handleRemoveItemTask(const T& aItem, int& rangeStart_) {
-			WLock l(cs);
-			sourceItems.erase(aItem);
-			removeMatchingItemUnsafe(aItem, rangeStart_);
-		}
-
 		bool matchesSourceFilter(const T& aItem) {
 			if (!sourceFilter) {
 				return true;
@@ -670,79 +613,6 @@ namespace webserver {
 			return matchesFilter<PropertyFilter*>(aItem, matcher);
 		}
 
-		// Returns false if the item was added/removed (or the item doesn't exist in any item list)
-		bool handleUpdateItemTask(const T& aItem, int aSortProperty, int aSortAscending, int& rangeStart_) {
-			if (!matchesSourceFilter(aItem)) {
-				return false;
-			}
-
-			bool inList;
-
-			{
-				RLock l(cs);
-				inList = isInList(aItem, matchingItems);
-
-				// A delayed update for a removed item?
-				if (!inList && sourceItems.find(aItem) == sourceItems.end()) {
-					return false;
-				}
-			}
-
-			auto matchers = getFilterMatcherList();
-			if (!matchesFilter(aItem, matchers)) {
-				if (inList) {
-					WLock l(cs);
-					removeMatchingItemUnsafe(aItem, rangeStart_);
-				}
-
-				return false;
-			} else if (!inList) {
-				WLock l(cs);
-				addMatchingItemUnsafe(aItem, aSortProperty, aSortAscending, rangeStart_);
-				return false;
-			}
-
-			return true;
-		}
-
-
-		// Add an item in the current matching view item list
-		void addMatchingItemUnsafe(const T& aItem, int aSortProperty, int aSortAscending, int& rangeStart_) {
-			auto matchingItemsIter = matchingItems.insert(
-				std::upper_bound(
-					matchingItems.begin(),
-					matchingItems.end(),
-					aItem,
-					std::bind(&ListViewController::itemSort, std::placeholders::_1, std::placeholders::_2, itemHandler, aSortProperty, aSortAscending)
-				),
-				aItem
-			);
-
-			auto pos = static_cast<int>(std::distance(matchingItems.begin(), matchingItemsIter));
-			if (pos < rangeStart_) {
-				// Update the range range positions
-				rangeStart_++;
-			}
-		}
-
-		// Remove an item from the current matching view item list
-		void removeMatchingItemUnsafe(const T& aItem, int& rangeStart_) {
-			auto matchingItemsIter = findItem(aItem, matchingItems);
-			if (matchingItemsIter == matchingItems.end()) {
-				//dcassert(0);
-				return;
-			}
-
-			auto pos = static_cast<int>(std::distance(matchingItems.begin(), matchingItemsIter));
-
-			matchingItems.erase(matchingItemsIter);
-
-			if (rangeStart_ > 0 && pos > rangeStart_) {
-				// Update the range range positions
-				rangeStart_--;
-			}
-		}
-
 		// TASKS END
 
 		// JSON APPEND START
@@ -778,8 +648,8 @@ namespace webserver {
 		// Items visible in the current viewport
 		ItemList currentViewportItems;
 
-		// All items matching the list of dynamic filters
-		ItemList matchingItems;
+		// All items matching the list of dynamic filters (sorted)
+		IndexedItemList<T> matchingItems;
 
 		bool active = false;
 
@@ -789,6 +659,11 @@ namespace webserver {
 		const std::string viewName;
 
 		ItemTasks<T> tasks;
+		ListViewTaskHandler<T> taskHandler {
+			cs, sourceItems, matchingItems,
+			[this](const T& aItem) { return matchesSourceFilter(aItem); },
+			[this](const T& aItem) { return matchesFilter(aItem, getFilterMatcherList()); }
+		};
 
 		TimerPtr timer;
 
@@ -0,0 +1,198 @@
+/*
+* Copyright (C) 2011-2021 AirDC++ Project
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+*/
+
+#ifndef DCPLUSPLUS_WEBSERVER_LISTVIEW_TASK_HANDLER_H
+#define DCPLUSPLUS_WEBSERVER_LISTVIEW_TASK_HANDLER_H
+
+#include <airdcpp/CriticalSection.h>
+
+#include <api/common/IndexedItemList.h>
+#include <api/common/Property.h>
+#include <api/common/ViewTasks.h>
+
+namespace webserver {
+
+	// Applies the queued item tasks of a list view to its source and matching item lists
+	//
+	// The item lists and the lock protecting them are owned by the view. The filters are evaluated
+	// without holding the lock.
+	template<class T>
+	class ListViewTaskHandler {
+	public:
+		typedef std::function<bool(const T& aItem)> MatchF;
+		typedef std::map<T, const PropertyIdSet&> ItemPropertyIdMap;
+
+		// aSourceFilterF: whether the item should be included in the source items
+		// aFilterF: whether the item matches the dynamic filters of the view
+		ListViewTaskHandler(SharedMutex& aCs, std::set<T, std::less<T>>& aSourceItems, IndexedItemList<T>& aMatchingItems, const MatchF& aSourceFilterF, const MatchF& aFilterF) :
+			cs(aCs), sourceItems(aSourceItems), matchingItems(aMatchingItems), sourceFilterF(aSourceFilterF), filterF(aFilterF) {
+
+		}
+
+		// Returns the items that remained in the list with their updated properties
+		// The range start is adjusted for the items that were added or removed before it
+		template<class SorterT>
+		ItemPropertyIdMap handleTasks(const typename ItemTasks<T>::TaskMap& aTaskList, int aSortProperty, const SorterT& aSorter, int& rangeStart_) {
+			// Items with changed sort values must not be used for positioning other items of the same batch
+			auto detachedItems = detachSortChangedItems(aTaskList, aSortProperty);
+
+			ItemPropertyIdMap updatedItems;
+			for (auto& t : aTaskList) {
+				switch (t.second.type) {
+				case ADD_ITEM: {
+					handleAddItemTask(t.first, aSorter, rangeStart_);
+					break;
+				}
+				case REMOVE_ITEM: {
+					handleRemoveItemTask(t.first, rangeStart_);
+					break;
+				}
+				case UPDATE_ITEM: {
+					auto detached = detachedItems.find(t.first) != detachedItems.end();
+					if (handleUpdateItemTask(t.first, aSorter, detached, rangeStart_)) {
+						updatedItems.emplace(t.first, t.second.updatedProperties);
+					}
+					break;
+				}
+				}
+			}
+
+			return updatedItems;
+		}
+	private:
+		// Removes the matching items whose sort values have changed (they are inserted back when handling the update task)
+		std::set<T> detachSortChangedItems(const typename ItemTasks<T>::TaskMap& aTaskList, int aSortProperty) {
+			std::set<T> ret;
+
+			WLock l(cs);
+			for (const auto& t : aTaskList) {
+				if (t.second.type == UPDATE_ITEM && t.second.updatedProperties.find(aSortProperty) != t.second.updatedProperties.end() && matchingItems.remove(t.first) != -1) {
+					ret.insert(t.first);
+				}
+			}
+
+			return ret;
+		}
+
+		template<class SorterT>
+		void handleAddItemTask(const T& aItem, const SorterT& aSorter, int& rangeStart_) {
+			if (!sourceFilterF(aItem)) {
+				return;
+			}
+
+			auto matchesFilters = filterF(aItem);
+
+			WLock l(cs);
+			sourceItems.emplace(aItem);
+			if (matchesFilters) {
+				addMatchingItemUnsafe(aItem, aSorter, rangeStart_);
+			}
+		}
+
+		void handleRemoveItemTask(const T& aItem, int& rangeStart_) {
+			WLock l(cs);
+			sourceItems.erase(aItem);
+			removeMatchingItemUnsafe(aItem, rangeStart_);
+		}
+
+		// Returns false if the item was added/removed (or the item doesn't exist in any item list)
+		// Detached items were removed from the matching items because of a changed sort value
+		template<class SorterT>
+		bool handleUpdateItemTask(const T& aItem, const SorterT& aSorter, bool aDetached, int& rangeStart_) {
+			if (!sourceFilterF(aItem)) {
+				if (aDetached) {
+					WLock l(cs);
+					matchingItems.insert(aItem, aSorter);
+				}
+
+				return false;
+			}
+
+			bool inList;
+
+			{
+				RLock l(cs);
+				inList = aDetached || matchingItems.contains(aItem);
+
+				// A delayed update for a removed item?
+				if (!inList && sourceItems.find(aItem) == sourceItems.end()) {
+					return false;
+				}
+			}
+
+			if (!filterF(aItem)) {
+				if (inList) {
+					WLock l(cs);
+					removeMatchingItemUnsafe(aItem, rangeStart_);
+				}
+
+				return false;
+			} else if (!inList) {
+				WLock l(cs);
+				addMatchingItemUnsafe(aItem, aSorter, rangeStart_);
+				return false;
+			}
+
+			if (aDetached) {
+				// Insert in the new position
+				WLock l(cs);
+				matchingItems.insert(aItem, aSorter);
+			}
+
+			return true;
+		}
+
+		// Add an item in the current matching view item list
+		template<class SorterT>
+		void addMatchingItemUnsafe(const T& aItem, const SorterT& aSorter, int& rangeStart_) {
+			if (matchingItems.contains(aItem)) {
+				// Added while the list was being initialized
+				return;
+			}
+
+			auto pos = static_cast<int>(matchingItems.insert(aItem, aSorter));
+			if (pos < rangeStart_) {
+				// Update the range range positions
+				rangeStart_++;
+			}
+		}
+
+		// Remove an item from the current matching view item list
+		void removeMatchingItemUnsafe(const T& aItem, int& rangeStart_) {
+			auto pos = static_cast<int>(matchingItems.remove(aItem));
+			if (pos == -1) {
+				//dcassert(0);
+				return;
+			}
+
+			if (rangeStart_ > 0 && pos > rangeStart_) {
+				// Update the range range positions
+				rangeStart_--;
+			}
+		}
+
+		SharedMutex& cs;
+		std::set<T, std::less<T>>& sourceItems;
+		IndexedItemList<T>& matchingItems;
+
+		const MatchF sourceFilterF;
+		const MatchF filterF;
+	};
+}
+
+#endif
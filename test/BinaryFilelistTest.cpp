@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/BinaryFilelist.h>
+#include <airdcpp/File.h>
+#include <airdcpp/SimpleXML.h>
+#include <airdcpp/SimpleXMLReader.h>
+#include <airdcpp/Streams.h>
+
+#include <random>
+
+using namespace dcpp;
+
+namespace {
+
+const string LIST_PATH = "BinaryFilelistTest.tmp";
+
+struct TestFile {
+	string name;
+	int64_t size;
+	TTHValue tth;
+};
+
+struct TestDirectory {
+	string name;
+	time_t date;
+	vector<TestFile> files;
+	vector<TestDirectory> directories;
+};
+
+TestDirectory createTree(std::mt19937& gen_, int aDepth, const string& aName) {
+	TestDirectory ret { aName, static_cast<time_t>(gen_() % 2000000000), {}, {} };
+
+	auto fileCount = gen_() % 100;
+	for (size_t i = 0; i < fileCount; ++i) {
+		TTHValue tth;
+		for (auto& b: tth.data) {
+			b = static_cast<uint8_t>(gen_());
+		}
+
+		// Names that must be escaped in XML
+		ret.files.push_back({ "file <" + std::to_string(i) + "> & \"\xc3\xa4\".bin", static_cast<int64_t>(gen_()) << (gen_() % 20), tth });
+	}
+
+	if (aDepth > 0) {
+		auto dirCount = 2 + gen_() % 3;
+		for (size_t i = 0; i < dirCount; ++i) {
+			ret.directories.push_back(createTree(gen_, aDepth - 1, "dir '" + std::to_string(i) + "'"));
+		}
+	}
+
+	return ret;
+}
+
+// Same element layout as the full XML lists of ShareManager
+void toXml(const TestDirectory& aDir, string& xml_) {
+	string tmp;
+	for (const auto& d: aDir.directories) {
+		xml_ += "<Directory Name=\"" + SimpleXML::escape(d.name, tmp, true) + "\" Date=\"" + std::to_string(d.date) + "\">\r\n";
+		toXml(d, xml_);
+		xml_ += "</Directory>\r\n";
+	}
+
+	for (const auto& f: aDir.files) {
+		xml_ += "<File Name=\"" + SimpleXML::escape(f.name, tmp, true) + "\" Size=\"" + std::to_string(f.size) + "\" TTH=\"" + f.tth.toBase32() + "\"/>\r\n";
+	}
+}
+
+// Same order as ShareManager::FilelistDirectory::toBinary
+void toBinary(const TestDirectory& aDir, BinaryFilelistWriter& aWriter, size_t aIndex) {
+	for (const auto& f: aDir.files) {
+		aWriter.addFile(f.name, f.size, f.tth, 0);
+	}
+
+	for (const auto& d: aDir.directories) {
+		toBinary(d, aWriter, aWriter.addDirectory(aIndex, d.name, d.date));
+	}
+}
+
+// Lines describing each item of the list
+class XmlLoader : public SimpleXMLReader::CallBack {
+public:
+	StringList items;
+
+	void startTag(const string& aName, StringPairList& aAttribs, bool aSimple) override {
+		if (aName == "Directory") {
+			path += getAttrib(aAttribs, "Name", 0) + "/";
+			items.push_back(path + " " + getAttrib(aAttribs, "Date", 1));
+			if (aSimple) {
+				endTag(aName);
+			}
+		} else if (aName == "File") {
+			items.push_back(path + getAttrib(aAttribs, "Name", 0) + " " + getAttrib(aAttribs, "Size", 1) + " " + getAttrib(aAttribs, "TTH", 2));
+		}
+	}
+
+	void endTag(const string& aName) override {
+		if (aName == "Directory") {
+			path.erase(path.rfind('/', path.size() - 2) + 1);
+		}
+	}
+private:
+	string path = "/";
+};
+
+StringList readBinary(BinaryFilelistReader& aReader) {
+	StringList ret;
+
+	const auto& dirs = aReader.getDirectories();
+	StringList paths;
+	for (size_t i = 0; i < dirs.size(); ++i) {
+		const auto& d = dirs[i];
+		paths.push_back(i == 0 ? "/" : paths[d.parent] + d.name + "/");
+		if (i > 0) {
+			ret.push_back(paths.back() + " " + std::to_string(d.date));
+		}
+
+		aReader.forEachFile(i, [&](const string& aName, int64_t aSize, const TTHValue& aTTH, time_t) {
+			ret.push_back(paths[i] + aName + " " + std::to_string(aSize) + " " + aTTH.toBase32());
+		});
+	}
+
+	return ret;
+}
+
+void writeBinary(const TestDirectory& aRoot) {
+	File f(LIST_PATH, File::WRITE, File::TRUNCATE | File::CREATE);
+	BinaryFilelistWriter writer(f, "/", aRoot.date, "test");
+	toBinary(aRoot, writer, 0);
+	writer.finish();
+}
+
+void testRoundTrip() {
+	std::mt19937 gen(1);
+	auto root = createTree(gen, 5, Util::emptyString);
+
+	string xml = SimpleXML::utf8Header;
+	xml += "<FileListing Version=\"1\" Base=\"/\" BaseDate=\"" + std::to_string(root.date) + "\" Generator=\"test\">\r\n";
+	toXml(root, xml);
+	xml += "</FileListing>";
+
+	XmlLoader xmlLoader;
+	{
+		MemoryInputStream is(xml);
+		SimpleXMLReader(&xmlLoader).parse(is);
+	}
+
+	writeBinary(root);
+
+	File f(LIST_PATH, File::READ, File::OPEN);
+	BinaryFilelistReader reader(f);
+	TEST_CHECK_EQUAL(reader.getBase(), "/");
+	TEST_CHECK_EQUAL(reader.getGenerator(), "test");
+
+	auto binaryItems = readBinary(reader);
+
+	// Multiple frames should have been written
+	TEST_CHECK(xml.size() > 4 * BinaryFilelistWriter::FRAME_SIZE);
+
+	// The files are listed before the directories in binary lists
+	sort(binaryItems.begin(), binaryItems.end());
+	sort(xmlLoader.items.begin(), xmlLoader.items.end());
+
+	TEST_CHECK_EQUAL(binaryItems.size(), xmlLoader.items.size());
+	TEST_CHECK(binaryItems == xmlLoader.items);
+}
+
+bool isRejected(const string& aList) {
+	{
+		File f(LIST_PATH, File::WRITE, File::TRUNCATE | File::CREATE);
+		f.write(aList);
+	}
+
+	try {
+		File f(LIST_PATH, File::READ, File::OPEN);
+		BinaryFilelistReader reader(f);
+		readBinary(reader);
+	} catch (const BinaryFilelistException&) {
+		return true;
+	}
+
+	return false;
+}
+
+void setFixed(string& list_, size_t aPos, uint64_t aValue, int aBytes) {
+	for (int i = 0; i < aBytes; ++i) {
+		list_[aPos + i] = static_cast<char>((aValue >> (i * 8)) & 0xFF);
+	}
+}
+
+// The sizes in the list must not cause huge allocations
+void testDeclaredSizes() {
+	std::mt19937 gen(2);
+	writeBinary(createTree(gen, 2, Util::emptyString));
+
+	string list;
+	{
+		File f(LIST_PATH, File::READ, File::OPEN);
+		list = f.read();
+	}
+
+	TEST_CHECK(!isRejected(list));
+
+	// Footer: index offset (8), compressed index size (4), index size (4), magic
+	auto footerPos = list.size() - 20;
+	auto indexCompressedSize = static_cast<uint8_t>(list[footerPos + 8]) | static_cast<uint8_t>(list[footerPos + 9]) << 8;
+
+	auto tampered = list;
+	setFixed(tampered, footerPos + 12, 0xFFFFFFFF, 4);
+	TEST_CHECK(isRejected(tampered));
+
+	// Below the absolute limit but not possible with the compressed size
+	tampered = list;
+	setFixed(tampered, footerPos + 12, indexCompressedSize * 2000, 4);
+	TEST_CHECK(isRejected(tampered));
+}
+
+}
+
+int main() {
+	try {
+		testRoundTrip();
+		testDeclaredSizes();
+	} catch (const Exception& e) {
+		std::cerr << "Unexpected exception: " << e.getError() << std::endl;
+		test::failures()++;
+	}
+
+	File::deleteFile(LIST_PATH);
+	return test::result();
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/Bundle.h>
+#include <airdcpp/QueueItem.h>
+#include <airdcpp/ResourceManager.h>
+#include <airdcpp/SettingsManager.h>
+#include <airdcpp/TimerManager.h>
+#include <airdcpp/User.h>
+#include <airdcpp/UserQueue.h>
+
+#include <random>
+
+using namespace dcpp;
+
+namespace {
+
+const string HUB_URL = "adcs://hub.example.com:1511";
+const OrderedStringSet HUBS = { HUB_URL };
+
+HintedUser createUser() {
+	return HintedUser(UserPtr(new User(CID::generate())), HUB_URL);
+}
+
+BundlePtr createBundle(QueueToken aToken, Priority aPriority = Priority::NORMAL, time_t aAdded = GET_TIME()) {
+	return make_shared<Bundle>("/downloads/Bundle " + std::to_string(aToken) + "/", aAdded, aPriority, 0, aToken, false);
+}
+
+// Items are normally added in the bundle by BundleQueue and the sources by QueueManager
+QueueItemPtr addItem(UserQueue& aUserQueue, const BundlePtr& aBundle, const HintedUserList& aSources, const string& aName, Flags::MaskType aFlags, Priority aPriority = Priority::NORMAL) {
+	auto qi = make_shared<QueueItem>(aBundle->getTarget() + aName, 10 * 1024 * 1024, aPriority, aFlags, GET_TIME(), TTHValue(), Util::emptyString);
+	aBundle->addQueue(qi);
+	qi->setBundle(aBundle);
+
+	for (const auto& u: aSources) {
+		aUserQueue.addSource(qi, u);
+	}
+
+	return qi;
+}
+
+QueueItemPtr getNext(Bundle& aBundle, const HintedUser& aUser, QueueItemBase::DownloadType aType) {
+	string lastError;
+	return aBundle.getNextQI(aUser.user, HUBS, lastError, Priority::LOWEST, 0, 0, aType, false);
+}
+
+// The regular items can't be downloaded with the small slot (and the other way around)
+void testConnectionTypes(size_t aScale) {
+	UserQueue userQueue;
+	auto user = createUser();
+	auto bundlePtr = createBundle(1);
+	auto& bundle = *bundlePtr;
+
+	QueueItemList regularItems;
+	for (size_t i = 0; i < 50000 * aScale; ++i) {
+		regularItems.push_back(addItem(userQueue, bundlePtr, { user }, "File " + std::to_string(i) + ".bin", 0));
+	}
+
+	auto smallItem = addItem(userQueue, bundlePtr, { user }, "Partial list", QueueItem::FLAG_PARTIAL_LIST);
+
+	QueueItemPtr next;
+	test::benchmark("Small slot item after " + std::to_string(regularItems.size()) + " regular items (1000 lookups)", [&] {
+		for (int i = 0; i < 1000; ++i) {
+			next = getNext(bundle, user, QueueItemBase::TYPE_SMALL);
+		}
+	});
+
+	TEST_CHECK(next == smallItem);
+
+	next = getNext(bundle, user, QueueItemBase::TYPE_MCN_NORMAL);
+	TEST_CHECK(next && next != smallItem);
+
+	// Both lanes are used without a connection type, the first item is picked
+	QueueItemList items;
+	bundle.getItems(user.user, items);
+	TEST_CHECK_EQUAL(items.size(), regularItems.size() + 1);
+	TEST_CHECK(getNext(bundle, user, QueueItemBase::TYPE_ANY) == items.front());
+
+	// Rotated items go to the back
+	bundle.rotateUserQueue(items.front(), user.user);
+
+	QueueItemList rotatedItems;
+	bundle.getItems(user.user, rotatedItems);
+	TEST_CHECK(rotatedItems.back() == items.front());
+	TEST_CHECK(getNext(bundle, user, QueueItemBase::TYPE_ANY) == rotatedItems.front());
+
+	for (const auto& qi: items) {
+		userQueue.removeSource(qi, user.user, 0);
+	}
+
+	TEST_CHECK(!getNext(bundle, user, QueueItemBase::TYPE_ANY));
+	TEST_CHECK(userQueue.getBundles(user.user).empty());
+}
+
+// Picking the next bundle by going through all bundles of the user (the implementation before the bundles were indexed)
+QueueItemPtr getNextReference(const BundleList& aBundles, const UserPtr& aUser, const QueueTokenSet& aRunningBundles, Priority aMinPrio,
+	QueueItemBase::DownloadType aType, string& lastError_, bool& hasDownload_) {
+
+	lastError_ = Util::emptyString;
+
+	auto bundleLimit = SETTING(MAX_RUNNING_BUNDLES);
+	for (const auto& b: aBundles) {
+		if (bundleLimit > 0 && static_cast<int>(aRunningBundles.size()) >= bundleLimit && aRunningBundles.find(b->getToken()) == aRunningBundles.end()) {
+			hasDownload_ = true;
+			lastError_ = STRING(MAX_BUNDLES_RUNNING);
+			continue;
+		}
+
+		if (b->getPriority() < aMinPrio) {
+			break;
+		}
+
+		auto qi = b->getNextQI(aUser, HUBS, lastError_, aMinPrio, 0, 0, aType, false);
+		if (qi) {
+			return qi;
+		}
+	}
+
+	return nullptr;
+}
+
+// Bundles of the user in the download order (bundles added at the same time are ordered by token)
+BundleList getUserBundles(const BundleList& aBundles, const UserPtr& aUser) {
+	BundleList ret;
+	copy_if(aBundles.begin(), aBundles.end(), back_inserter(ret), [&](const BundlePtr& b) { return b->isSource(aUser); });
+	sort(ret.begin(), ret.end(), [](const BundlePtr& a, const BundlePtr& b) {
+		if (a->getPriority() != b->getPriority() || a->getTimeAdded() != b->getTimeAdded()) {
+			return Bundle::SortOrder()(a, b);
+		}
+
+		return a->getToken() < b->getToken();
+	});
+
+	return ret;
+}
+
+const Priority PRIORITIES[] = { Priority::PAUSED_FORCE, Priority::PAUSED, Priority::LOWEST, Priority::LOW, Priority::NORMAL, Priority::HIGH, Priority::HIGHEST };
+
+Priority getRandomPriority(std::mt19937& gen_) {
+	return PRIORITIES[gen_() % (sizeof(PRIORITIES) / sizeof(PRIORITIES[0]))];
+}
+
+// The indexed bundles must give the same results as going through all bundles
+void testRandomQueue() {
+	std::mt19937 gen(1);
+
+	UserQueue userQueue;
+
+	HintedUserList users;
+	for (int i = 0; i < 4; ++i) {
+		users.push_back(createUser());
+	}
+
+	BundleList bundles;
+	QueueItemList items;
+	auto added = GET_TIME();
+	for (QueueToken token = 1; token <= 40; ++token) {
+		// Some bundles are added at the same time
+		auto bundle = createBundle(token, getRandomPriority(gen), added + gen() % 10);
+		bundles.push_back(bundle);
+
+		auto itemCount = 1 + gen() % 6;
+		for (size_t i = 0; i < itemCount; ++i) {
+			HintedUserList sources;
+			copy_if(users.begin(), users.end(), back_inserter(sources), [&](const HintedUser&) { return gen() % 2 == 0; });
+
+			auto flags = gen() % 5 == 0 ? QueueItem::FLAG_PARTIAL_LIST : 0;
+			items.push_back(addItem(userQueue, bundle, sources, "File " + std::to_string(i), flags, getRandomPriority(gen)));
+		}
+	}
+
+	for (int round = 0; round < 2000; ++round) {
+		auto& qi = items[gen() % items.size()];
+		const auto& user = users[gen() % users.size()];
+		switch (gen() % 4) {
+			case 0: {
+				if (!qi->isSource(user.user)) {
+					userQueue.addSource(qi, user);
+				}
+				break;
+			}
+			case 1: {
+				if (qi->isSource(user.user)) {
+					userQueue.removeSource(qi, user.user, 0);
+				}
+				break;
+			}
+			case 2: {
+				userQueue.setBundlePriority(qi->getBundle(), getRandomPriority(gen));
+				break;
+			}
+			case 3: {
+				userQueue.setQIPriority(qi, getRandomPriority(gen));
+				break;
+			}
+		}
+
+		// Random running bundles for the bundle limit
+		QueueTokenSet runningBundles;
+		for (const auto& b: bundles) {
+			if (gen() % 8 == 0) {
+				runningBundles.insert(b->getToken());
+			}
+		}
+
+		SettingsManager::getInstance()->set(SettingsManager::MAX_RUNNING_BUNDLES, gen() % 2 == 0 ? 0 : static_cast<int>(gen() % 8));
+		for (const auto& u: users) {
+			auto userBundles = getUserBundles(bundles, u.user);
+			TEST_CHECK(userQueue.getBundles(u.user) == userBundles);
+
+			for (auto type: { QueueItemBase::TYPE_ANY, QueueItemBase::TYPE_SMALL, QueueItemBase::TYPE_MCN_NORMAL }) {
+				for (auto minPrio: { Priority::LOWEST, Priority::HIGH }) {
+					string lastError, referenceLastError;
+					bool hasDownload = false, referenceHasDownload = false;
+
+					auto next = userQueue.getNextBundleQI(u.user, runningBundles, HUBS, minPrio, 0, 0, type, false, lastError, hasDownload);
+					auto referenceNext = getNextReference(userBundles, u.user, runningBundles, minPrio, type, referenceLastError, referenceHasDownload);
+					TEST_CHECK(next == referenceNext);
+					if (!next) {
+						TEST_CHECK_EQUAL(hasDownload, referenceHasDownload);
+						TEST_CHECK_EQUAL(lastError, referenceLastError);
+					}
+				}
+			}
+		}
+	}
+
+	SettingsManager::getInstance()->set(SettingsManager::MAX_RUNNING_BUNDLES, 0);
+}
+
+// 100k items from 1000 bundles with 1000 sources
+// All items are queued from one of the users and the download is picked from the last bundle
+void testManyBundles(size_t aScale) {
+	UserQueue userQueue;
+
+	HintedUserList users;
+	for (int i = 0; i < 1000; ++i) {
+		users.push_back(createUser());
+	}
+
+	const auto& user = users.front();
+
+	BundleList bundles;
+	auto added = GET_TIME();
+	size_t itemCount = 0;
+	test::benchmark("Queueing " + std::to_string(100000 * aScale) + " items with " + std::to_string(users.size()) + " sources", [&] {
+		for (QueueToken token = 1; token <= 1000 * aScale; ++token) {
+			auto bundle = createBundle(token, Priority::NORMAL, added + token);
+			bundles.push_back(bundle);
+
+			for (size_t i = 0; i < 100; ++i) {
+				const auto& other = users[1 + (itemCount++ % (users.size() - 1))];
+				addItem(userQueue, bundle, { user, other }, "File " + std::to_string(i) + ".bin", 0);
+			}
+		}
+	});
+
+	auto userBundles = getUserBundles(bundles, user.user);
+	TEST_CHECK_EQUAL(userBundles.size(), bundles.size());
+
+	auto benchmarkNext = [&](const string& aName, const QueueTokenSet& aRunningBundles, QueueItemBase::DownloadType aType, const QueueItemPtr& aExpected) {
+		QueueItemPtr next;
+		string lastError;
+		bool hasDownload = false;
+
+		test::benchmark(aName + ", all bundles (1000 lookups)", [&] {
+			for (int i = 0; i < 1000; ++i) {
+				next = getNextReference(userBundles, user.user, aRunningBundles, Priority::LOWEST, aType, lastError, hasDownload);
+			}
+		});
+		TEST_CHECK(next == aExpected);
+
+		test::benchmark(aName + ", indexed bundles (1000 lookups)", [&] {
+			for (int i = 0; i < 1000; ++i) {
+				next = userQueue.getNext(user.user, aRunningBundles, HUBS, lastError, hasDownload, Priority::LOWEST, 0, 0, aType);
+			}
+		});
+		TEST_CHECK(next == aExpected);
+	};
+
+	// Small slot
+	const auto& lastBundle = bundles.back();
+	auto smallItem = addItem(userQueue, lastBundle, { user }, "Partial list", QueueItem::FLAG_PARTIAL_LIST);
+	benchmarkNext("Small slot item from the last bundle", QueueTokenSet(), QueueItemBase::TYPE_SMALL, smallItem);
+
+	// Running bundle limit
+	auto lastRegularItem = getNext(*lastBundle, user, QueueItemBase::TYPE_MCN_NORMAL);
+	TEST_CHECK(lastRegularItem && lastRegularItem != smallItem);
+
+	SettingsManager::getInstance()->set(SettingsManager::MAX_RUNNING_BUNDLES, 1);
+	benchmarkNext("Running bundle limit reached", { lastBundle->getToken() }, QueueItemBase::TYPE_MCN_NORMAL, lastRegularItem);
+	SettingsManager::getInstance()->set(SettingsManager::MAX_RUNNING_BUNDLES, 0);
+
+	// Paused items
+	for (const auto& b: bundles) {
+		if (b == lastBundle) {
+			continue;
+		}
+
+		QueueItemList bundleItems;
+		b->getItems(user.user, bundleItems);
+		for (const auto& qi: bundleItems) {
+			userQueue.setQIPriority(qi, Priority::PAUSED);
+		}
+	}
+
+	benchmarkNext("Other bundles with paused items", QueueTokenSet(), QueueItemBase::TYPE_MCN_NORMAL, lastRegularItem);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	SettingsManager::newInstance();
+
+	auto scale = test::getScale(argc, argv);
+	testConnectionTypes(scale);
+	testRandomQueue();
+	testManyBundles(scale);
+
+	SettingsManager::deleteInstance();
+	return test::result();
+}
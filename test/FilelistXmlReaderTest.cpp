@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/CID.h>
+#include <airdcpp/Encoder.h>
+#include <airdcpp/FilelistXmlReader.h>
+#include <airdcpp/MerkleTree.h>
+#include <airdcpp/SimpleXMLReader.h>
+#include <airdcpp/StreamBase.h>
+
+#include <random>
+
+using namespace dcpp;
+
+namespace {
+
+const size_t FILES_PER_DIRECTORY = 100;
+
+// Generates a synthetic file list while it's being read so that large lists don't need to be kept in memory
+// The directories are rendered in advance and repeated, so the generating doesn't dominate the parsing times
+class ListGenerator : public InputStream {
+public:
+	explicit ListGenerator(size_t aFiles) : files(aFiles) {
+		pending = "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\r\n"
+			"<FileListing Version=\"1\" CID=\"" + CID::generate().toBase32() + "\" Base=\"/\" Generator=\"AirDC++ 4.10\">\r\n";
+	}
+
+	size_t read(void* aBuf, size_t& len) override {
+		while (pending.size() - pendingPos < len && generateDirectory()) {
+			//
+		}
+
+		auto n = min(len, pending.size() - pendingPos);
+		memcpy(aBuf, &pending[pendingPos], n);
+		pendingPos += n;
+
+		if (pendingPos > 1024 * 1024) {
+			pending.erase(0, pendingPos);
+			pendingPos = 0;
+		}
+
+		len = n;
+		return n;
+	}
+private:
+	static const vector<string>& getDirectories() {
+		static vector<string> directories;
+		if (directories.empty()) {
+			std::mt19937 gen(1);
+			for (size_t d = 0; d < 100; ++d) {
+				auto dir = std::to_string(d);
+				string xml = "\t<Directory Name=\"Artist " + dir + " &amp; Band \xc3\xa4\" Date=\"" + std::to_string(1500000000 + gen() % 100000000) + "\">\r\n";
+				for (size_t i = 0; i < FILES_PER_DIRECTORY; ++i) {
+					uint8_t tth[TTHValue::BYTES];
+					for (auto& b: tth) {
+						b = static_cast<uint8_t>(gen());
+					}
+
+					xml += "\t\t<File Name=\"" + std::to_string(i) + " - Track &quot;" + dir + "&quot;.mp3\" Size=\"" + std::to_string(gen() % 20000000) +
+						"\" TTH=\"" + Encoder::toBase32(tth, sizeof(tth)) + "\" Date=\"" + std::to_string(1500000000 + gen() % 100000000) + "\"/>\r\n";
+				}
+
+				xml += "\t</Directory>\r\n";
+				directories.push_back(move(xml));
+			}
+		}
+
+		return directories;
+	}
+
+	bool generateDirectory() {
+		if (generated == files) {
+			if (!finished) {
+				pending += "</FileListing>\r\n";
+				finished = true;
+			}
+
+			return false;
+		}
+
+		// The file count is a multiple of the directory size
+		const auto& directories = getDirectories();
+		pending += directories[(generated / FILES_PER_DIRECTORY) % directories.size()];
+		generated += FILES_PER_DIRECTORY;
+		return true;
+	}
+
+	const size_t files;
+	size_t generated = 0;
+	bool finished = false;
+
+	string pending;
+	size_t pendingPos = 0;
+};
+
+// Appends the parsed elements (with the attributes used by ListLoader) in a comparable form
+void appendElement(string& events_, const string& aTag, const string& aName, const string& aSize, const string& aTTH, const string& aDate, bool aSimple) {
+	events_ += aTag + "|" + aName + "|" + aSize + "|" + aDate + "|" + (aSimple ? "1" : "0");
+	if (!aTTH.empty()) {
+		// Decoded in the same way as ListLoader
+		TTHValue tth;
+		Encoder::fromBase32(aTTH.c_str(), tth.data, TTHValue::BYTES);
+		events_ += "|" + tth.toBase32();
+	}
+
+	events_ += "\n";
+}
+
+class ReferenceLoader : public SimpleXMLReader::CallBack {
+public:
+	void startTag(const string& aName, StringPairList& aAttribs, bool aSimple) override {
+		if (aName == "File") {
+			files++;
+		}
+
+		if (events) {
+			appendElement(*events, aName, getAttrib(aAttribs, "Name", 0), getAttrib(aAttribs, "Size", 1), getAttrib(aAttribs, "TTH", 2), getAttrib(aAttribs, "Date", 3), aSimple);
+		}
+	}
+
+	void endTag(const string& aName) override {
+		if (events) {
+			*events += "/" + aName + "\n";
+		}
+	}
+
+	string* events = nullptr;
+	size_t files = 0;
+};
+
+const char* getTagName(FilelistXmlReader::Tag aTag) {
+	switch (aTag) {
+		case FilelistXmlReader::TAG_FILELISTING: return "FileListing";
+		case FilelistXmlReader::TAG_DIRECTORY: return "Directory";
+		case FilelistXmlReader::TAG_FILE: return "File";
+		default: return "";
+	}
+}
+
+// Sum of the decoded hash bytes (so that the decoding isn't optimized away in benchmarks)
+uint64_t tthByteSum = 0;
+
+size_t parse(InputStream& aStream, string* events_) {
+	size_t files = 0;
+	FilelistXmlReader reader(aStream);
+	while (reader.next()) {
+		if (reader.getTag() == FilelistXmlReader::TAG_FILE) {
+			files++;
+		}
+
+		if (!events_) {
+			// Access the values in the same way as ListLoader
+			if (reader.isStart() && reader.getTag() == FilelistXmlReader::TAG_FILE) {
+				TTHValue tth;
+				Encoder::fromBase32(reader.getAttribute(FilelistXmlReader::ATTR_TTH).c_str(), tth.data, TTHValue::BYTES);
+				tthByteSum += tth.data[0];
+			}
+
+			continue;
+		}
+
+		string tag = getTagName(reader.getTag());
+		if (reader.isStart()) {
+			appendElement(*events_, tag, reader.getAttribute(FilelistXmlReader::ATTR_NAME), reader.getAttribute(FilelistXmlReader::ATTR_SIZE),
+				reader.getAttribute(FilelistXmlReader::ATTR_TTH), reader.getAttribute(FilelistXmlReader::ATTR_DATE), reader.isSimple());
+		} else {
+			*events_ += "/" + tag + "\n";
+		}
+	}
+
+	return files;
+}
+
+size_t parseReference(InputStream& aStream, string* events_) {
+	ReferenceLoader loader;
+	loader.events = events_;
+	SimpleXMLReader(&loader).parse(aStream);
+	return loader.files;
+}
+
+// Both readers must report the same elements and attribute values
+void testEqualOutput() {
+	string events, referenceEvents;
+	{
+		ListGenerator list(25000);
+		TEST_CHECK_EQUAL(parse(list, &events), static_cast<size_t>(25000));
+	}
+
+	{
+		ListGenerator list(25000);
+		TEST_CHECK_EQUAL(parseReference(list, &referenceEvents), static_cast<size_t>(25000));
+	}
+
+	TEST_CHECK(!events.empty());
+	TEST_CHECK(events == referenceEvents);
+}
+
+// 1M files with the default scale, 10M with a scale of 10
+void benchmarkLists(size_t aScale) {
+	auto files = 1000000 * aScale;
+	auto name = std::to_string(files) + " files";
+
+	auto generateMs = test::benchmark("Generating a list of " + name, [&] {
+		ListGenerator list(files);
+		vector<char> buf(64 * 1024);
+		for (;;) {
+			size_t len = buf.size();
+			if (list.read(buf.data(), len) == 0) {
+				break;
+			}
+		}
+	});
+
+	auto ms = test::benchmark("SimpleXMLReader, " + name, [&] {
+		ListGenerator list(files);
+		TEST_CHECK_EQUAL(parseReference(list, nullptr), files);
+	});
+	std::cout << "  " << ms - generateMs << " ms without generating" << std::endl;
+
+	ms = test::benchmark("FilelistXmlReader, " + name, [&] {
+		ListGenerator list(files);
+		TEST_CHECK_EQUAL(parse(list, nullptr), files);
+	});
+	std::cout << "  " << ms - generateMs << " ms without generating (" << tthByteSum << ")" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	testEqualOutput();
+	benchmarkLists(test::getScale(argc, argv));
+
+	return test::result();
+}
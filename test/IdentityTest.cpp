@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/OnlineUser.h>
+
+#include <random>
+#include <thread>
+
+using namespace dcpp;
+
+namespace {
+
+typedef vector<pair<string, string>> InfoFields;
+
+// Fields of a typical INF of a joining user (in the order that they are set by AdcHub)
+InfoFields createInf(size_t aIndex, std::mt19937& gen_) {
+	auto index = std::to_string(aIndex);
+	return {
+		{ "NI", "user" + index },
+		{ "DE", "Description of user " + index },
+		{ "SS", std::to_string(static_cast<int64_t>(gen_()) << 12) },
+		{ "SF", std::to_string(gen_() % 100000) },
+		{ "VE", "AirDC++ 4.10" },
+		{ "HN", std::to_string(gen_() % 20) },
+		{ "HR", "0" },
+		{ "HO", "0" },
+		{ "SL", std::to_string(gen_() % 20) },
+		{ "SU", "SEGA,ADC0,CCPM,TCP4,UDP4" },
+		{ "I4", "10." + std::to_string(aIndex >> 16) + "." + std::to_string((aIndex >> 8) & 0xFF) + "." + std::to_string(aIndex & 0xFF) },
+		{ "U4", std::to_string(1000 + gen_() % 60000) },
+		{ "CT", aIndex % 100 == 0 ? "4" : "0" },
+		{ "ST", "1" },
+	};
+}
+
+void applyInf(Identity& identity_, const InfoFields& aFields) {
+	for (const auto& f: aFields) {
+		identity_.set(f.first.c_str(), f.second);
+	}
+}
+
+// Replays a hub join while other threads read the identities that have been added (user list views, searches)
+void benchmarkJoin(size_t aUsers, size_t aReaders) {
+	std::mt19937 gen(1);
+	vector<InfoFields> infs;
+	vector<unique_ptr<Identity>> identities;
+	for (size_t i = 0; i < aUsers; ++i) {
+		infs.push_back(createInf(i, gen));
+		identities.push_back(make_unique<Identity>(UserPtr(new User(CID::generate())), static_cast<uint32_t>(i)));
+	}
+
+	atomic<size_t> joined { 0 };
+	atomic<bool> stop { false };
+	atomic<uint64_t> reads { 0 };
+
+	vector<std::thread> readers;
+	for (size_t i = 0; i < aReaders; ++i) {
+		readers.emplace_back([&, i] {
+			std::mt19937 readerGen(static_cast<uint32_t>(i));
+			uint64_t count = 0;
+			int64_t totalShared = 0;
+			while (!stop) {
+				auto added = joined.load();
+				if (added == 0) {
+					std::this_thread::yield();
+					continue;
+				}
+
+				const auto& identity = *identities[readerGen() % added];
+				if (!identity.getNick().empty() && !identity.isOp()) {
+					totalShared += identity.getBytesShared();
+				}
+
+				identity.get("DE");
+				count++;
+			}
+
+			reads += count;
+		});
+	}
+
+	test::benchmark("Join of " + std::to_string(aUsers) + " users (" + std::to_string(aReaders) + " reader threads)", [&] {
+		for (size_t i = 0; i < aUsers; ++i) {
+			applyInf(*identities[i], infs[i]);
+			joined = i + 1;
+		}
+	});
+
+	stop = true;
+	for (auto& t: readers) {
+		t.join();
+	}
+
+	std::cout << "  " << reads.load() << " reads during the join" << std::endl;
+
+	for (size_t i = 0; i < aUsers; ++i) {
+		const auto& identity = *identities[i];
+		for (const auto& f: infs[i]) {
+			TEST_CHECK_EQUAL(identity.get(f.first.c_str()), f.second);
+		}
+
+		TEST_CHECK_EQUAL(identity.getNick(), infs[i][0].second);
+		TEST_CHECK_EQUAL(identity.getBytesShared(), Util::toInt64(infs[i][2].second));
+		TEST_CHECK_EQUAL(identity.isOp(), i % 100 == 0);
+	}
+}
+
+// Updates, removals and copies of the fields
+void testFields() {
+	Identity identity(UserPtr(new User(CID::generate())), 1);
+	std::mt19937 gen(2);
+	applyInf(identity, createInf(1, gen));
+
+	TEST_CHECK_EQUAL(identity.getStatus(), Identity::NORMAL);
+	TEST_CHECK(identity.supports("ADC0"));
+	TEST_CHECK(!identity.isSet("AW"));
+
+	// Share size update
+	identity.setBytesShared("1024");
+	TEST_CHECK_EQUAL(identity.getBytesShared(), 1024);
+	TEST_CHECK_EQUAL(identity.getShareSize(), "1024");
+
+	// Empty values remove the field
+	identity.setDescription(Util::emptyString);
+	TEST_CHECK(!identity.isSet("DE"));
+	identity.setStatus(Util::emptyString);
+	TEST_CHECK_EQUAL(identity.getStatus(), 0);
+
+	auto info = identity.getInfo();
+	TEST_CHECK(info.find("DE") == info.end());
+	TEST_CHECK_EQUAL(info["NI"], "user1");
+
+	Identity copy(identity);
+	TEST_CHECK_EQUAL(copy.getNick(), "user1");
+	TEST_CHECK_EQUAL(copy.getBytesShared(), 1024);
+	TEST_CHECK(copy.getInfo() == info);
+
+	// Renames
+	identity.setNick("renamed");
+	TEST_CHECK_EQUAL(identity.getNick(), "renamed");
+	TEST_CHECK_EQUAL(copy.getNick(), "user1");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	testFields();
+	benchmarkJoin(50000 * test::getScale(argc, argv), 4);
+
+	return test::result();
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/debug.h>
+
+#include <nlohmann/json.hpp>
+
+// The web server headers expect these to be available (same as in the web server stdinc.h)
+namespace webserver {
+	using namespace dcpp;
+
+	using json = nlohmann::json;
+}
+
+#include <api/common/IndexedItemList.h>
+#include <api/common/ListViewTaskHandler.h>
+
+#include <random>
+
+using namespace dcpp;
+using webserver::IndexedItemList;
+using webserver::ItemTasks;
+using webserver::ListViewTaskHandler;
+using webserver::PropertyIdSet;
+
+namespace {
+
+struct Item {
+	Item(string aName, double aValue) : name(aName), value(aValue) { }
+
+	string name;
+	double value;
+};
+
+typedef shared_ptr<Item> ItemPtr;
+typedef vector<ItemPtr> ItemList;
+
+struct ItemLess {
+	bool operator()(const ItemPtr& a, const ItemPtr& b) const noexcept {
+		return a->value < b->value;
+	}
+};
+
+enum Properties {
+	PROP_VALUE,
+	PROP_NAME
+};
+
+string toString(const ItemList& aItems) {
+	string ret;
+	for (const auto& i: aItems) {
+		ret += i->name;
+	}
+
+	return ret;
+}
+
+bool isSorted(const IndexedItemList<ItemPtr>& aList) {
+	auto items = aList.getItems();
+	return std::is_sorted(items.begin(), items.end(), ItemLess());
+}
+
+// Item lists of a view sorted by the value, with the same task handling as ListViewController
+// Items with a value above the filter limit don't match the view filters
+struct View {
+	View() : taskHandler(cs, sourceItems, matchingItems, [](const ItemPtr&) { return true; }, [this](const ItemPtr& aItem) { return aItem->value <= filterLimit; }) {
+
+	}
+
+	void assign(const ItemList& aItems) {
+		sourceItems.insert(aItems.begin(), aItems.end());
+
+		ItemList items;
+		std::copy_if(aItems.begin(), aItems.end(), back_inserter(items), [this](const ItemPtr& aItem) { return aItem->value <= filterLimit; });
+		std::sort(items.begin(), items.end(), ItemLess());
+		matchingItems.assign(items);
+	}
+
+	// Returns the updated items that remained in the list
+	std::set<ItemPtr> runTasks() {
+		ItemTasks<ItemPtr>::TaskMap currentTasks;
+		PropertyIdSet updatedProperties;
+		tasks.get(currentTasks, updatedProperties);
+
+		int rangeStart = 0;
+		std::set<ItemPtr> ret;
+		for (const auto& u: taskHandler.handleTasks(currentTasks, PROP_VALUE, ItemLess(), rangeStart)) {
+			ret.insert(u.first);
+		}
+
+		return ret;
+	}
+
+	SharedMutex cs;
+	std::set<ItemPtr> sourceItems;
+	IndexedItemList<ItemPtr> matchingItems;
+	ItemTasks<ItemPtr> tasks;
+	double filterLimit = std::numeric_limits<double>::max();
+
+	ListViewTaskHandler<ItemPtr> taskHandler;
+};
+
+void testBatch() {
+	auto x = make_shared<Item>("X", 1), b = make_shared<Item>("B", 2), y = make_shared<Item>("Y", 3), z = make_shared<Item>("Z", 4);
+
+	View view;
+	view.assign({ x, b, y, z });
+
+	// B is moved to the end while A is added in the middle
+	b->value = 10;
+	view.tasks.updateItem(b, { PROP_VALUE });
+	view.tasks.addItem(make_shared<Item>("A", 3.5));
+
+	auto updated = view.runTasks();
+	TEST_CHECK_EQUAL(toString(view.matchingItems.getItems()), "XYAZB");
+	TEST_CHECK_EQUAL(updated.size(), static_cast<size_t>(1));
+	TEST_CHECK(updated.count(b) == 1);
+}
+
+// Random batches of additions, removals and updates compared with a full sort of the matching items
+void testRandomBatches() {
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<double> values(0, 100);
+
+	View view;
+	view.filterLimit = 90;
+
+	ItemList items, removed;
+	for (int i = 0; i < 200; ++i) {
+		items.push_back(make_shared<Item>(std::to_string(i), values(gen)));
+	}
+
+	view.assign(items);
+
+	for (int round = 0; round < 300; ++round) {
+		for (int i = 0; i < 10; ++i) {
+			auto item = items[gen() % items.size()];
+			switch (gen() % 3) {
+				case 0: {
+					item->value = values(gen);
+					view.tasks.updateItem(item, { PROP_VALUE, PROP_NAME });
+					break;
+				}
+				case 1: {
+					// Sort value unchanged
+					item->name += "x";
+					view.tasks.updateItem(item, { PROP_NAME });
+					break;
+				}
+				case 2: {
+					if (items.size() > 50) {
+						items.erase(find(items.begin(), items.end(), item));
+						removed.push_back(item);
+						view.tasks.removeItem(item);
+					}
+					break;
+				}
+			}
+		}
+
+		for (int i = 0; i < 4; ++i) {
+			items.push_back(make_shared<Item>("new" + std::to_string(round) + "_" + std::to_string(i), values(gen)));
+			view.tasks.addItem(items.back());
+		}
+
+		// Delayed update for a removed item
+		if (!removed.empty()) {
+			auto item = removed[gen() % removed.size()];
+			item->value = values(gen);
+			view.tasks.updateItem(item, { PROP_VALUE });
+		}
+
+		auto updated = view.runTasks();
+
+		ItemList expected;
+		for (const auto& i: items) {
+			if (i->value <= view.filterLimit) {
+				expected.push_back(i);
+			}
+		}
+
+		std::sort(expected.begin(), expected.end(), ItemLess());
+
+		TEST_CHECK(view.matchingItems.getItems() == expected);
+		TEST_CHECK(view.sourceItems == std::set<ItemPtr>(items.begin(), items.end()));
+		for (const auto& u: updated) {
+			TEST_CHECK(view.matchingItems.contains(u));
+		}
+	}
+
+	for (const auto& i: view.matchingItems.getItems()) {
+		auto pos = view.matchingItems.getPosition(i);
+		TEST_CHECK(pos >= 0 && view.matchingItems.getRange(static_cast<size_t>(pos), 1).front() == i);
+	}
+}
+
+void benchmarkBatches(size_t aScale) {
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<double> values(0, 1000000);
+
+	ItemList items;
+	for (size_t i = 0; i < 100000 * aScale; ++i) {
+		items.push_back(make_shared<Item>(std::to_string(i), values(gen)));
+	}
+
+	View view;
+	view.assign(items);
+
+	test::benchmark("Batches of 1000 changed items (" + std::to_string(items.size()) + " items)", [&] {
+		for (int round = 0; round < 100; ++round) {
+			for (int i = 0; i < 1000; ++i) {
+				auto& item = items[gen() % items.size()];
+				item->value = values(gen);
+				view.tasks.updateItem(item, { PROP_VALUE });
+			}
+
+			view.runTasks();
+		}
+	});
+
+	TEST_CHECK(isSorted(view.matchingItems));
+	TEST_CHECK_EQUAL(view.matchingItems.size(), items.size());
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	testBatch();
+	testRandomBatches();
+	benchmarkBatches(test::getScale(argc, argv));
+
+	return test::result();
+}
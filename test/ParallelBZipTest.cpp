@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/BZUtils.h>
+#include <airdcpp/Exception.h>
+
+#include <random>
+#include <thread>
+
+using namespace dcpp;
+
+namespace {
+
+// Input size of the blocks created by ParallelBZFilter
+const size_t CHUNK_SIZE = 700 * 1024;
+
+const uint64_t BLOCK_MAGIC = 0x314159265359ULL;
+
+// Output of "bzip2 -9" (version 1.0.8)
+const string BZIP2_TEXT = "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\n<FileListing Version=\"1\" Base=\"/\"><File Name=\"a.txt\" Size=\"3\"/></FileListing>\n";
+const uint8_t BZIP2_DATA[] = {
+	0x42, 0x5a, 0x68, 0x39, 0x31, 0x41, 0x59, 0x26, 0x53, 0x59, 0x15, 0x53,
+	0x16, 0x93, 0x00, 0x00, 0x11, 0xdf, 0x80, 0x00, 0x10, 0x50, 0x03, 0xe8,
+	0x47, 0x91, 0x05, 0x09, 0x00, 0x2f, 0xa7, 0x9f, 0x70, 0x20, 0x00, 0x64,
+	0x34, 0xd4, 0x29, 0xa6, 0x8f, 0xd2, 0x9b, 0x53, 0x35, 0x3d, 0x02, 0x64,
+	0xf4, 0xd4, 0x1e, 0xa1, 0x13, 0x44, 0xf5, 0x1a, 0x32, 0x03, 0x11, 0x90,
+	0xd1, 0xa0, 0xd0, 0xf0, 0xdc, 0x8e, 0x84, 0x79, 0x5a, 0x3e, 0xee, 0xf0,
+	0x29, 0x0a, 0x31, 0x36, 0xb7, 0x55, 0x11, 0x8b, 0x12, 0x37, 0xe0, 0x4e,
+	0x13, 0x04, 0x44, 0x99, 0x42, 0xd1, 0xd6, 0x44, 0x36, 0xc0, 0xd4, 0x76,
+	0xfa, 0xe3, 0x9a, 0x8e, 0x34, 0xc6, 0xb4, 0xe4, 0xe0, 0xb3, 0xfb, 0x55,
+	0xb1, 0x26, 0x8c, 0xb8, 0xa8, 0xe0, 0x51, 0xff, 0x13, 0x61, 0x5b, 0xc4,
+	0x9a, 0xc7, 0x1b, 0xd1, 0x0c, 0x88, 0xc5, 0x30, 0x61, 0x02, 0x57, 0xf0,
+	0x84, 0xa1, 0x4e, 0xf8, 0xa1, 0x3f, 0x8b, 0xb9, 0x22, 0x9c, 0x28, 0x48,
+	0x0a, 0xa9, 0x8b, 0x49, 0x80
+};
+
+// Feeds the data to the filter in the same way as FilteredOutputStream
+template<class FilterT>
+string compress(FilterT& filter_, const string& aData, size_t aInputChunk = 64 * 1024) {
+	string ret;
+	vector<char> buf(128 * 1024);
+
+	size_t pos = 0;
+	while (pos < aData.size()) {
+		size_t n = buf.size();
+		size_t m = min(aInputChunk, aData.size() - pos);
+		filter_(aData.data() + pos, m, buf.data(), n);
+		pos += m;
+		ret.append(buf.data(), n);
+	}
+
+	for (;;) {
+		size_t n = buf.size();
+		size_t zero = 0;
+		auto more = filter_(nullptr, zero, buf.data(), n);
+		ret.append(buf.data(), n);
+		if (!more) {
+			break;
+		}
+	}
+
+	return ret;
+}
+
+// Reads the data through the filter in the same way as FilteredInputStream
+template<class FilterT>
+string decompress(FilterT& filter_, const string& aData, size_t aInputChunk = 128 * 1024) {
+	string ret;
+	vector<char> buf(64 * 1024);
+
+	size_t pos = 0;
+	for (;;) {
+		size_t n = buf.size();
+		size_t m = min(aInputChunk, aData.size() - pos);
+		auto more = filter_(aData.data() + pos, m, buf.data(), n);
+		pos += m;
+		ret.append(buf.data(), n);
+		if (!more) {
+			break;
+		}
+	}
+
+	return ret;
+}
+
+string parallelCompress(const string& aData, size_t aBatchSize, size_t aInputChunk = 64 * 1024) {
+	ParallelBZFilter filter(aBatchSize);
+	return compress(filter, aData, aInputChunk);
+}
+
+string parallelDecompress(const string& aData, size_t aBatchSize, size_t aInputChunk = 128 * 1024) {
+	ParallelUnBZFilter filter(aBatchSize);
+	return decompress(filter, aData, aInputChunk);
+}
+
+string serialCompress(const string& aData) {
+	BZFilter filter;
+	return compress(filter, aData);
+}
+
+string serialDecompress(const string& aData) {
+	UnBZFilter filter;
+	return decompress(filter, aData);
+}
+
+// Level 9 stream created by libbz2 (identical to the output of "bzip2 -9")
+string libraryCompress(const string& aData) {
+	string ret;
+	auto len = static_cast<unsigned int>(aData.size() + aData.size() / 100 + 600);
+	ret.resize(len);
+	auto err = BZ2_bzBuffToBuffCompress(&ret[0], &len, const_cast<char*>(aData.data()), static_cast<unsigned int>(aData.size()), 9, 0, 30);
+	TEST_CHECK_EQUAL(err, BZ_OK);
+	ret.resize(len);
+	return ret;
+}
+
+template<class F>
+bool throws(F&& aF) {
+	try {
+		aF();
+	} catch (const Exception&) {
+		return true;
+	}
+
+	return false;
+}
+
+// Number of block header magics at any bit position
+size_t countBlockMagics(const string& aData) {
+	size_t count = 0;
+	uint64_t window = 0;
+	for (size_t i = 0; i < aData.size() * 8; ++i) {
+		window = ((window << 1) | ((static_cast<uint8_t>(aData[i / 8]) >> (7 - i % 8)) & 1)) & 0xFFFFFFFFFFFFULL;
+		if (i >= 47 && window == BLOCK_MAGIC) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+// File list content with random hashes
+string createListData(size_t aSize, std::mt19937& gen_) {
+	const char* base32 = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+	string ret;
+	ret.reserve(aSize + 256);
+	for (size_t i = 0; ret.size() < aSize; ++i) {
+		string tth;
+		for (int j = 0; j < 39; ++j) {
+			tth += base32[gen_() % 32];
+		}
+
+		ret += "<File Name=\"Track " + std::to_string(i) + ".mp3\" Size=\"" + std::to_string(gen_() % 10000000) + "\" TTH=\"" + tth + "\"/>\n";
+	}
+
+	ret.resize(aSize);
+	return ret;
+}
+
+string createRandomData(size_t aSize, std::mt19937& gen_) {
+	string ret(aSize, '\0');
+	for (auto& c: ret) {
+		c = static_cast<char>(gen_());
+	}
+
+	return ret;
+}
+
+void testRoundTrip() {
+	std::mt19937 gen(1);
+	for (auto size: { static_cast<size_t>(0), static_cast<size_t>(1), static_cast<size_t>(1000), CHUNK_SIZE - 1, CHUNK_SIZE, CHUNK_SIZE + 1, CHUNK_SIZE * 5 + 123 }) {
+		// Incompressible data expands in the initial run-length encoding
+		for (const auto& data: { createListData(size, gen), createRandomData(size, gen) }) {
+			for (auto batchSize: { 1, 2, 3 }) {
+				auto compressed = parallelCompress(data, batchSize, 1000 + gen() % (128 * 1024));
+
+				TEST_CHECK(serialDecompress(compressed) == data);
+				TEST_CHECK(parallelDecompress(compressed, batchSize, 1000 + gen() % (128 * 1024)) == data);
+			}
+
+			TEST_CHECK(parallelDecompress(serialCompress(data), 2) == data);
+		}
+	}
+}
+
+void testBzip2Output() {
+	string compressed(reinterpret_cast<const char*>(BZIP2_DATA), sizeof(BZIP2_DATA));
+	for (auto batchSize: { 1, 4 }) {
+		for (auto inputChunk: { 1, 7, 1000 }) {
+			TEST_CHECK_EQUAL(parallelDecompress(compressed, batchSize, inputChunk), BZIP2_TEXT);
+		}
+	}
+
+	// Multiple blocks
+	std::mt19937 gen(2);
+	auto data = createListData(3 * 1024 * 1024, gen);
+	compressed = libraryCompress(data);
+	TEST_CHECK(countBlockMagics(compressed) > 1);
+
+	for (auto batchSize: { 1, 2, 8 }) {
+		TEST_CHECK(parallelDecompress(compressed, batchSize, 1000) == data);
+		TEST_CHECK(parallelDecompress(compressed, batchSize, 1024 * 1024) == data);
+	}
+}
+
+void testConcatenatedStreams() {
+	std::mt19937 gen(3);
+	auto first = createListData(CHUNK_SIZE * 2, gen);
+	auto second = createListData(100, gen);
+	auto third = createListData(CHUNK_SIZE + 5, gen);
+
+	auto compressed = libraryCompress(first) + string(reinterpret_cast<const char*>(BZIP2_DATA), sizeof(BZIP2_DATA)) + libraryCompress(second) + parallelCompress(third, 2) + libraryCompress(string());
+	auto data = first + BZIP2_TEXT + second + third;
+	for (auto batchSize: { 1, 3 }) {
+		for (auto inputChunk: { 999, 128 * 1024 }) {
+			TEST_CHECK(parallelDecompress(compressed, batchSize, inputChunk) == data);
+		}
+	}
+}
+
+void testInvalidInput() {
+	// Truncated at every position
+	string fixture(reinterpret_cast<const char*>(BZIP2_DATA), sizeof(BZIP2_DATA));
+	for (size_t len = 0; len < fixture.size(); ++len) {
+		TEST_CHECK(throws([&] { parallelDecompress(fixture.substr(0, len), 2, 16); }));
+	}
+
+	std::mt19937 gen(4);
+	auto data = createListData(CHUNK_SIZE * 3, gen);
+	auto compressed = parallelCompress(data, 2);
+	for (auto len: { compressed.size() / 3, compressed.size() / 2, compressed.size() - 11, compressed.size() - 1 }) {
+		TEST_CHECK(throws([&] { parallelDecompress(compressed.substr(0, len), 2); }));
+	}
+
+	// Corrupted block data, block CRC and stream CRC
+	for (auto pos: { compressed.size() / 2, static_cast<size_t>(12), compressed.size() - 2 }) {
+		auto corrupted = compressed;
+		corrupted[pos] ^= 0x10;
+		TEST_CHECK(throws([&] { parallelDecompress(corrupted, 2); }));
+	}
+
+	// Not a bzip2 stream
+	TEST_CHECK(throws([&] { parallelDecompress(data.substr(0, 1000), 2); }));
+	TEST_CHECK(throws([&] { parallelDecompress("BZh9" + data.substr(0, 1000), 2); }));
+}
+
+// Data consisting of these bytes is described by the symbol map 0x3141 0x5926 0x5359 (bytes 0x10-0x3F)
+// in the block header, which contains the block magic inside each block
+string createFalseMagicData(size_t aSize, std::mt19937& gen_) {
+	vector<char> symbols;
+	const uint16_t maps[] = { 0x3141, 0x5926, 0x5359 };
+	for (int range = 0; range < 3; ++range) {
+		for (int bit = 0; bit < 16; ++bit) {
+			if (maps[range] & (0x8000 >> bit)) {
+				symbols.push_back(static_cast<char>(0x10 + range * 16 + bit));
+			}
+		}
+	}
+
+	// Avoid repeated bytes, run lengths would be added in the symbol map
+	string ret;
+	while (ret.size() < aSize) {
+		auto c = symbols[gen_() % symbols.size()];
+		if (ret.empty() || ret.back() != c) {
+			ret += c;
+		}
+	}
+
+	return ret;
+}
+
+void testFalseBlockMagic() {
+	std::mt19937 gen(5);
+	auto data = createFalseMagicData(CHUNK_SIZE * 3, gen);
+
+	for (const auto& compressed: { parallelCompress(data, 2), libraryCompress(data) }) {
+		// Each block has a false magic in addition to the real one
+		auto blocks = (data.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		TEST_CHECK(countBlockMagics(compressed) >= blocks * 2);
+
+		for (auto batchSize: { 1, 2, 8 }) {
+			TEST_CHECK(parallelDecompress(compressed, batchSize, 4096) == data);
+			TEST_CHECK(parallelDecompress(compressed, batchSize) == data);
+		}
+
+		TEST_CHECK(serialDecompress(compressed) == data);
+	}
+}
+
+// The blocks are processed with parallel_for_each, which runs serially unless the build has a parallel task scheduler (TBB or PPL)
+void benchmarkThreads(size_t aScale) {
+	std::mt19937 gen(6);
+	auto data = createListData(CHUNK_SIZE * 8 * aScale, gen);
+	auto mib = static_cast<double>(data.size()) / (1024 * 1024);
+
+	string compressed;
+	auto ms = test::benchmark("Serial compression", [&] { compressed = serialCompress(data); });
+	std::cout << "  " << mib * 1000 / ms << " MiB/s" << std::endl;
+
+	ms = test::benchmark("Serial decompression", [&] { TEST_CHECK(serialDecompress(compressed) == data); });
+	std::cout << "  " << mib * 1000 / ms << " MiB/s" << std::endl;
+
+	vector<size_t> batchSizes = { 1, 2, 4 };
+	auto cores = static_cast<size_t>(std::thread::hardware_concurrency());
+	if (cores > 4) {
+		batchSizes.push_back(cores);
+	}
+
+	for (auto batchSize: batchSizes) {
+		ms = test::benchmark("Parallel compression (" + std::to_string(batchSize) + " blocks)", [&] { compressed = parallelCompress(data, batchSize); });
+		std::cout << "  " << mib * 1000 / ms << " MiB/s" << std::endl;
+
+		ms = test::benchmark("Parallel decompression (" + std::to_string(batchSize) + " blocks)", [&] { TEST_CHECK(parallelDecompress(compressed, batchSize) == data); });
+		std::cout << "  " << mib * 1000 / ms << " MiB/s" << std::endl;
+	}
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	testRoundTrip();
+	testBzip2Output();
+	testConcatenatedStreams();
+	testInvalidInput();
+	testFalseBlockMagic();
+	benchmarkThreads(test::getScale(argc, argv));
+
+	return test::result();
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/AirUtil.h>
+#include <airdcpp/DCPlusPlus.h>
+#include <airdcpp/File.h>
+#include <airdcpp/HashManager.h>
+#include <airdcpp/LogManager.h>
+#include <airdcpp/QueueManager.h>
+#include <airdcpp/SettingsManager.h>
+#include <airdcpp/ShareManager.h>
+#include <airdcpp/SharePathValidator.h>
+#include <airdcpp/SimpleXML.h>
+#include <airdcpp/Streams.h>
+#include <airdcpp/TimerManager.h>
+
+#include <limits.h>
+#include <unistd.h>
+
+using namespace dcpp;
+
+namespace {
+
+// Deeper than the parallel split depth of the refresh
+const int TREE_DEPTH = 4;
+const int SUBDIRECTORIES = 3;
+const int FILES_PER_DIRECTORY = 3;
+
+const string HOOK_ID = "share_refresh_test";
+
+// The startup loader keeps references to the functions
+const ProgressFunction progressF = nullptr;
+const MessageFunction messageF = [](const string&, bool, bool) { return false; };
+
+// Counts of the items that should end up in the share (or be skipped) in a full refresh
+struct ExpectedTree {
+	size_t directories = 0;
+	size_t files = 0;
+	size_t skippedDirectories = 0;
+	size_t skippedFiles = 0;
+};
+
+// Each directory contains items that are rejected by every kind of validation
+// - hidden files and directories (SHARE_HIDDEN is disabled by default)
+// - files matching the default share skiplist
+// - files and directories rejected by the per-item hooks
+// - files and directories rejected by the batched directory content hook
+// - directories without shared content (not shared, but not counted as skipped either)
+void createDirectory(const string& aPath, int aDepth, ExpectedTree& expected_) {
+	File::ensureDirectory(aPath);
+
+	for (int i = 0; i < FILES_PER_DIRECTORY; ++i) {
+		File::createFile(aPath + "File " + Util::toString(i) + ".txt", aPath + Util::toString(i));
+	}
+
+	expected_.files += FILES_PER_DIRECTORY;
+
+	File::createFile(aPath + ".hidden", aPath);
+	File::createFile(aPath + "refresh.log", aPath);
+	File::createFile(aPath + "hook_file.txt", aPath);
+	File::createFile(aPath + "content_file.txt", aPath);
+	expected_.skippedFiles += 4;
+
+	if (aDepth == 0) {
+		return;
+	}
+
+	for (const auto& name: { ".hidden_dir", "hook_dir", "content_dir" }) {
+		auto path = aPath + name + PATH_SEPARATOR_STR;
+		File::ensureDirectory(path);
+		File::createFile(path + "File.txt", path);
+	}
+
+	expected_.skippedDirectories += 3;
+	File::ensureDirectory(aPath + "empty" + PATH_SEPARATOR_STR);
+
+	{
+		// Only the skipped items are counted
+		auto path = aPath + "skipped_content" + PATH_SEPARATOR_STR;
+		File::ensureDirectory(path);
+		File::createFile(path + ".hidden", path);
+		File::createFile(path + "refresh.log", path);
+		File::createFile(path + "hook_file.txt", path);
+		expected_.skippedFiles += 3;
+	}
+
+	for (int i = 0; i < SUBDIRECTORIES; ++i) {
+		createDirectory(aPath + "Directory " + Util::toString(i) + PATH_SEPARATOR_STR, aDepth - 1, expected_);
+		expected_.directories++;
+	}
+}
+
+// Hash all files in advance so that the trees won't change because of background hashing
+void hashDirectory(const string& aPath) {
+	File::forEachFile(aPath, "*", [&](const FilesystemItem& aInfo) {
+		if (aInfo.isDirectory) {
+			hashDirectory(aInfo.getPath(aPath));
+			return;
+		}
+
+		TTHValue tth;
+		int64_t sizeLeft = 0;
+		bool cancel = false;
+		HashManager::getInstance()->getFileTTH(aInfo.getPath(aPath), aInfo.size, true, tth, sizeLeft, cancel);
+	});
+}
+
+void addHooks(SharePathValidator& aValidator) {
+	aValidator.fileValidationHook.addSubscriber(ActionHookSubscriber(HOOK_ID, "Test", nullptr), [](const string& aPath, int64_t, const ActionHookResultGetter<nullptr_t>& aResultGetter) {
+		return Util::getFileName(aPath) == "hook_file.txt" ? aResultGetter.getRejection("file_rejected", "File rejected") : aResultGetter.getData(nullptr);
+	});
+
+	aValidator.directoryValidationHook.addSubscriber(ActionHookSubscriber(HOOK_ID, "Test", nullptr), [](const string& aPath, const ActionHookResultGetter<nullptr_t>& aResultGetter) {
+		return Util::getLastDir(aPath) == "hook_dir" ? aResultGetter.getRejection("directory_rejected", "Directory rejected") : aResultGetter.getData(nullptr);
+	});
+
+	aValidator.directoryContentValidationHook.addSubscriber(ActionHookSubscriber(HOOK_ID, "Test", nullptr), [](const string&, const ShareValidationItemList& aItems, bool, const ActionHookResultGetter<ShareValidationRejectionMap>& aResultGetter) {
+		ShareValidationRejectionMap rejections;
+		for (const auto& item: aItems) {
+			if (item.name.compare(0, 8, "content_") == 0) {
+				rejections.emplace(item.name, aResultGetter.getRejection("content_rejected", "Content rejected").error);
+			}
+		}
+
+		return aResultGetter.getData(rejections);
+	});
+}
+
+class RefreshListener : public ShareManagerListener {
+public:
+	void on(ShareManagerListener::RefreshCompleted, const ShareRefreshTask&, bool aSucceed, const ShareRefreshStats& aStats) noexcept override {
+		succeed = succeed && aSucceed;
+		stats.push_back(aStats);
+	}
+
+	bool succeed = true;
+	vector<ShareRefreshStats> stats;
+};
+
+struct RefreshResult {
+	// Stats of the initial refresh and a refresh of the existing tree
+	vector<ShareRefreshStats> stats;
+
+	string binaryList;
+	int64_t sharedSize = 0;
+	size_t sharedFiles = 0;
+
+	optional<ShareManager::ShareItemStats> itemStats;
+};
+
+// The share root is loaded from the setting file so that the refreshes can be run in this thread
+void writeSettings(const string& aShareRoot) {
+	string tmp;
+	File::createFile(Util::getPath(Util::PATH_USER_CONFIG) + "DCPlusPlus.xml", SimpleXML::utf8Header +
+		"<DCPlusPlus>\r\n"
+		"\t<Share Token=\"" + Util::toString(SETTING(DEFAULT_SP)) + "\" Name=\"Default\">\r\n"
+		"\t\t<Directory Virtual=\"Share\">" + SimpleXML::escape(aShareRoot, tmp, false) + "</Directory>\r\n"
+		"\t</Share>\r\n"
+		"</DCPlusPlus>\r\n");
+}
+
+RefreshResult refreshShare(const string& aShareRoot, int aThreading) {
+	RefreshResult ret;
+
+	ShareManager::newInstance();
+	auto sm = ShareManager::getInstance();
+
+	{
+		StartupLoader loader(nullptr, progressF, messageF);
+		SettingsManager::getInstance()->load(loader);
+	}
+
+	SettingsManager::getInstance()->set(SettingsManager::REFRESH_THREADING, aThreading);
+	addHooks(sm->getValidator());
+
+	RefreshListener listener;
+	sm->addListener(&listener);
+
+	for (int i = 0; i < 2; ++i) {
+		auto result = sm->refreshPathsHooked(ShareRefreshPriority::BLOCKING, { aShareRoot }, nullptr);
+		TEST_CHECK(result && result->result == ShareManager::RefreshTaskQueueResult::STARTED);
+	}
+
+	TEST_CHECK(listener.succeed);
+	ret.stats = listener.stats;
+
+	StringOutputStream os(ret.binaryList);
+	sm->toBinaryFilelist(os, SETTING(DEFAULT_SP));
+	sm->getProfileInfo(SETTING(DEFAULT_SP), ret.sharedSize, ret.sharedFiles);
+	ret.itemStats = sm->getShareItemStats();
+
+	sm->removeListener(&listener);
+	ShareManager::deleteInstance();
+	return ret;
+}
+
+void checkStats(const ShareRefreshStats& a, const ShareRefreshStats& b) {
+	TEST_CHECK_EQUAL(a.hashSize, b.hashSize);
+	TEST_CHECK_EQUAL(a.addedSize, b.addedSize);
+	TEST_CHECK_EQUAL(a.existingDirectoryCount, b.existingDirectoryCount);
+	TEST_CHECK_EQUAL(a.existingFileCount, b.existingFileCount);
+	TEST_CHECK_EQUAL(a.newDirectoryCount, b.newDirectoryCount);
+	TEST_CHECK_EQUAL(a.newFileCount, b.newFileCount);
+	TEST_CHECK_EQUAL(a.skippedDirectoryCount, b.skippedDirectoryCount);
+	TEST_CHECK_EQUAL(a.skippedFileCount, b.skippedFileCount);
+	TEST_CHECK_EQUAL(a.reusedDirectoryCount, b.reusedDirectoryCount);
+	TEST_CHECK_EQUAL(a.hashStoreLookupCount, b.hashStoreLookupCount);
+	TEST_CHECK_EQUAL(a.hashStoreBatchCount, b.hashStoreBatchCount);
+}
+
+// Refreshing the same tree with a single task and with parallel subtree tasks must produce identical results
+void testParallelRefresh(const string& aShareRoot, const ExpectedTree& aExpected) {
+	auto serial = refreshShare(aShareRoot, SettingsManager::MULTITHREAD_NEVER);
+	auto parallel = refreshShare(aShareRoot, SettingsManager::MULTITHREAD_ALWAYS);
+
+	TEST_CHECK_EQUAL(serial.stats.size(), static_cast<size_t>(2));
+	TEST_CHECK_EQUAL(parallel.stats.size(), static_cast<size_t>(2));
+	if (serial.stats.size() != 2 || parallel.stats.size() != 2) {
+		return;
+	}
+
+	for (size_t i = 0; i < serial.stats.size(); ++i) {
+		checkStats(serial.stats[i], parallel.stats[i]);
+	}
+
+	TEST_CHECK(!serial.binaryList.empty());
+	TEST_CHECK(serial.binaryList == parallel.binaryList);
+	TEST_CHECK_EQUAL(serial.sharedSize, parallel.sharedSize);
+	TEST_CHECK_EQUAL(serial.sharedFiles, parallel.sharedFiles);
+
+	// Everything except the rejected items was shared
+	const auto& initial = serial.stats[0];
+	TEST_CHECK_EQUAL(serial.sharedFiles, aExpected.files);
+	TEST_CHECK_EQUAL(initial.newDirectoryCount, aExpected.directories);
+	TEST_CHECK_EQUAL(initial.newFileCount, aExpected.files);
+	TEST_CHECK_EQUAL(initial.skippedDirectoryCount, aExpected.skippedDirectories);
+	TEST_CHECK_EQUAL(initial.skippedFileCount, aExpected.skippedFiles);
+	TEST_CHECK_EQUAL(initial.hashSize, static_cast<int64_t>(0));
+
+	// The second refresh finds the same items from the existing tree
+	const auto& existing = serial.stats[1];
+	TEST_CHECK_EQUAL(existing.newDirectoryCount, static_cast<size_t>(0));
+	TEST_CHECK_EQUAL(existing.newFileCount, static_cast<size_t>(0));
+	TEST_CHECK_EQUAL(existing.existingDirectoryCount, aExpected.directories);
+	TEST_CHECK_EQUAL(existing.existingFileCount, aExpected.files);
+	TEST_CHECK_EQUAL(existing.skippedDirectoryCount, aExpected.skippedDirectories);
+	TEST_CHECK_EQUAL(existing.skippedFileCount, aExpected.skippedFiles);
+}
+
+// Identical file names of the tree are stored once in the name pool of the refreshed root
+void testMemoryUsage(const string& aShareRoot, const ExpectedTree& aExpected) {
+	auto serial = refreshShare(aShareRoot, SettingsManager::MULTITHREAD_NEVER);
+	auto parallel = refreshShare(aShareRoot, SettingsManager::MULTITHREAD_ALWAYS);
+
+	TEST_CHECK(serial.itemStats && parallel.itemStats);
+	if (!serial.itemStats || !parallel.itemStats) {
+		return;
+	}
+
+	TEST_CHECK_EQUAL(serial.itemStats->totalFileCount, aExpected.files);
+	TEST_CHECK_EQUAL(parallel.itemStats->totalFileCount, aExpected.files);
+
+	// Every directory contains the same file names (the subtree tasks use the pool of the root)
+	TEST_CHECK_EQUAL(serial.itemStats->pooledFileNames, static_cast<size_t>(FILES_PER_DIRECTORY));
+	TEST_CHECK_EQUAL(parallel.itemStats->pooledFileNames, static_cast<size_t>(FILES_PER_DIRECTORY));
+
+	auto printUsage = [&](const string& aName, const ShareManager::ShareItemStats& aStats) {
+		TEST_CHECK(aStats.treeMemoryUsage > 0);
+		std::cout << "Tree memory usage with " << aName << ": " << aStats.treeMemoryUsage << " bytes (" <<
+			aStats.treeMemoryUsage / aExpected.files << " bytes per file, " << aStats.pooledFileNames << " pooled names)" << std::endl;
+	};
+
+	printUsage("a single task", *serial.itemStats);
+	printUsage("parallel tasks", *parallel.itemStats);
+}
+
+// The test files are created next to the executable
+void setApp(char* argv[]) {
+	char buf[PATH_MAX + 1] = { 0 };
+	char* path = buf;
+	if (readlink("/proc/self/exe", buf, sizeof(buf)) == -1) {
+		path = getenv("_");
+	}
+
+	Util::setApp(path == NULL ? argv[0] : path);
+}
+
+}
+
+int main(int, char* argv[]) {
+	setApp(argv);
+
+	auto testPath = Util::getAppFilePath() + "ShareRefreshTest" + PATH_SEPARATOR_STR;
+	File::removeDirectoryForced(testPath);
+
+	Util::initialize(testPath + "Settings" + PATH_SEPARATOR_STR);
+
+	SettingsManager::newInstance();
+	AirUtil::init();
+	TimerManager::newInstance();
+	LogManager::newInstance();
+	HashManager::newInstance();
+	QueueManager::newInstance();
+
+	{
+		StartupLoader loader(nullptr, progressF, messageF);
+		HashManager::getInstance()->startup(loader);
+	}
+
+	auto shareRoot = testPath + "Share" + PATH_SEPARATOR_STR;
+
+	ExpectedTree expected;
+	createDirectory(shareRoot, TREE_DEPTH, expected);
+	hashDirectory(shareRoot);
+	writeSettings(shareRoot);
+
+	testParallelRefresh(shareRoot, expected);
+	testMemoryUsage(shareRoot, expected);
+
+	HashManager::getInstance()->shutdown(nullptr);
+	HashManager::getInstance()->close();
+
+	QueueManager::deleteInstance();
+	HashManager::deleteInstance();
+	LogManager::deleteInstance();
+	TimerManager::deleteInstance();
+	SettingsManager::deleteInstance();
+
+	File::removeDirectoryForced(testPath);
+	return test::result();
+}
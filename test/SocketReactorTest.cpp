@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/SocketReactor.h>
+#include <airdcpp/TimerManager.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace dcpp;
+
+#ifdef HAVE_SYS_EPOLL_H
+
+namespace {
+
+const size_t CHUNK_SIZE = 16 * 1024;
+
+atomic<size_t> finishedPipes(0);
+
+// One end of a socket pair that writes or reads the wanted number of bytes without blocking
+class PipeEnd : public SocketReactor::Client {
+public:
+	PipeEnd(int aSock, bool aWriter, size_t aBytes) : sock(aSock), writer(aWriter), bytes(aBytes) {
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	}
+
+	~PipeEnd() {
+		::close(sock);
+	}
+
+	void start() {
+		SocketReactor::getInstance()->schedule(this);
+	}
+
+	size_t getTransferred() const noexcept { return transferred; }
+private:
+	void process() noexcept override {
+		auto reactor = SocketReactor::getInstance();
+		char buf[CHUNK_SIZE];
+
+		while (true) {
+			ssize_t n;
+			if (writer) {
+				if (transferred == bytes) {
+					::shutdown(sock, SHUT_WR);
+					break;
+				}
+
+				n = ::send(sock, buf, min(CHUNK_SIZE, bytes - transferred), 0);
+			} else {
+				n = ::recv(sock, buf, CHUNK_SIZE, 0);
+				if (n == 0) {
+					// Closed by the writer
+					break;
+				}
+			}
+
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					break;
+				}
+
+				TEST_CHECK(reactor->watch(this, sock, !writer, writer));
+				return;
+			}
+
+			transferred += n;
+		}
+
+		reactor->unwatch(this);
+		finishedPipes++;
+	}
+
+	void onReady() noexcept override {
+		SocketReactor::getInstance()->schedule(this);
+	}
+
+	const int sock;
+	const bool writer;
+	const size_t bytes;
+	size_t transferred = 0;
+};
+
+class TimerClient : public SocketReactor::Client {
+public:
+	void start(uint64_t aMillis) {
+		started = GET_TICK();
+		wanted = aMillis;
+		SocketReactor::getInstance()->setTimer(this, aMillis);
+	}
+
+	bool hasExpired() const noexcept { return expired > 0; }
+	uint64_t getElapsed() const noexcept { return expired - started; }
+	uint64_t getWanted() const noexcept { return wanted; }
+private:
+	void process() noexcept override { }
+	void onReady() noexcept override {
+		expired = GET_TICK();
+	}
+
+	uint64_t started = 0;
+	uint64_t wanted = 0;
+	atomic<uint64_t> expired { 0 };
+};
+
+bool waitFor(const function<bool ()>& aF) {
+	for (int i = 0; i < 3000 && !aF(); ++i) {
+		Thread::sleep(10);
+	}
+
+	return aF();
+}
+
+// Many sockets sending data through the small socket buffers at the same time
+void testSoak(size_t aPipes, size_t aBytes) {
+	vector<unique_ptr<PipeEnd>> ends;
+	for (size_t i = 0; i < aPipes; ++i) {
+		int sv[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+			TEST_CHECK(false);
+			return;
+		}
+
+		ends.push_back(make_unique<PipeEnd>(sv[0], true, aBytes));
+		ends.push_back(make_unique<PipeEnd>(sv[1], false, 0));
+	}
+
+	finishedPipes = 0;
+	test::benchmark("Soak (" + std::to_string(aPipes) + " sockets, " + std::to_string(aBytes / 1024) + " KiB each)", [&] {
+		for (auto& e: ends) {
+			e->start();
+		}
+
+		TEST_CHECK(waitFor([&] { return finishedPipes == ends.size(); }));
+	});
+
+	for (size_t i = 0; i < ends.size(); i += 2) {
+		TEST_CHECK_EQUAL(ends[i]->getTransferred(), aBytes);
+		TEST_CHECK_EQUAL(ends[i + 1]->getTransferred(), aBytes);
+	}
+}
+
+void testTimers() {
+	vector<unique_ptr<TimerClient>> clients;
+	for (uint64_t i = 0; i < 20; ++i) {
+		clients.push_back(make_unique<TimerClient>());
+		clients.back()->start(200 - i * 10);
+	}
+
+	TEST_CHECK(waitFor([&] {
+		return all_of(clients.begin(), clients.end(), [](const unique_ptr<TimerClient>& c) { return c->hasExpired(); });
+	}));
+
+	for (const auto& c: clients) {
+		TEST_CHECK(c->getElapsed() >= c->getWanted());
+	}
+
+	// Removed timers must not fire
+	TimerClient removed;
+	removed.start(10);
+	SocketReactor::getInstance()->unwatch(&removed);
+	Thread::sleep(50);
+	TEST_CHECK(!removed.hasExpired());
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	auto scale = test::getScale(argc, argv);
+
+	SocketReactor::newInstance();
+	testTimers();
+	testSoak(100 * scale, 1024 * 1024);
+	SocketReactor::deleteInstance();
+
+	return test::result();
+}
+
+#else
+
+int main() {
+	// Sockets use threads of their own
+	return 0;
+}
+
+#endif
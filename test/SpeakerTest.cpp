@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/Speaker.h>
+
+#include <thread>
+
+using namespace dcpp;
+
+namespace {
+
+class TestListener {
+public:
+	virtual ~TestListener() { }
+	template<int I>	struct X { enum { TYPE = I }; };
+
+	typedef X<0> Event;
+
+	virtual void on(Event, uint64_t&) noexcept { }
+};
+
+class TestSpeaker : public Speaker<TestListener> { };
+
+class CountingListener : public TestListener {
+public:
+	void on(Event, uint64_t& calls_) noexcept override {
+		calls_++;
+		if (removed) {
+			calledAfterRemove = true;
+		}
+	}
+
+	atomic<bool> removed { false };
+	atomic<bool> calledAfterRemove { false };
+};
+
+class RemovingListener : public TestListener {
+public:
+	RemovingListener(TestSpeaker& aSpeaker) : speaker(aSpeaker) { }
+
+	void on(Event, uint64_t& calls_) noexcept override {
+		calls_++;
+		speaker.removeListener(this);
+	}
+private:
+	TestSpeaker& speaker;
+};
+
+// Events fired from multiple threads at the same time
+void benchmarkFire(size_t aListeners, size_t aThreads, size_t aEvents) {
+	TestSpeaker speaker;
+	vector<CountingListener> listeners(aListeners);
+	for (auto& l: listeners) {
+		speaker.addListener(&l);
+	}
+
+	atomic<uint64_t> totalCalls { 0 };
+	auto ms = test::benchmark(std::to_string(aListeners) + " listener(s), " + std::to_string(aThreads) + " threads, " + std::to_string(aEvents) + " events each", [&] {
+		vector<std::thread> threads;
+		for (size_t i = 0; i < aThreads; ++i) {
+			threads.emplace_back([&] {
+				uint64_t calls = 0;
+				for (size_t e = 0; e < aEvents; ++e) {
+					speaker.fire(TestListener::Event(), calls);
+				}
+
+				totalCalls += calls;
+			});
+		}
+
+		for (auto& t: threads) {
+			t.join();
+		}
+	});
+
+	std::cout << "  " << static_cast<uint64_t>(aThreads * aEvents / (ms / 1000)) << " events per second" << std::endl;
+	TEST_CHECK_EQUAL(totalCalls.load(), aListeners * aThreads * aEvents);
+
+	speaker.removeListeners();
+}
+
+// Removed listeners must not be called after removeListener has returned
+void testRemoveWhileFiring() {
+	TestSpeaker speaker;
+	atomic<bool> stop { false };
+
+	vector<std::thread> threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.emplace_back([&] {
+			uint64_t calls = 0;
+			while (!stop) {
+				speaker.fire(TestListener::Event(), calls);
+			}
+		});
+	}
+
+	vector<unique_ptr<CountingListener>> removedListeners;
+	for (int i = 0; i < 200; ++i) {
+		removedListeners.push_back(make_unique<CountingListener>());
+		auto& l = *removedListeners.back();
+
+		speaker.addListener(&l);
+		TEST_CHECK(speaker.hasListener(&l));
+		std::this_thread::yield();
+
+		speaker.removeListener(&l);
+		l.removed = true;
+	}
+
+	stop = true;
+	for (auto& t: threads) {
+		t.join();
+	}
+
+	for (const auto& l: removedListeners) {
+		TEST_CHECK(!l->calledAfterRemove);
+	}
+
+	TEST_CHECK_EQUAL(speaker.getListenerCount(), 0U);
+}
+
+// Listeners may remove themselves inside the callback
+void testRemoveFromCallback() {
+	TestSpeaker speaker;
+	RemovingListener removing(speaker);
+	CountingListener counting;
+
+	speaker.addListener(&removing);
+	speaker.addListener(&counting);
+
+	uint64_t calls = 0;
+	speaker.fire(TestListener::Event(), calls);
+	TEST_CHECK_EQUAL(calls, 2U);
+	TEST_CHECK(!speaker.hasListener(&removing));
+
+	calls = 0;
+	speaker.fire(TestListener::Event(), calls);
+	TEST_CHECK_EQUAL(calls, 1U);
+
+	// Releases the snapshot that was replaced inside the callback
+	speaker.removeListener(&counting);
+	TEST_CHECK_EQUAL(speaker.getListenerCount(), 0U);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	auto scale = test::getScale(argc, argv);
+
+	testRemoveFromCallback();
+	testRemoveWhileFiring();
+
+	for (auto listeners: { 1, 8, 32 }) {
+		benchmarkFire(listeners, 4, 250000 * scale);
+	}
+
+	return test::result();
+}
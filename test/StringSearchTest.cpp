@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/StringSearch.h>
+#include <airdcpp/Text.h>
+
+#include <random>
+
+using namespace dcpp;
+
+namespace {
+
+// Matching with one Quick Search per pattern (the implementation before the automaton)
+class ReferenceSearch {
+public:
+	void addString(const string& aPattern) {
+		patterns.emplace_back(Text::toLower(aPattern));
+	}
+
+	bool match_all_lower(const string& aText) const {
+		for (const auto& p: patterns) {
+			if (p.matchLower(aText) == string::npos) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool match_any_lower(const string& aText) const {
+		for (const auto& p: patterns) {
+			if (p.matchLower(aText) != string::npos) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	int matchLower(const string& aText, bool aResumeOnNoMatch, StringSearch::ResultList* results_) const {
+		int matches = 0, listPos = 0;
+		for (const auto& p: patterns) {
+			size_t addPos = string::npos;
+			for (;;) {
+				size_t curPos = p.matchLower(aText, addPos == string::npos ? 0 : static_cast<int>(addPos + 1));
+				if (curPos != string::npos) {
+					if (results_ && listPos > 0) {
+						// prefer sequential match order if this isn't the first pattern
+						if ((*results_)[listPos - 1] != string::npos && (*results_)[listPos - 1] > curPos) {
+							addPos = curPos;
+							continue; // keep on searching
+						}
+					}
+
+					// use this match
+					addPos = curPos;
+				}
+
+				if (addPos != string::npos) {
+					matches++;
+					if (results_) {
+						(*results_)[listPos] = addPos;
+					}
+				} else if (!aResumeOnNoMatch) {
+					if (results_) {
+						fill_n((*results_).begin(), listPos, string::npos);
+					}
+					return 0;
+				}
+
+				break;
+			}
+			listPos++;
+		}
+
+		return matches;
+	}
+private:
+	StringSearch::PatternList patterns;
+};
+
+// A small alphabet with mixed case and multibyte characters so that the patterns overlap often
+const vector<string> SYMBOLS = { "a", "b", "A", "B", "c", ".", " ", "\xc3\xa4", "\xc3\x84", "\xc3\xb6" };
+
+string createString(std::mt19937& gen_, size_t aMinLength, size_t aMaxLength) {
+	string ret;
+	auto length = aMinLength + gen_() % (aMaxLength - aMinLength + 1);
+	for (size_t i = 0; i < length; ++i) {
+		ret += SYMBOLS[gen_() % SYMBOLS.size()];
+	}
+
+	return ret;
+}
+
+void testRandomPatterns() {
+	std::mt19937 gen(1);
+	for (int round = 0; round < 2000; ++round) {
+		StringSearch search;
+		ReferenceSearch reference;
+
+		auto patternCount = 1 + gen() % 6;
+		for (size_t i = 0; i < patternCount; ++i) {
+			// Prefixes/suffixes of each other and duplicates are common with the short patterns
+			auto pattern = createString(gen, 1, 4);
+			search.addString(pattern);
+			reference.addString(pattern);
+		}
+
+		// The positions are reused between calls (same as when matching the parent directories)
+		StringSearch::ResultList positions(patternCount, string::npos), referencePositions(patternCount, string::npos);
+		for (int i = 0; i < 50; ++i) {
+			auto text = createString(gen, 0, 40);
+			auto textLower = Text::toLower(text);
+
+			TEST_CHECK_EQUAL(search.match_all(text), reference.match_all_lower(textLower));
+			TEST_CHECK_EQUAL(search.match_any(text), reference.match_any_lower(textLower));
+			TEST_CHECK_EQUAL(search.match_all_lower(textLower), reference.match_all_lower(textLower));
+
+			auto resume = gen() % 2 == 0;
+			TEST_CHECK_EQUAL(search.matchLower(textLower, resume, &positions), reference.matchLower(textLower, resume, &referencePositions));
+			TEST_CHECK(positions == referencePositions);
+
+			TEST_CHECK_EQUAL(search.matchLower(textLower, resume), reference.matchLower(textLower, resume, nullptr));
+		}
+	}
+}
+
+void testCaseFolding() {
+	StringSearch search;
+	search.addString("\xc3\xa4" "Bc");
+	search.addString("BC.");
+
+	TEST_CHECK(search.match_all("X\xc3\xa4" "bC.x"));
+	TEST_CHECK(!search.match_all("X\xc3\xa4" "bCx"));
+	TEST_CHECK(search.match_any("XBc."));
+
+	// Overlapping matches
+	StringSearch::ResultList positions(search.count(), string::npos);
+	TEST_CHECK_EQUAL(search.matchLower("\xc3\xa4" "bc.", false, &positions), 2);
+	TEST_CHECK_EQUAL(positions[0], 0U);
+	TEST_CHECK_EQUAL(positions[1], 2U);
+}
+
+}
+
+int main() {
+	Text::initialize();
+
+	testCaseFolding();
+	testRandomPatterns();
+
+	return test::result();
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DCPLUSPLUS_TEST_UTIL_H
+#define DCPLUSPLUS_TEST_UTIL_H
+
+#include <airdcpp/stdinc.h>
+
+#include <chrono>
+#include <iostream>
+
+namespace dcpp {
+namespace test {
+
+// Number of failed checks in this test
+inline int& failures() {
+	static int count = 0;
+	return count;
+}
+
+#define TEST_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #cond << std::endl; \
+			dcpp::test::failures()++; \
+		} \
+	} while (false)
+
+#define TEST_CHECK_EQUAL(a, b) \
+	do { \
+		auto checkA = (a); \
+		auto checkB = (b); \
+		if (!(checkA == checkB)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #a << " == " << #b << " (" << checkA << " != " << checkB << ")" << std::endl; \
+			dcpp::test::failures()++; \
+		} \
+	} while (false)
+
+// Returns the exit code for main()
+inline int result() {
+	if (failures() > 0) {
+		std::cerr << failures() << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// Workload multiplier for benchmarks (the first command line argument)
+inline size_t getScale(int argc, char* argv[], size_t aDefault = 1) {
+	return argc > 1 ? static_cast<size_t>(std::stoul(argv[1])) : aDefault;
+}
+
+// Runs the function and prints the elapsed time
+template<class F>
+double benchmark(const string& aName, F&& aF) {
+	auto start = std::chrono::steady_clock::now();
+	aF();
+	auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << aName << ": " << ms << " ms" << std::endl;
+	return ms;
+}
+
+} // namespace test
+} // namespace dcpp
+
+#endif // !defined(DCPLUSPLUS_TEST_UTIL_H)
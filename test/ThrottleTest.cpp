@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/ThrottleManager.h>
+
+#include <cmath>
+
+using namespace dcpp;
+
+namespace {
+
+typedef ThrottleManager::Scheduler Scheduler;
+
+const int64_t LIMIT = 10 * 1024 * 1024; // bytes per second
+const size_t PACKET_SIZE = 16 * 1024;
+const uint64_t WINDOW_MS = 100;
+
+// Connection that tries to transfer a packet every millisecond
+struct SimFlow {
+	SimFlow(size_t aPacketSize = PACKET_SIZE) : packetSize(aPacketSize) { }
+
+	ThrottleManager::Flow flow;
+	const size_t packetSize;
+	uint64_t transferred = 0;
+};
+
+typedef vector<unique_ptr<SimFlow>> SimFlowList;
+
+// Bytes transferred by all flows in each window
+typedef vector<uint64_t> WindowList;
+
+WindowList simulate(Scheduler& aScheduler, SimFlowList& aFlows, uint64_t aStart, uint64_t aMillis) {
+	WindowList windows(static_cast<size_t>(aMillis / WINDOW_MS), 0);
+	for (uint64_t ms = 0; ms < aMillis; ++ms) {
+		// Rotate the order so that the first flows won't be preferred
+		for (size_t i = 0; i < aFlows.size(); ++i) {
+			auto& f = *aFlows[(i + ms) % aFlows.size()];
+			auto granted = aScheduler.acquire(f.flow, f.packetSize, LIMIT, aStart + ms);
+			f.transferred += granted;
+			windows[static_cast<size_t>(ms / WINDOW_MS)] += granted;
+		}
+	}
+
+	return windows;
+}
+
+SimFlowList createFlows(size_t aCount) {
+	SimFlowList ret;
+	for (size_t i = 0; i < aCount; ++i) {
+		ret.push_back(make_unique<SimFlow>());
+	}
+
+	return ret;
+}
+
+bool isNear(double aValue, double aExpected, double aTolerance) {
+	return std::abs(aValue - aExpected) <= aExpected * aTolerance;
+}
+
+// Many connections with equal weights get equal shares and the total rate stays even
+void testFairSplit(size_t aScale) {
+	Scheduler scheduler;
+	auto flows = createFlows(50 * aScale);
+
+	const uint64_t duration = 10000;
+	WindowList windows;
+	test::benchmark("Fair split (" + std::to_string(flows.size()) + " connections, " + std::to_string(duration) + " ms)", [&] {
+		windows = simulate(scheduler, flows, 1, duration);
+	});
+
+	uint64_t total = 0, minShare = UINT64_MAX, maxShare = 0;
+	for (const auto& f: flows) {
+		total += f->transferred;
+		minShare = min(minShare, f->transferred);
+		maxShare = max(maxShare, f->transferred);
+	}
+
+	auto expectedTotal = static_cast<double>(LIMIT) * duration / 1000;
+	auto fairShare = static_cast<double>(total) / flows.size();
+
+	// The buckets start empty
+	TEST_CHECK(isNear(static_cast<double>(total), expectedTotal, 0.02));
+	TEST_CHECK(isNear(static_cast<double>(minShare), fairShare, 0.1));
+	TEST_CHECK(isNear(static_cast<double>(maxShare), fairShare, 0.1));
+
+	// The rate must not vary by the refill interval (skip the first window while the buckets are filling)
+	auto expectedWindow = static_cast<double>(LIMIT) * WINDOW_MS / 1000;
+	uint64_t minWindow = UINT64_MAX, maxWindow = 0;
+	for (size_t i = 1; i < windows.size(); ++i) {
+		minWindow = min(minWindow, windows[i]);
+		maxWindow = max(maxWindow, windows[i]);
+	}
+
+	std::cout << "  Shares " << minShare << " - " << maxShare << " bytes, " << WINDOW_MS << " ms windows " << minWindow << " - " << maxWindow << " bytes" << std::endl;
+	TEST_CHECK(isNear(static_cast<double>(minWindow), expectedWindow, 0.05));
+	TEST_CHECK(isNear(static_cast<double>(maxWindow), expectedWindow, 0.05));
+}
+
+// The bandwidth is split by the priority weights
+void testWeights() {
+	Scheduler scheduler;
+	auto flows = createFlows(2);
+	flows[0]->flow.set(ThrottleManager::CLASS_STANDARD, 1, ThrottleManager::getPriorityWeight(Priority::HIGH));
+	flows[1]->flow.set(ThrottleManager::CLASS_STANDARD, 2, ThrottleManager::getPriorityWeight(Priority::LOW));
+
+	simulate(scheduler, flows, 1, 5000);
+
+	auto expectedRatio = static_cast<double>(ThrottleManager::getPriorityWeight(Priority::HIGH)) / ThrottleManager::getPriorityWeight(Priority::LOW);
+	auto ratio = static_cast<double>(flows[0]->transferred) / flows[1]->transferred;
+	TEST_CHECK(isNear(ratio, expectedRatio, 0.1));
+}
+
+// Connections in the same group share the bandwidth of the group
+void testGroups() {
+	Scheduler scheduler;
+	auto flows = createFlows(9);
+	for (size_t i = 0; i < flows.size(); ++i) {
+		flows[i]->flow.set(ThrottleManager::CLASS_STANDARD, i == 0 ? 1 : 2, ThrottleManager::getPriorityWeight(Priority::NORMAL));
+	}
+
+	simulate(scheduler, flows, 1, 5000);
+
+	uint64_t groupTotal = 0;
+	for (size_t i = 1; i < flows.size(); ++i) {
+		groupTotal += flows[i]->transferred;
+	}
+
+	TEST_CHECK(isNear(static_cast<double>(flows[0]->transferred), static_cast<double>(groupTotal), 0.1));
+	TEST_CHECK_EQUAL(scheduler.getGroupCount(), 2U);
+}
+
+// Minor transfers (small files, lists) get a smaller share than the regular ones
+void testClasses() {
+	Scheduler scheduler;
+	auto flows = createFlows(2);
+	flows[1]->flow.set(ThrottleManager::CLASS_MINOR, 1, ThrottleManager::getPriorityWeight(Priority::NORMAL));
+
+	simulate(scheduler, flows, 1, 5000);
+
+	auto ratio = static_cast<double>(flows[0]->transferred) / flows[1]->transferred;
+	TEST_CHECK(isNear(ratio, 3, 0.1));
+}
+
+// Bandwidth that a slow connection doesn't use can be borrowed by others
+void testBorrowing() {
+	Scheduler scheduler;
+	SimFlowList flows;
+	flows.push_back(make_unique<SimFlow>());
+	flows.push_back(make_unique<SimFlow>(100));
+
+	const uint64_t duration = 5000;
+	simulate(scheduler, flows, 1, duration);
+
+	TEST_CHECK(isNear(static_cast<double>(flows[1]->transferred), 100.0 * duration, 0.05));
+	TEST_CHECK(isNear(static_cast<double>(flows[0]->transferred + flows[1]->transferred), static_cast<double>(LIMIT) * duration / 1000, 0.02));
+
+	// Idle groups are removed
+	scheduler.removeIdle(1 + duration + 5000);
+	TEST_CHECK_EQUAL(scheduler.getGroupCount(), 0U);
+}
+
+// Non-blocking API
+void testWaitTime() {
+	Scheduler scheduler;
+	ThrottleManager::Flow flow;
+
+	// Nothing before the bucket has been refilled
+	TEST_CHECK_EQUAL(scheduler.acquire(flow, PACKET_SIZE, LIMIT, 1), 0U);
+
+	auto wait = scheduler.getWaitTime(flow, 1);
+	TEST_CHECK(wait > 0 && wait < 10);
+	TEST_CHECK(scheduler.getAvailable(flow, LIMIT, 1 + wait) >= 1024);
+
+	auto granted = scheduler.acquire(flow, PACKET_SIZE, LIMIT, 1 + wait);
+	TEST_CHECK(granted >= 1024);
+
+	scheduler.release(flow, granted);
+	TEST_CHECK(scheduler.getAvailable(flow, LIMIT, 1 + wait) >= granted);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	testWaitTime();
+	testFairSplit(test::getScale(argc, argv));
+	testWeights();
+	testGroups();
+	testClasses();
+	testBorrowing();
+
+	return test::result();
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2011-2021 AirDC++ Project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "TestUtil.h"
+
+#include <airdcpp/Encoder.h>
+#include <airdcpp/MerkleTree.h>
+#include <airdcpp/ParallelTreeHasher.h>
+#include <airdcpp/TigerHash.h>
+
+#include <random>
+
+using namespace dcpp;
+
+// Known answers from the reference implementation
+static const vector<pair<string, string>> tigerVectors = {
+	{ "", "3293AC630C13F0245F92BBB1766E16167A4E58492DDE73F3" },
+	{ "abc", "2AAB1484E8C158F2BFB8C5FF41B57A525129131C957B5F93" },
+	{ "Tiger", "DD00230799F5009FEC6DEBC838BB6A27DF2B9D6F110C7937" },
+	{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "8DCEA680A17583EE502BA38A3C368651890FFBCCDC49A8CC" },
+	{ "Tiger - A Fast New Hash Function, by Ross Anderson and Eli Biham", "8A866829040A410C729AD23F5ADA711603B3CDD357E4C15E" },
+	{ string(1000000, 'a'), "6DB0E2729CBEAD93D715C6A7D36302E9B3CEE0D2BC314B41" },
+};
+
+static string toHex(const uint8_t* aData, size_t aLen) {
+	static const char* digits = "0123456789ABCDEF";
+
+	string ret;
+	for (size_t i = 0; i < aLen; ++i) {
+		ret += digits[aData[i] >> 4];
+		ret += digits[aData[i] & 0x0F];
+	}
+
+	return ret;
+}
+
+static string hashSerial(uint8_t aPrefix, const uint8_t* aData, size_t aLen) {
+	TigerHash h;
+	h.update(&aPrefix, 1);
+	h.update(aData, aLen);
+	return toHex(h.finalize(), TigerHash::BYTES);
+}
+
+static void testSerial() {
+	for (const auto& v: tigerVectors) {
+		TigerHash h;
+		h.update(v.first.data(), v.first.size());
+		TEST_CHECK_EQUAL(toHex(h.finalize(), TigerHash::BYTES), v.second);
+	}
+}
+
+// The first byte of the message is passed as the prefix
+static void testKernelVectors(size_t aKernel) {
+	for (const auto& v: tigerVectors) {
+		if (v.first.empty()) {
+			continue;
+		}
+
+		for (size_t count = 1; count <= TigerHash::MAX_LANES; ++count) {
+			const uint8_t* data[TigerHash::MAX_LANES];
+			for (size_t l = 0; l < count; ++l) {
+				data[l] = reinterpret_cast<const uint8_t*>(v.first.data()) + 1;
+			}
+
+			uint8_t results[TigerHash::MAX_LANES * TigerHash::BYTES];
+			TigerHash::hashMultiple(aKernel, static_cast<uint8_t>(v.first[0]), data, v.first.size() - 1, count, results);
+
+			for (size_t l = 0; l < count; ++l) {
+				TEST_CHECK_EQUAL(toHex(results + l * TigerHash::BYTES, TigerHash::BYTES), v.second);
+			}
+		}
+	}
+}
+
+// Different data in each lane, all message lengths around the block boundaries
+static void testKernelLanes(size_t aKernel) {
+	mt19937 rng(1);
+	vector<uint8_t> buf(TigerHash::MAX_LANES * 300);
+	for (auto& b: buf) {
+		b = static_cast<uint8_t>(rng());
+	}
+
+	for (size_t len = 0; len < 300; ++len) {
+		for (size_t count = 1; count <= TigerHash::MAX_LANES; ++count) {
+			const uint8_t* data[TigerHash::MAX_LANES];
+			for (size_t l = 0; l < count; ++l) {
+				data[l] = buf.data() + l * 300;
+			}
+
+			uint8_t results[TigerHash::MAX_LANES * TigerHash::BYTES];
+			TigerHash::hashMultiple(aKernel, static_cast<uint8_t>(len), data, len, count, results);
+
+			for (size_t l = 0; l < count; ++l) {
+				TEST_CHECK_EQUAL(toHex(results + l * TigerHash::BYTES, TigerHash::BYTES), hashSerial(static_cast<uint8_t>(len), data[l], len));
+			}
+		}
+	}
+}
+
+// Leaves are hashed in batches, compare against a tree built from single hashes
+static string calcTreeSerial(const uint8_t* aData, size_t aLen) {
+	const size_t blockSize = TigerTree::BASE_BLOCK_SIZE;
+
+	vector<string> level;
+	for (size_t pos = 0; pos < aLen || level.empty(); pos += blockSize) {
+		TigerHash h;
+		uint8_t zero = 0;
+		h.update(&zero, 1);
+		h.update(aData + pos, min(blockSize, aLen - pos));
+		level.push_back(string(reinterpret_cast<const char*>(h.finalize()), TigerHash::BYTES));
+	}
+
+	while (level.size() > 1) {
+		vector<string> next;
+		for (size_t i = 0; i < level.size(); i += 2) {
+			if (i + 1 == level.size()) {
+				next.push_back(level[i]);
+				continue;
+			}
+
+			TigerHash h;
+			uint8_t one = 1;
+			h.update(&one, 1);
+			h.update(level[i].data(), TigerHash::BYTES);
+			h.update(level[i + 1].data(), TigerHash::BYTES);
+			next.push_back(string(reinterpret_cast<const char*>(h.finalize()), TigerHash::BYTES));
+		}
+
+		level.swap(next);
+	}
+
+	return toHex(reinterpret_cast<const uint8_t*>(level.front().data()), TigerHash::BYTES);
+}
+
+static void testTree() {
+	// Empty file
+	{
+		TigerTree tt;
+		tt.finalize();
+		TEST_CHECK_EQUAL(tt.getRoot().toBase32(), string("LWPNACQDBZRYXW3VHJVCJ64QBZNGHOHHHZWCLNQ"));
+	}
+
+	mt19937 rng(2);
+	vector<uint8_t> buf(200 * 1024);
+	for (auto& b: buf) {
+		b = static_cast<uint8_t>(rng());
+	}
+
+	for (auto size: { 1, 1023, 1024, 1025, 3 * 1024, 8 * 1024, 9 * 1024 + 5, 200 * 1024 }) {
+		TigerTree tt;
+		tt.update(buf.data(), size);
+		tt.finalize();
+		TEST_CHECK_EQUAL(toHex(tt.getRoot().data, TigerHash::BYTES), calcTreeSerial(buf.data(), size));
+	}
+}
+
+// The parallel hasher must produce the same leaves and root as a serial tree with the final block size
+static void testParallelTree() {
+	const int64_t batchSize = ParallelTreeHasher::BATCH_SIZE;
+	const int64_t blockSize = Hasher::MIN_BLOCK_SIZE;
+	const int64_t threads = 3;
+
+	mt19937 rng(3);
+	vector<uint8_t> buf(static_cast<size_t>(batchSize * (threads * 2 + 1) + blockSize * 2));
+	for (auto& b: buf) {
+		b = static_cast<uint8_t>(rng());
+	}
+
+	vector<int64_t> sizes = {
+		0, 1, 1023, 1024, 1025,
+		blockSize - 1, blockSize, blockSize + 1,
+		batchSize - 1, batchSize, batchSize + 1,
+		batchSize * threads - 1, batchSize * threads, batchSize * threads + 1,
+		batchSize * threads * 2 + blockSize + 5,
+		static_cast<int64_t>(buf.size())
+	};
+
+	for (auto size: sizes) {
+		auto treeBlockSize = max(TigerTree::calcBlockSize(size, 10), blockSize);
+
+		TigerTree serial(treeBlockSize);
+		serial.update(buf.data(), static_cast<size_t>(size));
+		serial.finalize();
+
+		// Feed the data in uneven pieces (the same as with file reads)
+		TigerTree parallel(treeBlockSize);
+		{
+			ParallelTreeHasher hasher(threads);
+			for (int64_t pos = 0; pos < size;) {
+				auto n = min(static_cast<int64_t>(1 + rng() % (batchSize / 2)), size - pos);
+				hasher.update(buf.data() + pos, static_cast<size_t>(n));
+				pos += n;
+			}
+
+			hasher.finalize(parallel);
+		}
+
+		TEST_CHECK_EQUAL(parallel.getRoot().toBase32(), serial.getRoot().toBase32());
+		TEST_CHECK_EQUAL(parallel.getFileSize(), size);
+		TEST_CHECK_EQUAL(parallel.getBlockSize(), treeBlockSize);
+		TEST_CHECK_EQUAL(parallel.getLeaves().size(), serial.getLeaves().size());
+		TEST_CHECK(parallel.getLeaves() == serial.getLeaves());
+	}
+}
+
+static void benchmarkKernels(size_t aScale) {
+	vector<uint8_t> buf(TigerHash::MAX_LANES * 1024 * 64 * aScale);
+	for (size_t kernel = 0; kernel < TigerHash::getMultiKernelCount(); ++kernel) {
+		auto ms = test::benchmark("Kernel " + std::to_string(kernel), [&] {
+			uint8_t results[TigerHash::MAX_LANES * TigerHash::BYTES];
+			for (size_t pos = 0; pos < buf.size(); pos += TigerHash::MAX_LANES * 1024) {
+				const uint8_t* data[TigerHash::MAX_LANES];
+				for (size_t l = 0; l < TigerHash::MAX_LANES; ++l) {
+					data[l] = buf.data() + pos + l * 1024;
+				}
+
+				TigerHash::hashMultiple(kernel, 0, data, 1024, TigerHash::MAX_LANES, results);
+			}
+		});
+
+		std::cout << "  " << (static_cast<double>(buf.size()) / 1024 / 1024) / (ms / 1000) << " MiB/s" << std::endl;
+	}
+
+	test::benchmark("Serial", [&] {
+		for (size_t pos = 0; pos < buf.size(); pos += 1024) {
+			hashSerial(0, buf.data() + pos, 1024);
+		}
+	});
+}
+
+int main(int argc, char* argv[]) {
+	testSerial();
+
+	std::cout << TigerHash::getMultiKernelCount() << " multi-buffer kernel(s) supported" << std::endl;
+	for (size_t kernel = 0; kernel < TigerHash::getMultiKernelCount(); ++kernel) {
+		testKernelVectors(kernel);
+		testKernelLanes(kernel);
+	}
+
+	testTree();
+	testParallelTree();
+	benchmarkKernels(test::getScale(argc, argv));
+	return test::result();
+}